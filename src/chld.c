@@ -148,9 +148,10 @@ int chld_fork(void) {
 			return -1;
 		}
 		else if (chld_listener == 0) {
-			char *argz[11];
+			char *argz[13];
 			char *envz[1];
 			char mtu[8];
+			char dumpopts[64];
 
 			snprintf(mtu, sizeof(mtu) -1, "%u", s->vi[0]->mtu);
 
@@ -165,13 +166,16 @@ int chld_fork(void) {
 			argz[7]=s->vi[0]->hwaddr_s;
 			argz[8]=(s->pcap_dumpfile == NULL ? xstrdup("none") : s->pcap_dumpfile);
 			argz[9]=xstrdup(listener_uri);
-			argz[10]=NULL;
+			snprintf(dumpopts, sizeof(dumpopts) -1, "%u:%u:%u", s->pcap_dumpsize, s->pcap_dumpsecs, s->pcap_dumpsnap);
+			argz[10]=dumpopts;
+			argz[11]=(s->pcap_readfile == NULL ? xstrdup("none") : s->pcap_readfile);
+			argz[12]=NULL;
 
 			envz[0]='\0';
 
-			DBG(M_CLD, "execve %s %s %s %s %s %s %s %s %s %s %s",
+			DBG(M_CLD, "execve %s %s %s %s %s %s %s %s %s %s %s %s %s",
 				LISTENER_PATH, argz[0], argz[1], argz[2], argz[3],
-				argz[4], argz[5], argz[6], argz[7], argz[8], argz[9]
+				argz[4], argz[5], argz[6], argz[7], argz[8], argz[9], argz[10], argz[11]
 			);
 			execve(LISTENER_PATH, argz, envz);
 
@@ -220,6 +224,21 @@ void chld_killall(void) {
 	return;
 }
 
+/*
+ * a process forked off the master that shares its drones but doesnt own
+ * them, exiting from it must not take them down
+ */
+void chld_forget(void) {
+	int j=0;
+
+	for (j=0; j < MAX_CHILDREN; j++) {
+		child_pids[j]=0;
+	}
+	child_forked=0;
+
+	return;
+}
+
 void chld_cleanup(void) {
 	static int cleanup_ran=0;
 
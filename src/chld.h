@@ -35,5 +35,8 @@ void chld_killall(void);
 /* atexit-compatible wrapper: idempotent, safe to call multiple times */
 void chld_cleanup(void);
 
+/* drop the child list, for a fork that must leave the drones alone */
+void chld_forget(void);
+
 
 #endif
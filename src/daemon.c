@@ -0,0 +1,610 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <settings.h>
+
+#include <unilib/terminate.h>
+#include <unilib/xmalloc.h>
+#include <unilib/output.h>
+#include <unilib/drone.h>
+#include <unilib/sockpath.h>
+
+#include <chld.h>
+#include <drone_setup.h>
+#include <daemon.h>
+
+#define JOB_STARTED	'b'
+#define JOB_DONE	'd'
+
+/* what a workers job is scanning, in a file mapping all the workers share */
+typedef struct daemon_lease_t {
+	pid_t job;			/* 0 no job holds it		*/
+	int cnt;			/* networks below, 0 any host	*/
+	uint32_t nets[DAEMON_LEASENETS];
+	uint32_t masks[DAEMON_LEASENETS];
+} daemon_lease_t;
+
+static int d_lsock=-1;
+static int d_jobpipe=-1;
+static int d_worker=-1;
+static int d_leasefd=-1;		/* also what is locked around the table	*/
+static daemon_lease_t *d_leases=NULL;
+static volatile sig_atomic_t d_quit=0;
+static pid_t d_workers[DAEMON_MAXJOBS];
+
+static void daemon_sigquit(int );
+static int daemon_listen(void);
+static pid_t daemon_spawn(int , void (*)(void), int (*)(int, char **));
+static void daemon_worker(int , int (*)(int, char **)) _NORETURN_;
+static int daemon_readjob(int , char * , size_t );
+static void daemon_dojob(int , const char * , int , unsigned int , int (*)(int, char **));
+static int lease_init(void);
+static int lease_lock(short );
+static int lease_overlap(const daemon_lease_t *, const daemon_lease_t *);
+static void lease_release(int );
+
+static void daemon_sigquit(int signo) {
+
+	if (signo == SIGTERM || signo == SIGINT) {
+		d_quit=1;
+	}
+
+	return;
+}
+
+int daemon_run(void (*drones_up)(void), int (*job)(int, char **)) {
+	struct sigaction sa;
+	time_t started[DAEMON_MAXJOBS];
+	unsigned int j=0, quick=0;
+	int status=0;
+	pid_t pid=0;
+
+	assert(drones_up != NULL && job != NULL && s->daemon_sock != NULL);
+
+	if (s->daemon_jobs < 1) {
+		s->daemon_jobs=1;
+	}
+	if (s->forklocal != (FORK_LOCAL_LISTENER|FORK_LOCAL_SENDER) && s->daemon_jobs > 1) {
+		VRB(0, "remote drones can only work one job at a time, running 1 job not %u", s->daemon_jobs);
+		s->daemon_jobs=1;
+	}
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler=&daemon_sigquit;
+	sigemptyset(&sa.sa_mask);
+	/* no SA_RESTART, accept and waitpid have to notice */
+	sa.sa_flags=0;
+
+	if (sigaction(SIGTERM, &sa, NULL) < 0 || sigaction(SIGINT, &sa, NULL) < 0) {
+		ERR("cant register daemon signal handlers: %s", strerror(errno));
+		return -1;
+	}
+
+	if (daemon_listen() < 0 || lease_init() < 0) {
+		return -1;
+	}
+
+	VRB(0, "taking scan jobs on `%s' with %u worker%s", s->daemon_sock, s->daemon_jobs, s->daemon_jobs == 1 ? "" : "s");
+
+	for (j=0; j < s->daemon_jobs; j++) {
+		d_workers[j]=daemon_spawn((int)j, drones_up, job);
+		time(&started[j]);
+	}
+
+	while (d_quit == 0) {
+		pid=waitpid(-1, &status, 0);
+		if (pid < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ERR("waitpid fails: %s", strerror(errno));
+			break;
+		}
+
+		for (j=0; j < s->daemon_jobs; j++) {
+			if (d_workers[j] == pid) {
+				break;
+			}
+		}
+		if (j == s->daemon_jobs || d_quit) {
+			continue;
+		}
+
+		/* a worker that cant even get its drones up will keep not getting them up */
+		if (time(NULL) - started[j] < DAEMON_JOBWAIT) {
+			if (++quick > 3) {
+				ERR("workers keep dying right after they start, giving up");
+				break;
+			}
+		}
+		else {
+			quick=0;
+		}
+
+		VRB(1, "worker %u (pid %d) is gone, starting a new one", j, (int)pid);
+		sleep(1);
+
+		d_workers[j]=daemon_spawn((int)j, drones_up, job);
+		time(&started[j]);
+	}
+
+	VRB(1, "daemon shutting down");
+
+	for (j=0; j < s->daemon_jobs; j++) {
+		if (d_workers[j] > 0) {
+			kill(d_workers[j], SIGTERM);
+		}
+	}
+	for (j=0; j < s->daemon_jobs; j++) {
+		if (d_workers[j] > 0) {
+			while (waitpid(d_workers[j], &status, 0) < 0 && errno == EINTR) {
+				;
+			}
+		}
+	}
+
+	close(d_lsock);
+	d_lsock=-1;
+	unlink(s->daemon_sock);
+
+	munmap(d_leases, sizeof(daemon_lease_t) * DAEMON_MAXJOBS);
+	d_leases=NULL;
+	close(d_leasefd);
+	d_leasefd=-1;
+
+	return 0;
+}
+
+static int daemon_listen(void) {
+	struct sockaddr_un sun;
+	mode_t omask;
+
+	if (strlen(s->daemon_sock) >= sizeof(sun.sun_path)) {
+		ERR("daemon socket path `%s' is too long", s->daemon_sock);
+		return -1;
+	}
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family=AF_UNIX;
+	strncpy(sun.sun_path, s->daemon_sock, sizeof(sun.sun_path) -1);
+
+	if ((d_lsock=socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		ERR("cant create daemon socket: %s", strerror(errno));
+		return -1;
+	}
+
+	unlink(sun.sun_path);
+
+	/* whoever can connect can make us send packets */
+	omask=umask(0077);
+	if (bind(d_lsock, (const struct sockaddr *)&sun, (socklen_t)sizeof(sun)) < 0 || listen(d_lsock, 16) < 0) {
+		ERR("cant listen on daemon socket `%s': %s", s->daemon_sock, strerror(errno));
+		umask(omask);
+		close(d_lsock);
+		d_lsock=-1;
+		return -1;
+	}
+	umask(omask);
+
+	return 1;
+}
+
+static pid_t daemon_spawn(int worker, void (*drones_up)(void), int (*job)(int, char **)) {
+	pid_t pid=0;
+
+	pid=fork();
+	if (pid < 0) {
+		ERR("cant fork daemon worker: %s", strerror(errno));
+		return -1;
+	}
+	if (pid == 0) {
+		d_worker=worker;
+		/* whatever the worker before us was doing is over */
+		lease_release(worker);
+
+		/* every worker has its own drones, so they need their own sockets */
+		sockpath_set_instance(worker + 1);
+
+		drones_up();
+
+		daemon_worker(worker, job);
+	}
+
+	DBG(M_CLD, "daemon worker %d is pid %d", worker, (int)pid);
+
+	return pid;
+}
+
+static void daemon_worker(int worker, int (*job)(int, char **)) {
+	char jline[DAEMON_JOBMAX];
+	unsigned int jobs=0;
+	int cfd=-1;
+
+	VRB(0, "worker %d ready, %d senders and %d listeners", worker, s->senders, s->listeners);
+
+	while (d_quit == 0 && s->senders > 0 && s->listeners > 0) {
+		cfd=accept(d_lsock, NULL, NULL);
+		if (cfd < 0) {
+			if (errno != EINTR && errno != ECONNABORTED) {
+				ERR("accept on daemon socket fails: %s", strerror(errno));
+				break;
+			}
+			continue;
+		}
+
+		if (daemon_readjob(cfd, jline, sizeof(jline)) < 0) {
+			close(cfd);
+			continue;
+		}
+
+		jobs++;
+
+		daemon_dojob(cfd, jline, worker, jobs, job);
+
+		close(cfd);
+	}
+
+	VRB(1, "worker %d stopping after %u jobs", worker, jobs);
+
+	terminate_alldrones();
+
+	/* chld_cleanup from atexit takes care of the local drones */
+	exit(0);
+}
+
+/* one line, newline ended, white space split, no quoting */
+static int daemon_readjob(int cfd, char *jline, size_t jsize) {
+	struct pollfd pfd;
+	size_t off=0;
+	ssize_t got=0;
+	time_t deadline=0;
+
+	deadline=time(NULL) + DAEMON_JOBWAIT;
+
+	for (;;) {
+		pfd.fd=cfd;
+		pfd.events=POLLIN;
+		pfd.revents=0;
+
+		if (time(NULL) >= deadline) {
+			DBG(M_CLD, "daemon client never sent a job");
+			return -1;
+		}
+
+		if (poll(&pfd, 1, 1000) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if (pfd.revents == 0) {
+			continue;
+		}
+
+		got=read(cfd, jline + off, jsize - off - 1);
+		if (got < 0 && errno == EINTR) {
+			continue;
+		}
+		if (got <= 0) {
+			break;
+		}
+		off += (size_t)got;
+		jline[off]='\0';
+
+		if (strchr(jline, '\n') != NULL || off == jsize - 1) {
+			break;
+		}
+	}
+
+	jline[off]='\0';
+	jline[strcspn(jline, "\r\n")]='\0';
+
+	if (strlen(jline) < 1) {
+		return -1;
+	}
+
+	return 1;
+}
+
+static void daemon_dojob(int cfd, const char *jline, int worker, unsigned int seq, int (*job)(int, char **)) {
+	char *argz[DAEMON_JOBARGS + 1], *jcopy=NULL, *tok=NULL, *rent=NULL;
+	char state[2], trailer[64];
+	const char *how=NULL;
+	int p[2], argc=0, ret=0;
+	ssize_t got=0;
+	size_t have=0;
+	pid_t pid=0;
+
+	if (pipe(p) < 0) {
+		ERR("cant make job pipe: %s", strerror(errno));
+		return;
+	}
+
+	VRB(1, "job %d.%u: `%s'", worker, seq, jline);
+
+	pid=fork();
+	if (pid < 0) {
+		ERR("cant fork for job %d.%u: %s", worker, seq, strerror(errno));
+		close(p[0]);
+		close(p[1]);
+		return;
+	}
+
+	if (pid == 0) {
+		struct sigaction sa;
+
+		/* the drones belong to the worker, nothing in here may kill them off */
+		s->forked=1;
+		chld_forget();
+
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_handler=SIG_DFL;
+		sigemptyset(&sa.sa_mask);
+		sigaction(SIGTERM, &sa, NULL);
+		sigaction(SIGINT, &sa, NULL);
+
+		close(p[0]);
+		close(d_lsock);
+		d_jobpipe=p[1];
+
+		fflush(NULL);
+		if (dup2(cfd, STDOUT_FILENO) < 0 || dup2(cfd, STDERR_FILENO) < 0) {
+			_exit(1);
+		}
+		close(cfd);
+		setvbuf(stdout, NULL, _IOLBF, 0);
+
+		jcopy=xstrdup(jline);
+		argz[argc++]=xstrdup(TARGETNAME);
+		for (tok=strtok_r(jcopy, " \t", &rent); tok != NULL && argc < DAEMON_JOBARGS; tok=strtok_r(NULL, " \t", &rent)) {
+			argz[argc++]=tok;
+		}
+		argz[argc]=NULL;
+
+		ret=job(argc, argz);
+
+		fflush(NULL);
+		if (ret > 0) {
+			state[0]=JOB_DONE;
+			if (write(d_jobpipe, state, 1) < 0) {
+				_exit(1);
+			}
+		}
+		_exit(ret > 0 ? 0 : 1);
+	}
+
+	close(p[1]);
+
+	/* the job says how far it got, silence means it never touched the drones */
+	have=0;
+	memset(state, 0, sizeof(state));
+	for (;;) {
+		got=read(p[0], state + have, sizeof(state) - have);
+		if (got < 0 && errno == EINTR) {
+			if (d_quit) {
+				kill(pid, SIGTERM);
+			}
+			continue;
+		}
+		if (got <= 0) {
+			break;
+		}
+		have += (size_t)got;
+		if (have == sizeof(state)) {
+			break;
+		}
+	}
+	close(p[0]);
+
+	/* no SIGCHLD handler reaps it when the drones are remote */
+	while (waitpid(pid, NULL, 0) < 0 && errno == EINTR) {
+		;
+	}
+
+	lease_release(worker);
+
+	if (have == 2 && state[1] == JOB_DONE) {
+		how="ok";
+	}
+	else if (have == 0) {
+		how="rejected";
+	}
+	else {
+		how="failed";
+	}
+
+	snprintf(trailer, sizeof(trailer) -1, "job %d.%u %s\n", worker, seq, how);
+	if (write(cfd, trailer, strlen(trailer)) < 0) {
+		DBG(M_CLD, "job %d.%u client went away", worker, seq);
+	}
+
+	VRB(1, "job %d.%u %s", worker, seq, how);
+
+	/* it died with work out at the drones, they cant be trusted anymore */
+	if (have == 1) {
+		ERR("job %d.%u died in the middle of its scan, restarting this worker", worker, seq);
+		d_quit=1;
+	}
+
+	return;
+}
+
+void daemon_job_started(void) {
+	char state=JOB_STARTED;
+
+	if (d_jobpipe < 0) {
+		return;
+	}
+
+	if (write(d_jobpipe, &state, 1) < 0) {
+		ERR("cant tell the worker the job started: %s", strerror(errno));
+	}
+
+	return;
+}
+
+int daemon_injob(void) {
+
+	return d_jobpipe < 0 ? 0 : 1;
+}
+
+int daemon_lease(const uint32_t *nets, const uint32_t *masks, int cnt) {
+	daemon_lease_t mine;
+	unsigned int j=0;
+	int busy=0, waited=0;
+
+	if (d_leases == NULL || d_worker < 0) {
+		return 1;
+	}
+
+	memset(&mine, 0, sizeof(mine));
+	mine.job=getpid();
+	if (cnt > 0 && cnt <= DAEMON_LEASENETS) {
+		assert(nets != NULL && masks != NULL);
+		mine.cnt=cnt;
+		memcpy(mine.nets, nets, sizeof(uint32_t) * (size_t)cnt);
+		memcpy(mine.masks, masks, sizeof(uint32_t) * (size_t)cnt);
+	}
+
+	for (;;) {
+		if (lease_lock(F_WRLCK) < 0) {
+			return -1;
+		}
+
+		for (j=0, busy=0; j < s->daemon_jobs; j++) {
+			if ((int)j != d_worker && d_leases[j].job != 0 && lease_overlap(&mine, &d_leases[j])) {
+				busy=1;
+				break;
+			}
+		}
+		if (! busy) {
+			d_leases[d_worker]=mine;
+		}
+
+		lease_lock(F_UNLCK);
+
+		if (! busy) {
+			break;
+		}
+
+		if (waited++ == 0) {
+			VRB(0, "waiting for a job scanning the same hosts to finish");
+		}
+		usleep(DAEMON_LEASEWAIT * 1000);
+	}
+
+	DBG(M_CLD, "job %d on worker %d holds a lease on %d networks", (int)mine.job, d_worker, mine.cnt);
+
+	return 1;
+}
+
+/* a file, not an anonymous mapping, so there is something for fcntl to lock */
+static int lease_init(void) {
+	FILE *lf=NULL;
+
+	lf=tmpfile();
+	if (lf == NULL) {
+		ERR("cant create daemon lease file: %s", strerror(errno));
+		return -1;
+	}
+
+	d_leasefd=dup(fileno(lf));
+	fclose(lf);
+	if (d_leasefd < 0) {
+		ERR("cant dup daemon lease file: %s", strerror(errno));
+		return -1;
+	}
+
+	if (ftruncate(d_leasefd, (off_t)(sizeof(daemon_lease_t) * DAEMON_MAXJOBS)) < 0) {
+		ERR("cant size daemon lease file: %s", strerror(errno));
+		close(d_leasefd);
+		d_leasefd=-1;
+		return -1;
+	}
+
+	d_leases=(daemon_lease_t *)mmap(NULL, sizeof(daemon_lease_t) * DAEMON_MAXJOBS, PROT_READ|PROT_WRITE, MAP_SHARED, d_leasefd, 0);
+	if (d_leases == MAP_FAILED) {
+		ERR("cant map daemon lease file: %s", strerror(errno));
+		d_leases=NULL;
+		close(d_leasefd);
+		d_leasefd=-1;
+		return -1;
+	}
+
+	return 1;
+}
+
+/* fcntl locks go away with the process holding them, a job killed mid lease cant wedge the rest */
+static int lease_lock(short how) {
+	struct flock fl;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type=how;
+	fl.l_whence=SEEK_SET;
+
+	while (fcntl(d_leasefd, how == F_UNLCK ? F_SETLK : F_SETLKW, &fl) < 0) {
+		if (errno != EINTR) {
+			ERR("cant lock daemon lease file: %s", strerror(errno));
+			return -1;
+		}
+	}
+
+	return 1;
+}
+
+static int lease_overlap(const daemon_lease_t *a, const daemon_lease_t *b) {
+	uint32_t mask=0;
+	int j=0, k=0;
+
+	if (a->cnt == 0 || b->cnt == 0) {
+		return 1;
+	}
+
+	for (j=0; j < a->cnt; j++) {
+		for (k=0; k < b->cnt; k++) {
+			mask=a->masks[j] & b->masks[k];
+			if ((a->nets[j] & mask) == (b->nets[k] & mask)) {
+				return 1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void lease_release(int worker) {
+
+	if (d_leases == NULL || lease_lock(F_WRLCK) < 0) {
+		return;
+	}
+	memset(&d_leases[worker], 0, sizeof(daemon_lease_t));
+	lease_lock(F_UNLCK);
+
+	return;
+}
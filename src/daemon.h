@@ -0,0 +1,72 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#ifndef _DAEMON_H
+# define _DAEMON_H
+
+/*
+ * --daemon, the master sets up once and then runs scan jobs sent to it over
+ * a unix socket. a client connects, writes one line of options and targets
+ * (what would follow the program name on a command line, split on white
+ * space) and reads the scan output back, the last line being
+ * `job <worker>.<n> ok', `... rejected' (bad options or nothing to
+ * scan) or `... failed'
+ *
+ * modules and the config file are loaded once. each of --daemon-jobs worker
+ * processes keeps its own sender and listener running (and the listeners
+ * pcap handle open) and forks a copy of itself per job, so the job starts
+ * from the daemons settings, applies its own options and throws them away
+ * when it is done. a job that dies in the middle of a scan takes its worker
+ * with it, the daemon starts a fresh one
+ */
+
+/*
+ * jobs side by side share the interface, and only TCP replies can be told
+ * apart by the syn cookie. so every job leases the networks it scans and
+ * narrows its listeners pcap filter to replies from them (or icmp errors
+ * quoting them), a job whose targets overlap one already running waits for
+ * it. a job with more than DAEMON_LEASENETS networks, or that isnt IPv4,
+ * leases everything and runs alone
+ */
+#define DAEMON_MAXJOBS		16
+#define DAEMON_LEASENETS	4
+#define DAEMON_LEASEWAIT	250	/* ms between looks at the leases	*/
+#define DAEMON_JOBMAX		4096	/* longest job line			*/
+#define DAEMON_JOBWAIT		10	/* seconds a client has to send it	*/
+#define DAEMON_JOBARGS		256
+
+/*
+ * drones_up forks and sets up the drones of a worker, job runs one job in
+ * the per job child and returns 1 once it has scanned, -1 if it didnt
+ * start. does not return until the daemon is told to stop, then 0
+ */
+int daemon_run(void (* /* drones_up */)(void), int (* /* job */)(int, char **));
+
+/* the job calls this right before it hands work to the drones */
+void daemon_job_started(void);
+
+/*
+ * blocks until no other job holds any of these networks, then takes them
+ * until the job exits. cnt < 1 leases everything. 1 outside the daemon
+ */
+int daemon_lease(const uint32_t * /* nets */, const uint32_t * /* masks */, int /* cnt */);
+
+/* 1 in the per job child, options fixed by the daemon are refused there */
+int daemon_injob(void);
+
+#endif
@@ -19,6 +19,7 @@
 #include <config.h>
 
 #include <errno.h>
+#include <sys/resource.h>
 
 #include <settings.h>
 #include <getconfig.h>
@@ -29,8 +30,40 @@
 #include <unilib/xipc.h>
 #include <unilib/drone.h>
 #include <unilib/cidr.h>
+#include <unilib/wanbatch.h>
 #include <scan_progs/workunits.h>
 
+/*
+ * every drone is a descriptor in the master, and the default soft limit is
+ * often 1024, so take as much of the hard limit as a big drone list needs
+ */
+static void drone_fdlimit(uint32_t drones) {
+	struct rlimit rl;
+	rlim_t want=0;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl) < 0) {
+		ERR("getrlimit fails: %s", strerror(errno));
+		return;
+	}
+
+	/* room for the drones plus our own files, pcap, output modules and such */
+	want=(rlim_t)drones + 64;
+
+	if (rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < want) {
+		if (rl.rlim_max != RLIM_INFINITY && rl.rlim_max < want) {
+			ERR("drone list needs %u descriptors, hard limit is %lu", drones + 64, (unsigned long)rl.rlim_max);
+			want=rl.rlim_max;
+		}
+		DBG(M_DRN, "raising descriptor limit from %lu to %lu", (unsigned long)rl.rlim_cur, (unsigned long)want);
+		rl.rlim_cur=want;
+		if (setrlimit(RLIMIT_NOFILE, &rl) < 0) {
+			ERR("setrlimit fails: %s", strerror(errno));
+		}
+	}
+
+	return;
+}
+
 int drone_setup(void) {
 	uint8_t status=0, msg_type=0, ecount=0;
 	size_t msg_len=0;
@@ -42,6 +75,7 @@ int drone_setup(void) {
 		drone_version_t *v;
 	} d_u;
 	int laggers=0;
+	uint8_t caps=0;
 
 	if (s->drone_str != NULL) {
 		DBG(M_DRN, "setup drones `%s'", s->drone_str);
@@ -54,6 +88,8 @@ int drone_setup(void) {
 	/* do stuff to figure out if there are working drones */
 	DBG(M_DRN, "drone list is %d big, connecting to them.", s->dlh->size);
 
+	drone_fdlimit(s->dlh->size);
+
 	do {
 		uint8_t *dummy=NULL;
 
@@ -142,7 +178,16 @@ int drone_setup(void) {
 								break;
 						}
 
-						if (send_message(c->s, MSG_ACK, MSG_STATUS_OK, dummy, 0) < 0) {
+						/* results from a listener across the network come back batched if it can */
+						caps=0;
+						if (c->type == DRONE_TYPE_LISTENER && ! drone_islocal(c)) {
+							caps=d_u.v->caps & wanbatch_caps();
+						}
+						if (caps) {
+							VRB(1, "listener on fd %d will batch its results", c->s);
+						}
+
+						if (send_message(c->s, MSG_ACK, MSG_STATUS_OK, &caps, (caps ? 1 : 0)) < 0) {
 							ERR("cant ack ident message from node on fd %d, marking as dead", c->s);
 							drone_updatestate(c, DRONE_STATUS_DEAD);
 						}
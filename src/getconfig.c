@@ -30,6 +30,7 @@
 #include <packageinfo.h>
 #include <getconfig.h>
 #include <parse/parse.h>
+#include <parse/confcache.h>
 
 #include <unilib/drone.h>
 #include <unilib/xmalloc.h>
@@ -46,6 +47,7 @@
 #endif
 
 #include <compile.h>
+#include <daemon.h>
 
 /*
  * inputs: NONE
@@ -58,6 +60,10 @@ static void usage(void) _NORETURN_;
 /*
  */
 static void display_version(void) _NORETURN_;
+static void compile_cache(void) _NORETURN_;
+
+/* the option as the user would write it, if a daemon job may not set it */
+static const char *job_fixedopt(int );
 
 /* XXX
  * this needs to be recoded
@@ -91,9 +97,26 @@ void getconfig_profile(const char *progname) {
 }
 
 int getconfig_argv(int argc, char ** argv) {
-	int ch=0;
 	char conffile[512];
 
+	scan_setdefaults();
+
+	snprintf(conffile, sizeof(conffile) -1, CONF_FILE, s->profile);
+	if (confcache_readconf(conffile) < 0) {
+		return -1;
+	}
+
+	return getconfig_opts(argc, argv);
+}
+
+/*
+ * the command line half of getconfig_argv(), applied over whatever is set
+ * already. daemon jobs come through here on top of the daemons own settings
+ */
+int getconfig_opts(int argc, char ** argv) {
+	int ch=0;
+	const char *fixed=NULL;
+
 /* Long-only option values (must be >= 256 to not conflict with short opts) */
 /* GeoIP integration (v6) */
 #define OPT_GEOIP_ENABLE	256
@@ -101,6 +124,23 @@ int getconfig_argv(int argc, char ** argv) {
 #define OPT_GEOIP_CITY_DB	258
 #define OPT_GEOIP_ASN_DB	259
 #define OPT_GEOIP_ANON_DB	260
+/* pcap savefile writer */
+#define OPT_SAVEFILE_SIZE	261
+#define OPT_SAVEFILE_TIME	262
+#define OPT_SAVEFILE_SNAP	263
+#define OPT_REPLAY		264
+#define OPT_IPC_SHM		265
+#define OPT_PROGRESS_SOCKET	266
+#define OPT_METRICS		267
+#define OPT_PIPELINE		268
+#define OPT_DAEMON		269
+#define OPT_DAEMON_JOBS		270
+#define OPT_COMPILE_CACHE	271
+#define OPT_ADAPTIVE_WAIT	272
+#define OPT_SELECT_RETRY	273
+#define OPT_STREAM		274
+#define OPT_SPILL		275
+#define OPT_RESOLVER		276
 
 #define OPTS	\
 		"b:" "B:" "c" "d:" "D" "e:" "E" "F" "G:" "h" "H:" "i:" "I" "j:" "l:" "L:" "m:" "M:" "N" "o:" "p:" "P:" "q:" "Q" \
@@ -152,22 +192,37 @@ int getconfig_argv(int argc, char ** argv) {
 		{"geoip-city-db",	1, NULL, OPT_GEOIP_CITY_DB},
 		{"geoip-asn-db",	1, NULL, OPT_GEOIP_ASN_DB},
 		{"geoip-anon-db",	1, NULL, OPT_GEOIP_ANON_DB},
+		{"savefile-rotate-size",	1, NULL, OPT_SAVEFILE_SIZE},
+		{"savefile-rotate-time",	1, NULL, OPT_SAVEFILE_TIME},
+		{"savefile-snaplen",	1, NULL, OPT_SAVEFILE_SNAP},
+		{"replay",		1, NULL, OPT_REPLAY},
+		{"ipc-shm",		0, NULL, OPT_IPC_SHM},
+		{"progress-socket",	1, NULL, OPT_PROGRESS_SOCKET},
+		{"metrics",		1, NULL, OPT_METRICS},
+		{"pipeline",		0, NULL, OPT_PIPELINE},
+		{"daemon",		1, NULL, OPT_DAEMON},
+		{"daemon-jobs",		1, NULL, OPT_DAEMON_JOBS},
+		{"compile-cache",	0, NULL, OPT_COMPILE_CACHE},
+		{"adaptive-wait",	0, NULL, OPT_ADAPTIVE_WAIT},
+		{"selective-retry",	1, NULL, OPT_SELECT_RETRY},
+		{"stream",		1, NULL, OPT_STREAM},
+		{"spill",		1, NULL, OPT_SPILL},
+		{"resolver",		1, NULL, OPT_RESOLVER},
 		{NULL,			0, NULL,  0 }
 	};
 #endif /* LONG OPTION SUPPORT */
 
-	scan_setdefaults();
-
-	snprintf(conffile, sizeof(conffile) -1, CONF_FILE, s->profile);
-	if (readconf(conffile) < 0) {
-		return -1;
-	}
-
 #ifdef WITH_LONGOPTS
 	while ((ch=getopt_long(argc, argv, OPTS, long_opts, NULL)) != -1) {
 #else
 	while ((ch=getopt(argc, argv, OPTS)) != -1) {
 #endif
+		/* the drones were started with these, a job that asks for others would get silently ignored */
+		if (daemon_injob() && (fixed=job_fixedopt(ch)) != NULL) {
+			ERR("%s is set when the daemon starts, a job cant change it", fixed);
+			return -1;
+		}
+
 		switch (ch) {
 			case 'b':
 				if (scan_setbroken(optarg) < 0) {
@@ -426,6 +481,94 @@ int getconfig_argv(int argc, char ** argv) {
 				}
 				break;
 
+			case OPT_SAVEFILE_SIZE: /* rotate pcap savefile every N MB */
+				if (scan_setsavefilesize(atoi(optarg)) < 0) {
+					usage();
+				}
+				break;
+
+			case OPT_SAVEFILE_TIME: /* rotate pcap savefile every N seconds */
+				if (scan_setsavefiletime(atoi(optarg)) < 0) {
+					usage();
+				}
+				break;
+
+			case OPT_SAVEFILE_SNAP: /* truncate frames written to the savefile */
+				if (scan_setsavefilesnap(atoi(optarg)) < 0) {
+					usage();
+				}
+				break;
+
+			case OPT_REPLAY: /* listener reads this pcap file instead of the wire */
+				if (scan_setreadfile(optarg) < 0) {
+					usage();
+				}
+				break;
+
+			case OPT_IPC_SHM: /* local sender/listener over shared memory instead of unix sockets */
+				scan_setipcshm(1);
+				break;
+
+			case OPT_PROGRESS_SOCKET: /* publish progress lines on a unix socket */
+				if (scan_setprogresssock(optarg) < 0) {
+					usage();
+				}
+				break;
+
+			case OPT_METRICS: /* serve prometheus metrics while scanning */
+				if (scan_setmetricsuri(optarg) < 0) {
+					usage();
+				}
+				break;
+
+			case OPT_PIPELINE: /* compound mode, start phase 2 on arp responders as they show up */
+				scan_setpipeline(1);
+				break;
+
+			case OPT_DAEMON: /* stay up and take scan jobs on a unix socket */
+				if (scan_setdaemon(optarg) < 0) {
+					usage();
+				}
+				break;
+
+			case OPT_DAEMON_JOBS: /* how many of those at once */
+				if (scan_setdaemonjobs(atoi(optarg)) < 0) {
+					usage();
+				}
+				break;
+
+			case OPT_COMPILE_CACHE: /* parse the config and lookup tables once, for everyone after us */
+				compile_cache();
+				break;
+
+			case OPT_ADAPTIVE_WAIT: /* -L is only the upper bound, stop once the rtts say were done */
+				scan_setadaptivewait(1);
+				break;
+
+			case OPT_SELECT_RETRY: /* -R rounds resend only to whats still quiet */
+				if (scan_setselectretry(atoi(optarg)) < 0) {
+					usage();
+				}
+				break;
+
+			case OPT_STREAM: /* no end of scan report, write results once as they come */
+				if (scan_setstream(atoi(optarg)) < 0) {
+					usage();
+				}
+				break;
+
+			case OPT_SPILL: /* sorted report bigger than memory, runs go to temp files */
+				if (scan_setspill(atoi(optarg)) < 0) {
+					usage();
+				}
+				break;
+
+			case OPT_RESOLVER: /* nameserver for -N reverse lookups */
+				if (scan_setresolver(optarg) < 0) {
+					usage();
+				}
+				break;
+
 			default:
 				usage();
 				break;
@@ -454,6 +597,32 @@ int getconfig_argv(int argc, char ** argv) {
 	return 1;
 }
 
+static const char *job_fixedopt(int ch) {
+
+	switch (ch) {
+		case 'i':
+			return "the interface (-i)";
+		case 'e':
+		case 'M':
+			return "the module set (-e, -M)";
+		case 'w':
+		case OPT_SAVEFILE_SIZE:
+		case OPT_SAVEFILE_TIME:
+		case OPT_SAVEFILE_SNAP:
+		case OPT_REPLAY:
+			return "the listeners pcap savefile or replay file";
+		case 'Z':
+		case OPT_IPC_SHM:
+			return "the drone set (-Z, --ipc-shm)";
+		case OPT_DAEMON:
+		case OPT_DAEMON_JOBS:
+			return "daemon mode";
+		default:
+			break;
+	}
+
+	return NULL;
+}
 
 void do_targets(void) {
 	union {
@@ -572,6 +741,31 @@ static void usage(void) {
 	"\t    --geoip-city-db   *Path to city database (e.g., /usr/share/GeoIP/GeoLite2-City.mmdb)\n"
 	"\t    --geoip-asn-db    *Path to ASN database (e.g., /usr/share/GeoIP/GeoLite2-ASN.mmdb)\n"
 	"\t    --geoip-anon-db   *Path to anonymous IP database (paid, optional)\n"
+	"\n\tpcap savefile (-w):\n"
+	"\t    --savefile-rotate-size *start a new savefile every N megabytes\n"
+	"\t    --savefile-rotate-time *start a new savefile every N seconds\n"
+	"\t    --savefile-snaplen     *only log the first N bytes of each frame\n"
+	"\t    --replay               *listener parses this pcap file (from memory) instead of the wire\n"
+	"\n\tipc:\n"
+	"\t    --ipc-shm              talk to the local sender and listener over shared memory\n"
+	"\t    --progress-socket      *publish scan progress lines on this unix socket path\n"
+	"\t    --metrics              *serve prometheus metrics on unix:/path or [addr:]port\n"
+	"\n\tcompound mode (-mA+T):\n"
+	"\t    --pipeline             probe arp responders while arp is still running, no barrier\n"
+	"\n\treceive timeout (-L):\n"
+	"\t    --adaptive-wait        stop waiting once measured tcp rtts have passed and replies went quiet\n"
+	"\n\trepeats (-R):\n"
+	"\t    --selective-retry      *later rounds skip targets that answered, pausing N ms (doubling) first\n"
+	"\n\tresults:\n"
+	"\t    --stream               *write results as they arrive, no sorted report, N MB duplicate filter\n"
+	"\t    --spill                *keep N MB of results in memory, sort the rest through temp files (ends -I without -c)\n"
+	"\n\treverse dns (-N):\n"
+	"\t    --resolver             *nameserver as addr[:port], `system' for the libc resolver one at a time\n"
+	"\n\tdaemon:\n"
+	"\t    --daemon               *keep drones up and take scan jobs on this unix socket path\n"
+	"\t    --daemon-jobs          *jobs to run at the same time, each with its own drones (default 1)\n"
+	"\n\tconfig cache:\n"
+	"\t    --compile-cache        write the config, ports.txt and oui.txt out as a binary cache and exit\n"
 	"*:\toptions with `*' require an argument following them\n\n"
 	"  address ranges are cidr like 1.2.3.4/8 for all of 1.?.?.?\n"
 	"  if you omit the cidr mask then /32 is implied\n"
@@ -596,3 +790,11 @@ static void display_version(void) {
 
 	uexit(0);
 }
+
+static void compile_cache(void) {
+	char conffile[512];
+
+	snprintf(conffile, sizeof(conffile) -1, CONF_FILE, s->profile);
+
+	uexit(confcache_compile(conffile) < 0 ? 1 : 0);
+}
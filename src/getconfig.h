@@ -22,6 +22,8 @@
 /*
  */
 int getconfig_argv(int /* argc */, char ** /* argv[] */);
+/* just the options and targets, no defaults or config file */
+int getconfig_opts(int /* argc */, char ** /* argv[] */);
 
 /*
  */
@@ -39,18 +39,22 @@
 #include <unilib/drone.h>
 #include <unilib/modules.h>
 #include <unilib/qfifo.h>
+#include <unilib/metrics.h>
 #include <unilib/xmalloc.h>
 
 #include <scan_progs/scan_export.h>
+#include <scan_progs/options.h>
 #include <scan_progs/master.h>
 #include <scan_progs/workunits.h>
 #include <scan_progs/report.h>
 #include <scan_progs/connect.h>
 #include <scan_progs/phase_filter.h>
+#include <scan_progs/telemetry.h>
 
 #include <usignals.h>
 #include <drone_setup.h>
 #include <chld.h>
+#include <daemon.h>
 
 settings_t *s=NULL;
 int ident=0;
@@ -113,17 +117,6 @@ static void get_first_target_port_spec(void *target) {
 	}
 }
 
-/*
- * CIDR Aggregation for Phase 2+ Workunits
- *
- * Instead of creating one /32 workunit per ARP responder, we aggregate
- * responding hosts into optimal CIDR blocks. This reduces workunit count
- * while still only scanning hosts that responded to ARP.
- *
- * Example: if .40, .41, .42, .43 all responded, we create one /30 instead
- * of four /32s. The algorithm finds the largest valid CIDR at each position.
- */
-
 /* Collector structure for gathering IPs during phase_filter_walk */
 typedef struct {
 	uint32_t *ips;		/* array of IPs in host byte order */
@@ -145,237 +138,489 @@ static void collect_arp_ip(uint32_t ipaddr, void *ctx) {
 	c->ips[c->count++]=ntohl(ipaddr);
 }
 
-/* qsort comparison for uint32_t */
-static int compare_u32(const void *a, const void *b) {
-	uint32_t va=*(const uint32_t *)a;
-	uint32_t vb=*(const uint32_t *)b;
+/*
+ * Create workunits from ARP cache for compound mode phase 2+.
+ *
+ * Collects all ARP responders, aggregates them into optimal CIDR blocks,
+ * and creates workunits. This ensures phase 2+ only scans hosts discovered
+ * in phase 1, with minimal workunit overhead.
+ *
+ * The port specification is extracted from the original target string(s)
+ * so that target:port syntax is honored in phase 2+.
+ */
+static void do_targets_from_arp_cache(void) {
+	uint32_t count=0;
+	const char *port_spec=NULL;
+	ip_collector_t collector;
+
+	count=phase_filter_count();
+	if (count == 0) {
+		VRB(0, "phase 2+: no ARP responses cached, nothing to scan");
+		return;
+	}
 
-	if (va < vb) return -1;
-	if (va > vb) return 1;
-	return 0;
+	/*
+	 * Extract port spec from original target(s). Uses first target's
+	 * port spec for all phase 2+ workunits. If no port spec was given
+	 * on the target, workunit_add() falls back to s->gport_str.
+	 */
+	first_target_port=NULL;
+	fifo_walk(s->target_strs, get_first_target_port_spec);
+	port_spec=first_target_port;
+
+	if (port_spec != NULL) {
+		DBG(M_WRK, "phase 2+: using port spec '%s' from original target", port_spec);
+	}
+
+	/* collect all ARP responder IPs */
+	memset(&collector, 0, sizeof(collector));
+	phase_filter_walk(collect_arp_ip, &collector);
+
+	if (collector.count == 0) {
+		VRB(0, "phase 2+: no IPs collected from ARP cache");
+		return;
+	}
+
+	/* aggregate into optimal CIDRs and create workunits */
+	workunit_add_hosts(collector.ips, collector.count, port_spec);
+
+	xfree(collector.ips);
 }
 
 /*
- * Binary search to check if an IP is in the sorted array.
- * Returns 1 if found, 0 if not.
+ * Pipelined compound mode, the arp phase and the one after it run as one
+ * scan. the arp workunits are queued already, the settings for the next
+ * phase are loaded and the arp listener workunit is turned into one for that
+ * phase that still passes arp replies on. the master then queues each new
+ * responder for probing as its reply comes in, so there is no barrier and
+ * no separate recv timeout between the two phases.
  */
-static int ip_in_set(const uint32_t *ips, uint32_t count, uint32_t ip) {
-	uint32_t lo=0, hi=count;
+static void pipeline_begin(void) {
+	int cnt=0;
 
-	while (lo < hi) {
-		uint32_t mid=(lo + hi) / 2;
+	if (load_phase_settings(1) != 1) {
+		terminate("failed to load phase 2 settings for compound mode");
+	}
 
-		if (ips[mid] == ip) {
-			return 1;
-		}
-		if (ips[mid] < ip) {
-			lo=mid + 1;
-		}
-		else {
-			hi=mid;
-		}
+	if ((cnt=workunit_pipeline_lp()) < 1) {
+		terminate("no arp listener workunit to pipeline phase 2 into");
 	}
 
-	return 0;
+	first_target_port=NULL;
+	fifo_walk(s->target_strs, get_first_target_port_spec);
+
+	VRB(1, "phase 1+2: %s of arp responders starts as they answer",
+		strscanmode(scan_getmode()));
+
+	master_pipeline_start(first_target_port);
+
+	return;
+}
+
+static void pipeline_end(void) {
+	uint32_t hosts=0;
+
+	hosts=master_pipeline_stop();
+
+	VRB(0, "phase 1+2: %u hosts answered arp and were probed with %s",
+		hosts, strscanmode(scan_getmode()));
+
+	/* the phase after arp has run, the loop moves on to the one after that */
+	s->cur_phase++;
+
+	return;
 }
 
 /*
- * Find the largest CIDR block starting at base_ip where all hosts
- * in the block are present in our set. Returns the CIDR prefix length.
- *
- * A CIDR /N block contains 2^(32-N) hosts and must be aligned to
- * that boundary (base_ip % block_size == 0).
+ * compound mode phase filter and per-phase settings, plus the pipeline sanity check
+ * has to run after the options are parsed and before do_targets()
  */
-static int find_largest_cidr(const uint32_t *ips, uint32_t count,
-			     uint32_t base_ip, uint32_t max_ip) {
-	int cidr=0;
-
+static void phases_init(void) {
 	/*
-	 * Try progressively larger blocks from /31 down to /24.
-	 * Stop at /24 since larger blocks are impractical for local scans.
+	 * Initialize phase filter for compound mode ARP caching.
+	 * Must be done after getconfig_argv() sets s->num_phases,
+	 * and before do_targets() so the cache is ready for validation.
 	 */
-	for (cidr=31; cidr >= 24; cidr--) {
-		uint32_t block_size=1U << (32 - cidr);
-		uint32_t block_mask=~(block_size - 1);
-		uint32_t block_base=base_ip & block_mask;
-		uint32_t block_end=block_base + block_size - 1;
-		uint32_t i=0;
-		int all_present=1;
-
-		/* block must start at base_ip (aligned) */
-		if (block_base != base_ip) {
-			continue;
+	if (s->num_phases > 1) {
+		if (phase_filter_init() != 1) {
+			terminate("failed to initialize phase filter for compound mode");
 		}
-
-		/* block must not exceed our IP range */
-		if (block_end > max_ip) {
-			continue;
+		/*
+		 * Load phase 0 settings BEFORE creating workunits.
+		 * This ensures per-phase PPS/repeats/timeout override global -r/-R/-L
+		 * options that were parsed after -m on the command line.
+		 */
+		if (load_phase_settings(0) != 1) {
+			terminate("failed to load phase 0 settings for compound mode");
 		}
+	}
 
-		/* check if all hosts in block are in our set */
-		for (i=0; i < block_size; i++) {
-			if (!ip_in_set(ips, count, block_base + i)) {
-				all_present=0;
-				break;
-			}
+	if (GET_PIPELINE()) {
+		if (s->num_phases < 2 || s->phases[0].mode != MODE_ARPSCAN ||
+		(s->phases[1].mode != MODE_TCPSCAN && s->phases[1].mode != MODE_UDPSCAN)) {
+			VRB(0, "pipelining needs a compound scan going from arp to tcp or udp (-mA+T), ignoring it");
+			SET_PIPELINE(0);
 		}
+	}
 
-		if (all_present) {
-			return cidr;
-		}
+	return;
+}
+
+static void show_estimate(void) {
+	unsigned int num_secs=0, time_off=0;
+	char time_est[128];
+
+	time_est[0]='\0';
+	time_off=0;
+
+	/*
+	 * For compound mode, calculate and display phase 1 estimate only.
+	 * Phase 2+ estimates shown after ARP completes with actual live count.
+	 * For single mode, use the accumulated total estimate.
+	 */
+	if (s->num_phases > 1) {
+		num_secs=calculate_phase_estimate(0, s->num_hosts, NULL);
 	}
+	else {
+		num_secs=s->num_secs;
+	}
+
+	if (num_secs > (60 * 60)) {
+		unsigned long long int hours=0;
+		int sret=0;
 
-	/* fallback to /32 */
-	return 32;
+		hours=num_secs / (60 * 60);
+
+		sret=snprintf(&time_est[time_off], sizeof(time_est) - (time_off + 1), "%llu Hours, ", hours);
+		assert(sret > 0);
+		time_off += sret;
+
+		num_secs -= hours * (60 * 60);
+	}
+	if (num_secs > 60) {
+		unsigned long long int minutes=0;
+		int sret=0;
+
+		minutes=num_secs / 60;
+
+		sret=snprintf(&time_est[time_off], sizeof(time_est) - (time_off + 1), "%llu Minutes, ", minutes);
+		assert(sret > 0);
+		time_off += sret;
+
+		num_secs -= minutes * 60;
+	}
+
+	snprintf(&time_est[time_off], sizeof(time_est) - (time_off + 1), "%u Seconds", num_secs);
+
+	/*
+	 * Display time estimate: phase-specific for compound mode,
+	 * total estimate for single mode.
+	 */
+	if (s->num_phases > 1) {
+		VRB(0, "phase 1 (%s): ~%s for %.2e hosts",
+			strscanmode(s->phases[0].mode),
+			time_est,
+			s->num_hosts
+		);
+	}
+	else {
+		VRB(0, "scaning %.2e total hosts with %.2e total packets, should take a little longer than %s",
+			s->num_hosts,
+			s->num_packets,
+			time_est
+		);
+	}
+
+	return;
 }
 
 /*
- * Create a workunit for a CIDR block with optional port specification.
+ * fork off the local drones if we have any, then connect to all of them
  */
-static void create_cidr_workunit(uint32_t host_ip, int cidr,
-				 const char *port_spec) {
-	char ip_str[80];
-	char *estr=NULL;
-	uint32_t net_ip=htonl(host_ip);
-
-	if (cidr == 32) {
-		/* /32 - single host, no CIDR suffix needed */
-		if (port_spec != NULL && strlen(port_spec) > 0) {
-			snprintf(ip_str, sizeof(ip_str), "%u.%u.%u.%u:%s",
-				(net_ip >> 0) & 0xff, (net_ip >> 8) & 0xff,
-				(net_ip >> 16) & 0xff, (net_ip >> 24) & 0xff,
-				port_spec);
-		}
-		else {
-			snprintf(ip_str, sizeof(ip_str), "%u.%u.%u.%u",
-				(net_ip >> 0) & 0xff, (net_ip >> 8) & 0xff,
-				(net_ip >> 16) & 0xff, (net_ip >> 24) & 0xff);
+static void drones_up(void) {
+	if (s->forklocal) {
+		chld_init();
+
+		/* setup signals for children to sync with */
+		if (signals_children() < 0) {
+			terminate("cant setup child signals");
 		}
-	}
-	else {
-		/* CIDR block */
-		if (port_spec != NULL && strlen(port_spec) > 0) {
-			snprintf(ip_str, sizeof(ip_str), "%u.%u.%u.%u/%d:%s",
-				(net_ip >> 0) & 0xff, (net_ip >> 8) & 0xff,
-				(net_ip >> 16) & 0xff, (net_ip >> 24) & 0xff,
-				cidr, port_spec);
+
+		/* register cleanup handler before forking so exit() kills children */
+		atexit(chld_cleanup);
+
+		/* initialize senders */
+		if (chld_fork() < 0) {
+			terminate("something went wrong while forking children");
 		}
-		else {
-			snprintf(ip_str, sizeof(ip_str), "%u.%u.%u.%u/%d",
-				(net_ip >> 0) & 0xff, (net_ip >> 8) & 0xff,
-				(net_ip >> 16) & 0xff, (net_ip >> 24) & 0xff,
-				cidr);
+
+		while (chld_waitsync() > 0) {
+			usleep(10000);
 		}
+
+		DBG(M_CLD, "children synced");
 	}
 
-	if (workunit_add(ip_str, &estr) < 0) {
-		ERR("failed to add workunit %s: %s", ip_str, estr);
+	if (s->metrics_uri != NULL) {
+		metrics_init();
 	}
-}
 
-/*
- * Aggregate IPs into optimal CIDRs and create workunits.
- *
- * Algorithm: iterate through sorted IPs, at each position find the
- * largest valid CIDR block where all hosts responded to ARP. This
- * greedily produces the minimal number of workunits.
- */
-static void aggregate_cidrs_and_create_workunits(const uint32_t *ips,
-						 uint32_t count,
-						 const char *port_spec) {
-	uint32_t i=0;
-	uint32_t workunits=0;
-	uint32_t max_ip=0;
-	uint8_t *covered=NULL;
+	if (drone_setup() < 0) {
+		terminate("cant setup drones, exiting");
+	}
 
-	if (count == 0) {
-		return;
+	/* XXX remove this and fix */
+	if (s->senders == 0 && GET_SENDDRONE()) {
+		/* XXX */
+		terminate("no senders for scan, giving up and rudley disconnecting from other drones without warning");
+	}
+
+	if (s->listeners == 0 && GET_LISTENDRONE()) {
+		/* XXX */
+		terminate("no listeners for scan, giving up and rudley disconnecting from other drones without warning");
+	}
+
+	return;
+}
+
+static void scan_all(void) {
+	report_init();
+	VRB(1, "connect mode: %s (options=0x%x)", GET_DOCONNECT() ? "enabled" : "disabled", s->options);
+	if (GET_DOCONNECT()) {
+		connect_init();
 	}
 
-	max_ip=ips[count - 1];
-	covered=(uint8_t *)xmalloc(count);
-	memset(covered, 0, count);
+	for (s->cur_iter=1 ; s->cur_iter < (s->scan_iter + 1); s->cur_iter++) {
+		/*
+		 * Phase loop for compound mode (e.g., -mA+T).
+		 * Single mode (num_phases <= 1) runs once with existing settings.
+		 */
+		int num_phases_to_run=(s->num_phases > 1) ? s->num_phases : 1;
+
+		for (s->cur_phase=0; s->cur_phase < num_phases_to_run; s->cur_phase++) {
+			if (s->num_phases > 1) {
+				/*
+				 * Compound mode: load phase-specific settings.
+				 * Phase 0 already loaded before do_targets() to ensure
+				 * workunits are created with correct per-phase PPS.
+				 * Phase 1+ need settings loaded and workunits regenerated.
+				 */
+				if (s->cur_phase > 0) {
+					if (load_phase_settings(s->cur_phase) != 1) {
+						terminate("failed to load phase %d settings", s->cur_phase + 1);
+					}
+					VRB(1, "phase %d: regenerating workunits for %s",
+						s->cur_phase + 1, strscanmode(scan_getmode()));
+					workunit_reinit();
+					master_reset_phase_state();
+					/*
+					 * For phase 2+, if phase 0 was ARP, create workunits
+					 * only for hosts that responded. Otherwise (e.g., -mT+U),
+					 * use original target list for all phases.
+					 */
+					if (s->phases[0].mode == MODE_ARPSCAN) {
+						do_targets_from_arp_cache();
+					}
+					else {
+						prepare_targets_for_phase();
+						do_targets();
+					}
+				}
+
+				VRB(1, "scan iteration %u phase %u/%u: %s",
+					s->cur_iter, s->cur_phase + 1, s->num_phases,
+					strscanmode(scan_getmode()));
+			}
+			else {
+				VRB(1, "scan iteration %u out of %u", s->cur_iter, s->scan_iter);
+			}
+
+			workunit_reset();
+
+			if (GET_PIPELINE() && s->cur_phase == 0) {
+				pipeline_begin();
+				run_scan();
+				pipeline_end();
+				continue;
+			}
+
+			run_scan();
+
+			/*
+			 * In compound mode, after completing an ARP phase,
+			 * display phase 2 time estimate using actual live host count.
+			 * ARP results will be output in final report_do(), grouped
+			 * with TCP results per-IP for cleaner output.
+			 */
+			if (s->num_phases > 1 && scan_getmode() == MODE_ARPSCAN) {
+				if (s->cur_phase + 1 < s->num_phases) {
+					uint32_t live_count=0;
+
+					live_count=phase_filter_count();
+					if (live_count > 0) {
+						uint32_t p2_secs=0;
+						unsigned int p2_off=0;
+						char p2_est[128];
+						const char *port_spec=NULL;
 
-	for (i=0; i < count; i++) {
-		uint32_t block_size=0;
-		int cidr=0;
-		uint32_t j=0;
+						/*
+						 * Extract port spec from first target for accurate
+						 * phase 2 time estimate. The target:port syntax
+						 * overrides s->gport_str.
+						 */
+						first_target_port=NULL;
+						fifo_walk(s->target_strs, get_first_target_port_spec);
+						port_spec=first_target_port;
+
+						p2_secs=calculate_phase_estimate(s->cur_phase + 1, (double)live_count, port_spec);
+						p2_est[0]='\0';
+						p2_off=0;
+
+						if (p2_secs > (60 * 60)) {
+							unsigned long long int hours=0;
+							int sret=0;
+
+							hours=p2_secs / (60 * 60);
+							sret=snprintf(&p2_est[p2_off], sizeof(p2_est) - (p2_off + 1), "%llu Hours, ", hours);
+							assert(sret > 0);
+							p2_off += sret;
+							p2_secs -= hours * (60 * 60);
+						}
+						if (p2_secs > 60) {
+							unsigned long long int minutes=0;
+							int sret=0;
+
+							minutes=p2_secs / 60;
+							sret=snprintf(&p2_est[p2_off], sizeof(p2_est) - (p2_off + 1), "%llu Minutes, ", minutes);
+							assert(sret > 0);
+							p2_off += sret;
+							p2_secs -= minutes * 60;
+						}
+						snprintf(&p2_est[p2_off], sizeof(p2_est) - (p2_off + 1), "%u Seconds", p2_secs);
 
-		if (covered[i]) {
-			continue;
+						VRB(0, "phase %d (%s): ~%s for %u live hosts",
+							s->cur_phase + 2,
+							strscanmode(s->phases[s->cur_phase + 1].mode),
+							p2_est,
+							live_count);
+					}
+					else {
+						VRB(0, "phase %d: no hosts responded to ARP, skipping",
+							s->cur_phase + 2);
+					}
+				}
+			}
 		}
+	}
 
-		/* find largest CIDR block starting at this IP */
-		cidr=find_largest_cidr(ips, count, ips[i], max_ip);
-		block_size=1U << (32 - cidr);
+	report_do();
+	report_destroy();
 
-		/* create workunit for this block */
-		create_cidr_workunit(ips[i], cidr, port_spec);
-		workunits++;
+	if (GET_DOCONNECT()) {
+		connect_destroy();
+	}
+
+	return;
+}
 
-		/* mark all IPs in this block as covered */
-		for (j=i; j < count && ips[j] < ips[i] + block_size; j++) {
-			covered[j]=1;
+/*
+ * wait for our targets to be ours alone, then keep the listener to them, later
+ * phases build their recv workunits from the same s->extra_pcapfilter
+ */
+static int daemon_joblease(void) {
+	uint32_t nets[DAEMON_LEASENETS], masks[DAEMON_LEASENETS];
+	char filter[512];
+	int cnt=0, j=0;
+
+	cnt=workunit_get_targets(nets, masks, DAEMON_LEASENETS);
+
+	/* nothing narrows arp replies to a job, an arp scan has the interface to itself */
+	if (s->ss->mode == MODE_ARPSCAN || GET_ARPALSO()) {
+		cnt=-1;
+	}
+	for (j=0; s->phases != NULL && j < (int)s->num_phases; j++) {
+		if (s->phases[j].mode == MODE_ARPSCAN) {
+			cnt=-1;
 		}
 	}
+	if (cnt > 0 && workunit_target_pcapfilter(nets, masks, cnt, filter, sizeof(filter)) < 0) {
+		cnt=-1;
+	}
 
-	VRB(1, "phase 2+: aggregated %u hosts into %u CIDR workunits",
-		count, workunits);
+	if (daemon_lease(nets, masks, cnt) < 0) {
+		ERR("cant lease the jobs targets");
+		return -1;
+	}
 
-	xfree(covered);
+	if (cnt > 0) {
+		DBG(M_CLD, "job listener filter `%s'", filter);
+		if (scan_setpcapfilter(filter) < 0) {
+			return -1;
+		}
+		workunit_refilter_lp();
+	}
+
+	return 1;
 }
 
 /*
- * Create workunits from ARP cache for compound mode phase 2+.
- *
- * Collects all ARP responders, aggregates them into optimal CIDR blocks,
- * and creates workunits. This ensures phase 2+ only scans hosts discovered
- * in phase 1, with minimal workunit overhead.
- *
- * The port specification is extracted from the original target string(s)
- * so that target:port syntax is honored in phase 2+.
+ * one daemon job, we are a fresh fork of a worker that has the modules loaded
+ * and the drones connected, so this is main() minus all that
  */
-static void do_targets_from_arp_cache(void) {
-	uint32_t count=0;
-	const char *port_spec=NULL;
-	ip_collector_t collector;
+static int daemon_job(int argc, char **argv) {
 
-	count=phase_filter_count();
-	if (count == 0) {
-		VRB(0, "phase 2+: no ARP responses cached, nothing to scan");
-		return;
+	prng_init();
+	s->ss->syn_key=prng_get32();
+	time(&s->s_time);
+
+#ifdef __GLIBC__
+	optind=0;
+#else
+	optreset=1;
+	optind=1;
+#endif
+
+	if (getconfig_opts(argc, argv) < 0) {
+		ERR("bad job options");
+		return -1;
 	}
 
-	/*
-	 * Extract port spec from original target(s). Uses first target's
-	 * port spec for all phase 2+ workunits. If no port spec was given
-	 * on the target, workunit_add() falls back to s->gport_str.
-	 */
-	first_target_port=NULL;
-	fifo_walk(s->target_strs, get_first_target_port_spec);
-	port_spec=first_target_port;
+	phases_init();
 
-	if (port_spec != NULL) {
-		DBG(M_WRK, "phase 2+: using port spec '%s' from original target", port_spec);
+	do_targets();
+
+	if (daemon_joblease() < 0) {
+		return -1;
 	}
 
-	/* collect all ARP responder IPs */
-	memset(&collector, 0, sizeof(collector));
-	phase_filter_walk(collect_arp_ip, &collector);
+	if (init_output_modules() < 0) {
+		ERR("cant initialize output module structures");
+		return -1;
+	}
 
-	if (collector.count == 0) {
-		VRB(0, "phase 2+: no IPs collected from ARP cache");
-		return;
+	if (init_report_modules() < 0) {
+		ERR("cant initialize report module structures");
+		return -1;
 	}
 
-	/* sort IPs for CIDR aggregation */
-	qsort(collector.ips, collector.count, sizeof(uint32_t), compare_u32);
+	show_estimate();
 
-	/* aggregate into optimal CIDRs and create workunits */
-	aggregate_cidrs_and_create_workunits(collector.ips, collector.count,
-					     port_spec);
+	daemon_job_started();
 
-	xfree(collector.ips);
+	scan_all();
+
+	telemetry_fini();
+
+	time(&s->e_time);
+
+	fini_output_modules();
+	fini_report_modules();
+
+	if (s->num_phases > 1) {
+		phase_filter_destroy();
+	}
+
+	return 1;
 }
 
 #ifdef __APPLE__
@@ -422,8 +667,6 @@ static int check_bpf_access(void) {
 #endif /* __APPLE__ */
 
 int main(int argc, char **argv) {
-	unsigned int num_secs=0, time_off=0;
-	char time_est[128];
 
 	ident=IDENT_MASTER;
 	ident_name_ptr=IDENT_MASTER_NAME;
@@ -462,23 +705,8 @@ int main(int argc, char **argv) {
 		terminate("unable to get configuration");
 	}
 
-	/*
-	 * Initialize phase filter for compound mode ARP caching.
-	 * Must be done after getconfig_argv() sets s->num_phases,
-	 * and before do_targets() so the cache is ready for validation.
-	 */
-	if (s->num_phases > 1) {
-		if (phase_filter_init() != 1) {
-			terminate("failed to initialize phase filter for compound mode");
-		}
-		/*
-		 * Load phase 0 settings BEFORE creating workunits.
-		 * This ensures per-phase PPS/repeats/timeout override global -r/-R/-L
-		 * options that were parsed after -m on the command line.
-		 */
-		if (load_phase_settings(0) != 1) {
-			terminate("failed to load phase 0 settings for compound mode");
-		}
+	if (s->daemon_sock == NULL) {
+		phases_init();
 	}
 
 	/*
@@ -493,8 +721,13 @@ int main(int argc, char **argv) {
 		terminate("cant initialize payload module structures, quiting");
 	}
 
-	/* now parse argv data for a target -> workunit list */
-	do_targets();
+	if (s->daemon_sock == NULL) {
+		/* now parse argv data for a target -> workunit list */
+		do_targets();
+	}
+	else if (s->interface_str == NULL) {
+		terminate("daemon mode needs an interface, give it one with -i");
+	}
 
 	if (s->interface_str == NULL) {
 		if (workunit_get_interfaces() < 0) {
@@ -505,73 +738,16 @@ int main(int argc, char **argv) {
 
 	VRB(0, "using interface(s) %s", s->interface_str);
 
-	if (init_output_modules() < 0) {
-		terminate("cant initialize output module structures, quiting");
-	}
-
-	if (init_report_modules() < 0) {
-		terminate("cant initialize report module structures, quiting");
-	}
-
-	time_est[0]='\0';
-	time_off=0;
-
-	/*
-	 * For compound mode, calculate and display phase 1 estimate only.
-	 * Phase 2+ estimates shown after ARP completes with actual live count.
-	 * For single mode, use the accumulated total estimate.
-	 */
-	if (s->num_phases > 1) {
-		num_secs=calculate_phase_estimate(0, s->num_hosts, NULL);
-	}
-	else {
-		num_secs=s->num_secs;
-	}
-
-	if (num_secs > (60 * 60)) {
-		unsigned long long int hours=0;
-		int sret=0;
-
-		hours=num_secs / (60 * 60);
-
-		sret=snprintf(&time_est[time_off], sizeof(time_est) - (time_off + 1), "%llu Hours, ", hours);
-		assert(sret > 0);
-		time_off += sret;
-
-		num_secs -= hours * (60 * 60);
-	}
-	if (num_secs > 60) {
-		unsigned long long int minutes=0;
-		int sret=0;
-
-		minutes=num_secs / 60;
+	if (s->daemon_sock == NULL) {
+		if (init_output_modules() < 0) {
+			terminate("cant initialize output module structures, quiting");
+		}
 
-		sret=snprintf(&time_est[time_off], sizeof(time_est) - (time_off + 1), "%llu Minutes, ", minutes);
-		assert(sret > 0);
-		time_off += sret;
+		if (init_report_modules() < 0) {
+			terminate("cant initialize report module structures, quiting");
+		}
 
-		num_secs -= minutes * 60;
-	}
-
-	snprintf(&time_est[time_off], sizeof(time_est) - (time_off + 1), "%u Seconds", num_secs);
-
-	/*
-	 * Display time estimate: phase-specific for compound mode,
-	 * total estimate for single mode.
-	 */
-	if (s->num_phases > 1) {
-		VRB(0, "phase 1 (%s): ~%s for %.2e hosts",
-			strscanmode(s->phases[0].mode),
-			time_est,
-			s->num_hosts
-		);
-	}
-	else {
-		VRB(0, "scaning %.2e total hosts with %.2e total packets, should take a little longer than %s",
-			s->num_hosts,
-			s->num_packets,
-			time_est
-		);
+		show_estimate();
 	}
 
 	if (GET_OVERRIDE()) {
@@ -610,180 +786,23 @@ int main(int argc, char **argv) {
 	}
 #endif
 
-	if (s->forklocal) {
-		chld_init();
-
-		/* setup signals for children to sync with */
-		if (signals_children() < 0) {
-			terminate("cant setup child signals");
-		}
-
-		/* register cleanup handler before forking so exit() kills children */
-		atexit(chld_cleanup);
-
-		/* initialize senders */
-		if (chld_fork() < 0) {
-			terminate("something went wrong while forking children");
-		}
-
-		while (chld_waitsync() > 0) {
-			usleep(10000);
-		}
-
-		DBG(M_CLD, "children synced");
-	}
-
-	if (drone_setup() < 0) {
-		terminate("cant setup drones, exiting");
+	if (s->daemon_sock != NULL) {
+		uexit(daemon_run(&drones_up, &daemon_job) < 0 ? 1 : 0);
 	}
 
-	/* XXX remove this and fix */
-	if (s->senders == 0 && GET_SENDDRONE()) {
-		/* XXX */
-		terminate("no senders for scan, giving up and rudley disconnecting from other drones without warning");
-	}
-
-	if (s->listeners == 0 && GET_LISTENDRONE()) {
-		/* XXX */
-		terminate("no listeners for scan, giving up and rudley disconnecting from other drones without warning");
-	}
+	drones_up();
 
 	if (GET_SENDDRONE() || GET_LISTENDRONE()) {
 		run_drone();
 	}
 	else {
-
-		report_init();
-		VRB(1, "connect mode: %s (options=0x%x)", GET_DOCONNECT() ? "enabled" : "disabled", s->options);
-		if (GET_DOCONNECT()) {
-			connect_init();
-		}
-
-		for (s->cur_iter=1 ; s->cur_iter < (s->scan_iter + 1); s->cur_iter++) {
-			/*
-			 * Phase loop for compound mode (e.g., -mA+T).
-			 * Single mode (num_phases <= 1) runs once with existing settings.
-			 */
-			int num_phases_to_run=(s->num_phases > 1) ? s->num_phases : 1;
-
-			for (s->cur_phase=0; s->cur_phase < num_phases_to_run; s->cur_phase++) {
-				if (s->num_phases > 1) {
-					/*
-					 * Compound mode: load phase-specific settings.
-					 * Phase 0 already loaded before do_targets() to ensure
-					 * workunits are created with correct per-phase PPS.
-					 * Phase 1+ need settings loaded and workunits regenerated.
-					 */
-					if (s->cur_phase > 0) {
-						if (load_phase_settings(s->cur_phase) != 1) {
-							terminate("failed to load phase %d settings", s->cur_phase + 1);
-						}
-						VRB(1, "phase %d: regenerating workunits for %s",
-							s->cur_phase + 1, strscanmode(scan_getmode()));
-						workunit_reinit();
-						master_reset_phase_state();
-						/*
-						 * For phase 2+, if phase 0 was ARP, create workunits
-						 * only for hosts that responded. Otherwise (e.g., -mT+U),
-						 * use original target list for all phases.
-						 */
-						if (s->phases[0].mode == MODE_ARPSCAN) {
-							do_targets_from_arp_cache();
-						}
-						else {
-							prepare_targets_for_phase();
-							do_targets();
-						}
-					}
-
-					VRB(1, "scan iteration %u phase %u/%u: %s",
-						s->cur_iter, s->cur_phase + 1, s->num_phases,
-						strscanmode(scan_getmode()));
-				}
-				else {
-					VRB(1, "scan iteration %u out of %u", s->cur_iter, s->scan_iter);
-				}
-
-				workunit_reset();
-				run_scan();
-
-				/*
-				 * In compound mode, after completing an ARP phase,
-				 * display phase 2 time estimate using actual live host count.
-				 * ARP results will be output in final report_do(), grouped
-				 * with TCP results per-IP for cleaner output.
-				 */
-				if (s->num_phases > 1 && scan_getmode() == MODE_ARPSCAN) {
-					if (s->cur_phase + 1 < s->num_phases) {
-						uint32_t live_count=0;
-
-						live_count=phase_filter_count();
-						if (live_count > 0) {
-							uint32_t p2_secs=0;
-							unsigned int p2_off=0;
-							char p2_est[128];
-							const char *port_spec=NULL;
-
-							/*
-							 * Extract port spec from first target for accurate
-							 * phase 2 time estimate. The target:port syntax
-							 * overrides s->gport_str.
-							 */
-							first_target_port=NULL;
-							fifo_walk(s->target_strs, get_first_target_port_spec);
-							port_spec=first_target_port;
-
-							p2_secs=calculate_phase_estimate(s->cur_phase + 1, (double)live_count, port_spec);
-							p2_est[0]='\0';
-							p2_off=0;
-
-							if (p2_secs > (60 * 60)) {
-								unsigned long long int hours=0;
-								int sret=0;
-
-								hours=p2_secs / (60 * 60);
-								sret=snprintf(&p2_est[p2_off], sizeof(p2_est) - (p2_off + 1), "%llu Hours, ", hours);
-								assert(sret > 0);
-								p2_off += sret;
-								p2_secs -= hours * (60 * 60);
-							}
-							if (p2_secs > 60) {
-								unsigned long long int minutes=0;
-								int sret=0;
-
-								minutes=p2_secs / 60;
-								sret=snprintf(&p2_est[p2_off], sizeof(p2_est) - (p2_off + 1), "%llu Minutes, ", minutes);
-								assert(sret > 0);
-								p2_off += sret;
-								p2_secs -= minutes * 60;
-							}
-							snprintf(&p2_est[p2_off], sizeof(p2_est) - (p2_off + 1), "%u Seconds", p2_secs);
-
-							VRB(0, "phase %d (%s): ~%s for %u live hosts",
-								s->cur_phase + 2,
-								strscanmode(s->phases[s->cur_phase + 1].mode),
-								p2_est,
-								live_count);
-						}
-						else {
-							VRB(0, "phase %d: no hosts responded to ARP, skipping",
-								s->cur_phase + 2);
-						}
-					}
-				}
-			}
-		}
-
-		report_do();
-		report_destroy();
-
-		if (GET_DOCONNECT()) {
-			connect_destroy();
-		}
+		scan_all();
 	}
 
 	terminate_alldrones();
 
+	telemetry_fini();
+
 	time(&s->e_time);
 
 	DBG(M_MOD, "main shuting down output modules");
@@ -0,0 +1,561 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+/*
+ * per result upsert throughput, old statement text against prepared statements
+ * sent down a pipeline, then report row load throughput, COPY as the output
+ * module does it against the same rows as pipelined prepared inserts
+ *
+ * bench_pgsql [-n reports] conninfo
+ *
+ * needs a database with the unicornscan schema in it.  each report is the
+ * host upsert with its host_scans row, the mac history row, a service and
+ * an os fingerprint, and the report rows are the uni_ipreport row and its
+ * banner in uni_ipreportdata, with ids taken from the sequence in one block
+ * as the module does.  each run goes against its own scratch uni_scan row in
+ * a transaction that is rolled back after it, so neither run pays for the
+ * others rows and nothing is left behind.  run it against a database that
+ * already holds some hosts and has been analyzed, on empty tables the
+ * upsert functions plan sequential scans and that is all it measures
+ */
+#include <config.h>
+
+#include <sys/time.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <poll.h>
+
+#include <libpq-fe.h>
+
+#include <scan_progs/scan_export.h>
+
+#include "pgsql_stmts.h"
+
+#define PIPE_READ	64
+#define REPORT_ROWS	5	/* host, host_scans, mac history, service, os fingerprint */
+#define LOAD_ROWS	2	/* ipreport, ipreportdata */
+#define COPY_BUF	(1024 * 1024)	/* the module's default copybuf */
+#define MAXPARAM	24
+
+#define BANNER		"SSH-2.0-OpenSSH_9.6p1 Ubuntu-3ubuntu13"
+
+static const char *load_stmts[2][2]={
+	{ "bench_ipreport", "insert into uni_ipreport (ipreport_id, scan_id, magic, sport, dport, proto, type, subtype, "
+	  "send_addr, host_addr, trace_addr, ttl, tstamp, utstamp, flags, mseq, tseq, window_size, t_tstamp, m_tstamp, "
+	  "eth_hwaddr) values ($1, $2, $3, $4, $5, $6, $7, $8, $9, $10, $11, $12, $13, $14, $15, $16, $17, $18, $19, $20, $21)" },
+	{ "bench_ipdata", "insert into uni_ipreportdata (ipreport_id, type, data) values ($1, $2, $3)" },
+};
+
+static PGconn *conn=NULL;
+static unsigned long long int scanid=0;
+
+/* one statement's parameters, binary */
+static char pbuf[1024];
+static size_t plen=0;
+static const char *values[MAXPARAM];
+static int lengths[MAXPARAM], formats[MAXPARAM], nparams=0;
+
+static void p_put(const void *data, int len) {
+
+	if (len < 0) {
+		values[nparams]=NULL;
+		lengths[nparams]=0;
+	}
+	else {
+		memcpy(pbuf + plen, data, (size_t)len);
+		values[nparams]=pbuf + plen;
+		lengths[nparams]=len;
+		plen += (size_t)len;
+	}
+	formats[nparams++]=1;
+
+	return;
+}
+
+static void p_int8(uint64_t val) {
+	uint32_t w[2];
+
+	w[0]=htonl((uint32_t)(val >> 32));
+	w[1]=htonl((uint32_t)val);
+	p_put(w, 8);
+
+	return;
+}
+
+static void p_int4(uint32_t val) {
+
+	val=htonl(val);
+	p_put(&val, 4);
+
+	return;
+}
+
+static void p_int2(uint16_t val) {
+
+	val=htons(val);
+	p_put(&val, 2);
+
+	return;
+}
+
+static void p_inet4(uint32_t addr) {
+	uint8_t in[8]={ 2, 32, 0, 4, 0, 0, 0, 0 };
+
+	memcpy(&in[4], &addr, sizeof(addr));
+	p_put(in, 8);
+
+	return;
+}
+
+static int exec_cmd(const char *cmd, unsigned long long int *val) {
+	PGresult *res=NULL;
+	int ret=1;
+
+	res=PQexec(conn, cmd);
+	if (PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res) == 1) {
+		if (val != NULL) {
+			sscanf(PQgetvalue(res, 0, 0), "%llu", val);
+		}
+	}
+	else if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+		fprintf(stderr, "`%.60s...' fails: %s", cmd, PQresultErrorMessage(res));
+		ret=-1;
+	}
+	PQclear(res);
+
+	return ret;
+}
+
+/* statement text per report, the way the output module built it before */
+static int run_text(unsigned int count) {
+	char q[2048], addr[32], mac[32];
+	unsigned long long int host_id=0;
+	unsigned int j=0;
+	struct in_addr ia;
+
+	for (j=0; j < count; j++) {
+		ia.s_addr=htonl(0x0a000000 + j);
+		inet_ntop(AF_INET, &ia, addr, sizeof(addr));
+		snprintf(mac, sizeof(mac), "02:00:%02x:%02x:%02x:%02x", (j >> 24) & 0xff, (j >> 16) & 0xff, (j >> 8) & 0xff, j & 0xff);
+
+		snprintf(q, sizeof(q), "SELECT fn_upsert_host('%s'::inet, '%s'::macaddr);", addr, mac);
+		if (exec_cmd(q, &host_id) < 0) {
+			return -1;
+		}
+		snprintf(q, sizeof(q),
+			"INSERT INTO uni_host_scans (host_id, scan_id, first_response, response_count) "
+			"VALUES (%llu, %llu, NOW(), 1) "
+			"ON CONFLICT (host_id, scan_id) DO UPDATE SET response_count = uni_host_scans.response_count + 1;",
+			host_id, scanid);
+		if (exec_cmd(q, NULL) < 0) {
+			return -1;
+		}
+		snprintf(q, sizeof(q), "SELECT fn_record_mac_ip('%s'::inet, '%s'::macaddr, %llu);", addr, mac, scanid);
+		if (exec_cmd(q, NULL) < 0) {
+			return -1;
+		}
+		snprintf(q, sizeof(q),
+			"INSERT INTO uni_services (host_addr, port, proto, scan_id, ipreport_id, "
+			"service_name, product, version, banner_raw, detected_at) "
+			"VALUES ('%s', %d, %d, %llu, NULL, "
+			"NULLIF('%s',''), NULLIF('%s',''), NULLIF('%s',''), '%s', NOW()) "
+			"ON CONFLICT (host_addr, port, proto, scan_id) DO UPDATE SET "
+			"service_name = COALESCE(NULLIF(EXCLUDED.service_name,''), uni_services.service_name), "
+			"product = COALESCE(NULLIF(EXCLUDED.product,''), uni_services.product), "
+			"version = COALESCE(NULLIF(EXCLUDED.version,''), uni_services.version), "
+			"banner_raw = EXCLUDED.banner_raw;",
+			addr, 22, 6, scanid, "ssh", "OpenSSH", "9.6p1", "SSH-2.0-OpenSSH_9.6p1 Ubuntu-3ubuntu13");
+		if (exec_cmd(q, NULL) < 0) {
+			return -1;
+		}
+		snprintf(q, sizeof(q),
+			"INSERT INTO uni_os_fingerprints (host_addr, scan_id, ipreport_id, "
+			"os_family, os_name, os_version, os_full, device_type, "
+			"ttl_observed, window_size, detected_at) "
+			"VALUES ('%s', %llu, NULL, "
+			"NULLIF('%s',''), NULLIF('%s',''), NULLIF('%s',''), '%s', NULLIF('%s',''), "
+			"%d, %d, NOW());",
+			addr, scanid, "Linux", "Linux 2.6", "2.6", "Linux 2.6", "general purpose", 64, 5792);
+		if (exec_cmd(q, NULL) < 0) {
+			return -1;
+		}
+	}
+
+	return 1;
+}
+
+static int pipe_results(unsigned int *synced, unsigned int sent, int wait) {
+	PGresult *res=NULL;
+	struct pollfd pfd;
+
+	while (*synced < sent) {
+		if (PQconsumeInput(conn) != 1) {
+			return -1;
+		}
+		if (PQisBusy(conn)) {
+			if (wait == 0) {
+				return 1;
+			}
+			pfd.fd=PQsocket(conn);
+			pfd.events=POLLIN | (PQflush(conn) == 1 ? POLLOUT : 0);
+			pfd.revents=0;
+			if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+				return -1;
+			}
+			continue;
+		}
+		res=PQgetResult(conn);
+		if (res == NULL) {
+			continue;
+		}
+		if (PQresultStatus(res) == PGRES_PIPELINE_SYNC) {
+			(*synced)++;
+		}
+		else if (PQresultStatus(res) == PGRES_FATAL_ERROR) {
+			fprintf(stderr, "pipelined statement fails: %s", PQresultErrorMessage(res));
+		}
+		PQclear(res);
+	}
+
+	return 1;
+}
+
+static int send_stmt(const char *name, unsigned int *sent, unsigned int *synced) {
+
+	if (PQsendQueryPrepared(conn, name, nparams, values, lengths, formats, 0) != 1 ||
+	PQpipelineSync(conn) != 1) {
+		return -1;
+	}
+	(*sent)++;
+	plen=0;
+	nparams=0;
+
+	if (*sent % PIPE_READ == 0) {
+		return pipe_results(synced, *sent, 0);
+	}
+
+	return 1;
+}
+
+/* the prepared statements from the output module, all in flight at once */
+static int run_pipeline(unsigned int count) {
+	unsigned int j=0, sent=0, synced=0;
+	uint8_t mac[6]={ 0x02, 0x00, 0, 0, 0, 0 };
+	static const char *svc[]={ "ssh", "OpenSSH", "9.6p1", "SSH-2.0-OpenSSH_9.6p1 Ubuntu-3ubuntu13" };
+	static const char *os[]={ "Linux", "Linux 2.6", "2.6", "Linux 2.6", "general purpose" };
+	uint32_t addr=0;
+	int k=0;
+
+	if (PQsetnonblocking(conn, 1) != 0 || PQenterPipelineMode(conn) != 1) {
+		fprintf(stderr, "pipeline mode fails: %s", PQerrorMessage(conn));
+		return -1;
+	}
+
+	for (j=0; j < count; j++) {
+		addr=htonl(0x0b000000 + j);
+		mac[2]=(j >> 24) & 0xff;
+		mac[3]=(j >> 16) & 0xff;
+		mac[4]=(j >> 8) & 0xff;
+		mac[5]=j & 0xff;
+
+		p_inet4(addr);
+		p_put(mac, 6);
+		p_int8(scanid);
+		if (send_stmt(pgsql_stmts[PGS_HOST].name, &sent, &synced) < 0) {
+			return -1;
+		}
+
+		p_inet4(addr);
+		p_put(mac, 6);
+		p_int8(scanid);
+		if (send_stmt(pgsql_stmts[PGS_MACIP].name, &sent, &synced) < 0) {
+			return -1;
+		}
+
+		p_inet4(addr);
+		p_int4(22);
+		p_int2(6);
+		p_int8(scanid);
+		p_put(NULL, -1);
+		for (k=0; k < 4; k++) {
+			p_put(svc[k], (int)strlen(svc[k]));
+		}
+		if (send_stmt(pgsql_stmts[PGS_SERVICE].name, &sent, &synced) < 0) {
+			return -1;
+		}
+
+		p_inet4(addr);
+		p_int8(scanid);
+		p_put(NULL, -1);
+		for (k=0; k < 5; k++) {
+			p_put(os[k], (int)strlen(os[k]));
+		}
+		p_int2(64);
+		p_int4(5792);
+		if (send_stmt(pgsql_stmts[PGS_OSFP].name, &sent, &synced) < 0) {
+			return -1;
+		}
+	}
+
+	if (pipe_results(&synced, sent, 1) < 0) {
+		return -1;
+	}
+	PQexitPipelineMode(conn);
+	PQsetnonblocking(conn, 0);
+
+	return 1;
+}
+
+/* a block of report ids from the sequence, as the module takes them, the first one */
+static unsigned long long int id_block(unsigned int count) {
+	char q[256];
+	unsigned long long int last=0;
+
+	snprintf(q, sizeof(q), "select setval('uni_ipreport_id_seq', nextval('uni_ipreport_id_seq') + %u - 1)", count);
+	if (exec_cmd(q, &last) < 0) {
+		return 0;
+	}
+
+	return last - count + 1;
+}
+
+static int copy_out(const char *copy, const char *buf, size_t len) {
+	PGresult *res=NULL;
+	int ret=1;
+
+	res=PQexec(conn, copy);
+	if (PQresultStatus(res) != PGRES_COPY_IN) {
+		fprintf(stderr, "`%s' fails: %s", copy, PQresultErrorMessage(res));
+		PQclear(res);
+		return -1;
+	}
+	PQclear(res);
+
+	if (PQputCopyData(conn, buf, (int)len) != 1 || PQputCopyEnd(conn, NULL) != 1) {
+		return -1;
+	}
+	while ((res=PQgetResult(conn)) != NULL) {
+		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+			fprintf(stderr, "`%s' fails: %s", copy, PQresultErrorMessage(res));
+			ret=-1;
+		}
+		PQclear(res);
+	}
+
+	return ret;
+}
+
+/* report rows in COPY text buffers, out once they pass COPY_BUF, reports before their data */
+static int run_copy(unsigned int count) {
+	static char rbuf[COPY_BUF + 1024], dbuf[COPY_BUF + 1024];
+	size_t rlen=0, dlen=0;
+	unsigned long long int id=0;
+	unsigned int j=0;
+	char addr[32];
+	struct in_addr ia;
+
+	id=id_block(count);
+	if (id == 0) {
+		return -1;
+	}
+
+	for (j=0; j < count; j++, id++) {
+		ia.s_addr=htonl(0x0c000000 + j);
+		inet_ntop(AF_INET, &ia, addr, sizeof(addr));
+
+		rlen += (size_t)snprintf(rbuf + rlen, sizeof(rbuf) - rlen,
+			"%llu\t%llu\t%u\t22\t40000\t6\t18\t0\t10.0.0.1\t%s\t%s\t64\t%u\t0\t0\t%u\t0\t5792\t0\t0\t"
+			"02:00:%02x:%02x:%02x:%02x\n",
+			id, scanid, IP_REPORT_MAGIC, addr, addr, 1700000000 + j, j,
+			(j >> 24) & 0xff, (j >> 16) & 0xff, (j >> 8) & 0xff, j & 0xff);
+		dlen += (size_t)snprintf(dbuf + dlen, sizeof(dbuf) - dlen, "%llu\t1\t" BANNER "\n", id);
+
+		if (rlen >= COPY_BUF || dlen >= COPY_BUF || j + 1 == count) {
+			if (copy_out("copy uni_ipreport (ipreport_id, scan_id, magic, sport, dport, proto, type, subtype, "
+				"send_addr, host_addr, trace_addr, ttl, tstamp, utstamp, flags, mseq, tseq, window_size, "
+				"t_tstamp, m_tstamp, eth_hwaddr) from stdin", rbuf, rlen) < 0 ||
+			copy_out("copy uni_ipreportdata (ipreport_id, type, data) from stdin", dbuf, dlen) < 0) {
+				return -1;
+			}
+			rlen=0;
+			dlen=0;
+		}
+	}
+
+	return 1;
+}
+
+/* the same report rows through prepared inserts, all in flight at once */
+static int run_rowpipe(unsigned int count) {
+	unsigned long long int id=0;
+	unsigned int j=0, sent=0, synced=0;
+	uint8_t mac[6]={ 0x02, 0x00, 0, 0, 0, 0 };
+	uint32_t addr=0;
+
+	id=id_block(count);
+	if (id == 0) {
+		return -1;
+	}
+
+	if (PQsetnonblocking(conn, 1) != 0 || PQenterPipelineMode(conn) != 1) {
+		fprintf(stderr, "pipeline mode fails: %s", PQerrorMessage(conn));
+		return -1;
+	}
+
+	for (j=0; j < count; j++, id++) {
+		addr=htonl(0x0d000000 + j);
+		mac[2]=(j >> 24) & 0xff;
+		mac[3]=(j >> 16) & 0xff;
+		mac[4]=(j >> 8) & 0xff;
+		mac[5]=j & 0xff;
+
+		p_int8(id);
+		p_int8(scanid);
+		p_int8(IP_REPORT_MAGIC);
+		p_int4(22);
+		p_int4(40000);
+		p_int2(6);
+		p_int4(18);
+		p_int4(0);
+		p_inet4(htonl(0x0a000001));
+		p_inet4(addr);
+		p_inet4(addr);
+		p_int2(64);
+		p_int8(1700000000 + j);
+		p_int8(0);
+		p_int4(0);
+		p_int8(j);
+		p_int8(0);
+		p_int4(5792);
+		p_int8(0);
+		p_int8(0);
+		p_put(mac, 6);
+		if (send_stmt(load_stmts[0][0], &sent, &synced) < 0) {
+			return -1;
+		}
+
+		p_int8(id);
+		p_int2(1);
+		p_put(BANNER, (int)strlen(BANNER));
+		if (send_stmt(load_stmts[1][0], &sent, &synced) < 0) {
+			return -1;
+		}
+	}
+
+	if (pipe_results(&synced, sent, 1) < 0) {
+		return -1;
+	}
+	PQexitPipelineMode(conn);
+	PQsetnonblocking(conn, 0);
+
+	return 1;
+}
+
+static double elapsed(const struct timeval *start) {
+	struct timeval end;
+
+	gettimeofday(&end, NULL);
+
+	return (double)(end.tv_sec - start->tv_sec) + ((double)(end.tv_usec - start->tv_usec) / 1000000.0);
+}
+
+/* each run gets its own scratch scan in its own rolled back transaction, so neither sees the others rows */
+static double run_one(int (*run)(unsigned int ), unsigned int count) {
+	struct timeval start;
+	double took=0.0;
+
+	if (exec_cmd("begin", NULL) < 0 || exec_cmd(
+		"insert into uni_scan (s_time, e_time, est_e_time, senders, listeners, scan_iter, profile, "
+		"options, payload_group, dronestr, covertness, modules, \"user\", tickrate, num_hosts, num_packets) "
+		"values (0, 0, 0, 0, 0, 0, 'bench_pgsql', 0, 0, '', 0, '', 'bench_pgsql', 0, 0, 0) returning scan_id",
+		&scanid) < 0) {
+		exit(1);
+	}
+
+	gettimeofday(&start, NULL);
+	if (run(count) < 0) {
+		fprintf(stderr, "run fails: %s", PQerrorMessage(conn));
+		exit(1);
+	}
+	took=elapsed(&start);
+
+	exec_cmd("rollback", NULL);
+
+	return took;
+}
+
+int main(int argc, char **argv) {
+	unsigned int count=10000;
+	double t_text=0.0, t_pipe=0.0, t_copy=0.0, t_rows=0.0;
+	PGresult *res=NULL;
+	int ch=0, j=0;
+
+	while ((ch=getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+			case 'n':
+				count=(unsigned int)strtoul(optarg, NULL, 10);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n reports] conninfo\n", argv[0]);
+				exit(1);
+		}
+	}
+	if (optind >= argc || count == 0) {
+		fprintf(stderr, "usage: %s [-n reports] conninfo\n", argv[0]);
+		exit(1);
+	}
+
+	conn=PQconnectdb(argv[optind]);
+	if (PQstatus(conn) != CONNECTION_OK) {
+		fprintf(stderr, "connect fails: %s", PQerrorMessage(conn));
+		exit(1);
+	}
+
+	for (j=0; j < PGS_MAX; j++) {
+		res=PQprepare(conn, pgsql_stmts[j].name, pgsql_stmts[j].sql, pgsql_stmts[j].nparams, pgsql_stmts[j].types);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+			fprintf(stderr, "prepare of `%s' fails: %s", pgsql_stmts[j].name, PQresultErrorMessage(res));
+			exit(1);
+		}
+		PQclear(res);
+	}
+	for (j=0; j < 2; j++) {
+		res=PQprepare(conn, load_stmts[j][0], load_stmts[j][1], 0, NULL);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+			fprintf(stderr, "prepare of `%s' fails: %s", load_stmts[j][0], PQresultErrorMessage(res));
+			exit(1);
+		}
+		PQclear(res);
+	}
+
+	t_text=run_one(&run_text, count);
+	t_pipe=run_one(&run_pipeline, count);
+	t_copy=run_one(&run_copy, count);
+	t_rows=run_one(&run_rowpipe, count);
+
+	PQfinish(conn);
+
+	printf("%u reports, 4 upserts and %d rows each\n", count, REPORT_ROWS);
+	printf("statement text, PQexec:      %8.3f s %10.0f reports/s %10.0f rows/s\n", t_text, (double)count / t_text, (double)count * REPORT_ROWS / t_text);
+	printf("prepared, binary, pipelined: %8.3f s %10.0f reports/s %10.0f rows/s\n", t_pipe, (double)count / t_pipe, (double)count * REPORT_ROWS / t_pipe);
+	printf("%u reports, %d report rows each\n", count, LOAD_ROWS);
+	printf("COPY text, 1 MB buffers:     %8.3f s %10.0f reports/s %10.0f rows/s\n", t_copy, (double)count / t_copy, (double)count * LOAD_ROWS / t_copy);
+	printf("prepared inserts, pipelined: %8.3f s %10.0f reports/s %10.0f rows/s\n", t_rows, (double)count / t_rows, (double)count * LOAD_ROWS / t_rows);
+
+	exit(0);
+}
@@ -24,8 +24,12 @@
  * Manages provider selection, initialization, cleanup, and caching.
  *
  * Caching:
- * - LRU cache for recent IP lookups
- * - Configurable size (default 10000 entries)
+ * - Keyed by binary address, IPv4 mapped into the IPv6 space
+ * - Each answer is kept for the whole network the provider matched, in a
+ *   sorted array of non-overlapping ranges searched by bisection, so one
+ *   lookup serves every later address in that network
+ * - Configurable size (default 10000 ranges), second chance eviction
+ * - Hit/miss counts and time spent in each via geoip_cache_stats()
  * - Thread-safe for single-threaded use (no mutex needed for unicornscan)
  */
 
@@ -43,57 +47,114 @@
 #include "geoip_provider.h"
 
 /* ==========================================================================
- * LRU Cache Implementation
+ * Range Cache Implementation
  * ========================================================================== */
 
 #define GEOIP_DEFAULT_CACHE_SIZE 10000
-#define GEOIP_CACHE_IP_SIZE 46  /* Max IPv6 string length + NUL */
 
-/* Cache entry */
-typedef struct geoip_cache_entry {
-	char ip[GEOIP_CACHE_IP_SIZE];
+/*
+ * Addresses are kept as 128 bit keys, IPv4 mapped into ::ffff:0:0/96, so one
+ * table serves both families and a v4 prefix is simply 96 bits longer
+ */
+typedef struct geoip_key {
+	uint64_t hi;
+	uint64_t lo;
+} geoip_key_t;
+
+/* One cached answer, valid for every address in [first, last] */
+typedef struct geoip_range {
+	geoip_key_t first;
+	geoip_key_t last;
+	uint32_t slot;			/* Index into slots[] */
+} geoip_range_t;
+
+typedef struct geoip_slot {
 	geoip_result_t result;
-	time_t timestamp;
-	struct geoip_cache_entry *prev;
-	struct geoip_cache_entry *next;
-	struct geoip_cache_entry *hash_next;  /* Hash chain */
-} geoip_cache_entry_t;
+	geoip_key_t first;		/* Start of the range pointing here */
+	int ret;			/* Provider return, 0 found or 1 not found */
+	int ref;			/* Clock bit, set on every hit */
+} geoip_slot_t;
 
 /* Cache structure */
 typedef struct geoip_cache {
-	geoip_cache_entry_t *head;	/* Most recently used */
-	geoip_cache_entry_t *tail;	/* Least recently used */
-	geoip_cache_entry_t **hash_table;
-	geoip_cache_entry_t *entries;	/* Pre-allocated entries */
+	geoip_range_t *ranges;		/* Sorted by first, never overlapping */
+	geoip_slot_t *slots;		/* Results, filled in order then recycled */
 	size_t capacity;
 	size_t size;
-	size_t hash_size;
+	size_t hand;			/* Clock hand for eviction */
 	unsigned long hits;
 	unsigned long misses;
+	uint64_t hit_ns;		/* Time spent answering hits */
+	uint64_t miss_ns;		/* Time spent answering misses (provider included) */
 } geoip_cache_t;
 
 static geoip_cache_t *cache = NULL;
 
+#define KEY_LT(a, b) ((a).hi < (b).hi || ((a).hi == (b).hi && (a).lo < (b).lo))
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
 /*
- * Simple hash function for IP strings (djb2)
+ * Build a cache key from a binary address
+ * Returns: 0 on success, -1 for an unsupported family
  */
-static unsigned long hash_ip(const char *ip, size_t hash_size) {
-	unsigned long hash = 5381;
-	int c;
+static int key_from_addr(int af, const void *addr, geoip_key_t *key) {
+	const uint8_t *p = (const uint8_t *)addr;
+	int i;
+
+	if (af == AF_INET) {
+		key->hi = 0;
+		key->lo = 0x0000ffff00000000ULL |
+			((uint64_t)p[0] << 24) | ((uint64_t)p[1] << 16) | ((uint64_t)p[2] << 8) | p[3];
+		return 0;
+	}
 
-	while ((c = *ip++)) {
-		hash = ((hash << 5) + hash) + c;
+	if (af == AF_INET6) {
+		key->hi = 0;
+		key->lo = 0;
+		for (i = 0; i < 8; i++) {
+			key->hi = (key->hi << 8) | p[i];
+			key->lo = (key->lo << 8) | p[i + 8];
+		}
+		return 0;
 	}
 
-	return hash % hash_size;
+	return -1;
 }
 
 /*
- * Initialize LRU cache
+ * Widen a key to the network it sits in, prefix counted over all 128 bits
  */
-static int cache_init(size_t capacity) {
-	size_t i;
+static void key_range(const geoip_key_t *key, unsigned int prefix, geoip_key_t *first, geoip_key_t *last) {
+	uint64_t mhi, mlo;
+
+	if (prefix > 128) {
+		prefix = 128;
+	}
 
+	if (prefix <= 64) {
+		mhi = (prefix == 0) ? 0 : ~0ULL << (64 - prefix);
+		mlo = 0;
+	} else {
+		mhi = ~0ULL;
+		mlo = (prefix == 128) ? ~0ULL : ~0ULL << (128 - prefix);
+	}
+
+	first->hi = key->hi & mhi;
+	first->lo = key->lo & mlo;
+	last->hi = key->hi | ~mhi;
+	last->lo = key->lo | ~mlo;
+}
+
+/*
+ * Initialize range cache
+ */
+static int cache_init(size_t capacity) {
 	if (capacity == 0) {
 		return 0;  /* Caching disabled */
 	}
@@ -104,235 +165,138 @@ static int cache_init(size_t capacity) {
 	}
 
 	cache->capacity = capacity;
-	cache->size = 0;
-	cache->hash_size = capacity * 2;  /* Over-allocate for fewer collisions */
-
-	/* Allocate hash table */
-	cache->hash_table = calloc(cache->hash_size, sizeof(geoip_cache_entry_t *));
-	if (cache->hash_table == NULL) {
-		free(cache);
-		cache = NULL;
-		return -1;
-	}
-
-	/* Pre-allocate all entries */
-	cache->entries = calloc(capacity, sizeof(geoip_cache_entry_t));
-	if (cache->entries == NULL) {
-		free(cache->hash_table);
+	cache->ranges = calloc(capacity, sizeof(geoip_range_t));
+	cache->slots = calloc(capacity, sizeof(geoip_slot_t));
+	if (cache->ranges == NULL || cache->slots == NULL) {
+		free(cache->ranges);
+		free(cache->slots);
 		free(cache);
 		cache = NULL;
 		return -1;
 	}
 
-	/* Initialize entries as a free pool (linked via prev/next) */
-	cache->head = NULL;
-	cache->tail = NULL;
-
-	/* Clear all entries */
-	for (i = 0; i < capacity; i++) {
-		cache->entries[i].ip[0] = '\0';
-	}
-
 	return 0;
 }
 
 /*
- * Find entry in cache
+ * Binary search for the first range whose start is above key
+ * The range that could hold key, if any, is the one just before it
  */
-static geoip_cache_entry_t *cache_find(const char *ip) {
-	unsigned long h;
-	geoip_cache_entry_t *entry;
-
-	if (cache == NULL || ip == NULL) {
-		return NULL;
-	}
-
-	h = hash_ip(ip, cache->hash_size);
-	entry = cache->hash_table[h];
-
-	while (entry != NULL) {
-		if (strcmp(entry->ip, ip) == 0) {
-			return entry;
+static size_t cache_upper(const geoip_key_t *key) {
+	size_t low = 0, high = cache->size, mid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (KEY_LT(*key, cache->ranges[mid].first)) {
+			high = mid;
+		} else {
+			low = mid + 1;
 		}
-		entry = entry->hash_next;
 	}
 
-	return NULL;
+	return low;
 }
 
 /*
- * Move entry to head of LRU list (most recently used)
+ * Find the cached range holding key
  */
-static void cache_move_to_head(geoip_cache_entry_t *entry) {
-	if (cache == NULL || entry == NULL || entry == cache->head) {
-		return;
-	}
+static geoip_slot_t *cache_find(const geoip_key_t *key) {
+	size_t pos;
+	geoip_range_t *r;
 
-	/* Remove from current position */
-	if (entry->prev != NULL) {
-		entry->prev->next = entry->next;
-	}
-	if (entry->next != NULL) {
-		entry->next->prev = entry->prev;
-	}
-	if (entry == cache->tail) {
-		cache->tail = entry->prev;
+	if (cache == NULL || cache->size == 0) {
+		return NULL;
 	}
 
-	/* Insert at head */
-	entry->prev = NULL;
-	entry->next = cache->head;
-	if (cache->head != NULL) {
-		cache->head->prev = entry;
-	}
-	cache->head = entry;
-	if (cache->tail == NULL) {
-		cache->tail = entry;
+	pos = cache_upper(key);
+	if (pos == 0) {
+		return NULL;
 	}
-}
 
-/*
- * Remove entry from hash table
- */
-static void cache_hash_remove(geoip_cache_entry_t *entry) {
-	unsigned long h;
-	geoip_cache_entry_t *curr, *prev;
-
-	if (cache == NULL || entry == NULL || entry->ip[0] == '\0') {
-		return;
+	r = &cache->ranges[pos - 1];
+	if (KEY_LT(r->last, *key)) {
+		return NULL;
 	}
 
-	h = hash_ip(entry->ip, cache->hash_size);
-	curr = cache->hash_table[h];
-	prev = NULL;
-
-	while (curr != NULL) {
-		if (curr == entry) {
-			if (prev == NULL) {
-				cache->hash_table[h] = curr->hash_next;
-			} else {
-				prev->hash_next = curr->hash_next;
-			}
-			entry->hash_next = NULL;
-			return;
-		}
-		prev = curr;
-		curr = curr->hash_next;
-	}
+	return &cache->slots[r->slot];
 }
 
 /*
- * Add entry to hash table
+ * Pick a slot for a new range, second chance over the slots so ranges
+ * that keep getting hits stay while one-off misses cycle out
  */
-static void cache_hash_add(geoip_cache_entry_t *entry) {
-	unsigned long h;
+static uint32_t cache_evict(void) {
+	geoip_slot_t *slot;
+	size_t pos;
+	uint32_t victim;
+
+	for (;;) {
+		slot = &cache->slots[cache->hand];
+		if (slot->ref == 0) {
+			break;
+		}
+		slot->ref = 0;
+		cache->hand = (cache->hand + 1) % cache->capacity;
+	}
+	victim = (uint32_t)cache->hand;
+	cache->hand = (cache->hand + 1) % cache->capacity;
 
-	if (cache == NULL || entry == NULL) {
-		return;
+	/* Drop the victim's range, starts are unique so its own start finds it */
+	pos = cache_upper(&slot->first);
+	if (pos > 0 && cache->ranges[pos - 1].slot == victim) {
+		pos--;
+		memmove(&cache->ranges[pos], &cache->ranges[pos + 1], (cache->size - pos - 1) * sizeof(geoip_range_t));
+		cache->size--;
 	}
 
-	h = hash_ip(entry->ip, cache->hash_size);
-	entry->hash_next = cache->hash_table[h];
-	cache->hash_table[h] = entry;
+	return victim;
 }
 
 /*
- * Store result in cache
+ * Store result for the whole network around key
+ * prefix is the provider's prefix length over 128 bit keys
  */
-static void cache_store(const char *ip, const geoip_result_t *result) {
-	geoip_cache_entry_t *entry;
-	size_t i;
+static void cache_store(const geoip_key_t *key, unsigned int prefix, int ret, const geoip_result_t *result) {
+	geoip_key_t first, last;
+	geoip_range_t *r;
+	uint32_t slot;
+	size_t pos;
 
-	if (cache == NULL || ip == NULL || result == NULL) {
+	if (cache == NULL || result == NULL) {
 		return;
 	}
 
-	/* Check if already in cache */
-	entry = cache_find(ip);
-	if (entry != NULL) {
-		/* Update existing entry */
-		memcpy(&entry->result, result, sizeof(geoip_result_t));
-		entry->timestamp = time(NULL);
-		cache_move_to_head(entry);
-		return;
-	}
-
-	/* Find a free entry or evict LRU */
 	if (cache->size < cache->capacity) {
-		/* Find first unused entry */
-		for (i = 0; i < cache->capacity; i++) {
-			if (cache->entries[i].ip[0] == '\0') {
-				entry = &cache->entries[i];
-				cache->size++;
-				break;
-			}
-		}
+		slot = (uint32_t)cache->size;
 	} else {
-		/* Evict LRU (tail) */
-		entry = cache->tail;
-		if (entry != NULL) {
-			/* Remove from hash table */
-			cache_hash_remove(entry);
-
-			/* Remove from LRU list */
-			if (entry->prev != NULL) {
-				entry->prev->next = NULL;
-			}
-			cache->tail = entry->prev;
-			if (cache->head == entry) {
-				cache->head = NULL;
-			}
-		}
-	}
-
-	if (entry == NULL) {
-		return;  /* Should not happen */
-	}
-
-	/* Populate entry */
-	strncpy(entry->ip, ip, sizeof(entry->ip) - 1);
-	entry->ip[sizeof(entry->ip) - 1] = '\0';
-	memcpy(&entry->result, result, sizeof(geoip_result_t));
-	entry->timestamp = time(NULL);
-	entry->prev = NULL;
-	entry->next = NULL;
-	entry->hash_next = NULL;
-
-	/* Add to hash table */
-	cache_hash_add(entry);
-
-	/* Add to head of LRU list */
-	entry->next = cache->head;
-	if (cache->head != NULL) {
-		cache->head->prev = entry;
-	}
-	cache->head = entry;
-	if (cache->tail == NULL) {
-		cache->tail = entry;
-	}
-}
-
-/*
- * Lookup in cache
- * Returns: 0 on hit (result populated), -1 on miss
- */
-static int cache_lookup(const char *ip, geoip_result_t *result) {
-	geoip_cache_entry_t *entry;
-
-	if (cache == NULL) {
-		return -1;
-	}
-
-	entry = cache_find(ip);
-	if (entry != NULL) {
-		memcpy(result, &entry->result, sizeof(geoip_result_t));
-		cache_move_to_head(entry);
-		cache->hits++;
-		return 0;
-	}
-
-	cache->misses++;
-	return -1;
+		slot = cache_evict();
+	}
+
+	key_range(key, prefix, &first, &last);
+
+	/*
+	 * Networks out of one database never partially overlap, but a
+	 * provider that reports a range wider than the data it merged must
+	 * not shadow its neighbours; fall back to caching just this address
+	 */
+	pos = cache_upper(key);
+	if ((pos > 0 && !KEY_LT(cache->ranges[pos - 1].last, first)) ||
+	    (pos < cache->size && !KEY_LT(last, cache->ranges[pos].first))) {
+		first = *key;
+		last = *key;
+	}
+
+	memmove(&cache->ranges[pos + 1], &cache->ranges[pos], (cache->size - pos) * sizeof(geoip_range_t));
+	r = &cache->ranges[pos];
+	r->first = first;
+	r->last = last;
+	r->slot = slot;
+	cache->size++;
+
+	memcpy(&cache->slots[slot].result, result, sizeof(geoip_result_t));
+	cache->slots[slot].first = first;
+	cache->slots[slot].ret = ret;
+	cache->slots[slot].ref = 0;
 }
 
 /*
@@ -343,12 +307,8 @@ static void cache_cleanup(void) {
 		return;
 	}
 
-	if (cache->entries != NULL) {
-		free(cache->entries);
-	}
-	if (cache->hash_table != NULL) {
-		free(cache->hash_table);
-	}
+	free(cache->ranges);
+	free(cache->slots);
 	free(cache);
 	cache = NULL;
 }
@@ -356,18 +316,63 @@ static void cache_cleanup(void) {
 /*
  * Get cache statistics
  */
-void geoip_cache_stats(unsigned long *hits, unsigned long *misses, size_t *size) {
+void geoip_cache_stats(unsigned long *hits, unsigned long *misses, size_t *size, uint64_t *hit_ns, uint64_t *miss_ns) {
 	if (cache == NULL) {
 		if (hits) *hits = 0;
 		if (misses) *misses = 0;
 		if (size) *size = 0;
+		if (hit_ns) *hit_ns = 0;
+		if (miss_ns) *miss_ns = 0;
 		return;
 	}
 
 	if (hits) *hits = cache->hits;
 	if (misses) *misses = cache->misses;
 	if (size) *size = cache->size;
+	if (hit_ns) *hit_ns = cache->hit_ns;
+	if (miss_ns) *miss_ns = cache->miss_ns;
+}
+
+#ifdef HAVE_LIBMAXMINDDB
+/*
+ * Look addr up in one mmdb file for the providers that read them, raising
+ * *plen to the prefix length of the network matched, which is what the
+ * cache above keys a range on.  libmaxminddb counts the ::/96 in front of
+ * IPv4 addresses held in an IPv6 tree, take it back off
+ */
+MMDB_lookup_result_s geoip_mmdb_lookup(MMDB_s *mmdb, int af, const void *addr, unsigned int *plen, int *mmdb_error) {
+	struct sockaddr_storage ss;
+	struct sockaddr_in *sin = (struct sockaddr_in *)&ss;
+	struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)&ss;
+	MMDB_lookup_result_s res;
+	unsigned int nm;
+
+	memset(&ss, 0, sizeof(ss));
+	if (af == AF_INET) {
+		sin->sin_family = AF_INET;
+		memcpy(&sin->sin_addr, addr, sizeof(sin->sin_addr));
+	} else {
+		sin6->sin6_family = AF_INET6;
+		memcpy(&sin6->sin6_addr, addr, sizeof(sin6->sin6_addr));
+	}
+
+	res = MMDB_lookup_sockaddr(mmdb, (struct sockaddr *)&ss, mmdb_error);
+	if (*mmdb_error == MMDB_SUCCESS) {
+		nm = res.netmask;
+		if (af == AF_INET && mmdb->metadata.ip_version == 6) {
+			nm = (nm > 96) ? nm - 96 : 0;
+		}
+		if (nm > *plen) {
+			*plen = nm;
+		}
+	} else {
+		/* Nothing known about this database's network, only the address itself is safe */
+		*plen = (af == AF_INET) ? 32 : 128;
+	}
+
+	return res;
 }
+#endif
 
 /* ==========================================================================
  * Provider Management
@@ -452,36 +457,75 @@ int geoip_init(const geoip_config_t *config) {
 }
 
 /*
- * Perform IP lookup using active provider
- * Uses cache for performance; cache misses trigger provider lookup
+ * Perform lookup of a binary address using active provider
+ * Uses cache for performance; cache misses trigger provider lookup and
+ * the answer is cached for the whole network the provider matched
  */
-int geoip_lookup(const char *ip, geoip_result_t *result) {
+int geoip_lookup_addr(int af, const void *addr, geoip_result_t *result) {
+	geoip_key_t key;
+	geoip_slot_t *slot;
+	unsigned int prefix;
+	uint64_t start;
 	int ret;
 
 	if (active_provider == NULL || !active_provider->is_ready()) {
 		return -1;
 	}
 
-	if (ip == NULL || result == NULL) {
+	if (addr == NULL || result == NULL || key_from_addr(af, addr, &key) != 0) {
 		return -1;
 	}
 
+	start = (cache != NULL) ? now_ns() : 0;
+
 	/* Check cache first */
-	if (cache_lookup(ip, result) == 0) {
-		return 0;  /* Cache hit */
+	slot = cache_find(&key);
+	if (slot != NULL) {
+		memcpy(result, &slot->result, sizeof(geoip_result_t));
+		slot->ref = 1;
+		cache->hits++;
+		cache->hit_ns += now_ns() - start;
+		return slot->ret;
 	}
 
 	/* Cache miss - perform actual lookup */
-	ret = active_provider->lookup(ip, result);
+	prefix = (af == AF_INET) ? 32 : 128;
+	ret = active_provider->lookup(af, addr, result, &prefix);
 
-	/* Store successful lookups in cache */
-	if (ret == 0) {
-		cache_store(ip, result);
+	/* Found and not found both hold for the whole network, errors are not cached */
+	if (cache != NULL) {
+		if (ret == 0 || ret == 1) {
+			cache_store(&key, (af == AF_INET) ? prefix + 96 : prefix, ret, result);
+		}
+		cache->misses++;
+		cache->miss_ns += now_ns() - start;
 	}
 
 	return ret;
 }
 
+/*
+ * Perform IP lookup of an address string
+ */
+int geoip_lookup(const char *ip, geoip_result_t *result) {
+	struct in_addr addr4;
+	struct in6_addr addr6;
+
+	if (ip == NULL || result == NULL) {
+		return -1;
+	}
+
+	if (inet_pton(AF_INET, ip, &addr4) == 1) {
+		return geoip_lookup_addr(AF_INET, &addr4, result);
+	}
+
+	if (inet_pton(AF_INET6, ip, &addr6) == 1) {
+		return geoip_lookup_addr(AF_INET6, &addr6, result);
+	}
+
+	return -1;
+}
+
 /*
  * Get active provider's database version
  */
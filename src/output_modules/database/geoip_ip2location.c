@@ -44,6 +44,9 @@
 #include <unistd.h>
 #include <math.h>
 #include <limits.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <IP2Location.h>
 
 #include "geoip_provider.h"
@@ -166,11 +169,18 @@ static int ip2location_init(const geoip_config_t *config) {
 
 /*
  * Perform lookup against IP2Location databases
+ * The library only takes address strings and its records carry no range,
+ * so *prefix is left at the full address length
  */
-static int ip2location_lookup(const char *ip, geoip_result_t *result) {
+static int ip2location_lookup(int af, const void *addr, geoip_result_t *result, unsigned int *prefix) {
 	IP2LocationRecord *record;
+	char ip[INET6_ADDRSTRLEN];
 
-	if (ip2l_city == NULL || ip == NULL || result == NULL) {
+	if (ip2l_city == NULL || addr == NULL || result == NULL || prefix == NULL) {
+		return -1;
+	}
+
+	if (inet_ntop(af, addr, ip, sizeof(ip)) == NULL) {
 		return -1;
 	}
 
@@ -180,7 +190,7 @@ static int ip2location_lookup(const char *ip, geoip_result_t *result) {
 	strncpy(result->db_version, db_version, sizeof(result->db_version) - 1);
 
 	/* Lookup in city database */
-	record = IP2Location_get_all(ip2l_city, (char *)ip);
+	record = IP2Location_get_all(ip2l_city, ip);
 	if (record == NULL) {
 		return -1;
 	}
@@ -214,7 +224,7 @@ static int ip2location_lookup(const char *ip, geoip_result_t *result) {
 
 	/* Lookup in proxy database if available */
 	if (ip2l_proxy != NULL) {
-		IP2ProxyRecord *proxy_record = IP2Proxy_get_all(ip2l_proxy, (char *)ip);
+		IP2ProxyRecord *proxy_record = IP2Proxy_get_all(ip2l_proxy, ip);
 		if (proxy_record != NULL) {
 			/* Determine IP type from proxy detection */
 			if (proxy_record->is_proxy >= 0) {
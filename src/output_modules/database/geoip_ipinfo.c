@@ -49,6 +49,8 @@
 #include <unistd.h>
 #include <math.h>
 #include <limits.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
 #include <maxminddb.h>
 
 #include "geoip_provider.h"
@@ -285,12 +287,13 @@ static int ipinfo_init(const geoip_config_t *config) {
  *   - hosting: true/false
  *   - service: "Provider Name"
  */
-static int ipinfo_lookup(const char *ip, geoip_result_t *result) {
-	int gai_error, mmdb_error;
+static int ipinfo_lookup(int af, const void *addr, geoip_result_t *result, unsigned int *prefix) {
+	int mmdb_error;
+	unsigned int plen = 0;
 	MMDB_lookup_result_s lookup_result;
 	char loc_buf[64];
 
-	if (!country_open || ip == NULL || result == NULL) {
+	if (!country_open || addr == NULL || result == NULL || prefix == NULL) {
 		return -1;
 	}
 
@@ -300,13 +303,14 @@ static int ipinfo_lookup(const char *ip, geoip_result_t *result) {
 	strncpy(result->db_version, db_version, sizeof(result->db_version) - 1);
 
 	/* Lookup in Country/City database */
-	lookup_result = MMDB_lookup_string(&ipinfo_country, ip, &gai_error, &mmdb_error);
+	lookup_result = geoip_mmdb_lookup(&ipinfo_country, af, addr, &plen, &mmdb_error);
 
-	if (gai_error != 0 || mmdb_error != MMDB_SUCCESS) {
+	if (mmdb_error != MMDB_SUCCESS) {
 		return -1;
 	}
 
 	if (!lookup_result.found_entry) {
+		*prefix = plen;
 		return 1; /* Not found */
 	}
 
@@ -339,8 +343,8 @@ static int ipinfo_lookup(const char *ip, geoip_result_t *result) {
 
 	/* Lookup in ASN database if available */
 	if (asn_open) {
-		lookup_result = MMDB_lookup_string(&ipinfo_asn, ip, &gai_error, &mmdb_error);
-		if (gai_error == 0 && mmdb_error == MMDB_SUCCESS && lookup_result.found_entry) {
+		lookup_result = geoip_mmdb_lookup(&ipinfo_asn, af, addr, &plen, &mmdb_error);
+		if (mmdb_error == MMDB_SUCCESS && lookup_result.found_entry) {
 			entry = &lookup_result.entry;
 
 			result->asn = extract_asn_from_string(entry, "asn");
@@ -370,8 +374,8 @@ static int ipinfo_lookup(const char *ip, geoip_result_t *result) {
 
 	/* Lookup in Privacy database if available */
 	if (privacy_open) {
-		lookup_result = MMDB_lookup_string(&ipinfo_privacy, ip, &gai_error, &mmdb_error);
-		if (gai_error == 0 && mmdb_error == MMDB_SUCCESS && lookup_result.found_entry) {
+		lookup_result = geoip_mmdb_lookup(&ipinfo_privacy, af, addr, &plen, &mmdb_error);
+		if (mmdb_error == MMDB_SUCCESS && lookup_result.found_entry) {
 			entry = &lookup_result.entry;
 
 			/* Determine IP type from privacy flags - most specific first */
@@ -390,6 +394,7 @@ static int ipinfo_lookup(const char *ip, geoip_result_t *result) {
 		}
 	}
 
+	*prefix = plen;
 	return 0;
 }
 
@@ -276,11 +276,12 @@ static int maxmind_init(const geoip_config_t *config) {
 /*
  * Perform lookup against all available MaxMind databases
  */
-static int maxmind_lookup(const char *ip, geoip_result_t *result) {
-	int gai_error, mmdb_error;
+static int maxmind_lookup(int af, const void *addr, geoip_result_t *result, unsigned int *prefix) {
+	int mmdb_error;
+	unsigned int plen = 0;
 	MMDB_lookup_result_s lookup_result;
 
-	if (!city_open || ip == NULL || result == NULL) {
+	if (!city_open || addr == NULL || result == NULL || prefix == NULL) {
 		return -1;
 	}
 
@@ -290,13 +291,14 @@ static int maxmind_lookup(const char *ip, geoip_result_t *result) {
 	strncpy(result->db_version, db_version, sizeof(result->db_version) - 1);
 
 	/* Lookup in City database */
-	lookup_result = MMDB_lookup_string(&mmdb_city, ip, &gai_error, &mmdb_error);
+	lookup_result = geoip_mmdb_lookup(&mmdb_city, af, addr, &plen, &mmdb_error);
 
-	if (gai_error != 0 || mmdb_error != MMDB_SUCCESS) {
+	if (mmdb_error != MMDB_SUCCESS) {
 		return -1;
 	}
 
 	if (!lookup_result.found_entry) {
+		*prefix = plen;
 		return 1; /* Not found */
 	}
 
@@ -324,8 +326,8 @@ static int maxmind_lookup(const char *ip, geoip_result_t *result) {
 
 	/* Lookup in ASN database if available */
 	if (asn_open) {
-		lookup_result = MMDB_lookup_string(&mmdb_asn, ip, &gai_error, &mmdb_error);
-		if (gai_error == 0 && mmdb_error == MMDB_SUCCESS && lookup_result.found_entry) {
+		lookup_result = geoip_mmdb_lookup(&mmdb_asn, af, addr, &plen, &mmdb_error);
+		if (mmdb_error == MMDB_SUCCESS && lookup_result.found_entry) {
 			entry = &lookup_result.entry;
 			result->asn = extract_uint32(entry, "autonomous_system_number", NULL);
 			extract_string(entry, result->as_org, sizeof(result->as_org),
@@ -340,8 +342,8 @@ static int maxmind_lookup(const char *ip, geoip_result_t *result) {
 
 	/* Lookup in Anonymous IP database if available (paid) */
 	if (anonymous_open) {
-		lookup_result = MMDB_lookup_string(&mmdb_anonymous, ip, &gai_error, &mmdb_error);
-		if (gai_error == 0 && mmdb_error == MMDB_SUCCESS && lookup_result.found_entry) {
+		lookup_result = geoip_mmdb_lookup(&mmdb_anonymous, af, addr, &plen, &mmdb_error);
+		if (mmdb_error == MMDB_SUCCESS && lookup_result.found_entry) {
 			entry = &lookup_result.entry;
 
 			/* Determine IP type from anonymous IP flags */
@@ -364,6 +366,7 @@ static int maxmind_lookup(const char *ip, geoip_result_t *result) {
 		}
 	}
 
+	*prefix = plen;
 	return 0;
 }
 
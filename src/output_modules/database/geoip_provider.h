@@ -114,9 +114,13 @@ typedef struct geoip_provider {
 
 	/*
 	 * Perform IP lookup and populate result structure
+	 * addr is a struct in_addr (AF_INET) or struct in6_addr (AF_INET6) in
+	 * network order.  *prefix comes in as the full address length and should
+	 * be narrowed to the network the answer holds for, so the cache can
+	 * reuse it for every address in that network (also when not found)
 	 * Returns: 0 on success (data found), 1 on not found, -1 on error
 	 */
-	int (*lookup)(const char *ip, geoip_result_t *result);
+	int (*lookup)(int af, const void *addr, geoip_result_t *result, unsigned int *prefix);
 
 	/*
 	 * Get database version string
@@ -141,9 +145,18 @@ typedef struct geoip_provider {
  * ========================================================================== */
 
 #ifdef HAVE_LIBMAXMINDDB
+#include <maxminddb.h>
+
 extern geoip_provider_t geoip_maxmind_provider;
 /* IPinfo uses MMDB format, so it also requires libmaxminddb */
 extern geoip_provider_t geoip_ipinfo_provider;
+
+/*
+ * Look addr up in one mmdb file (AF_INET or AF_INET6, network order)
+ * Raises *plen to the prefix length of the network matched, for the cache
+ * Returns: the libmaxminddb result, *mmdb_error as MMDB_lookup_sockaddr sets it
+ */
+MMDB_lookup_result_s geoip_mmdb_lookup(MMDB_s *mmdb, int af, const void *addr, unsigned int *plen, int *mmdb_error);
 #endif
 
 #ifdef HAVE_IP2LOCATION
@@ -168,6 +181,11 @@ int geoip_init(const geoip_config_t *config);
  */
 int geoip_lookup(const char *ip, geoip_result_t *result);
 
+/*
+ * Same as geoip_lookup for a binary address (see provider lookup above)
+ */
+int geoip_lookup_addr(int af, const void *addr, geoip_result_t *result);
+
 /*
  * Get active provider's database version
  * Returns: version string or "unknown"
@@ -192,10 +210,11 @@ void geoip_cleanup(void);
 const char *geoip_get_provider_name(void);
 
 /*
- * Get cache statistics
+ * Get cache statistics: hits, misses, cached ranges, and the nanoseconds
+ * spent answering hits and misses (misses include the provider lookup)
  * Any parameter can be NULL if not needed
  */
-void geoip_cache_stats(unsigned long *hits, unsigned long *misses, size_t *size);
+void geoip_cache_stats(unsigned long *hits, unsigned long *misses, size_t *size, uint64_t *hit_ns, uint64_t *miss_ns);
 
 /* ==========================================================================
  * Utility functions
@@ -0,0 +1,100 @@
+/**********************************************************************
+ * Copyright (C) 2026 Robert E. Lee <robert@unicornscan.org>          *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#ifndef _PGSQL_STMTS_H
+#define _PGSQL_STMTS_H
+
+/*
+ * server side prepared statements for the per result upserts, prepared
+ * once per connection by pgsqldb and by the bench_pgsql tool.  every
+ * parameter is sent in binary, the types below are the server's type
+ * oids (pg_type.h is not installed with the client library)
+ *
+ * the host upsert and its uni_host_scans row are one statement so they
+ * can go down a pipeline without waiting on the host_id in between
+ */
+
+#define PGS_HOST	0
+#define PGS_MACIP	1
+#define PGS_SERVICE	2
+#define PGS_OSFP	3
+#define PGS_GEOIP	4
+#define PGS_MAX		5
+
+#define PGS_MAXPARAM	19
+
+#define PGS_INT8	20
+#define PGS_INT2	21
+#define PGS_INT4	23
+#define PGS_TEXT	25
+#define PGS_FLOAT8	701
+#define PGS_MACADDR	829
+#define PGS_INET	869
+
+typedef struct pgsql_stmt_t {
+	const char *name;
+	const char *sql;
+	int nparams;
+	Oid types[PGS_MAXPARAM];
+} pgsql_stmt_t;
+
+static const pgsql_stmt_t pgsql_stmts[PGS_MAX]={
+	{ "uni_host",
+	  "INSERT INTO uni_host_scans (host_id, scan_id, first_response, response_count) "
+	  "SELECT h, $3, NOW(), 1 FROM fn_upsert_host($1, $2) AS h WHERE h IS NOT NULL "
+	  "ON CONFLICT (host_id, scan_id) DO UPDATE SET response_count = uni_host_scans.response_count + 1",
+	  3, { PGS_INET, PGS_MACADDR, PGS_INT8 } },
+	{ "uni_mac_ip",
+	  "SELECT fn_record_mac_ip($1, $2, $3)",
+	  3, { PGS_INET, PGS_MACADDR, PGS_INT8 } },
+	{ "uni_service",
+	  "INSERT INTO uni_services (host_addr, port, proto, scan_id, ipreport_id, "
+	  "service_name, product, version, banner_raw, detected_at) "
+	  "VALUES ($1, $2, $3, $4, $5, NULLIF($6,''), NULLIF($7,''), NULLIF($8,''), $9, NOW()) "
+	  "ON CONFLICT (host_addr, port, proto, scan_id) DO UPDATE SET "
+	  "service_name = COALESCE(NULLIF(EXCLUDED.service_name,''), uni_services.service_name), "
+	  "product = COALESCE(NULLIF(EXCLUDED.product,''), uni_services.product), "
+	  "version = COALESCE(NULLIF(EXCLUDED.version,''), uni_services.version), "
+	  "banner_raw = EXCLUDED.banner_raw",
+	  9, { PGS_INET, PGS_INT4, PGS_INT2, PGS_INT8, PGS_INT8, PGS_TEXT, PGS_TEXT, PGS_TEXT, PGS_TEXT } },
+	{ "uni_os_fingerprint",
+	  "INSERT INTO uni_os_fingerprints (host_addr, scan_id, ipreport_id, "
+	  "os_family, os_name, os_version, os_full, device_type, "
+	  "ttl_observed, window_size, detected_at) "
+	  "VALUES ($1, $2, $3, NULLIF($4,''), NULLIF($5,''), NULLIF($6,''), $7, NULLIF($8,''), $9, $10, NOW())",
+	  10, { PGS_INET, PGS_INT8, PGS_INT8, PGS_TEXT, PGS_TEXT, PGS_TEXT, PGS_TEXT, PGS_TEXT, PGS_INT2, PGS_INT4 } },
+	{ "uni_geoip",
+	  "INSERT INTO uni_geoip ("
+	  "host_ip, scan_id, "
+	  "country_code, country_name, region_code, region_name, city, postal_code, "
+	  "latitude, longitude, timezone, "
+	  "ip_type, isp, organization, asn, as_org, "
+	  "provider, database_version, confidence"
+	  ") VALUES ("
+	  "$1, $2, "
+	  "NULLIF($3,''), NULLIF($4,''), NULLIF($5,''), NULLIF($6,''), NULLIF($7,''), NULLIF($8,''), "
+	  "$9, $10, NULLIF($11,''), "
+	  "NULLIF($12,''), NULLIF($13,''), NULLIF($14,''), $15, NULLIF($16,''), "
+	  "$17, NULLIF($18,''), $19"
+	  ") ON CONFLICT (host_ip, scan_id) DO NOTHING",
+	  19, { PGS_INET, PGS_INT8, PGS_TEXT, PGS_TEXT, PGS_TEXT, PGS_TEXT, PGS_TEXT, PGS_TEXT,
+	  PGS_FLOAT8, PGS_FLOAT8, PGS_TEXT, PGS_TEXT, PGS_TEXT, PGS_TEXT, PGS_INT4, PGS_TEXT,
+	  PGS_TEXT, PGS_TEXT, PGS_INT2 } },
+};
+
+#endif
@@ -29,13 +29,20 @@
 #include <unilib/xmalloc.h>
 #include <unilib/modules.h>
 #include <unilib/cidr.h>
+#include <unilib/metrics.h>
 
 #include <arpa/inet.h>
+#include <errno.h>
 #include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <time.h>
 
 #include <libpq-fe.h>
 
 #include "pgsql_schema_embedded.h"
+#include "pgsql_stmts.h"
 #include "geoip_provider.h"
 
 static int pgsql_disable=0;
@@ -56,6 +63,121 @@ static char db_os[4096], db_banner[4096];
 /* v5: Additional query buffer for secondary inserts */
 static char querybuf2[1024 * 4];
 
+/*
+ * bulk loading: report rows are not inserted a statement at a time, they
+ * are formatted into one COPY text buffer per table and streamed to the
+ * server with COPY ... FROM STDIN, in one transaction, once the buffers
+ * pass copy_max bytes, once the oldest buffered row is copy_delay ms old,
+ * and at pgsql_database_fini().  report ids come from the sequences in
+ * blocks up front, so packets, banners and hops can be buffered before
+ * their report reaches the server.  the host, mac history, service, os
+ * fingerprint and geoip rows keep their own conflict handling, so they
+ * are queued as parameters for the statements in pgsql_stmts.h and run
+ * through a libpq pipeline once the COPY transaction commits.
+ *
+ * none of that happens on the thread calling send_output(): a due set of
+ * buffers is sealed into a batch and queued for the writer thread, which
+ * has its own connection, so a slow database never holds up the master
+ * reading its drones.  the queue is bounded by wq_max bytes, when it is
+ * full the open buffers keep growing, and only once they alone reach the
+ * bound does send_output() wait for the writer (counted in the metrics)
+ */
+#define CB_IPREPORT	0
+#define CB_ARPREPORT	1
+#define CB_IPDATA	2
+#define CB_IPPACKETS	3
+#define CB_ARPPACKETS	4
+#define CB_HOPS		5
+#define CB_MAX		6
+
+typedef struct copybuf_t {
+	const char *copy;
+	char *buf;
+	size_t len;
+	size_t size;
+} copybuf_t;
+
+/* in flush order, reports before the rows that reference them */
+static copybuf_t copybufs[CB_MAX]={
+	{ "copy uni_ipreport (ipreport_id, scan_id, magic, sport, dport, proto, type, subtype, send_addr, host_addr, "
+	  "trace_addr, ttl, tstamp, utstamp, flags, mseq, tseq, window_size, t_tstamp, m_tstamp, eth_hwaddr) from stdin",
+	  NULL, 0, 0 },
+	{ "copy uni_arpreport (arpreport_id, scan_id, magic, host_addr, hwaddr, tstamp, utstamp) from stdin", NULL, 0, 0 },
+	{ "copy uni_ipreportdata (ipreport_id, type, data) from stdin", NULL, 0, 0 },
+	{ "copy uni_ippackets (ipreport_id, packet) from stdin", NULL, 0, 0 },
+	{ "copy uni_arppackets (arpreport_id, packet) from stdin", NULL, 0, 0 },
+	{ "copy uni_hops (ipreport_id, scan_id, target_addr, hop_addr, hop_number, ttl_observed, rtt_us) from stdin",
+	  NULL, 0, 0 },
+};
+
+#define COPY_DEFMAX	1024		/* KB */
+#define COPY_DEFDELAY	2000		/* ms */
+#define IDBLOCK		256
+
+static size_t copy_max=COPY_DEFMAX * 1024, copy_total=0;
+static unsigned int copy_delay=COPY_DEFDELAY;
+static struct timespec copy_first;
+
+/*
+ * prepared statement executions waiting for the COPY transaction, each a
+ * PGS_ byte followed by its parameters as a native int32 length (-1 for
+ * NULL) and that many bytes in the binary wire format.  PEND_NEEDHOST on
+ * the byte means the row is about the host queued just before it, and is
+ * skipped if that host upsert fails, as it was when host_id came back 0
+ */
+#define PEND_NEEDHOST	0x80
+
+static char *pend_buf=NULL;
+static size_t pend_len=0, pend_size=0;
+static unsigned int pend_cnt=0;
+
+typedef struct pgbatch_t {
+	char *buf[CB_MAX];
+	size_t len[CB_MAX];
+	size_t size[CB_MAX];
+	char *pend;
+	size_t pend_len;
+	size_t pend_size;
+	unsigned int pend_cnt;
+	size_t total;
+	struct pgbatch_t *next;
+} pgbatch_t;
+
+#define QUEUE_DEFMAX	8192		/* KB */
+
+static pthread_mutex_t wr_lock=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wr_cond=PTHREAD_COND_INITIALIZER;		/* batches for the writer */
+static pthread_cond_t wr_space=PTHREAD_COND_INITIALIZER;	/* the writer finished one */
+static pthread_t wr_thread;
+static int wr_running=0, wr_stop=0, wr_failed=0;
+static uint64_t wr_lost=0;
+
+/* head is the oldest batch, bytes count a batch until the writer is done with it */
+static pgbatch_t *wq_head=NULL, *wq_tail=NULL, *wq_spare=NULL;
+static unsigned int wq_depth=0;
+static size_t wq_bytes=0, wq_max=QUEUE_DEFMAX * 1024;
+
+static PGconn *wconn=NULL;
+
+static void cb_printf(int /* CB_ */, const char * /* fmt */, ...) _PRINTF23_;
+static void cb_putstr(int, const char *);
+static void cb_putbytea(int, const uint8_t *, size_t);
+static unsigned long long int pgsql_nextid(int /* CB_IPREPORT or CB_ARPREPORT */);
+static void pend_begin(int /* PGS_ */);
+static void pend_put(const void *, int32_t);
+static void pend_int8(uint64_t);
+static void pend_int4(uint32_t);
+static void pend_int2(uint16_t);
+static void pend_float8(double);
+static void pend_text(const char *);
+static void pend_inet4(uint32_t /* network order */);
+static void pend_mac(const uint8_t *);
+static int pgsql_prepare(void);
+static int pgsql_handoff(int /* wait for room */);
+static void pgsql_batch_free(pgbatch_t *);
+static void *pgsql_writer(void *);
+static int pgsql_bulk_due(void);
+
 /*
  * Helper function to get mode character from mode flag
  * Returns: 'T' for TCP, 'U' for UDP, 'A' for ARP, 'I' for ICMP, 'P' for IP
@@ -234,133 +356,38 @@ static const char *build_target_str(const settings_t *settings) {
 }
 
 /*
- * v5: Call fn_upsert_host() to insert/update host and return host_id
+ * v5: Queue fn_upsert_host() and the uni_host_scans row linking the host to this scan
  * Parameters:
- *   host_addr: IP address string (e.g., "192.168.1.1")
- *   mac_addr: MAC address string or NULL (e.g., "00:11:22:33:44:55")
- * Returns: host_id on success, 0 on failure
+ *   host_addr: IPv4 address, network order
+ *   mac_addr: 6 byte MAC address or NULL
  */
-static unsigned long long int pgsql_upsert_host(const char *host_addr, const char *mac_addr) {
-	PGresult *res;
-	unsigned long long int host_id = 0;
-	char host_escaped[64];  /* Fixed buffer - IP addresses are max ~45 chars */
-	char *escaped_mac = NULL;
-
-	if (host_addr == NULL || pgconn == NULL) {
-		return 0;
-	}
-
-	/* Copy escaped host immediately - pgsql_escstr uses static buffer */
-	{
-		char *tmp = pgsql_escstr(host_addr);
-		if (tmp == NULL) {
-			return 0;
-		}
-		snprintf(host_escaped, sizeof(host_escaped), "%s", tmp);
-	}
+static void pgsql_upsert_host(uint32_t host_addr, const uint8_t *mac_addr, unsigned long long int scan_id) {
 
+	pend_begin(PGS_HOST);
+	pend_inet4(host_addr);
 	if (mac_addr != NULL) {
-		escaped_mac = pgsql_escstr(mac_addr);
-		snprintf(querybuf2, sizeof(querybuf2) - 1,
-			"SELECT fn_upsert_host('%s'::inet, '%s'::macaddr);",
-			host_escaped, escaped_mac ? escaped_mac : "00:00:00:00:00:00"
-		);
-	}
-	else {
-		snprintf(querybuf2, sizeof(querybuf2) - 1,
-			"SELECT fn_upsert_host('%s'::inet, NULL);",
-			host_escaped
-		);
-	}
-
-	res = PQexec(pgconn, querybuf2);
-	if (PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res) == 1) {
-		const char *val = PQgetvalue(res, 0, 0);
-		if (val != NULL) {
-			sscanf(val, "%llu", &host_id);
-		}
-	}
-	else {
-		DBG(M_MOD, "fn_upsert_host failed: %s", PQerrorMessage(pgconn));
-	}
-
-	PQclear(res);
-	return host_id;
-}
-
-/*
- * v5: Insert uni_host_scans junction record (host ↔ scan relationship)
- * Uses ON CONFLICT to handle duplicates gracefully
- */
-static int pgsql_insert_host_scan(unsigned long long int host_id, unsigned long long int scan_id) {
-	PGresult *res;
-	int ret = 0;
-
-	if (host_id == 0 || scan_id == 0 || pgconn == NULL) {
-		return 0;
-	}
-
-	snprintf(querybuf2, sizeof(querybuf2) - 1,
-		"INSERT INTO uni_host_scans (host_id, scan_id, first_response, response_count) "
-		"VALUES (%llu, %llu, NOW(), 1) "
-		"ON CONFLICT (host_id, scan_id) DO UPDATE SET response_count = uni_host_scans.response_count + 1;",
-		host_id, scan_id
-	);
-
-	res = PQexec(pgconn, querybuf2);
-	if (PQresultStatus(res) == PGRES_COMMAND_OK) {
-		ret = 1;
+		pend_mac(mac_addr);
 	}
 	else {
-		DBG(M_MOD, "uni_host_scans insert failed: %s", PQerrorMessage(pgconn));
+		pend_put(NULL, -1);
 	}
+	pend_int8(scan_id);
 
-	PQclear(res);
-	return ret;
+	return;
 }
 
 /*
  * v8: Record MAC<->IP association in uni_mac_ip_history
  * Tracks historical MAC<->IP pairings for temporal analysis
  */
-static unsigned long long int pgsql_record_mac_ip(const char *host_addr, const char *mac_addr, unsigned long long int scan_id) {
-	PGresult *res;
-	unsigned long long int history_id=0;
-	char esc_host[128], esc_mac[64];
-	char *tmp=NULL;
-
-	if (host_addr == NULL || mac_addr == NULL || pgconn == NULL) {
-		return 0;
-	}
-
-	/* pgsql_escstr uses static buffer - copy before next call */
-	tmp=pgsql_escstr(host_addr);
-	if (tmp == NULL) return 0;
-	strncpy(esc_host, tmp, sizeof(esc_host)-1);
-	esc_host[sizeof(esc_host)-1]='\0';
-
-	tmp=pgsql_escstr(mac_addr);
-	if (tmp == NULL) return 0;
-	strncpy(esc_mac, tmp, sizeof(esc_mac)-1);
-	esc_mac[sizeof(esc_mac)-1]='\0';
-
-	snprintf(querybuf2, sizeof(querybuf2)-1,
-		"SELECT fn_record_mac_ip('%s'::inet, '%s'::macaddr, %llu);",
-		esc_host, esc_mac, scan_id);
+static void pgsql_record_mac_ip(uint32_t host_addr, const uint8_t *mac_addr, unsigned long long int scan_id, int needhost) {
 
-	res = PQexec(pgconn, querybuf2);
-	if (PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res) == 1) {
-		const char *val = PQgetvalue(res, 0, 0);
-		if (val != NULL) {
-			sscanf(val, "%llu", &history_id);
-		}
-	}
-	else {
-		DBG(M_MOD, "fn_record_mac_ip failed: %s", PQerrorMessage(pgconn));
-	}
+	pend_begin(PGS_MACIP | (needhost ? PEND_NEEDHOST : 0));
+	pend_inet4(host_addr);
+	pend_mac(mac_addr);
+	pend_int8(scan_id);
 
-	PQclear(res);
-	return history_id;
+	return;
 }
 
 /*
@@ -368,41 +395,15 @@ static unsigned long long int pgsql_record_mac_ip(const char *host_addr, const c
  */
 static int pgsql_insert_hop(unsigned long long int ipreport_id, unsigned long long int scan_id,
                             const char *target_addr, const char *hop_addr, int ttl) {
-	PGresult *res;
-	int ret=0;
-	char esc_target[64], esc_hop[64];
-	char *tmp=NULL;
 
 	if (target_addr == NULL || hop_addr == NULL || pgconn == NULL) {
 		return 0;
 	}
 
-	/* pgsql_escstr uses static buffer - copy before next call */
-	tmp=pgsql_escstr(target_addr);
-	if (tmp == NULL) return 0;
-	strncpy(esc_target, tmp, sizeof(esc_target)-1);
-	esc_target[sizeof(esc_target)-1]='\0';
-
-	tmp=pgsql_escstr(hop_addr);
-	if (tmp == NULL) return 0;
-	strncpy(esc_hop, tmp, sizeof(esc_hop)-1);
-	esc_hop[sizeof(esc_hop)-1]='\0';
+	/* addresses come from inet_ntop, nothing in them needs COPY escaping */
+	cb_printf(CB_HOPS, "%llu\t%llu\t%s\t%s\t\\N\t%d\t\\N\n", ipreport_id, scan_id, target_addr, hop_addr, ttl);
 
-	snprintf(querybuf2, sizeof(querybuf2)-1,
-		"INSERT INTO uni_hops (ipreport_id, scan_id, target_addr, hop_addr, ttl_observed) "
-		"VALUES (%llu, %llu, '%s', '%s', %d);",
-		ipreport_id, scan_id, esc_target, esc_hop, ttl);
-
-	res = PQexec(pgconn, querybuf2);
-	if (PQresultStatus(res) == PGRES_COMMAND_OK) {
-		ret = 1;
-	}
-	else {
-		DBG(M_MOD, "uni_hops insert failed: %s", PQerrorMessage(pgconn));
-	}
-
-	PQclear(res);
-	return ret;
+	return 1;
 }
 
 /*
@@ -564,15 +565,10 @@ static int pgsql_parse_banner(const char *banner, int port, int proto,
  * v5: Insert uni_services record with parsed banner data
  */
 static int pgsql_insert_service(unsigned long long int ipreport_id, unsigned long long int scan_id,
-                                const char *host_addr, int port, int proto, const char *banner) {
-	PGresult *res;
-	int ret = 0;
+                                uint32_t host_addr, int port, int proto, const char *banner) {
 	char service_name[64], product[128], version[64];
-	/* Local buffers for escaped strings - pgsql_escstr uses static buffer */
-	char esc_host[128], esc_banner[4096], esc_svc[128], esc_prod[256], esc_ver[128];
-	char *tmp = NULL;
 
-	if (host_addr == NULL || banner == NULL || pgconn == NULL) {
+	if (banner == NULL || pgconn == NULL) {
 		return 0;
 	}
 
@@ -585,57 +581,19 @@ static int pgsql_insert_service(unsigned long long int ipreport_id, unsigned lon
 		version[0] = '\0';
 	}
 
-	/* pgsql_escstr uses static buffer - copy each result before next call */
-	tmp = pgsql_escstr(host_addr);
-	if (tmp == NULL) return 0;
-	strncpy(esc_host, tmp, sizeof(esc_host) - 1);
-	esc_host[sizeof(esc_host) - 1] = '\0';
-
-	tmp = pgsql_escstr(banner);
-	if (tmp == NULL) return 0;
-	strncpy(esc_banner, tmp, sizeof(esc_banner) - 1);
-	esc_banner[sizeof(esc_banner) - 1] = '\0';
-
-	tmp = pgsql_escstr(service_name);
-	if (tmp == NULL) { esc_svc[0] = '\0'; }
-	else { strncpy(esc_svc, tmp, sizeof(esc_svc) - 1); esc_svc[sizeof(esc_svc) - 1] = '\0'; }
-
-	tmp = pgsql_escstr(product);
-	if (tmp == NULL) { esc_prod[0] = '\0'; }
-	else { strncpy(esc_prod, tmp, sizeof(esc_prod) - 1); esc_prod[sizeof(esc_prod) - 1] = '\0'; }
-
-	tmp = pgsql_escstr(version);
-	if (tmp == NULL) { esc_ver[0] = '\0'; }
-	else { strncpy(esc_ver, tmp, sizeof(esc_ver) - 1); esc_ver[sizeof(esc_ver) - 1] = '\0'; }
-
-	snprintf(querybuf2, sizeof(querybuf2) - 1,
-		"INSERT INTO uni_services (host_addr, port, proto, scan_id, ipreport_id, "
-		"service_name, product, version, banner_raw, detected_at) "
-		"VALUES ('%s', %d, %d, %llu, %llu, "
-		"NULLIF('%s',''), NULLIF('%s',''), NULLIF('%s',''), '%s', NOW()) "
-		"ON CONFLICT (host_addr, port, proto, scan_id) DO UPDATE SET "
-		"service_name = COALESCE(NULLIF(EXCLUDED.service_name,''), uni_services.service_name), "
-		"product = COALESCE(NULLIF(EXCLUDED.product,''), uni_services.product), "
-		"version = COALESCE(NULLIF(EXCLUDED.version,''), uni_services.version), "
-		"banner_raw = EXCLUDED.banner_raw;",
-		esc_host,
-		port, proto, scan_id, ipreport_id,
-		esc_svc,
-		esc_prod,
-		esc_ver,
-		esc_banner
-	);
-
-	res = PQexec(pgconn, querybuf2);
-	if (PQresultStatus(res) == PGRES_COMMAND_OK) {
-		ret = 1;
-	}
-	else {
-		DBG(M_MOD, "uni_services insert failed: %s", PQerrorMessage(pgconn));
-	}
+	/* the report row it points at may still be sitting in a COPY buffer */
+	pend_begin(PGS_SERVICE);
+	pend_inet4(host_addr);
+	pend_int4((uint32_t)port);
+	pend_int2((uint16_t)proto);
+	pend_int8(scan_id);
+	pend_int8(ipreport_id);
+	pend_text(service_name);
+	pend_text(product);
+	pend_text(version);
+	pend_text(banner);
 
-	PQclear(res);
-	return ret;
+	return 1;
 }
 
 /*
@@ -743,15 +701,10 @@ static int pgsql_parse_os_fingerprint(const char *os_str, int ttl, int window_si
  * v5: Insert uni_os_fingerprints record with parsed OS data
  */
 static int pgsql_insert_os_fingerprint(unsigned long long int ipreport_id, unsigned long long int scan_id,
-                                       const char *host_addr, const char *os_str, int ttl, int window_size) {
-	PGresult *res;
-	int ret = 0;
+                                       uint32_t host_addr, const char *os_str, int ttl, int window_size) {
 	char os_family[64], os_name[128], os_version[64], device_type[64];
-	/* Local buffers for escaped strings - pgsql_escstr uses static buffer */
-	char esc_host[128], esc_os_str[512], esc_family[128], esc_name[256], esc_version[128], esc_device[128];
-	char *tmp = NULL;
 
-	if (host_addr == NULL || os_str == NULL || pgconn == NULL) {
+	if (os_str == NULL || pgconn == NULL) {
 		return 0;
 	}
 
@@ -768,60 +721,19 @@ static int pgsql_insert_os_fingerprint(unsigned long long int ipreport_id, unsig
 		device_type[0] = '\0';
 	}
 
-	/* pgsql_escstr uses static buffer - copy each result before next call */
-	tmp = pgsql_escstr(host_addr);
-	if (tmp == NULL) return 0;
-	strncpy(esc_host, tmp, sizeof(esc_host) - 1);
-	esc_host[sizeof(esc_host) - 1] = '\0';
-
-	tmp = pgsql_escstr(os_str);
-	if (tmp == NULL) return 0;
-	strncpy(esc_os_str, tmp, sizeof(esc_os_str) - 1);
-	esc_os_str[sizeof(esc_os_str) - 1] = '\0';
-
-	tmp = pgsql_escstr(os_family);
-	if (tmp == NULL) { esc_family[0] = '\0'; }
-	else { strncpy(esc_family, tmp, sizeof(esc_family) - 1); esc_family[sizeof(esc_family) - 1] = '\0'; }
-
-	tmp = pgsql_escstr(os_name);
-	if (tmp == NULL) { esc_name[0] = '\0'; }
-	else { strncpy(esc_name, tmp, sizeof(esc_name) - 1); esc_name[sizeof(esc_name) - 1] = '\0'; }
-
-	tmp = pgsql_escstr(os_version);
-	if (tmp == NULL) { esc_version[0] = '\0'; }
-	else { strncpy(esc_version, tmp, sizeof(esc_version) - 1); esc_version[sizeof(esc_version) - 1] = '\0'; }
-
-	tmp = pgsql_escstr(device_type);
-	if (tmp == NULL) { esc_device[0] = '\0'; }
-	else { strncpy(esc_device, tmp, sizeof(esc_device) - 1); esc_device[sizeof(esc_device) - 1] = '\0'; }
-
-	snprintf(querybuf2, sizeof(querybuf2) - 1,
-		"INSERT INTO uni_os_fingerprints (host_addr, scan_id, ipreport_id, "
-		"os_family, os_name, os_version, os_full, device_type, "
-		"ttl_observed, window_size, detected_at) "
-		"VALUES ('%s', %llu, %llu, "
-		"NULLIF('%s',''), NULLIF('%s',''), NULLIF('%s',''), '%s', NULLIF('%s',''), "
-		"%d, %d, NOW());",
-		esc_host,
-		scan_id, ipreport_id,
-		esc_family,
-		esc_name,
-		esc_version,
-		esc_os_str,
-		esc_device,
-		ttl, window_size
-	);
-
-	res = PQexec(pgconn, querybuf2);
-	if (PQresultStatus(res) == PGRES_COMMAND_OK) {
-		ret = 1;
-	}
-	else {
-		DBG(M_MOD, "uni_os_fingerprints insert failed: %s", PQerrorMessage(pgconn));
-	}
+	pend_begin(PGS_OSFP);
+	pend_inet4(host_addr);
+	pend_int8(scan_id);
+	pend_int8(ipreport_id);
+	pend_text(os_family);
+	pend_text(os_name);
+	pend_text(os_version);
+	pend_text(os_str);
+	pend_text(device_type);
+	pend_int2((uint16_t)ttl);
+	pend_int4((uint32_t)window_size);
 
-	PQclear(res);
-	return ret;
+	return 1;
 }
 
 /*
@@ -867,153 +779,77 @@ static int pgsql_insert_phases(unsigned long long int scanid, const settings_t *
 /*
  * v6: Insert uni_geoip record with GeoIP lookup data
  */
-static int pgsql_insert_geoip(unsigned long long int scan_id, const char *host_addr) {
-	PGresult *res;
-	int ret = 0;
+static int pgsql_insert_geoip(unsigned long long int scan_id, uint32_t host_ip) {
 	geoip_result_t geoip;
-	/* Local buffers for escaped strings - pgsql_escstr uses static buffer */
-	char esc_host[128], esc_country[8], esc_country_name[128], esc_region[16], esc_region_name[128];
-	char esc_city[128], esc_postal[32], esc_timezone[64], esc_ip_type[32];
-	char esc_isp[256], esc_org[256], esc_as_org[256], esc_provider[64], esc_db_version[64];
-	char *tmp = NULL;
-	char lat_str[32], lon_str[32], asn_str[32], conf_str[16];
-
-	if (!geoip_enabled || host_addr == NULL || pgconn == NULL) {
-		return 0;
-	}
+	unsigned long c_hits = 0, c_misses = 0;
+	size_t c_size = 0;
+	uint64_t c_hit_ns = 0, c_miss_ns = 0;
+	struct in_addr ia;
+	int lret = 0;
 
-	/* Perform GeoIP lookup */
-	if (geoip_lookup(host_addr, &geoip) != 0) {
-		return 0; /* Lookup failed or not found - not an error */
+	if (!geoip_enabled || pgconn == NULL) {
+		return 0;
 	}
 
-	/* pgsql_escstr uses static buffer - copy each result before next call */
-	tmp = pgsql_escstr(host_addr);
-	if (tmp == NULL) return 0;
-	strncpy(esc_host, tmp, sizeof(esc_host) - 1);
-	esc_host[sizeof(esc_host) - 1] = '\0';
+	/* Perform GeoIP lookup, binary address so the cache skips parsing */
+	ia.s_addr = host_ip;
+	lret = geoip_lookup_addr(AF_INET, &ia, &geoip);
 
-	tmp = pgsql_escstr(geoip.country_code);
-	if (tmp == NULL) { esc_country[0] = '\0'; }
-	else { strncpy(esc_country, tmp, sizeof(esc_country) - 1); esc_country[sizeof(esc_country) - 1] = '\0'; }
+	/* cache counters for --metrics, cheap stores into the master's slots */
+	geoip_cache_stats(&c_hits, &c_misses, &c_size, &c_hit_ns, &c_miss_ns);
+	METRIC_SET(MET_GEOIP_HITS, c_hits);
+	METRIC_SET(MET_GEOIP_MISSES, c_misses);
+	METRIC_SET(MET_GEOIP_CACHED, c_size);
+	METRIC_SET(MET_GEOIP_HIT_NS, c_hit_ns);
+	METRIC_SET(MET_GEOIP_MISS_NS, c_miss_ns);
 
-	tmp = pgsql_escstr(geoip.country_name);
-	if (tmp == NULL) { esc_country_name[0] = '\0'; }
-	else { strncpy(esc_country_name, tmp, sizeof(esc_country_name) - 1); esc_country_name[sizeof(esc_country_name) - 1] = '\0'; }
-
-	tmp = pgsql_escstr(geoip.region_code);
-	if (tmp == NULL) { esc_region[0] = '\0'; }
-	else { strncpy(esc_region, tmp, sizeof(esc_region) - 1); esc_region[sizeof(esc_region) - 1] = '\0'; }
-
-	tmp = pgsql_escstr(geoip.region_name);
-	if (tmp == NULL) { esc_region_name[0] = '\0'; }
-	else { strncpy(esc_region_name, tmp, sizeof(esc_region_name) - 1); esc_region_name[sizeof(esc_region_name) - 1] = '\0'; }
-
-	tmp = pgsql_escstr(geoip.city);
-	if (tmp == NULL) { esc_city[0] = '\0'; }
-	else { strncpy(esc_city, tmp, sizeof(esc_city) - 1); esc_city[sizeof(esc_city) - 1] = '\0'; }
-
-	tmp = pgsql_escstr(geoip.postal_code);
-	if (tmp == NULL) { esc_postal[0] = '\0'; }
-	else { strncpy(esc_postal, tmp, sizeof(esc_postal) - 1); esc_postal[sizeof(esc_postal) - 1] = '\0'; }
-
-	tmp = pgsql_escstr(geoip.timezone);
-	if (tmp == NULL) { esc_timezone[0] = '\0'; }
-	else { strncpy(esc_timezone, tmp, sizeof(esc_timezone) - 1); esc_timezone[sizeof(esc_timezone) - 1] = '\0'; }
-
-	tmp = pgsql_escstr(geoip.ip_type);
-	if (tmp == NULL) { esc_ip_type[0] = '\0'; }
-	else { strncpy(esc_ip_type, tmp, sizeof(esc_ip_type) - 1); esc_ip_type[sizeof(esc_ip_type) - 1] = '\0'; }
-
-	tmp = pgsql_escstr(geoip.isp);
-	if (tmp == NULL) { esc_isp[0] = '\0'; }
-	else { strncpy(esc_isp, tmp, sizeof(esc_isp) - 1); esc_isp[sizeof(esc_isp) - 1] = '\0'; }
-
-	tmp = pgsql_escstr(geoip.organization);
-	if (tmp == NULL) { esc_org[0] = '\0'; }
-	else { strncpy(esc_org, tmp, sizeof(esc_org) - 1); esc_org[sizeof(esc_org) - 1] = '\0'; }
-
-	tmp = pgsql_escstr(geoip.as_org);
-	if (tmp == NULL) { esc_as_org[0] = '\0'; }
-	else { strncpy(esc_as_org, tmp, sizeof(esc_as_org) - 1); esc_as_org[sizeof(esc_as_org) - 1] = '\0'; }
-
-	tmp = pgsql_escstr(geoip.provider);
-	if (tmp == NULL) { strncpy(esc_provider, "unknown", sizeof(esc_provider) - 1); }
-	else { strncpy(esc_provider, tmp, sizeof(esc_provider) - 1); }
-	esc_provider[sizeof(esc_provider) - 1] = '\0';
+	if (lret != 0) {
+		return 0; /* Lookup failed or not found - not an error */
+	}
 
-	tmp = pgsql_escstr(geoip.db_version);
-	if (tmp == NULL) { esc_db_version[0] = '\0'; }
-	else { strncpy(esc_db_version, tmp, sizeof(esc_db_version) - 1); esc_db_version[sizeof(esc_db_version) - 1] = '\0'; }
+	pend_begin(PGS_GEOIP | PEND_NEEDHOST);
+	pend_inet4(host_ip);
+	pend_int8(scan_id);
+	pend_text(geoip.country_code);
+	pend_text(geoip.country_name);
+	pend_text(geoip.region_code);
+	pend_text(geoip.region_name);
+	pend_text(geoip.city);
+	pend_text(geoip.postal_code);
 
-	/* Format lat/long (handle NAN) */
+	/* lat/long and the numbers below are NULL when the provider has none */
 	if (isnan(geoip.latitude)) {
-		strncpy(lat_str, "NULL", sizeof(lat_str));
+		pend_put(NULL, -1);
 	} else {
-		snprintf(lat_str, sizeof(lat_str), "%.6f", geoip.latitude);
+		pend_float8(geoip.latitude);
 	}
 	if (isnan(geoip.longitude)) {
-		strncpy(lon_str, "NULL", sizeof(lon_str));
+		pend_put(NULL, -1);
 	} else {
-		snprintf(lon_str, sizeof(lon_str), "%.6f", geoip.longitude);
+		pend_float8(geoip.longitude);
 	}
+	pend_text(geoip.timezone);
 
-	/* Format ASN and confidence */
-	if (geoip.asn > 0) {
-		snprintf(asn_str, sizeof(asn_str), "%u", geoip.asn);
+	pend_text(geoip.ip_type);
+	pend_text(geoip.isp);
+	pend_text(geoip.organization);
+	/* asn is an int4 column, 32 bit ASNs past its range are left out */
+	if (geoip.asn > 0 && geoip.asn <= 0x7fffffff) {
+		pend_int4(geoip.asn);
 	} else {
-		strncpy(asn_str, "NULL", sizeof(asn_str));
+		pend_put(NULL, -1);
 	}
+	pend_text(geoip.as_org);
+
+	pend_text(geoip.provider);
+	pend_text(geoip.db_version);
 	if (geoip.confidence >= 0) {
-		snprintf(conf_str, sizeof(conf_str), "%d", geoip.confidence);
+		pend_int2((uint16_t)geoip.confidence);
 	} else {
-		strncpy(conf_str, "NULL", sizeof(conf_str));
-	}
-
-	snprintf(querybuf2, sizeof(querybuf2) - 1,
-		"INSERT INTO uni_geoip ("
-		"  host_ip, scan_id, "
-		"  country_code, country_name, region_code, region_name, city, postal_code, "
-		"  latitude, longitude, timezone, "
-		"  ip_type, isp, organization, asn, as_org, "
-		"  provider, database_version, confidence"
-		") VALUES ("
-		"  '%s', %llu, "
-		"  NULLIF('%s',''), NULLIF('%s',''), NULLIF('%s',''), NULLIF('%s',''), NULLIF('%s',''), NULLIF('%s',''), "
-		"  %s, %s, NULLIF('%s',''), "
-		"  NULLIF('%s',''), NULLIF('%s',''), NULLIF('%s',''), %s, NULLIF('%s',''), "
-		"  '%s', NULLIF('%s',''), %s"
-		") ON CONFLICT (host_ip, scan_id) DO NOTHING;",
-		esc_host,
-		scan_id,
-		esc_country,
-		esc_country_name,
-		esc_region,
-		esc_region_name,
-		esc_city,
-		esc_postal,
-		lat_str, lon_str,
-		esc_timezone,
-		esc_ip_type,
-		esc_isp,
-		esc_org,
-		asn_str,
-		esc_as_org,
-		esc_provider,
-		esc_db_version,
-		conf_str
-	);
-
-	res = PQexec(pgconn, querybuf2);
-	if (PQresultStatus(res) == PGRES_COMMAND_OK) {
-		ret = 1;
-	}
-	else {
-		DBG(M_MOD, "uni_geoip insert failed: %s", PQerrorMessage(pgconn));
+		pend_put(NULL, -1);
 	}
 
-	PQclear(res);
-	return ret;
+	return 1;
 }
 
 void pgsql_database_init(void);
@@ -1515,7 +1351,7 @@ void pgsql_database_init(void) {
 	const char *mode_str_ptr, *target_str_ptr;
 	uint8_t mode_flags;
 	long long int est_e_time=0;
-	int schema_exists, current_version;
+	int schema_exists, current_version, ret=0;
 
 	grab_keyvals(_m);
 
@@ -1559,6 +1395,38 @@ void pgsql_database_init(void) {
 		if (strcmp(kv->key, "geoip_asndb") == 0) {
 			scan_setgeoipasndb(kv->value);
 		}
+		/* bulk load thresholds, KB buffered and ms a row may wait */
+		if (strcmp(kv->key, "copybuf") == 0) {
+			unsigned int kb=0;
+
+			if (sscanf(kv->value, "%u", &kb) != 1 || kb < 16 || kb > 256 * 1024) {
+				ERR("copybuf `%s' is not between 16 and %u KB, using %u", kv->value, 256 * 1024, COPY_DEFMAX);
+			}
+			else {
+				copy_max=(size_t)kb * 1024;
+			}
+		}
+		if (strcmp(kv->key, "copydelay") == 0) {
+			if (sscanf(kv->value, "%u", &copy_delay) != 1) {
+				ERR("copydelay `%s' is not a number of milliseconds, using %u", kv->value, COPY_DEFDELAY);
+				copy_delay=COPY_DEFDELAY;
+			}
+		}
+		/* how far the writer thread may fall behind, KB */
+		if (strcmp(kv->key, "queuebuf") == 0) {
+			unsigned int kb=0;
+
+			if (sscanf(kv->value, "%u", &kb) != 1 || kb < 64 || kb > 4096 * 1024) {
+				ERR("queuebuf `%s' is not between 64 and %u KB, using %u", kv->value, 4096 * 1024, QUEUE_DEFMAX);
+			}
+			else {
+				wq_max=(size_t)kb * 1024;
+			}
+		}
+	}
+
+	if (wq_max < copy_max) {
+		wq_max=copy_max;
 	}
 
 	if (connstr == NULL) {
@@ -1805,6 +1673,32 @@ void pgsql_database_init(void) {
 	}
 	PQclear(pgres);
 
+	/* results are written from their own thread, on their own connection */
+	wconn=PQconnectdb(connstr);
+	if (wconn == NULL || PQstatus(wconn) != CONNECTION_OK) {
+		ERR("PostgreSQL writer connection fails: %s",
+			wconn == NULL ? "unknown" : PQerrorMessage(wconn)
+		);
+		pgsql_disable=1;
+		return;
+	}
+
+	if (pgsql_prepare() < 0) {
+		pgsql_disable=1;
+		return;
+	}
+
+	wr_stop=0;
+	wr_failed=0;
+	wr_lost=0;
+	ret=pthread_create(&wr_thread, NULL, &pgsql_writer, NULL);
+	if (ret != 0) {
+		ERR("cant start PostgreSQL writer thread: %s", strerror(ret));
+		pgsql_disable=1;
+		return;
+	}
+	wr_running=1;
+
 	/* Insert phase data for compound mode scans */
 	if (s->num_phases > 1 && s->phases != NULL) {
 		if (!pgsql_insert_phases(pgscanid, s)) {
@@ -1830,6 +1724,8 @@ int send_output(const void *p) {
 		const trace_path_report_t *tpr;
 	} d_u;
 
+	int ret=1;
+
 	d_u.p=p;
 
 	if (pgsql_disable || pgconn == NULL) {
@@ -1859,15 +1755,15 @@ int send_output(const void *p) {
 			break;
 
 		case IP_REPORT_MAGIC:
-			return pgsql_dealwith_ipreport(d_u.ir);
+			ret=pgsql_dealwith_ipreport(d_u.ir);
 			break;
 
 		case ARP_REPORT_MAGIC:
-			return pgsql_dealwith_arpreport(d_u.arrrrr);
+			ret=pgsql_dealwith_arpreport(d_u.arrrrr);
 			break;
 
 		case TRACE_PATH_MAGIC:
-			return pgsql_dealwith_tracepath(d_u.tpr);
+			ret=pgsql_dealwith_tracepath(d_u.tpr);
 			break;
 
 		default:
@@ -1875,7 +1771,14 @@ int send_output(const void *p) {
 			break;
 	}
 
-	return 1;
+	if (ret > 0 && pgsql_bulk_due()) {
+		ret=pgsql_handoff(0);
+		if (ret < 0) {
+			pgsql_disable=1;
+		}
+	}
+
+	return ret;
 }
 
 static int pgsql_dealwith_sworkunit(uint32_t wid, const send_workunit_t *w) {
@@ -2073,10 +1976,8 @@ static int pgsql_dealwith_rworkunit(uint32_t wid, const recv_workunit_t *w) {
 static int pgsql_dealwith_ipreport(const ip_report_t *i) {
 	uint32_t tv_sec=0, tv_usec=0;
 	char send_addr[128], host_addr[128], trace_addr[128];
-	char eth_hwaddr_sql[40]; /* v9: "NULL" or "'xx:xx:xx:xx:xx:xx'" for INSERT */
-	char eth_hwaddr_str[32]; /* v9: "xx:xx:xx:xx:xx:xx" for helper functions */
+	char eth_hwaddr_str[32]; /* v9: "xx:xx:xx:xx:xx:xx", empty when there is none */
 	unsigned long long int ipreportid=0;
-	unsigned long long int host_id=0; /* v5: for uni_hosts */
 	struct in_addr ia;
 
 	ia.s_addr=i->send_addr;
@@ -2093,92 +1994,50 @@ static int pgsql_dealwith_ipreport(const ip_report_t *i) {
 			"%02x:%02x:%02x:%02x:%02x:%02x",
 			i->eth_hwaddr[0], i->eth_hwaddr[1], i->eth_hwaddr[2],
 			i->eth_hwaddr[3], i->eth_hwaddr[4], i->eth_hwaddr[5]);
-		snprintf(eth_hwaddr_sql, sizeof(eth_hwaddr_sql), "'%s'", eth_hwaddr_str);
-	} else {
-		strcpy(eth_hwaddr_sql, "NULL");
 	}
 
 	tv_sec=(uint32_t )i->recv_time.tv_sec;
 	tv_usec=(uint32_t )i->recv_time.tv_usec;
 
-	snprintf(querybuf, sizeof(querybuf) -1,
-	"insert into uni_ipreport (							\n"
-	"	\"scan_id\",		\"magic\",	\"sport\",	\"dport\",	\n"
-	"	\"proto\",		\"type\",	\"subtype\",	\"send_addr\",	\n"
-	"	\"host_addr\",		\"trace_addr\",	\"ttl\",	\"tstamp\",	\n"
-	"	\"utstamp\",		\"flags\",	\"mseq\",	\"tseq\",	\n"
-	"	\"window_size\",	\"t_tstamp\",	\"m_tstamp\",	\"eth_hwaddr\"	\n"
-	")										\n"
-	"values(									\n"
-	"	%llu,			%u,		%hu,		%hu,		\n"
-	"	%hu,			%hu,		%hu,		'%s',		\n"
-	"	'%s',			'%s',		%hu,		%u,		\n"
-	"	%u,			%hu,		%u,		%u,		\n"
-	"	%hu,			%u,		%u,		%s		\n"
-	");										\n"
-	"select currval('uni_ipreport_id_seq') as ipreportid;				\n",
-		pgscanid,		i->magic,	i->sport,	i->dport,
-		i->proto,		i->type,	i->subtype,	send_addr,
-		host_addr,		trace_addr,	i->ttl,		tv_sec,
-		tv_usec,		i->flags,	i->mseq,	i->tseq,
-		i->window_size,		i->t_tstamp,	i->m_tstamp,	eth_hwaddr_sql
-	);
-
-	pgres=PQexec(pgconn, querybuf);
-	pgret=PQresultStatus(pgres);
-	if (pgret != PGRES_TUPLES_OK) {
-		ERR("PostgreSQL scan insert id returned a strange return code %s: %s", PQresStatus(pgret), PQresultErrorMessage(pgres));
-		pgsql_disable=1;
-		return -1;
-	}
-
-	if (PQntuples(pgres) != 1) {
-		ERR("PostgreSQL returned a row count other than 1, disable");
+	ipreportid=pgsql_nextid(CB_IPREPORT);
+	if (ipreportid == 0) {
 		pgsql_disable=1;
 		return -1;
 	}
-	else {
-		char *res_ptr=NULL;
-
-		res_ptr=PQgetvalue(pgres, 0, 0);
 
-		if (res_ptr == NULL) {
-			ERR("database returned NULL result pointer, disable");
-			pgsql_disable=1;
-			return -1;
-		}
-
-		if (sscanf(res_ptr, "%llu", &ipreportid) != 1) {
-			ERR("malformed pgscanid from database");
-			pgsql_disable=1;
-			return -1;
-		}
-	}
-	PQclear(pgres);
+	cb_printf(CB_IPREPORT,
+		"%llu\t%llu\t%u\t%hu\t%hu\t"
+		"%hu\t%hu\t%hu\t%s\t%s\t"
+		"%s\t%hu\t%u\t%u\t%hu\t"
+		"%u\t%u\t%hu\t%u\t%u\t"
+		"%s\n",
+		ipreportid,		pgscanid,	i->magic,	i->sport,	i->dport,
+		i->proto,		i->type,	i->subtype,	send_addr,	host_addr,
+		trace_addr,		i->ttl,		tv_sec,		tv_usec,	i->flags,
+		i->mseq,		i->tseq,	i->window_size,	i->t_tstamp,	i->m_tstamp,
+		i->eth_hwaddr_valid ? eth_hwaddr_str : "\\N"
+	);
 
 	/*
 	 * v5: Populate uni_hosts and uni_host_scans for frontend support
-	 * Call fn_upsert_host() to insert/update host record
+	 * Call fn_upsert_host() to insert/update host record and link it to this scan
 	 * v9: Pass MAC address if captured from local network response
 	 */
-	host_id = pgsql_upsert_host(host_addr, i->eth_hwaddr_valid ? eth_hwaddr_str : NULL);
-	if (host_id > 0) {
-		/* Link host to this scan */
-		pgsql_insert_host_scan(host_id, pgscanid);
+	pgsql_upsert_host(i->host_addr, i->eth_hwaddr_valid ? i->eth_hwaddr : NULL, pgscanid);
 
-		/*
-		 * v6: Perform GeoIP lookup and store results
-		 * Only done once per host per scan due to UNIQUE constraint
-		 */
-		pgsql_insert_geoip(pgscanid, host_addr);
+	/*
+	 * v6: Perform GeoIP lookup and store results
+	 * Only done once per host per scan due to UNIQUE constraint
+	 * it and the mac history row are queued behind the host, and dropped if that fails
+	 */
+	pgsql_insert_geoip(pgscanid, i->host_addr);
 
-		/*
-		 * v9: Record MAC<->IP association in history table if MAC is available
-		 * This enables temporal tracking of address relationships for local network hosts
-		 */
-		if (i->eth_hwaddr_valid) {
-			pgsql_record_mac_ip(host_addr, eth_hwaddr_str, pgscanid);
-		}
+	/*
+	 * v9: Record MAC<->IP association in history table if MAC is available
+	 * This enables temporal tracking of address relationships for local network hosts
+	 */
+	if (i->eth_hwaddr_valid) {
+		pgsql_record_mac_ip(i->host_addr, i->eth_hwaddr, pgscanid, 1);
 	}
 
 	/*
@@ -2195,36 +2054,19 @@ static int pgsql_dealwith_ipreport(const ip_report_t *i) {
 	 */
 	if (i->doff > 0) {
 		const void *packet=NULL;
-		size_t packet_len=i->doff, packet_strlen=0;
+		size_t packet_len=i->doff;
 		union {
 			const void *p;
 			const ip_report_t *i;
 		} d_u;
-		char *packet_str=NULL;
 
 		d_u.i=i;
 
 		d_u.i++;
 		packet=d_u.p;
 
-		packet_str=(char *)PQescapeBytea(packet, packet_len, &packet_strlen);
-
-		snprintf(querybuf, sizeof(querybuf) -1,
-			"insert into uni_ippackets (\"ipreport_id\", \"packet\") values(%llu, '%s');",
-			ipreportid, packet_str
-		);
-
-		pgres=PQexec(pgconn, querybuf);
-
-		pgret=PQresultStatus(pgres);
-		if (pgret != PGRES_COMMAND_OK) {
-			ERR("PostgreSQL insert returned a strange return code %s: %s", PQresStatus(pgret), PQresultErrorMessage(pgres));
-			pgsql_disable=1;
-			return -1;
-		}
-		PQclear(pgres);
-
-		free(packet_str); /* not from xfree */
+		cb_printf(CB_IPPACKETS, "%llu\t", ipreportid);
+		cb_putbytea(CB_IPPACKETS, (const uint8_t *)packet, packet_len);
 	}
 
 	CLEAR(db_banner);
@@ -2233,40 +2075,24 @@ static int pgsql_dealwith_ipreport(const ip_report_t *i) {
 	fifo_walk(i->od_q, database_walk_func);
 
 	if (strlen(db_banner)) {
-		snprintf(querybuf, sizeof(querybuf) -1,
-			"insert into uni_ipreportdata (ipreport_id, type, data) values(%llu, 1, '%s');", ipreportid, pgsql_escstr(db_banner));
-                pgres=PQexec(pgconn, querybuf);
-                pgret=PQresultStatus(pgres);
-                if (pgret != PGRES_COMMAND_OK) {
-                        ERR("PostgreSQL banner insert returned a strange return code %s: %s", PQresStatus(pgret), PQresultErrorMessage(pgres));
-                        pgsql_disable=1;
-                        return -1;
-                }
-                PQclear(pgres);
+		cb_printf(CB_IPDATA, "%llu\t1\t", ipreportid);
+		cb_putstr(CB_IPDATA, db_banner);
 
 		/*
 		 * v5: Also insert into uni_services with parsed banner data
 		 */
-		pgsql_insert_service(ipreportid, pgscanid, host_addr, i->dport, i->proto, db_banner);
-        }
-
-        if (strlen(db_os)) {
-                CLEAR(querybuf);
-                snprintf(querybuf, sizeof(querybuf) -1, "insert into uni_ipreportdata (ipreport_id, type, data) values(%llu, 2, '%s');", ipreportid, pgsql_escstr(db_os));
-                pgres=PQexec(pgconn, querybuf);
-                pgret=PQresultStatus(pgres);
-                if (pgret != PGRES_COMMAND_OK) {
-                        ERR("PostgreSQL banner insert returned a strange return code %s: %s", PQresStatus(pgret), PQresultErrorMessage(pgres));
-                        pgsql_disable=1;
-                        return -1;
-                }
-                PQclear(pgres);
+		pgsql_insert_service(ipreportid, pgscanid, i->host_addr, i->dport, i->proto, db_banner);
+	}
+
+	if (strlen(db_os)) {
+		cb_printf(CB_IPDATA, "%llu\t2\t", ipreportid);
+		cb_putstr(CB_IPDATA, db_os);
 
 		/*
 		 * v5: Also insert into uni_os_fingerprints with parsed OS data
 		 */
-		pgsql_insert_os_fingerprint(ipreportid, pgscanid, host_addr, db_os, i->ttl, i->window_size);
-        }
+		pgsql_insert_os_fingerprint(ipreportid, pgscanid, i->host_addr, db_os, i->ttl, i->window_size);
+	}
 
 	return 1;
 }
@@ -2279,7 +2105,6 @@ static int pgsql_dealwith_arpreport(const arp_report_t *a) {
 	char host_addr[128], hwaddr[32];
 	struct in_addr ia;
 	long long unsigned int arpreportid=0;
-	unsigned long long int host_id=0; /* v5: for uni_hosts */
 
 	ia.s_addr=a->ipaddr;
 
@@ -2294,103 +2119,47 @@ static int pgsql_dealwith_arpreport(const arp_report_t *a) {
 	tv_sec=(uint32_t )a->recv_time.tv_sec;
 	tv_usec=(uint32_t )a->recv_time.tv_usec;
 
-	snprintf(querybuf, sizeof(querybuf) -1,
-	"insert into uni_arpreport (							\n"
-	"	\"scan_id\",		\"magic\",	\"host_addr\",	\"hwaddr\",	\n"
-	"	\"tstamp\",		\"utstamp\"					\n"
-	")										\n"
-	"values(									\n"
-	"	%llu,			%u,		'%s',		'%s',		\n"
-	"	%u,			%u						\n"
-	");										\n"
-	"select currval('uni_arpreport_id_seq') as arpreportid;				\n",
-		pgscanid,		a->magic,	host_addr,	hwaddr,
-		tv_sec,			tv_usec
-	);
-
-	pgres=PQexec(pgconn, querybuf);
-	pgret=PQresultStatus(pgres);
-	if (pgret != PGRES_TUPLES_OK) {
-		ERR("PostgreSQL scan insert id returned a strange return code %s: %s", PQresStatus(pgret), PQresultErrorMessage(pgres));
-		pgsql_disable=1;
-		return -1;
-	}
-
-	if (PQntuples(pgres) != 1) {
-		ERR("PostgreSQL returned a row count other than 1, disable");
+	arpreportid=pgsql_nextid(CB_ARPREPORT);
+	if (arpreportid == 0) {
 		pgsql_disable=1;
 		return -1;
 	}
-	else {
-		char *res_ptr=NULL;
-
-		res_ptr=PQgetvalue(pgres, 0, 0);
-
-		if (res_ptr == NULL) {
-			ERR("database returned NULL result pointer, disable");
-			pgsql_disable=1;
-			return -1;
-		}
 
-		if (sscanf(res_ptr, "%llu", &arpreportid) != 1) {
-			ERR("malformed pgscanid from database");
-			pgsql_disable=1;
-			return -1;
-		}
-	}
-	PQclear(pgres);
+	cb_printf(CB_ARPREPORT, "%llu\t%llu\t%u\t%s\t%s\t%u\t%u\n",
+		arpreportid,	pgscanid,	a->magic,	host_addr,	hwaddr,
+		tv_sec,		tv_usec
+	);
 
 	/*
 	 * v5: Populate uni_hosts and uni_host_scans for frontend support
 	 * ARP reports have MAC addresses - use IP+MAC for host identity
 	 */
-	host_id = pgsql_upsert_host(host_addr, hwaddr);
-	if (host_id > 0) {
-		/* Link host to this scan */
-		pgsql_insert_host_scan(host_id, pgscanid);
-	}
+	pgsql_upsert_host(a->ipaddr, a->hwaddr, pgscanid);
 
 	/*
 	 * v8: Record MAC<->IP association in history table
 	 * This enables temporal tracking of address relationships
 	 */
-	pgsql_record_mac_ip(host_addr, hwaddr, pgscanid);
+	pgsql_record_mac_ip(a->ipaddr, a->hwaddr, pgscanid, 0);
 
 	/*
 	 * trust problem
 	 */
 	if (a->doff > 0) {
 		const void *packet=NULL;
-		size_t packet_len=a->doff, packet_strlen=0;
+		size_t packet_len=a->doff;
 		union {
 			const void *p;
 			const arp_report_t *a;
 		} d_u;
-		char *packet_str=NULL;
 
 		d_u.a=a;
 
 		d_u.a++;
 		packet=d_u.p;
 
-		packet_str=(char *)PQescapeBytea(packet, packet_len, &packet_strlen);
-
-		snprintf(querybuf, sizeof(querybuf) -1,
-			"insert into uni_arppackets (\"arpreport_id\", \"packet\") values(%llu, '%s');",
-			arpreportid, packet_str
-		);
-
-		pgres=PQexec(pgconn, querybuf);
-
-		pgret=PQresultStatus(pgres);
-		if (pgret != PGRES_COMMAND_OK) {
-			ERR("PostgreSQL insert returned a strange return code %s: %s", PQresStatus(pgret), PQresultErrorMessage(pgres));
-			pgsql_disable=1;
-			return -1;
-		}
-		PQclear(pgres);
-
-		free(packet_str); /* not from xfree */
+		cb_printf(CB_ARPPACKETS, "%llu\t", arpreportid);
+		cb_putbytea(CB_ARPPACKETS, (const uint8_t *)packet, packet_len);
 	}
 
 	return 1;
@@ -2401,13 +2170,13 @@ static int pgsql_dealwith_arpreport(const arp_report_t *a) {
  * Copyright (C) 2026 Robert E. Lee <robert@unicornscan.org>
  *
  * trace_path_report contains ordered hop array with hop_number and rtt_us.
- * we insert each hop as a row, using NULL for ipreport_id since trace paths
+ * each hop becomes a row, using NULL for ipreport_id since trace paths
  * are reported as a batch rather than per-report.
  */
 static int pgsql_dealwith_tracepath(const trace_path_report_t *t) {
 	struct in_addr ia;
 	char target_addr[64], hop_addr[64];
-	int j=0, inserted=0;
+	int j=0;
 
 	if (t == NULL) {
 		ERR("null tracepath report");
@@ -2435,44 +2204,75 @@ static int pgsql_dealwith_tracepath(const trace_path_report_t *t) {
 	DBG(M_MOD, "inserting tracepath to %s port %u: %u hops", target_addr, t->target_port, t->hop_count);
 
 	/*
-	 * insert each hop in the path.
+	 * one row per hop in the path.
 	 * ipreport_id is NULL since trace paths are batched.
 	 */
 	for (j=0; j < t->hop_count; j++) {
-		PGresult *res=NULL;
-
 		ia.s_addr=t->hops[j].router_addr;
 		inet_ntop(AF_INET, &ia, hop_addr, sizeof(hop_addr));
 
-		snprintf(querybuf2, sizeof(querybuf2)-1,
-			"INSERT INTO uni_hops (scan_id, target_addr, hop_addr, hop_number, ttl_observed, rtt_us) "
-			"VALUES (%llu, '%s', '%s', %u, %u, %u);",
+		cb_printf(CB_HOPS, "\\N\t%llu\t%s\t%s\t%u\t%u\t%u\n",
 			pgscanid, target_addr, hop_addr,
 			t->hops[j].hop_number,
 			t->hops[j].hop_number,	/* ttl_observed = hop_number for trace paths */
 			t->hops[j].rtt_us
 		);
-
-		res=PQexec(pgconn, querybuf2);
-		if (PQresultStatus(res) == PGRES_COMMAND_OK) {
-			inserted++;
-		}
-		else {
-			ERR("uni_hops insert failed for hop %u: %s", j, PQerrorMessage(pgconn));
-		}
-		PQclear(res);
 	}
 
-	DBG(M_MOD, "inserted %d/%u hops for tracepath to %s", inserted, t->hop_count, target_addr);
+	DBG(M_MOD, "queued %u hops for tracepath to %s", t->hop_count, target_addr);
 
 	return 1;
 }
 
 void pgsql_database_fini(void) {
+	int j=0;
 
-	if (pgsql_disable) {
-		return;
-	}
+	if (wr_running) {
+		/* hand over what is still open, the writer drains the queue before it exits */
+		if (pgsql_disable == 0 && pgsql_handoff(1) < 0) {
+			pgsql_disable=1;
+		}
+
+		pthread_mutex_lock(&wr_lock);
+		wr_stop=1;
+		pthread_cond_signal(&wr_cond);
+		pthread_mutex_unlock(&wr_lock);
+
+		pthread_join(wr_thread, NULL);
+		wr_running=0;
+
+		if (wr_failed) {
+			ERR("PostgreSQL writer failed, %llu bytes of results were not stored", (unsigned long long int)wr_lost);
+			pgsql_disable=1;
+		}
+
+		if (wq_spare != NULL) {
+			pgsql_batch_free(wq_spare);
+			wq_spare=NULL;
+		}
+
+		PQfinish(wconn);
+		wconn=NULL;
+	}
+
+	for (j=0; j < CB_MAX; j++) {
+		if (copybufs[j].buf != NULL) {
+			xfree(copybufs[j].buf);
+			copybufs[j].buf=NULL;
+		}
+		copybufs[j].len=0;
+		copybufs[j].size=0;
+	}
+	if (pend_buf != NULL) {
+		xfree(pend_buf);
+		pend_buf=NULL;
+	}
+	pend_len=pend_size=0;
+	pend_cnt=0;
+
+	if (pgsql_disable) {
+		return;
+	}
 
 	snprintf(querybuf, sizeof(querybuf) -1, "update uni_scan set e_time=%lld where scan_id=%llu;",
 		(long long int )s->e_time,
@@ -2510,14 +2310,15 @@ static void database_walk_func(void *data) {
 
 	switch (d_u.o->type) {
 
+		/* kept raw, the COPY and insert paths each escape for themselves */
 		case OD_TYPE_BANNER:
 			CLEAR(db_banner);
-			snprintf(db_banner, sizeof(db_banner) -1, "%s", pgsql_escstr(d_u.o->t_u.banner));
+			snprintf(db_banner, sizeof(db_banner) -1, "%s", d_u.o->t_u.banner);
 			break;
 
 		case OD_TYPE_OS:
 			CLEAR(db_os);
-			snprintf(db_os, sizeof(db_os) -1, "%s", pgsql_escstr(d_u.o->t_u.os));
+			snprintf(db_os, sizeof(db_os) -1, "%s", d_u.o->t_u.os);
 			break;
 
 		default:
@@ -2558,3 +2359,748 @@ static char *pgsql_escstr(const char *in) {
 
 	return outstr;
 }
+
+static void cb_grow(copybuf_t *cb, size_t need) {
+
+	if (cb->len + need <= cb->size) {
+		return;
+	}
+
+	if (cb->size == 0) {
+		cb->size=64 * 1024;
+	}
+	while (cb->len + need > cb->size) {
+		cb->size *= 2;
+	}
+	cb->buf=(char *)xrealloc(cb->buf, cb->size);
+
+	return;
+}
+
+static void cb_mark(size_t added) {
+
+	if (copy_total == 0) {
+		clock_gettime(CLOCK_MONOTONIC, &copy_first);
+	}
+	copy_total += added;
+
+	return;
+}
+
+static void cb_printf(int which, const char *fmt, ...) {
+	copybuf_t *cb=&copybufs[which];
+	va_list ap;
+	int len=0;
+
+	va_start(ap, fmt);
+	len=vsnprintf(NULL, 0, fmt, ap);
+	va_end(ap);
+
+	if (len < 0) {
+		return;
+	}
+
+	cb_grow(cb, (size_t)len + 1);
+
+	va_start(ap, fmt);
+	vsnprintf(cb->buf + cb->len, cb->size - cb->len, fmt, ap);
+	va_end(ap);
+
+	cb->len += (size_t)len;
+	cb_mark((size_t)len);
+
+	return;
+}
+
+/* a text column in COPY text format, always the last one of a row */
+static void cb_putstr(int which, const char *str) {
+	copybuf_t *cb=&copybufs[which];
+	size_t start=0, slen=0, j=0;
+	char *out=NULL;
+
+	slen=strlen(str);
+	/* worst case every byte becomes \ooo, plus the newline */
+	cb_grow(cb, (slen * 4) + 1);
+
+	start=cb->len;
+	out=cb->buf + cb->len;
+	for (j=0; j < slen; j++) {
+		unsigned char c=(unsigned char)str[j];
+
+		if (c == '\\') {
+			*out++='\\';
+			*out++='\\';
+		}
+		else if (c < 0x20 || c == 0x7f) {
+			*out++='\\';
+			*out++=(char)('0' + ((c >> 6) & 7));
+			*out++=(char)('0' + ((c >> 3) & 7));
+			*out++=(char)('0' + (c & 7));
+		}
+		else {
+			*out++=(char)c;
+		}
+	}
+	*out++='\n';
+
+	cb->len=(size_t)(out - cb->buf);
+	cb_mark(cb->len - start);
+
+	return;
+}
+
+/* a bytea column as \\x hex, always the last one of a row */
+static void cb_putbytea(int which, const uint8_t *data, size_t len) {
+	static const char hex[]="0123456789abcdef";
+	copybuf_t *cb=&copybufs[which];
+	char *out=NULL;
+	size_t j=0;
+
+	cb_grow(cb, (len * 2) + 4);
+
+	out=cb->buf + cb->len;
+	*out++='\\';
+	*out++='\\';
+	*out++='x';
+	for (j=0; j < len; j++) {
+		*out++=hex[data[j] >> 4];
+		*out++=hex[data[j] & 0xf];
+	}
+	*out++='\n';
+
+	cb->len += (len * 2) + 4;
+	cb_mark((len * 2) + 4);
+
+	return;
+}
+
+/*
+ * report ids, handed out from blocks taken off the table's sequence so rows
+ * that reference a report can be written before the report itself is sent
+ */
+static unsigned long long int pgsql_nextid(int which) {
+	static unsigned long long int ids[2][IDBLOCK];
+	static unsigned int pos[2]={ 0, 0 }, cnt[2]={ 0, 0 };
+	PGresult *res=NULL;
+	unsigned int j=0, k=0;
+
+	k=(which == CB_IPREPORT ? 0 : 1);
+
+	if (pos[k] < cnt[k]) {
+		return ids[k][pos[k]++];
+	}
+
+	snprintf(querybuf2, sizeof(querybuf2) -1, "select nextval('%s') from generate_series(1, %u);",
+		k == 0 ? "uni_ipreport_id_seq" : "uni_arpreport_id_seq", IDBLOCK);
+
+	res=PQexec(pgconn, querybuf2);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) != IDBLOCK) {
+		ERR("PostgreSQL report id allocation fails: %s", PQresultErrorMessage(res));
+		PQclear(res);
+		return 0;
+	}
+
+	for (j=0; j < IDBLOCK; j++) {
+		if (sscanf(PQgetvalue(res, (int)j, 0), "%llu", &ids[k][j]) != 1) {
+			ERR("malformed report id from database");
+			PQclear(res);
+			return 0;
+		}
+	}
+	PQclear(res);
+
+	pos[k]=0;
+	cnt[k]=IDBLOCK;
+
+	return ids[k][pos[k]++];
+}
+
+static void pend_grow(size_t need) {
+
+	if (pend_len + need <= pend_size) {
+		return;
+	}
+
+	if (pend_size == 0) {
+		pend_size=16 * 1024;
+	}
+	while (pend_len + need > pend_size) {
+		pend_size *= 2;
+	}
+	pend_buf=(char *)xrealloc(pend_buf, pend_size);
+
+	return;
+}
+
+static void pend_begin(int which) {
+
+	pend_grow(1);
+	pend_buf[pend_len++]=(char)which;
+	pend_cnt++;
+	cb_mark(1);
+
+	return;
+}
+
+static void pend_put(const void *data, int32_t len) {
+	size_t need=0;
+
+	need=sizeof(len) + (len > 0 ? (size_t)len : 0);
+	pend_grow(need);
+
+	memcpy(pend_buf + pend_len, &len, sizeof(len));
+	if (len > 0) {
+		memcpy(pend_buf + pend_len + sizeof(len), data, (size_t)len);
+	}
+	pend_len += need;
+	cb_mark(need);
+
+	return;
+}
+
+static void pend_int8(uint64_t val) {
+	uint32_t w[2];
+
+	w[0]=htonl((uint32_t)(val >> 32));
+	w[1]=htonl((uint32_t)val);
+	pend_put(w, 8);
+
+	return;
+}
+
+static void pend_int4(uint32_t val) {
+
+	val=htonl(val);
+	pend_put(&val, 4);
+
+	return;
+}
+
+static void pend_int2(uint16_t val) {
+
+	val=htons(val);
+	pend_put(&val, 2);
+
+	return;
+}
+
+static void pend_float8(double val) {
+	uint64_t bits=0;
+
+	memcpy(&bits, &val, sizeof(bits));
+	pend_int8(bits);
+
+	return;
+}
+
+static void pend_text(const char *str) {
+
+	pend_put(str, (int32_t)strlen(str));
+
+	return;
+}
+
+/* family (PGSQL_AF_INET), bits, is_cidr, address length, address */
+static void pend_inet4(uint32_t addr) {
+	uint8_t in[8];
+
+	in[0]=2;
+	in[1]=32;
+	in[2]=0;
+	in[3]=4;
+	memcpy(&in[4], &addr, sizeof(addr));
+	pend_put(in, sizeof(in));
+
+	return;
+}
+
+static void pend_mac(const uint8_t *mac) {
+
+	pend_put(mac, 6);
+
+	return;
+}
+
+static int pgsql_prepare(void) {
+	PGresult *res=NULL;
+	int j=0;
+
+	for (j=0; j < PGS_MAX; j++) {
+		res=PQprepare(wconn, pgsql_stmts[j].name, pgsql_stmts[j].sql, pgsql_stmts[j].nparams, pgsql_stmts[j].types);
+		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+			ERR("PostgreSQL prepare of `%s' fails: %s", pgsql_stmts[j].name, PQresultErrorMessage(res));
+			PQclear(res);
+			return -1;
+		}
+		PQclear(res);
+	}
+
+	return 1;
+}
+
+static int pgsql_bulk_due(void) {
+	struct timespec now;
+	uint64_t waited=0;
+
+	if (copy_total == 0) {
+		return 0;
+	}
+	if (copy_total >= copy_max) {
+		return 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	waited=((uint64_t)(now.tv_sec - copy_first.tv_sec) * 1000) + (uint64_t)((now.tv_nsec - copy_first.tv_nsec) / 1000000);
+
+	return waited >= copy_delay ? 1 : 0;
+}
+
+static int pgsql_copy(int which, const char *buf, size_t len) {
+	const char *copy=copybufs[which].copy;
+	PGresult *res=NULL;
+	int ret=1;
+
+	res=PQexec(wconn, copy);
+	if (PQresultStatus(res) != PGRES_COPY_IN) {
+		ERR("PostgreSQL `%s' fails: %s", copy, PQresultErrorMessage(res));
+		PQclear(res);
+		return -1;
+	}
+	PQclear(res);
+
+	if (PQputCopyData(wconn, buf, (int)len) != 1) {
+		ERR("PostgreSQL copy data fails: %s", PQerrorMessage(wconn));
+		PQputCopyEnd(wconn, "client side failure");
+		ret=-1;
+	}
+	else if (PQputCopyEnd(wconn, NULL) != 1) {
+		ERR("PostgreSQL copy end fails: %s", PQerrorMessage(wconn));
+		ret=-1;
+	}
+
+	while ((res=PQgetResult(wconn)) != NULL) {
+		if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+			if (ret > 0) {
+				ERR("PostgreSQL `%s' fails: %s", copy, PQresultErrorMessage(res));
+			}
+			ret=-1;
+		}
+		PQclear(res);
+	}
+
+	return ret;
+}
+
+static int pgsql_exec_cmd(const char *cmd) {
+	PGresult *res=NULL;
+	int ret=1;
+
+	res=PQexec(wconn, cmd);
+	if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+		ERR("PostgreSQL `%s' fails: %s", cmd, PQresultErrorMessage(res));
+		ret=-1;
+	}
+	PQclear(res);
+
+	return ret;
+}
+
+#ifdef LIBPQ_HAS_PIPELINING
+#define PIPE_READ	64	/* statements sent between looks at the results */
+
+/*
+ * collects pipeline results until every sent statement's sync has come
+ * back, or with wait == 0 until no more are ready.  the socket is polled
+ * for write too, the statements go out non blocking and the server can
+ * not take more of them while its own results are sitting unread
+ */
+static int pgsql_pipe_results(unsigned int *synced, unsigned int sent, unsigned int *failed, int wait) {
+	PGresult *res=NULL;
+	struct pollfd pfd;
+
+	while (*synced < sent) {
+		if (PQconsumeInput(wconn) != 1) {
+			return -1;
+		}
+
+		if (PQisBusy(wconn)) {
+			if (wait == 0) {
+				return 1;
+			}
+			pfd.fd=PQsocket(wconn);
+			pfd.events=POLLIN;
+			pfd.revents=0;
+			switch (PQflush(wconn)) {
+				case -1:
+					return -1;
+				case 1:
+					pfd.events |= POLLOUT;
+					break;
+				default:
+					break;
+			}
+			if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+				return -1;
+			}
+			continue;
+		}
+
+		res=PQgetResult(wconn);
+		if (res == NULL) {
+			continue;
+		}
+		switch (PQresultStatus(res)) {
+			case PGRES_PIPELINE_SYNC:
+				(*synced)++;
+				break;
+			case PGRES_FATAL_ERROR:
+				DBG(M_MOD, "queued insert failed: %s", PQresultErrorMessage(res));
+				(*failed)++;
+				break;
+			case PGRES_PIPELINE_ABORTED:
+				/* rode on a host upsert that failed */
+				(*failed)++;
+				break;
+			default:
+				break;
+		}
+		PQclear(res);
+	}
+
+	return 1;
+}
+#endif
+
+/*
+ * runs the queued statements.  with a pipelining libpq they all go out
+ * before any result is read, each with its own sync so a failing row only
+ * takes itself down, the same as when each was its own PQexec.  the
+ * PEND_NEEDHOST rows share their hosts sync, the server aborts them along
+ * with it (and a failing geoip row takes the mac history row after it)
+ */
+static int pgsql_pend_run(const pgbatch_t *b) {
+	const char *values[PGS_MAXPARAM];
+	int lengths[PGS_MAXPARAM], formats[PGS_MAXPARAM];
+	const pgsql_stmt_t *st=NULL;
+	unsigned int sent=0, synced=0, failed=0;
+	size_t off=0;
+	int32_t len=0;
+	int j=0, ret=1;
+#ifndef LIBPQ_HAS_PIPELINING
+	int needhost=0, hostfail=0;
+#endif
+
+#ifdef LIBPQ_HAS_PIPELINING
+	if (PQsetnonblocking(wconn, 1) != 0 || PQenterPipelineMode(wconn) != 1) {
+		ERR("PostgreSQL pipeline mode fails: %s", PQerrorMessage(wconn));
+		return -1;
+	}
+#endif
+
+	for (off=0; off < b->pend_len;) {
+#ifndef LIBPQ_HAS_PIPELINING
+		needhost=((uint8_t)b->pend[off] & PEND_NEEDHOST) ? 1 : 0;
+#endif
+		st=&pgsql_stmts[(uint8_t)b->pend[off++] & ~PEND_NEEDHOST];
+
+		for (j=0; j < st->nparams; j++) {
+			memcpy(&len, b->pend + off, sizeof(len));
+			off += sizeof(len);
+			formats[j]=1;
+			if (len < 0) {
+				values[j]=NULL;
+				lengths[j]=0;
+			}
+			else {
+				values[j]=b->pend + off;
+				lengths[j]=len;
+				off += (size_t)len;
+			}
+		}
+
+#ifdef LIBPQ_HAS_PIPELINING
+		if (PQsendQueryPrepared(wconn, st->name, st->nparams, values, lengths, formats, 0) != 1) {
+			ret=-1;
+			break;
+		}
+		/* the next one needs this host, keep it in the same sync */
+		if (off < b->pend_len && ((uint8_t)b->pend[off] & PEND_NEEDHOST)) {
+			continue;
+		}
+		if (PQpipelineSync(wconn) != 1) {
+			ret=-1;
+			break;
+		}
+		sent++;
+		if (sent % PIPE_READ == 0 && pgsql_pipe_results(&synced, sent, &failed, 0) < 0) {
+			ret=-1;
+			break;
+		}
+#else
+		if (needhost && hostfail) {
+			failed++;
+			continue;
+		}
+		{
+			PGresult *res=NULL;
+
+			res=PQexecPrepared(wconn, st->name, st->nparams, values, lengths, formats, 0);
+			if (PQresultStatus(res) != PGRES_COMMAND_OK && PQresultStatus(res) != PGRES_TUPLES_OK) {
+				DBG(M_MOD, "queued insert failed: %s", PQresultErrorMessage(res));
+				failed++;
+				if (! needhost) {
+					hostfail=1;
+				}
+			}
+			else if (! needhost) {
+				hostfail=0;
+			}
+			PQclear(res);
+			sent++;
+			synced++;
+		}
+#endif
+	}
+
+#ifdef LIBPQ_HAS_PIPELINING
+	if (ret > 0 && pgsql_pipe_results(&synced, sent, &failed, 1) < 0) {
+		ret=-1;
+	}
+	if (ret < 0) {
+		ERR("PostgreSQL pipeline fails: %s", PQerrorMessage(wconn));
+		return -1;
+	}
+	PQexitPipelineMode(wconn);
+	PQsetnonblocking(wconn, 0);
+#endif
+
+	DBG(M_MOD, "ran %u queued statements, %u failed", synced, failed);
+
+	return ret;
+}
+
+/*
+ * writes one batch, on the writer thread: the COPYs go in one transaction,
+ * the queued statements after it commits, each on its own as they always were
+ */
+static int pgsql_bulk_flush(const pgbatch_t *b) {
+	PGresult *res=NULL;
+	size_t copied=0;
+	int j=0, ret=1;
+
+	for (j=0; j < CB_MAX; j++) {
+		copied += b->len[j];
+	}
+
+	if (copied > 0) {
+		if (pgsql_exec_cmd("begin") < 0) {
+			ret=-1;
+		}
+		for (j=0; ret > 0 && j < CB_MAX; j++) {
+			if (b->len[j] > 0 && pgsql_copy(j, b->buf[j], b->len[j]) < 0) {
+				ret=-1;
+			}
+		}
+		if (ret > 0) {
+			ret=pgsql_exec_cmd("commit");
+		}
+		else {
+			res=PQexec(wconn, "rollback");
+			PQclear(res);
+		}
+	}
+
+	if (ret > 0 && b->pend_cnt > 0) {
+		ret=pgsql_pend_run(b);
+	}
+
+	if (ret < 0) {
+		ERR("PostgreSQL bulk load fails, disabling module");
+		return -1;
+	}
+
+	return 1;
+}
+
+static void pgsql_batch_free(pgbatch_t *b) {
+	int j=0;
+
+	for (j=0; j < CB_MAX; j++) {
+		if (b->buf[j] != NULL) {
+			xfree(b->buf[j]);
+		}
+	}
+	if (b->pend != NULL) {
+		xfree(b->pend);
+	}
+	xfree(b);
+
+	return;
+}
+
+/*
+ * seals the open buffers into a batch for the writer, trading them for the
+ * spare batch's empty buffers when there is one.  with wait == 0 a full
+ * queue only makes us wait once the open buffers alone would fill it
+ */
+static int pgsql_handoff(int wait) {
+	struct timespec start, end;
+	pgbatch_t *b=NULL;
+	size_t t_size=0;
+	char *t_buf=NULL;
+	int j=0;
+
+	if (copy_total == 0) {
+		return 1;
+	}
+
+	pthread_mutex_lock(&wr_lock);
+
+	if (wr_failed == 0 && wq_bytes > 0 && wq_bytes + copy_total > wq_max) {
+		if (wait == 0 && copy_total < wq_max) {
+			pthread_mutex_unlock(&wr_lock);
+			return 1;
+		}
+
+		DBG(M_MOD, "database writer is " STFMT " bytes behind, waiting for it", wq_bytes);
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		while (wq_bytes > 0 && wr_failed == 0) {
+			pthread_cond_wait(&wr_space, &wr_lock);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		METRIC_ADD(MET_DB_STALLS, 1);
+		METRIC_ADD(MET_DB_STALL_NS, ((uint64_t)(end.tv_sec - start.tv_sec) * 1000000000) + (uint64_t)(end.tv_nsec - start.tv_nsec));
+	}
+
+	if (wr_failed) {
+		pthread_mutex_unlock(&wr_lock);
+		return -1;
+	}
+
+	b=wq_spare;
+	wq_spare=NULL;
+
+	pthread_mutex_unlock(&wr_lock);
+
+	if (b == NULL) {
+		b=(pgbatch_t *)xmalloc(sizeof(pgbatch_t));
+		memset(b, 0, sizeof(pgbatch_t));
+	}
+
+	for (j=0; j < CB_MAX; j++) {
+		t_buf=b->buf[j];
+		t_size=b->size[j];
+		b->buf[j]=copybufs[j].buf;
+		b->size[j]=copybufs[j].size;
+		b->len[j]=copybufs[j].len;
+		copybufs[j].buf=t_buf;
+		copybufs[j].size=t_size;
+		copybufs[j].len=0;
+	}
+
+	t_buf=b->pend;
+	t_size=b->pend_size;
+	b->pend=pend_buf;
+	b->pend_size=pend_size;
+	b->pend_len=pend_len;
+	b->pend_cnt=pend_cnt;
+	pend_buf=t_buf;
+	pend_size=t_size;
+	pend_len=0;
+	pend_cnt=0;
+
+	b->total=copy_total;
+	b->next=NULL;
+	copy_total=0;
+
+	pthread_mutex_lock(&wr_lock);
+
+	if (wq_tail == NULL) {
+		wq_head=b;
+	}
+	else {
+		wq_tail->next=b;
+	}
+	wq_tail=b;
+	wq_depth++;
+	wq_bytes += b->total;
+
+	METRIC_SET(MET_DBQ_DEPTH, wq_depth);
+	METRIC_SET(MET_DBQ_BYTES, wq_bytes);
+
+	pthread_cond_signal(&wr_cond);
+	pthread_mutex_unlock(&wr_lock);
+
+	return 1;
+}
+
+static void *pgsql_writer(void *unused) {
+	struct timespec start, end;
+	pgbatch_t *b=NULL;
+	uint64_t took=0;
+	int ret=0;
+
+	pthread_mutex_lock(&wr_lock);
+
+	for (;;) {
+		while (wq_head == NULL && wr_stop == 0) {
+			pthread_cond_wait(&wr_cond, &wr_lock);
+		}
+
+		if (wq_head == NULL) {
+			break;
+		}
+
+		b=wq_head;
+		wq_head=b->next;
+		if (wq_head == NULL) {
+			wq_tail=NULL;
+		}
+
+		pthread_mutex_unlock(&wr_lock);
+
+		/* once a batch is lost the rest are too, they would reference it */
+		ret=-1;
+		took=0;
+		if (wr_failed == 0) {
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			ret=pgsql_bulk_flush(b);
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			took=((uint64_t)(end.tv_sec - start.tv_sec) * 1000000000) + (uint64_t)(end.tv_nsec - start.tv_nsec);
+
+			DBG(M_MOD, "bulk flush of " STFMT " bytes took %llu ms", b->total, (unsigned long long int)(took / 1000000));
+		}
+
+		pthread_mutex_lock(&wr_lock);
+
+		if (ret < 0) {
+			wr_failed=1;
+			wr_lost += b->total;
+		}
+		else {
+			METRIC_ADD(MET_DB_FLUSHES, 1);
+			METRIC_ADD(MET_DB_FLUSH_NS, took);
+			METRIC_SET(MET_DB_FLUSH_LAST_NS, took);
+		}
+
+		wq_depth--;
+		wq_bytes -= b->total;
+		METRIC_SET(MET_DBQ_DEPTH, wq_depth);
+		METRIC_SET(MET_DBQ_BYTES, wq_bytes);
+
+		/* one emptied batch is kept so the master can swap buffers instead of allocating */
+		if (wq_spare == NULL) {
+			wq_spare=b;
+		}
+		else {
+			pgsql_batch_free(b);
+		}
+
+		pthread_cond_signal(&wr_space);
+	}
+
+	pthread_mutex_unlock(&wr_lock);
+
+	return unused;
+}
@@ -0,0 +1,683 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#include <config.h>
+
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <scan_progs/scanopts.h>
+#include <scan_progs/scan_export.h>
+
+#include <settings.h>
+#include <unilib/qfifo.h>
+#include <unilib/output.h>
+#include <unilib/xmalloc.h>
+#include <unilib/modules.h>
+
+#include "journal.h"
+
+/*
+ * appends binary result records (see journal.h) to a journal file, for
+ * post processing with unijournal or anything that can mmap a file.
+ * records are built in place in one large buffer that goes out with a
+ * single write() once full, so a scan costs a handful of syscalls.
+ * the file is only flock()ed while its tail is checked and a buffer goes
+ * out, so scans sharing a journal (daemon jobs, or separate runs) append
+ * side by side.  a buffer only ever holds whole records, and each record
+ * carries the number of the scan that wrote it, so interleaved scans can
+ * still be told apart.
+ *
+ * modules.conf:
+ *	module "journal" {
+ *		file:		"/var/tmp/unicornscan.ujrn";
+ *		bufsize:	"1024";		kilobytes
+ *	};
+ */
+
+#define JRN_DEFFILE		"unicornscan.ujrn"
+#define JRN_DEFBUF		1024		/* KB */
+#define JRN_MAXBUF		(256 * 1024)	/* KB */
+
+static int jrn_disable=0;
+static int jrn_fd=-1, jrn_locked=0;
+static char *jrn_file=NULL;
+static uint16_t jrn_scan=0;		/* ours, 1 past the last scan in the file	*/
+static size_t jrn_end=0;		/* the file is whole records up to here	*/
+static uint8_t *jrn_buf=NULL;
+static size_t jrn_bufsz=0, jrn_off=0;
+static uint64_t jrn_records=0;
+
+/* od_q walk results, the strings stay owned by the report */
+static const char *jrn_banner=NULL, *jrn_os=NULL;
+
+/* for joining the target strings into the scan record */
+static size_t target_len=0;
+static uint8_t *target_ptr=NULL;
+
+static mod_entry_t *_m=NULL;
+static const settings_t *s=NULL;
+
+void journal_init(void);
+void journal_fini(void);
+
+static int jrn_open(const char *);
+static int jrn_lock(void);
+static void jrn_unlock(void);
+static int jrn_check(size_t /* from */, uint16_t * /* last scan seen */);
+static int jrn_flush(void);
+static void *jrn_reserve(uint16_t /* JRN_REC_ */, size_t /* len */);
+static size_t jrn_put(uint8_t *, const char *, size_t);
+static void jrn_odwalk(void *);
+static void jrn_targetlen(void *);
+static void jrn_targetput(void *);
+
+int init_module(mod_entry_t *m) {
+	snprintf(m->license, sizeof(m->license) -1, "GPLv2");
+	snprintf(m->author, sizeof(m->author) -1, "jack");
+	snprintf(m->desc, sizeof(m->desc) -1, "Output to a binary result journal");
+	snprintf(m->name, sizeof(m->name) -1, "journal");
+	snprintf(m->errstr, sizeof(m->errstr) -1, "No Error");
+
+	m->iver=0x0103; /* 1.0 */
+	m->type=MI_TYPE_OUTPUT;
+
+	m->param_u.output_s.init_output=&journal_init;
+	m->param_u.output_s.fini_output=&journal_fini;
+
+	s=m->s;
+	_m=m;
+	return 1;
+}
+
+int delete_module(void) {
+
+	return 1;
+}
+
+void journal_init(void) {
+	keyval_t *kv=NULL;
+	const char *file=JRN_DEFFILE, *str[JRN_STR_MAX];
+	unsigned int bufkb=JRN_DEFBUF;
+	size_t len=0, slen[JRN_STR_MAX];
+	jrn_scan_t *sc=NULL;
+	uint8_t *ptr=NULL;
+	int j=0;
+
+	grab_keyvals(_m);
+
+	if (s == NULL || s->ss == NULL) {
+		ERR("journal module: settings not initialized");
+		jrn_disable=1;
+		return;
+	}
+
+	if (_m != NULL && _m->mp != NULL) {
+		for (kv=_m->mp->kv ; kv != NULL ; kv=kv->next) {
+			if (strcmp(kv->key, "file") == 0) {
+				file=kv->value;
+			}
+			else if (strcmp(kv->key, "bufsize") == 0) {
+				if (sscanf(kv->value, "%u", &bufkb) != 1 || bufkb < 64 || bufkb > JRN_MAXBUF) {
+					ERR("journal bufsize `%s' is not between 64 and %u KB, using %u", kv->value, JRN_MAXBUF, JRN_DEFBUF);
+					bufkb=JRN_DEFBUF;
+				}
+			}
+		}
+	}
+
+	jrn_bufsz=(size_t)bufkb * 1024;
+	jrn_buf=(uint8_t *)xmalloc(jrn_bufsz);
+	jrn_off=0;
+
+	if (jrn_open(file) < 0) {
+		if (jrn_fd >= 0) {
+			close(jrn_fd);
+			jrn_fd=-1;
+		}
+		jrn_locked=0;
+		jrn_disable=1;
+		return;
+	}
+
+	str[JRN_STR_PROFILE]=s->profile;
+	str[JRN_STR_DRONES]=s->drone_str;
+	str[JRN_STR_MODULES]=s->module_enable;
+	str[JRN_STR_USER]=s->user;
+	str[JRN_STR_INTERFACE]=s->interface_str;
+	str[JRN_STR_PORTS]=s->ss->port_str;
+	str[JRN_STR_TARGETS]=NULL;
+
+	for (j=0; j < JRN_STR_MAX; j++) {
+		slen[j]=str[j] == NULL ? 0 : strlen(str[j]);
+		if (slen[j] > 0xffff) {
+			slen[j]=0xffff;
+		}
+		len += slen[j];
+	}
+
+	/* the target strings are a fifo, joined with spaces */
+	target_len=0;
+	if (s->target_strs != NULL) {
+		fifo_walk(s->target_strs, &jrn_targetlen);
+		if (target_len > 0) {
+			target_len--;
+		}
+	}
+	slen[JRN_STR_TARGETS]=target_len > 0xffff ? 0xffff : target_len;
+	len += slen[JRN_STR_TARGETS];
+
+	sc=(jrn_scan_t *)jrn_reserve(JRN_REC_SCAN, sizeof(jrn_scan_t) + len);
+	if (sc == NULL) {
+		jrn_unlock();
+		return;
+	}
+
+	sc->s_time=(uint64_t)s->s_time;
+	sc->est_e_time=(uint64_t)s->s_time + s->ss->recv_timeout + s->num_secs;
+	sc->num_hosts=s->num_hosts;
+	sc->num_packets=s->num_packets;
+	sc->pps=s->pps;
+	sc->repeats=s->repeats;
+	sc->senders=(uint16_t)s->senders;
+	sc->listeners=(uint16_t)s->listeners;
+	sc->scan_iter=(uint16_t)s->scan_iter;
+	sc->options=s->options;
+	sc->send_opts=s->send_opts;
+	sc->recv_opts=s->recv_opts;
+	sc->payload_group=s->payload_group;
+	sc->tickrate=s->master_tickrate;
+	sc->tcphdrflgs=s->ss->tcphdrflgs;
+	sc->mode=s->ss->mode;
+	sc->covertness=s->covertness;
+	sc->recv_timeout=s->ss->recv_timeout;
+	sc->num_phases=s->num_phases > 0xff ? 0xff : (uint8_t)s->num_phases;
+
+	ptr=(uint8_t *)sc + sizeof(jrn_scan_t);
+	for (j=0; j < JRN_STR_MAX; j++) {
+		sc->str_len[j]=(uint16_t)slen[j];
+		if (j == JRN_STR_TARGETS) {
+			if (slen[j] > 0) {
+				target_ptr=ptr;
+				target_len=slen[j];
+				fifo_walk(s->target_strs, &jrn_targetput);
+				ptr += slen[j];
+			}
+		}
+		else {
+			ptr += jrn_put(ptr, str[j], slen[j]);
+		}
+	}
+
+	/* out while jrn_open still holds the lock, the next scan to open counts from ours */
+	if (jrn_flush() < 0) {
+		return;
+	}
+
+	DBG(M_MOD, "journal `%s' open as scan %u, %u KB buffer", jrn_file, jrn_scan, bufkb);
+
+	return;
+}
+
+int send_output(const void *p) {
+	union {
+		const uint32_t *magic;
+		const void *p;
+		const ip_report_t *ir;
+		const arp_report_t *ar;
+		const trace_path_report_t *tpr;
+	} d_u;
+	union {
+		const ip_report_t *ir;
+		const arp_report_t *ar;
+		const uint8_t *p;
+	} pk_u;
+	size_t blen=0, olen=0, plen=0;
+	uint8_t *ptr=NULL;
+	unsigned int j=0;
+
+	if (jrn_disable || p == NULL) {
+		return -1;
+	}
+
+	d_u.p=p;
+
+	switch (*d_u.magic) {
+		case IP_REPORT_MAGIC: {
+			jrn_ip_t *r=NULL;
+
+			jrn_banner=NULL;
+			jrn_os=NULL;
+			if (d_u.ir->od_q != NULL) {
+				fifo_walk(d_u.ir->od_q, &jrn_odwalk);
+			}
+			blen=jrn_banner == NULL ? 0 : MIN(strlen(jrn_banner), 0xffff);
+			olen=jrn_os == NULL ? 0 : MIN(strlen(jrn_os), 0xffff);
+			plen=d_u.ir->doff;
+
+			r=(jrn_ip_t *)jrn_reserve(JRN_REC_IP, sizeof(jrn_ip_t) + blen + olen + plen);
+			if (r == NULL) {
+				return -1;
+			}
+
+			r->send_addr=d_u.ir->send_addr;
+			r->host_addr=d_u.ir->host_addr;
+			r->trace_addr=d_u.ir->trace_addr;
+			r->tv_sec=(uint32_t)d_u.ir->recv_time.tv_sec;
+			r->tv_usec=(uint32_t)d_u.ir->recv_time.tv_usec;
+			r->mseq=d_u.ir->mseq;
+			r->tseq=d_u.ir->tseq;
+			r->t_tstamp=d_u.ir->t_tstamp;
+			r->m_tstamp=d_u.ir->m_tstamp;
+			r->sport=d_u.ir->sport;
+			r->dport=d_u.ir->dport;
+			r->type=d_u.ir->type;
+			r->subtype=d_u.ir->subtype;
+			r->flags=d_u.ir->flags;
+			r->window_size=d_u.ir->window_size;
+			r->proto=d_u.ir->proto;
+			r->ttl=d_u.ir->ttl;
+			r->eth_hwaddr_valid=d_u.ir->eth_hwaddr_valid;
+			memcpy(r->eth_hwaddr, d_u.ir->eth_hwaddr, sizeof(r->eth_hwaddr));
+			r->banner_len=(uint16_t)blen;
+			r->os_len=(uint16_t)olen;
+			r->pkt_len=(uint16_t)plen;
+
+			ptr=(uint8_t *)r + sizeof(jrn_ip_t);
+			ptr += jrn_put(ptr, jrn_banner, blen);
+			ptr += jrn_put(ptr, jrn_os, olen);
+			if (plen > 0) {
+				/* the packet, when there is one, sits right behind the report */
+				pk_u.ir=d_u.ir + 1;
+				memcpy(ptr, pk_u.p, plen);
+			}
+			break;
+		}
+
+		case ARP_REPORT_MAGIC: {
+			jrn_arp_t *r=NULL;
+
+			plen=d_u.ar->doff;
+
+			r=(jrn_arp_t *)jrn_reserve(JRN_REC_ARP, sizeof(jrn_arp_t) + plen);
+			if (r == NULL) {
+				return -1;
+			}
+
+			r->ipaddr=d_u.ar->ipaddr;
+			r->tv_sec=(uint32_t)d_u.ar->recv_time.tv_sec;
+			r->tv_usec=(uint32_t)d_u.ar->recv_time.tv_usec;
+			memcpy(r->hwaddr, d_u.ar->hwaddr, sizeof(r->hwaddr));
+			r->flags=d_u.ar->flags;
+			r->pkt_len=(uint16_t)plen;
+
+			if (plen > 0) {
+				pk_u.ar=d_u.ar + 1;
+				memcpy((uint8_t *)r + sizeof(jrn_arp_t), pk_u.p, plen);
+			}
+			break;
+		}
+
+		case TRACE_PATH_MAGIC: {
+			jrn_trace_t *r=NULL;
+			jrn_hop_t *hop=NULL;
+			unsigned int hops=0;
+
+			hops=MIN(d_u.tpr->hop_count, TRACE_PATH_MAX_HOPS);
+
+			r=(jrn_trace_t *)jrn_reserve(JRN_REC_TRACE, sizeof(jrn_trace_t) + hops * sizeof(jrn_hop_t));
+			if (r == NULL) {
+				return -1;
+			}
+
+			r->target_addr=d_u.tpr->target_addr;
+			r->target_port=d_u.tpr->target_port;
+			r->hop_count=(uint8_t)hops;
+			r->complete=d_u.tpr->complete;
+
+			hop=(jrn_hop_t *)((uint8_t *)r + sizeof(jrn_trace_t));
+			for (j=0; j < hops; j++) {
+				hop[j].router_addr=d_u.tpr->hops[j].router_addr;
+				hop[j].rtt_us=d_u.tpr->hops[j].rtt_us;
+				hop[j].hop_number=d_u.tpr->hops[j].hop_number;
+				hop[j].flags=d_u.tpr->hops[j].flags;
+			}
+			break;
+		}
+
+		default:
+			/* workunits and their stats have no place in a result journal */
+			return 1;
+	}
+
+	jrn_records++;
+
+	return 1;
+}
+
+void journal_fini(void) {
+	jrn_end_t *e=NULL;
+
+	if (jrn_disable || jrn_fd < 0) {
+		return;
+	}
+
+	e=(jrn_end_t *)jrn_reserve(JRN_REC_END, sizeof(jrn_end_t));
+	if (e != NULL) {
+		e->e_time=(uint64_t)s->e_time;
+		e->records=jrn_records;
+	}
+
+	jrn_flush();
+
+	if (close(jrn_fd) < 0) {
+		ERR("journal close `%s': %s", jrn_file, strerror(errno));
+	}
+	jrn_fd=-1;
+
+	VRB(1, "journal: %llu records appended to `%s'", (unsigned long long)jrn_records, jrn_file);
+
+	xfree(jrn_buf);
+	jrn_buf=NULL;
+	xfree(jrn_file);
+	jrn_file=NULL;
+
+	return;
+}
+
+/*
+ * open for append, starting the file if it is new and otherwise checking
+ * that it is a journal we can add to and taking the next scan number.
+ * returns with the lock held, journal_init writes the scan record out
+ * under it so no other scan can take the same number
+ */
+static int jrn_open(const char *file) {
+	struct stat sb;
+	jrn_file_t hdr;
+	uint16_t last=0;
+
+	jrn_file=xstrdup(file);
+
+	jrn_fd=open(file, O_RDWR|O_CREAT|O_APPEND, 0644);
+	if (jrn_fd < 0) {
+		ERR("journal: cant open `%s': %s", file, strerror(errno));
+		return -1;
+	}
+
+	if (jrn_lock() < 0) {
+		return -1;
+	}
+
+	if (fstat(jrn_fd, &sb) < 0) {
+		ERR("journal: cant stat `%s': %s", file, strerror(errno));
+		return -1;
+	}
+
+	if (sb.st_size == 0) {
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.magic=JRN_MAGIC;
+		hdr.version=JRN_VERSION;
+		hdr.hdr_len=JRN_PAD(sizeof(jrn_file_t));
+		hdr.order=JRN_ORDER;
+		hdr.c_time=(uint64_t)time(NULL);
+
+		memcpy(jrn_buf, &hdr, sizeof(hdr));
+		memset(jrn_buf + sizeof(hdr), 0, hdr.hdr_len - sizeof(hdr));
+		jrn_off=hdr.hdr_len;
+		jrn_end=0;
+		jrn_scan=1;
+
+		return 1;
+	}
+
+	if ((size_t)sb.st_size < sizeof(jrn_file_t) || pread(jrn_fd, &hdr, sizeof(hdr), 0) != (ssize_t)sizeof(hdr)) {
+		ERR("journal: `%s' is not a result journal", file);
+		return -1;
+	}
+
+	if (hdr.magic != JRN_MAGIC || hdr.order != JRN_ORDER) {
+		ERR("journal: `%s' is not a result journal written on a host like this one", file);
+		return -1;
+	}
+	if (hdr.version != JRN_VERSION) {
+		ERR("journal: `%s' is version %u, this module writes version %u", file, hdr.version, JRN_VERSION);
+		return -1;
+	}
+
+	if (jrn_check(hdr.hdr_len, &last) < 0) {
+		return -1;
+	}
+
+	/* 0 is never a scan number, so wrapping skips it */
+	jrn_scan=(last == 0xffff ? 1 : last + 1);
+
+	return 1;
+}
+
+static int jrn_lock(void) {
+
+	while (flock(jrn_fd, LOCK_EX) < 0) {
+		if (errno != EINTR) {
+			ERR("journal: cant lock `%s': %s", jrn_file, strerror(errno));
+			return -1;
+		}
+	}
+	jrn_locked=1;
+
+	return 1;
+}
+
+static void jrn_unlock(void) {
+
+	if (jrn_locked) {
+		flock(jrn_fd, LOCK_UN);
+		jrn_locked=0;
+	}
+
+	return;
+}
+
+/*
+ * under the lock, walk what was appended since from, which is a record
+ * boundary.  a scan that died mid write can leave a torn record at the
+ * end, which would swallow everything appended after it, so the tail is
+ * cut back to the last whole one.  if last isnt NULL it gets the number
+ * of the last scan record seen
+ */
+static int jrn_check(size_t from, uint16_t *last) {
+	struct stat sb;
+	uint8_t *map=NULL;
+	const jrn_rec_t *rec=NULL;
+	size_t off=0, moff=0, mlen=0;
+
+	if (fstat(jrn_fd, &sb) < 0) {
+		ERR("journal: cant stat `%s': %s", jrn_file, strerror(errno));
+		return -1;
+	}
+
+	if ((size_t)sb.st_size <= from) {
+		jrn_end=(size_t)sb.st_size;
+		return 1;
+	}
+
+	/* only the new part is mapped, from the page it starts in */
+	moff=from & ~((size_t)sysconf(_SC_PAGESIZE) - 1);
+	mlen=(size_t)sb.st_size - moff;
+
+	map=(uint8_t *)mmap(NULL, mlen, PROT_READ, MAP_SHARED, jrn_fd, (off_t)moff);
+	if (map == MAP_FAILED) {
+		ERR("journal: cant mmap `%s': %s", jrn_file, strerror(errno));
+		return -1;
+	}
+
+	for (off=from; off + sizeof(jrn_rec_t) <= (size_t)sb.st_size; off += rec->len) {
+		rec=(const jrn_rec_t *)(map + (off - moff));
+		if (rec->len < sizeof(jrn_rec_t) || (rec->len % JRN_ALIGN) != 0 || rec->len > (size_t)sb.st_size - off) {
+			break;
+		}
+		if (last != NULL && rec->type == JRN_REC_SCAN) {
+			*last=rec->scan;
+		}
+	}
+	munmap(map, mlen);
+
+	if (off != (size_t)sb.st_size) {
+		ERR("journal: `%s' ends in a torn record, cutting it back from " STFMT " to " STFMT " bytes", jrn_file, (size_t)sb.st_size, off);
+		if (ftruncate(jrn_fd, (off_t)off) < 0) {
+			ERR("journal: cant truncate `%s': %s", jrn_file, strerror(errno));
+			return -1;
+		}
+	}
+	jrn_end=off;
+
+	return 1;
+}
+
+/* the buffer only holds whole records, it goes out in one piece under the lock */
+static int jrn_flush(void) {
+	size_t done=0;
+	ssize_t ret=0;
+
+	if (jrn_off == 0) {
+		jrn_unlock();
+		return 1;
+	}
+
+	if (! jrn_locked && (jrn_lock() < 0 || jrn_check(jrn_end, NULL) < 0)) {
+		ERR("journal: cant append to `%s', disabling", jrn_file);
+		jrn_unlock();
+		jrn_disable=1;
+		jrn_off=0;
+		return -1;
+	}
+
+	while (done < jrn_off) {
+		ret=write(jrn_fd, jrn_buf + done, jrn_off - done);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			ERR("journal write to `%s' fails: %s, disabling", jrn_file, strerror(errno));
+			jrn_unlock();
+			jrn_disable=1;
+			jrn_off=0;
+			return -1;
+		}
+		done += (size_t)ret;
+	}
+	jrn_end += jrn_off;
+	jrn_off=0;
+
+	jrn_unlock();
+
+	return 1;
+}
+
+/*
+ * room for a whole record in the buffer, header filled in, the rest
+ * (padding included) zeroed.  the buffer grows for the odd record that
+ * is bigger than it
+ */
+static void *jrn_reserve(uint16_t type, size_t len) {
+	jrn_rec_t *rec=NULL;
+	size_t plen=JRN_PAD(len);
+
+	if (jrn_off + plen > jrn_bufsz) {
+		if (jrn_flush() < 0) {
+			return NULL;
+		}
+		if (plen > jrn_bufsz) {
+			jrn_bufsz=plen;
+			jrn_buf=(uint8_t *)xrealloc(jrn_buf, jrn_bufsz);
+		}
+	}
+
+	rec=(jrn_rec_t *)(jrn_buf + jrn_off);
+	memset(rec, 0, plen);
+	rec->type=type;
+	rec->scan=jrn_scan;
+	rec->len=(uint32_t)plen;
+	jrn_off += plen;
+
+	return rec;
+}
+
+static size_t jrn_put(uint8_t *ptr, const char *str, size_t len) {
+
+	if (len > 0) {
+		memcpy(ptr, str, len);
+	}
+
+	return len;
+}
+
+static void jrn_odwalk(void *data) {
+	union {
+		void *p;
+		output_data_t *o;
+	} d_u;
+
+	d_u.p=data;
+
+	switch (d_u.o->type) {
+		case OD_TYPE_BANNER:
+			jrn_banner=d_u.o->t_u.banner;
+			break;
+
+		case OD_TYPE_OS:
+			jrn_os=d_u.o->t_u.os;
+			break;
+
+		default:
+			break;
+	}
+
+	return;
+}
+
+static void jrn_targetlen(void *data) {
+
+	if (data != NULL) {
+		target_len += strlen((const char *)data) + 1;
+	}
+
+	return;
+}
+
+static void jrn_targetput(void *data) {
+	size_t len=0;
+
+	if (data == NULL || target_len == 0) {
+		return;
+	}
+
+	len=MIN(strlen((const char *)data), target_len);
+	memcpy(target_ptr, data, len);
+	target_ptr += len;
+	target_len -= len;
+
+	if (target_len > 0) {
+		*target_ptr++=' ';
+		target_len--;
+	}
+
+	return;
+}
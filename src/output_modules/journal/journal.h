@@ -0,0 +1,167 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#ifndef _JOURNAL_H
+# define _JOURNAL_H
+
+/*
+ * on disk layout of the binary result journal written by the journal
+ * output module and read back by unijournal.  a journal is one file
+ * header followed by records, appended to by any number of scans, each
+ * scan opening with a JRN_REC_SCAN and (when it finished cleanly) closing
+ * with a JRN_REC_END.  scans can be appending at the same time, so their
+ * records can be interleaved.  every record carries its scan's number,
+ * 1 more than the scan before it in the file (after 65535 comes 1).
+ *
+ * everything is host byte order (jrn_file_t.order tells a reader if it
+ * isnt its own) except addresses, which stay in network order as they are
+ * in the reports.  every record starts on an 8 byte boundary and the
+ * fixed part of each is laid out on natural alignment, so a reader can
+ * mmap the file and walk it with plain pointer casts.  variable data
+ * (strings, the captured packet, trace hops) follows the fixed part, the
+ * record is zero padded up to the next 8 bytes, and jrn_rec_t.len covers
+ * all of it.  readers skip record types they do not know by len
+ */
+
+#define JRN_MAGIC		0x4e524a55	/* "UJRN" read as a little endian uint32 */
+#define JRN_VERSION		1
+#define JRN_ORDER		0x01020304
+
+#define JRN_ALIGN		8
+#define JRN_PAD(x)		(((x) + (JRN_ALIGN - 1)) & ~((size_t)JRN_ALIGN - 1))
+
+typedef struct _PACKED_ jrn_file_t {
+	uint32_t magic;
+	uint16_t version;	/* JRN_VERSION					*/
+	uint16_t hdr_len;	/* first record starts here			*/
+	uint32_t order;		/* JRN_ORDER as the writer saw it		*/
+	uint32_t res;
+	uint64_t c_time;	/* when the journal was created			*/
+} jrn_file_t;
+
+typedef struct _PACKED_ jrn_rec_t {
+	uint16_t type;		/* JRN_REC_					*/
+	uint16_t scan;		/* the JRN_REC_SCAN this belongs to has the same */
+	uint32_t len;		/* whole record, padding included		*/
+} jrn_rec_t;
+
+#define JRN_REC_SCAN		1
+#define JRN_REC_END		2
+#define JRN_REC_IP		3
+#define JRN_REC_ARP		4
+#define JRN_REC_TRACE		5
+
+/* strings in a JRN_REC_SCAN, in this order, lengths in str_len[] */
+#define JRN_STR_PROFILE		0
+#define JRN_STR_DRONES		1
+#define JRN_STR_MODULES		2
+#define JRN_STR_USER		3
+#define JRN_STR_INTERFACE	4
+#define JRN_STR_PORTS		5
+#define JRN_STR_TARGETS		6
+#define JRN_STR_MAX		7
+
+typedef struct _PACKED_ jrn_scan_t {
+	jrn_rec_t rec;
+	uint64_t s_time;
+	uint64_t est_e_time;
+	double num_hosts;
+	double num_packets;
+	uint32_t pps;
+	uint32_t repeats;
+	uint16_t senders;
+	uint16_t listeners;
+	uint16_t scan_iter;
+	uint16_t options;
+	uint16_t send_opts;
+	uint16_t recv_opts;
+	uint16_t payload_group;
+	uint16_t tickrate;
+	uint16_t tcphdrflgs;
+	uint8_t mode;		/* MODE_ of the (first) phase			*/
+	uint8_t covertness;
+	uint8_t recv_timeout;
+	uint8_t num_phases;
+	uint16_t str_len[JRN_STR_MAX];
+	/* 84: strings follow, not NUL terminated */
+} jrn_scan_t;
+
+typedef struct _PACKED_ jrn_end_t {
+	jrn_rec_t rec;
+	uint64_t e_time;
+	uint64_t records;	/* reports this scan wrote			*/
+} jrn_end_t;
+
+typedef struct _PACKED_ jrn_ip_t {
+	jrn_rec_t rec;
+	uint32_t send_addr;
+	uint32_t host_addr;
+	uint32_t trace_addr;
+	uint32_t tv_sec;
+	uint32_t tv_usec;
+	uint32_t mseq;
+	uint32_t tseq;
+	uint32_t t_tstamp;
+	uint32_t m_tstamp;
+	uint16_t sport;
+	uint16_t dport;
+	uint16_t type;
+	uint16_t subtype;
+	uint16_t flags;
+	uint16_t window_size;
+	uint8_t proto;
+	uint8_t ttl;
+	uint8_t eth_hwaddr_valid;
+	uint8_t res;
+	uint8_t eth_hwaddr[6];
+	uint16_t banner_len;
+	uint16_t os_len;
+	uint16_t pkt_len;
+	/* 72: banner, os, then the packet follow */
+} jrn_ip_t;
+
+typedef struct _PACKED_ jrn_arp_t {
+	jrn_rec_t rec;
+	uint32_t ipaddr;
+	uint32_t tv_sec;
+	uint32_t tv_usec;
+	uint8_t hwaddr[6];
+	uint16_t flags;
+	uint16_t pkt_len;
+	uint16_t res;
+	/* 32: the packet follows */
+} jrn_arp_t;
+
+typedef struct _PACKED_ jrn_hop_t {
+	uint32_t router_addr;
+	uint32_t rtt_us;
+	uint8_t hop_number;
+	uint8_t flags;
+	uint16_t res;
+} jrn_hop_t;
+
+typedef struct _PACKED_ jrn_trace_t {
+	jrn_rec_t rec;
+	uint32_t target_addr;
+	uint16_t target_port;
+	uint8_t hop_count;
+	uint8_t complete;
+	/* 16: hop_count jrn_hop_t follow */
+} jrn_trace_t;
+
+#endif
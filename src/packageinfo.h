@@ -20,7 +20,7 @@
 #define MODULE_IVER	0x0103 /* 1.02 */
 
 #define DRONE_MAJ	1
-#define DRONE_MIN	1
+#define DRONE_MIN	2
 
 #define MOD_VERSION(version, maj, min) \
 	maj=(((version) & 0xFF00) >> 8); \
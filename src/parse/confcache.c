@@ -0,0 +1,661 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#include <config.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <settings.h>
+#include <packageinfo.h>
+
+#include <scan_progs/scan_export.h>
+#include <scan_progs/options.h>
+
+#include <unilib/terminate.h>
+#include <unilib/xmalloc.h>
+#include <unilib/output.h>
+
+#include <parse/parse.h>
+#include <parse/confcache.h>
+
+#define MAIN (ident == IDENT_MASTER || ident == IDENT_ANY)
+#define SEND (ident == IDENT_SEND || ident == IDENT_ANY)
+
+/*
+ * file layout, host byte order, it never leaves the box it was made on
+ *
+ * header | files | statements | tcp names | udp names | oui prefixes | strings
+ *
+ * every string (and payload data) is an offset into the string blob, the
+ * blob starts with a \0 so offset 0 is the empty string
+ */
+typedef struct cc_hdr_t {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t hdrlen;
+	uint32_t pkgver;	/* blob offset of VERSION		*/
+	uint32_t conffile;	/* blob offset of the top config file	*/
+	uint32_t nfiles;
+	uint32_t files;		/* file offsets from here on		*/
+	uint32_t nrecs;
+	uint32_t recs;
+	uint32_t tcpnames;	/* 0x10000 blob offsets each, 0 is none	*/
+	uint32_t udpnames;
+	uint32_t nouis;
+	uint32_t ouis;		/* sorted by prefix			*/
+	uint32_t blob;
+	uint32_t bloblen;
+	uint64_t total;
+} cc_hdr_t;
+
+typedef struct cc_file_t {
+	uint32_t path;
+	uint32_t res;
+	int64_t mtime;
+	int64_t size;
+} cc_file_t;
+
+typedef struct cc_rec_t {
+	uint8_t type;		/* CC_					*/
+	uint8_t proto;
+	uint16_t plg;
+	int32_t num;		/* number value, or payload dest port	*/
+	int32_t sport;
+	uint32_t key;
+	uint32_t val;
+	uint32_t vlen;		/* payload data length			*/
+} cc_rec_t;
+
+typedef struct cc_oui_t {
+	uint32_t prefix;
+	uint32_t name;
+} cc_oui_t;
+
+#define CC_NAMES	0x10000
+
+/* while compiling */
+static int cc_recording=0;
+static cc_file_t *c_files=NULL;
+static uint32_t c_nfiles=0;
+static cc_rec_t *c_recs=NULL;
+static uint32_t c_nrecs=0, c_recsize=0;
+static cc_oui_t *c_ouis=NULL;
+static uint32_t c_nouis=0, c_ouisize=0;
+static uint8_t *c_blob=NULL;
+static uint32_t c_bloblen=0, c_blobsize=0;
+
+/* once mapped, stays mapped, option strings can point in here */
+static int cc_state=0;
+static const uint8_t *cc_base=NULL;
+static const cc_hdr_t *cc_hdr=NULL;
+
+static uint32_t blob_add(const void *, uint32_t );
+static uint32_t blob_str(const char *);
+static cc_rec_t *rec_new(int );
+static int cc_readports(uint32_t * /* tcp */, uint32_t * /* udp */);
+static int cc_readoui(void);
+static int oui_cmp(const void *, const void *);
+static int cc_write(const char * /* path */, uint32_t /* conffile */, const uint32_t *, const uint32_t *);
+static int cc_map(void);
+static int cc_fits(uint32_t /* off */, uint32_t /* count */, size_t /* size */);
+static const char *cc_str(uint32_t );
+static void cc_replay(const cc_rec_t *);
+
+static uint32_t blob_add(const void *data, uint32_t len) {
+	uint32_t off=0;
+
+	if (c_bloblen + len > c_blobsize) {
+		while (c_bloblen + len > c_blobsize) {
+			c_blobsize=(c_blobsize == 0 ? 0x10000 : c_blobsize * 2);
+		}
+		c_blob=(uint8_t *)xrealloc(c_blob, c_blobsize);
+	}
+
+	off=c_bloblen;
+	if (len > 0) {
+		memcpy(c_blob + off, data, len);
+	}
+	c_bloblen += len;
+
+	return off;
+}
+
+static uint32_t blob_str(const char *str) {
+
+	if (str == NULL || *str == '\0') {
+		return 0;
+	}
+
+	return blob_add(str, (uint32_t)strlen(str) + 1);
+}
+
+static cc_rec_t *rec_new(int type) {
+	cc_rec_t *r=NULL;
+
+	if (c_nrecs == c_recsize) {
+		c_recsize=(c_recsize == 0 ? 64 : c_recsize * 2);
+		c_recs=(cc_rec_t *)xrealloc(c_recs, sizeof(cc_rec_t) * c_recsize);
+	}
+
+	r=&c_recs[c_nrecs++];
+	memset(r, 0, sizeof(cc_rec_t));
+	r->type=(uint8_t)type;
+
+	return r;
+}
+
+void confcache_rec_file(const char *file) {
+	struct stat sb;
+
+	if (cc_recording == 0) {
+		return;
+	}
+
+	if (stat(file, &sb) < 0) {
+		ERR("cant stat `%s' for the config cache: %s", file, strerror(errno));
+		cc_recording=-1;
+		return;
+	}
+
+	c_files=(cc_file_t *)xrealloc(c_files, sizeof(cc_file_t) * (c_nfiles + 1));
+	c_files[c_nfiles].path=blob_str(file);
+	c_files[c_nfiles].res=0;
+	c_files[c_nfiles].mtime=(int64_t)sb.st_mtime;
+	c_files[c_nfiles].size=(int64_t)sb.st_size;
+	c_nfiles++;
+
+	return;
+}
+
+void confcache_rec_opt(int type, const char *key, const char *value, int num) {
+	cc_rec_t *r=NULL;
+
+	if (cc_recording == 0) {
+		return;
+	}
+
+	r=rec_new(type);
+	r->key=blob_str(key);
+	r->val=blob_str(value);
+	r->num=num;
+
+	return;
+}
+
+void confcache_rec_payload(uint8_t proto, int32_t dport, int32_t sport, uint16_t plg, const uint8_t *data, uint32_t len) {
+	cc_rec_t *r=NULL;
+
+	if (cc_recording == 0) {
+		return;
+	}
+
+	r=rec_new(CC_PAYLOAD);
+	r->proto=proto;
+	r->num=dport;
+	r->sport=sport;
+	r->plg=plg;
+	r->val=blob_add(data, len);
+	r->vlen=len;
+
+	return;
+}
+
+void confcache_rec_module(int type, const char *key, const char *value) {
+	cc_rec_t *r=NULL;
+
+	if (cc_recording == 0) {
+		return;
+	}
+
+	r=rec_new(type);
+	r->key=blob_str(key);
+	r->val=blob_str(value);
+
+	return;
+}
+
+/*
+ * first line for a port wins, same as getservname() scanning the file did
+ */
+static int cc_readports(uint32_t *tcp, uint32_t *udp) {
+	char line[256], name[64], proto[4];
+	int port=0;
+	FILE *fp=NULL;
+
+	fp=fopen(PORT_NUMBERS, "r");
+	if (fp == NULL) {
+		ERR("cant open `%s': %s", PORT_NUMBERS, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line) -1, fp) != NULL) {
+		uint32_t *tbl=NULL;
+
+		if (line[0] == '#' || sscanf(line, "%63s %d/%3s", name, &port, proto) != 3) {
+			continue;
+		}
+		if (port < 0 || port > 0xffff) {
+			continue;
+		}
+
+		if (strcmp(proto, "tcp") == 0) {
+			tbl=tcp;
+		}
+		else if (strcmp(proto, "udp") == 0) {
+			tbl=udp;
+		}
+
+		if (tbl != NULL && tbl[port] == 0) {
+			tbl[port]=blob_str(name);
+		}
+	}
+
+	fclose(fp);
+
+	confcache_rec_file(PORT_NUMBERS);
+
+	return 1;
+}
+
+static int oui_cmp(const void *a, const void *b) {
+	const cc_oui_t *oa=(const cc_oui_t *)a, *ob=(const cc_oui_t *)b;
+
+	if (oa->prefix != ob->prefix) {
+		return oa->prefix < ob->prefix ? -1 : 1;
+	}
+	/* earlier lines have lower blob offsets, keep the earlier one first */
+	if (oa->name != ob->name) {
+		return oa->name < ob->name ? -1 : 1;
+	}
+	return 0;
+}
+
+static int cc_readoui(void) {
+	char line[256], name[64];
+	unsigned int fa=0, fb=0, fc=0;
+	uint32_t j=0, k=0;
+	FILE *fp=NULL;
+
+	fp=fopen(OUI_CONF, "r");
+	if (fp == NULL) {
+		ERR("cant open `%s': %s", OUI_CONF, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line) -1, fp) != NULL) {
+		if (line[0] == '#') {
+			continue;
+		}
+
+		memset(name, 0, sizeof(name));
+		if (sscanf(line, "%x-%x-%x:%63[^\n]", &fa, &fb, &fc, name) != 4) {
+			continue;
+		}
+
+		if (c_nouis == c_ouisize) {
+			c_ouisize=(c_ouisize == 0 ? 0x1000 : c_ouisize * 2);
+			c_ouis=(cc_oui_t *)xrealloc(c_ouis, sizeof(cc_oui_t) * c_ouisize);
+		}
+		c_ouis[c_nouis].prefix=((fa & 0xff) << 16) | ((fb & 0xff) << 8) | (fc & 0xff);
+		c_ouis[c_nouis].name=blob_str(name);
+		c_nouis++;
+	}
+
+	fclose(fp);
+
+	if (c_nouis > 0) {
+		qsort(c_ouis, c_nouis, sizeof(cc_oui_t), &oui_cmp);
+
+		for (j=1, k=0; j < c_nouis; j++) {
+			if (c_ouis[j].prefix != c_ouis[k].prefix) {
+				c_ouis[++k]=c_ouis[j];
+			}
+		}
+		c_nouis=k + 1;
+	}
+
+	confcache_rec_file(OUI_CONF);
+
+	return 1;
+}
+
+int confcache_compile(const char *conffile) {
+	char path[512];
+	uint32_t *tcp=NULL, *udp=NULL, top=0;
+	int ret=-1;
+
+	assert(conffile != NULL && s->profile != NULL);
+
+	snprintf(path, sizeof(path) -1, CONF_CACHE, s->profile);
+
+	c_nfiles=0;
+	c_nrecs=0;
+	c_nouis=0;
+	c_bloblen=0;
+	blob_add("", 1);
+
+	top=blob_str(conffile);
+
+	tcp=(uint32_t *)xmalloc(sizeof(uint32_t) * CC_NAMES);
+	udp=(uint32_t *)xmalloc(sizeof(uint32_t) * CC_NAMES);
+	memset(tcp, 0, sizeof(uint32_t) * CC_NAMES);
+	memset(udp, 0, sizeof(uint32_t) * CC_NAMES);
+
+	cc_recording=1;
+
+	/* readconf() records the file and the includes as it opens them, the grammar the statements */
+	if (readconf(conffile) < 0 || cc_readports(tcp, udp) < 0 || cc_readoui() < 0 || cc_recording < 0) {
+		ERR("not writing config cache `%s'", path);
+	}
+	else {
+		ret=cc_write(path, top, tcp, udp);
+	}
+
+	cc_recording=0;
+
+	xfree(tcp);
+	xfree(udp);
+
+	return ret;
+}
+
+static int cc_write(const char *path, uint32_t top, const uint32_t *tcp, const uint32_t *udp) {
+	char tmppath[600];
+	cc_hdr_t hdr;
+	uint64_t off=0;
+	FILE *fp=NULL;
+	int bad=0;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic=CONFCACHE_MAGIC;
+	hdr.version=CONFCACHE_VERSION;
+	hdr.hdrlen=(uint16_t)sizeof(cc_hdr_t);
+	hdr.pkgver=blob_str(VERSION);
+	hdr.conffile=top;
+
+	off=sizeof(cc_hdr_t);
+	hdr.nfiles=c_nfiles;
+	hdr.files=(uint32_t)off;
+	off += sizeof(cc_file_t) * c_nfiles;
+	hdr.nrecs=c_nrecs;
+	hdr.recs=(uint32_t)off;
+	off += sizeof(cc_rec_t) * c_nrecs;
+	hdr.tcpnames=(uint32_t)off;
+	off += sizeof(uint32_t) * CC_NAMES;
+	hdr.udpnames=(uint32_t)off;
+	off += sizeof(uint32_t) * CC_NAMES;
+	hdr.nouis=c_nouis;
+	hdr.ouis=(uint32_t)off;
+	off += sizeof(cc_oui_t) * c_nouis;
+	hdr.blob=(uint32_t)off;
+	hdr.bloblen=c_bloblen;
+	off += c_bloblen;
+	hdr.total=off;
+
+	/* write it beside and rename it over, whoever has the old one mapped keeps it */
+	snprintf(tmppath, sizeof(tmppath) -1, "%s.%d", path, (int)getpid());
+
+	fp=fopen(tmppath, "w");
+	if (fp == NULL) {
+		ERR("cant open `%s' for writing: %s", tmppath, strerror(errno));
+		return -1;
+	}
+
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) bad++;
+	if (c_nfiles > 0 && fwrite(c_files, sizeof(cc_file_t), c_nfiles, fp) != c_nfiles) bad++;
+	if (c_nrecs > 0 && fwrite(c_recs, sizeof(cc_rec_t), c_nrecs, fp) != c_nrecs) bad++;
+	if (fwrite(tcp, sizeof(uint32_t), CC_NAMES, fp) != CC_NAMES) bad++;
+	if (fwrite(udp, sizeof(uint32_t), CC_NAMES, fp) != CC_NAMES) bad++;
+	if (c_nouis > 0 && fwrite(c_ouis, sizeof(cc_oui_t), c_nouis, fp) != c_nouis) bad++;
+	if (fwrite(c_blob, 1, c_bloblen, fp) != c_bloblen) bad++;
+
+	if (fclose(fp) != 0) {
+		bad++;
+	}
+
+	if (bad || rename(tmppath, path) < 0) {
+		ERR("cant write config cache `%s': %s", path, strerror(errno));
+		unlink(tmppath);
+		return -1;
+	}
+
+	VRB(0, "wrote config cache `%s': %u statements from %u files, %u oui prefixes, " STFMT " bytes",
+		path, c_nrecs, c_nfiles, c_nouis, (size_t)hdr.total
+	);
+
+	return 1;
+}
+
+static int cc_fits(uint32_t off, uint32_t count, size_t size) {
+
+	return (uint64_t)off + ((uint64_t)count * size) <= cc_hdr->total ? 1 : 0;
+}
+
+static const char *cc_str(uint32_t off) {
+
+	if (off >= cc_hdr->bloblen) {
+		return "";
+	}
+
+	return (const char *)(cc_base + cc_hdr->blob + off);
+}
+
+static int cc_map(void) {
+	char path[512];
+	struct stat sb;
+	const cc_file_t *f=NULL;
+	void *map=NULL;
+	size_t len=0;
+	uint32_t j=0;
+	int fd=-1;
+
+	if (cc_state != 0) {
+		return cc_state;
+	}
+	cc_state=-1;
+
+	if (s->profile == NULL) {
+		return -1;
+	}
+
+	snprintf(path, sizeof(path) -1, CONF_CACHE, s->profile);
+
+	fd=open(path, O_RDONLY);
+	if (fd < 0) {
+		DBG(M_CNF, "no config cache `%s': %s", path, strerror(errno));
+		return -1;
+	}
+
+	if (fstat(fd, &sb) < 0 || (size_t)sb.st_size < sizeof(cc_hdr_t)) {
+		close(fd);
+		return -1;
+	}
+
+	len=(size_t)sb.st_size;
+	map=mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		ERR("cant mmap `%s': %s", path, strerror(errno));
+		return -1;
+	}
+
+	cc_base=(const uint8_t *)map;
+	cc_hdr=(const cc_hdr_t *)map;
+
+	if (cc_hdr->magic != CONFCACHE_MAGIC || cc_hdr->version != CONFCACHE_VERSION ||
+	cc_hdr->hdrlen != sizeof(cc_hdr_t) || cc_hdr->total != (uint64_t)len ||
+	cc_fits(cc_hdr->files, cc_hdr->nfiles, sizeof(cc_file_t)) != 1 ||
+	cc_fits(cc_hdr->recs, cc_hdr->nrecs, sizeof(cc_rec_t)) != 1 ||
+	cc_fits(cc_hdr->tcpnames, CC_NAMES, sizeof(uint32_t)) != 1 ||
+	cc_fits(cc_hdr->udpnames, CC_NAMES, sizeof(uint32_t)) != 1 ||
+	cc_fits(cc_hdr->ouis, cc_hdr->nouis, sizeof(cc_oui_t)) != 1 ||
+	cc_fits(cc_hdr->blob, cc_hdr->bloblen, 1) != 1 || cc_hdr->bloblen < 1 ||
+	cc_base[cc_hdr->blob + cc_hdr->bloblen - 1] != '\0' ||
+	strcmp(cc_str(cc_hdr->pkgver), VERSION) != 0) {
+		VRB(1, "config cache `%s' is damaged or from another version, ignoring it", path);
+		goto unmap;
+	}
+
+	f=(const cc_file_t *)(cc_base + cc_hdr->files);
+	for (j=0; j < cc_hdr->nfiles; j++) {
+		if (stat(cc_str(f[j].path), &sb) < 0 || (int64_t)sb.st_mtime != f[j].mtime || (int64_t)sb.st_size != f[j].size) {
+			VRB(1, "`%s' changed since the config cache was made, rerun with --compile-cache", cc_str(f[j].path));
+			goto unmap;
+		}
+	}
+
+	DBG(M_CNF, "using config cache `%s' with %u statements", path, cc_hdr->nrecs);
+
+	cc_state=1;
+
+	return 1;
+
+unmap:
+	munmap(map, len);
+	cc_base=NULL;
+	cc_hdr=NULL;
+
+	return -1;
+}
+
+/* what the grammar does with each statement, see parse.y */
+static void cc_replay(const cc_rec_t *r) {
+	const char *key=NULL, *val=NULL;
+	char *eptr=NULL;
+	uint16_t dport=0;
+
+	key=cc_str(r->key);
+	val=cc_str(r->val);
+
+	switch (r->type) {
+		case CC_OPT:
+			if (MAIN && (eptr=scan_optmap(key, val)) != NULL) {
+				terminate("config cache error: `%s' for `%s'", eptr, key);
+			}
+			break;
+
+		case CC_OPTI:
+			if (MAIN && (eptr=scan_optmapi(key, r->num)) != NULL) {
+				terminate("config cache error: `%s' for `%s'", eptr, key);
+			}
+			break;
+
+		case CC_OPTBLK:
+			if ((eptr=scan_optmap(key, val)) != NULL) {
+				terminate("config cache error: `%s' for `%s'", eptr, key);
+			}
+			break;
+
+		case CC_PAYLOAD:
+			if (r->num == -1) {
+				if (SEND && r->proto == IPPROTO_UDP) {
+					add_default_payload(IPPROTO_UDP, r->sport, (const uint8_t *)val, r->vlen, NULL, r->plg);
+				}
+				else if (MAIN && r->proto == IPPROTO_TCP) {
+					add_default_payload(IPPROTO_TCP, r->sport, (const uint8_t *)val, r->vlen, NULL, r->plg);
+				}
+			}
+			else {
+				dport=(uint16_t)r->num;
+			}
+
+			if (SEND && r->proto == IPPROTO_UDP) {
+				add_payload(IPPROTO_UDP, dport, r->sport, (const uint8_t *)val, r->vlen, NULL, r->plg);
+			}
+			else if (MAIN && r->proto == IPPROTO_TCP) {
+				add_payload(IPPROTO_TCP, dport, r->sport, (const uint8_t *)val, r->vlen, NULL, r->plg);
+			}
+			break;
+
+		case CC_MODKV:
+			scan_modaddkeyval(key, val);
+			break;
+
+		case CC_MODULE:
+			scan_collectkeyval(key);
+			break;
+
+		default:
+			terminate("config cache has a statement of unknown type %u", r->type);
+	}
+
+	return;
+}
+
+int confcache_readconf(const char *conffile) {
+	const cc_rec_t *r=NULL;
+	uint32_t j=0;
+
+	assert(conffile != NULL);
+
+	if (cc_map() != 1 || strcmp(cc_str(cc_hdr->conffile), conffile) != 0) {
+		return readconf(conffile);
+	}
+
+	r=(const cc_rec_t *)(cc_base + cc_hdr->recs);
+	for (j=0; j < cc_hdr->nrecs; j++) {
+		cc_replay(&r[j]);
+	}
+
+	return 1;
+}
+
+const char *confcache_servname(uint8_t proto, uint16_t port) {
+	const uint32_t *tbl=NULL;
+
+	if (cc_map() != 1) {
+		return NULL;
+	}
+
+	tbl=(const uint32_t *)(cc_base + (proto == IPPROTO_TCP ? cc_hdr->tcpnames : cc_hdr->udpnames));
+	if (tbl[port] == 0) {
+		return "unknown";
+	}
+
+	return cc_str(tbl[port]);
+}
+
+const char *confcache_ouiname(uint8_t a, uint8_t b, uint8_t c) {
+	const cc_oui_t *o=NULL;
+	uint32_t prefix=0, low=0, high=0, mid=0;
+
+	if (cc_map() != 1) {
+		return NULL;
+	}
+
+	prefix=((uint32_t)a << 16) | ((uint32_t)b << 8) | c;
+	o=(const cc_oui_t *)(cc_base + cc_hdr->ouis);
+
+	for (low=0, high=cc_hdr->nouis; low < high;) {
+		mid=low + ((high - low) / 2);
+		if (o[mid].prefix == prefix) {
+			return cc_str(o[mid].name);
+		}
+		if (o[mid].prefix < prefix) {
+			low=mid + 1;
+		}
+		else {
+			high=mid;
+		}
+	}
+
+	return "unknown";
+}
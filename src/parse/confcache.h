@@ -0,0 +1,60 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#ifndef _CONFCACHE_H
+# define _CONFCACHE_H
+
+/*
+ * a compiled copy of everything we otherwise parse out of text at every
+ * start: the statements of the config file and its includes, ports.txt and
+ * oui.txt.  --compile-cache writes it, every process that reads the config
+ * mmaps it and replays the statements instead of running the parser
+ *
+ * the cache remembers the size and mtime of every file it came from, if any
+ * of them changed (or the cache came from another version) it is ignored
+ * and the text files get parsed like before
+ */
+
+#define CONFCACHE_MAGIC		0x55434331
+#define CONFCACHE_VERSION	1
+
+/* statement kinds, what the grammar would have done with them */
+#define CC_OPT			1	/* scan_optmap, master only	*/
+#define CC_OPTI			2	/* scan_optmapi, master only	*/
+#define CC_OPTBLK		3	/* scan_optmap from a { } block	*/
+#define CC_PAYLOAD		4	/* add_payload and friends	*/
+#define CC_MODKV		5	/* scan_modaddkeyval		*/
+#define CC_MODULE		6	/* scan_collectkeyval		*/
+
+/* called from the grammar, they do nothing unless a cache is being compiled */
+void confcache_rec_file(const char *);
+void confcache_rec_opt(int /* CC_ */, const char * /* key */, const char * /* value */, int /* number */);
+void confcache_rec_payload(uint8_t /* proto */, int32_t /* dport, -1 is default */, int32_t /* sport */, uint16_t /* group */, const uint8_t *, uint32_t);
+void confcache_rec_module(int /* CC_ */, const char * /* key or module name */, const char * /* value */);
+
+/* 1 ok -1 error */
+int confcache_compile(const char * /* config file */);
+
+/* replays the cache if it is good for this config file, otherwise readconf() */
+int confcache_readconf(const char * /* config file */);
+
+/* NULL when there is no usable cache */
+const char *confcache_servname(uint8_t /* proto */, uint16_t /* port */);
+const char *confcache_ouiname(uint8_t , uint8_t , uint8_t );
+
+#endif
@@ -829,6 +829,7 @@ char *yytext;
 #include <settings.h>
 
 #include <parse/putil.h>
+#include <parse/confcache.h>
 
 #include "parse.tab.h"
 
@@ -2334,6 +2335,8 @@ void switchfiles(const char *newfile) {
 
 	uuin=incs[incs_index].fp;
 
+	confcache_rec_file(newfile);
+
 	return;
 }
 
@@ -2370,6 +2373,9 @@ int readconf(const char *in) {
 	snprintf(incs[incs_index].filename, sizeof(incs[incs_index].filename) -1, "%s", in);
 	incs[incs_index].fp=uuin;
 	incs[incs_index].lineno=0;
+
+	confcache_rec_file(in);
+
 	uuparse();
 
 	if (uuin) {
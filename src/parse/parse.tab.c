@@ -99,6 +99,7 @@
 #include <errno.h>
 
 #include <parse/putil.h>
+#include <parse/confcache.h>
 
 #include <scan_progs/scan_export.h>
 #include <settings.h>
@@ -114,7 +115,7 @@ extern void uuerror(const char *);
 static char *eptr=NULL;
 
 
-#line 118 "parse.tab.c"
+#line 119 "parse.tab.c"
 
 # ifndef YY_CAST
 #  ifdef __cplusplus
@@ -175,12 +176,12 @@ typedef enum yysymbol_kind_t yysymbol_kind_t;
 
 
 /* Second part of user prologue.  */
-#line 57 "parse.y"
+#line 58 "parse.y"
 
 
 
 
-#line 184 "parse.tab.c"
+#line 185 "parse.tab.c"
 
 
 #ifdef short
@@ -563,10 +564,10 @@ static const yytype_int8 yytranslate[] =
 /* YYRLINE[YYN] -- Source line where rule number YYN was defined.  */
 static const yytype_int16 yyrline[] =
 {
-       0,    63,    63,    64,    68,    69,    70,    75,    76,    79,
-      80,    83,    84,    88,    93,    98,   106,   111,   116,   136,
-     200,   203,   209,   215,   218,   239,   240,   244,   257,   260,
-     263,   272
+       0,    64,    64,    65,    69,    70,    71,    77,    78,    81,
+      82,    85,    86,    90,    96,   102,   111,   117,   123,   144,
+     210,   214,   221,   228,   232,   254,   255,   259,   272,   275,
+     278,   287
 };
 #endif
 
@@ -1164,68 +1165,74 @@ yyreduce:
   switch (yyn)
     {
   case 6: /* section: MODULE STR '{' mlines '}' ';'  */
-#line 70 "parse.y"
+#line 71 "parse.y"
                                         {
+		confcache_rec_module(CC_MODULE, (const char *)(yyvsp[-4].ptr), NULL);
 		scan_collectkeyval((const char *)(yyvsp[-4].ptr));
 	}
-#line 1172 "parse.tab.c"
+#line 1174 "parse.tab.c"
     break;
 
   case 13: /* g_statement: WORD ':' STR ';'  */
-#line 88 "parse.y"
+#line 90 "parse.y"
                          {
+		confcache_rec_opt(CC_OPT, (const char *)(yyvsp[-3].ptr), (const char *)(yyvsp[-1].ptr), 0);
 		if (MAIN && (eptr=scan_optmap((const char *)(yyvsp[-3].ptr), (const char *)(yyvsp[-1].ptr))) != NULL) {
 			uuerror(eptr);
 		}
 	}
-#line 1182 "parse.tab.c"
+#line 1185 "parse.tab.c"
     break;
 
   case 14: /* g_statement: WORD ':' NUMBER ';'  */
-#line 93 "parse.y"
+#line 96 "parse.y"
                               {
+		confcache_rec_opt(CC_OPTI, (const char *)(yyvsp[-3].ptr), NULL, (yyvsp[-1].inum));
 		if (MAIN && (eptr=scan_optmapi((const char *)(yyvsp[-3].ptr), (yyvsp[-1].inum))) != NULL) {
 			uuerror(eptr);
 		}
 	}
-#line 1192 "parse.tab.c"
+#line 1196 "parse.tab.c"
     break;
 
   case 15: /* g_statement: WORD ':' UNUMBER ';'  */
-#line 98 "parse.y"
+#line 102 "parse.y"
                                {
 		if ((yyvsp[-1].uinum) > INT_MAX) {
 			uuerror("number out of range");
 		}
+		confcache_rec_opt(CC_OPTI, (const char *)(yyvsp[-3].ptr), NULL, (int)(yyvsp[-1].uinum));
 		if (MAIN && (eptr=scan_optmapi((const char *)(yyvsp[-3].ptr), (int)(yyvsp[-1].uinum))) != NULL) {
 			uuerror(eptr);
 		}
 	}
-#line 1205 "parse.tab.c"
+#line 1210 "parse.tab.c"
     break;
 
   case 16: /* g_statement: WORD ':' BOOL ';'  */
-#line 106 "parse.y"
+#line 111 "parse.y"
                             {
+		confcache_rec_opt(CC_OPTI, (const char *)(yyvsp[-3].ptr), NULL, (int)(yyvsp[-1].uinum));
 		if (MAIN && (eptr=scan_optmapi((const char *)(yyvsp[-3].ptr), (int)(yyvsp[-1].uinum))) != NULL) {
 			uuerror(eptr);
 		}
 	}
-#line 1215 "parse.tab.c"
+#line 1221 "parse.tab.c"
     break;
 
   case 17: /* g_statement: WORD ':' WORD ';'  */
-#line 111 "parse.y"
+#line 117 "parse.y"
                             {
+		confcache_rec_opt(CC_OPT, (const char *)(yyvsp[-3].ptr), (const char *)(yyvsp[-1].ptr), 0);
 		if (MAIN && (eptr=scan_optmap((const char *)(yyvsp[-3].ptr), (const char *)(yyvsp[-1].ptr))) != NULL) {
 			uuerror(eptr);
 		}
 	}
-#line 1225 "parse.tab.c"
+#line 1232 "parse.tab.c"
     break;
 
   case 18: /* g_statement: WORD '{' pdata '}' ';'  */
-#line 116 "parse.y"
+#line 123 "parse.y"
                                  {
 		buf_t data;
 		char *string=NULL;
@@ -1236,17 +1243,18 @@ yyreduce:
 		memcpy(string, data.ptr, data.len);
 		string[data.len]='\0';
 
+		confcache_rec_opt(CC_OPTBLK, (const char *)(yyvsp[-4].ptr), (const char *)string, 0);
 		if ((eptr=scan_optmap((const char *)(yyvsp[-4].ptr), (const char *)string)) != NULL) {
 			uuerror(eptr);
 		}
 
 		pbuffer_reset();
 	}
-#line 1246 "parse.tab.c"
+#line 1254 "parse.tab.c"
     break;
 
   case 19: /* p_statement: WORD NUMBER NUMBER NUMBER '{' pdata '}' ';'  */
-#line 136 "parse.y"
+#line 144 "parse.y"
                                                     {
 		uint8_t proto=0;
 		uint16_t dstport=0;
@@ -1306,51 +1314,57 @@ yyreduce:
 			PANIC("im confused in %s with proto %u from configuration", ((MAIN) ? "Main" : "Send"), proto);
 		}
 
+		confcache_rec_payload(proto, ((yyvsp[-6].inum) == -1 ? -1 : (int32_t)dstport), (yyvsp[-5].inum), plg, (const uint8_t *)data.ptr, (uint32_t)data.len);
+
 		pbuffer_reset();
 	}
-#line 1312 "parse.tab.c"
+#line 1322 "parse.tab.c"
     break;
 
   case 20: /* m_statement: WORD ':' WORD ';'  */
-#line 200 "parse.y"
+#line 210 "parse.y"
                           {
+		confcache_rec_module(CC_MODKV, (const char *)(yyvsp[-3].ptr), (const char *)(yyvsp[-1].ptr));
 		scan_modaddkeyval((const char *)(yyvsp[-3].ptr), (const char *)(yyvsp[-1].ptr));
 	}
-#line 1320 "parse.tab.c"
+#line 1331 "parse.tab.c"
     break;
 
   case 21: /* m_statement: WORD ':' NUMBER ';'  */
-#line 203 "parse.y"
+#line 214 "parse.y"
                               {
 		char numbuf[16];
 
 		snprintf(numbuf, sizeof(numbuf) -1, "%d", (yyvsp[-1].inum));
+		confcache_rec_module(CC_MODKV, (const char *)(yyvsp[-3].ptr), (const char *)numbuf);
 		scan_modaddkeyval((const char *)(yyvsp[-3].ptr), (const char *)numbuf);
 	}
-#line 1331 "parse.tab.c"
+#line 1343 "parse.tab.c"
     break;
 
   case 22: /* m_statement: WORD ':' BOOL ';'  */
-#line 209 "parse.y"
+#line 221 "parse.y"
                             {
 		char numbuf[16];
 
 		snprintf(numbuf, sizeof(numbuf) -1, "%d", (yyvsp[-1].uinum));
+		confcache_rec_module(CC_MODKV, (const char *)(yyvsp[-3].ptr), (const char *)numbuf);
 		scan_modaddkeyval((const char *)(yyvsp[-3].ptr), (const char *)numbuf);
 	}
-#line 1342 "parse.tab.c"
+#line 1355 "parse.tab.c"
     break;
 
   case 23: /* m_statement: WORD ':' STR ';'  */
-#line 215 "parse.y"
+#line 228 "parse.y"
                            {
+		confcache_rec_module(CC_MODKV, (const char *)(yyvsp[-3].ptr), (const char *)(yyvsp[-1].ptr));
 		scan_modaddkeyval((const char *)(yyvsp[-3].ptr), (const char *)(yyvsp[-1].ptr));
 	}
-#line 1350 "parse.tab.c"
+#line 1364 "parse.tab.c"
     break;
 
   case 24: /* m_statement: multi_line_str ';'  */
-#line 218 "parse.y"
+#line 232 "parse.y"
                              {
 		char mtls[4096];
 		buf_t data;
@@ -1364,16 +1378,17 @@ yyreduce:
 			memcpy(mtls, data.ptr, data.len);
 			mtls[data.len]='\0';
 
+			confcache_rec_module(CC_MODKV, "DATA", (const char *)mtls);
 			scan_modaddkeyval("DATA", (const char *)mtls);
 		}
 
 		pbuffer_reset();
 	}
-#line 1373 "parse.tab.c"
+#line 1388 "parse.tab.c"
     break;
 
   case 27: /* line_str: STR  */
-#line 244 "parse.y"
+#line 259 "parse.y"
             {
 		buf_t data;
 
@@ -1384,27 +1399,27 @@ yyreduce:
 			pbuffer_append(&data);
 		}
 	}
-#line 1388 "parse.tab.c"
+#line 1403 "parse.tab.c"
     break;
 
   case 28: /* pdata: BSTR  */
-#line 257 "parse.y"
+#line 272 "parse.y"
              {
 		if (SEND || MAIN) pbuffer_append(&(yyvsp[0].buf));
 	}
-#line 1396 "parse.tab.c"
+#line 1411 "parse.tab.c"
     break;
 
   case 29: /* pdata: pdata BSTR  */
-#line 260 "parse.y"
+#line 275 "parse.y"
                      {
 		if (SEND || MAIN) pbuffer_append(&(yyvsp[0].buf));
 	}
-#line 1404 "parse.tab.c"
+#line 1419 "parse.tab.c"
     break;
 
   case 30: /* pdata: STR  */
-#line 263 "parse.y"
+#line 278 "parse.y"
               {
 		if (SEND || MAIN) {
 			buf_t data;
@@ -1414,11 +1429,11 @@ yyreduce:
 			pbuffer_append(&data);
 		}
 	}
-#line 1418 "parse.tab.c"
+#line 1433 "parse.tab.c"
     break;
 
   case 31: /* pdata: pdata STR  */
-#line 272 "parse.y"
+#line 287 "parse.y"
                     {
 		if (SEND || MAIN) {
 			buf_t data;
@@ -1428,11 +1443,11 @@ yyreduce:
 			pbuffer_append(&data);
 		}
 	}
-#line 1432 "parse.tab.c"
+#line 1447 "parse.tab.c"
     break;
 
 
-#line 1436 "parse.tab.c"
+#line 1451 "parse.tab.c"
 
       default: break;
     }
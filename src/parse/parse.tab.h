@@ -71,7 +71,7 @@ extern int uudebug;
 #if ! defined YYSTYPE && ! defined YYSTYPE_IS_DECLARED
 union YYSTYPE
 {
-#line 41 "parse.y"
+#line 42 "parse.y"
 
 	int inum;
 	unsigned int uinum;
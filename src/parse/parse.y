@@ -22,6 +22,7 @@
 #include <errno.h>
 
 #include <parse/putil.h>
+#include <parse/confcache.h>
 
 #include <scan_progs/scan_export.h>
 #include <settings.h>
@@ -68,6 +69,7 @@ section:
 	GLOBAL '{' glines '}' ';'
 	| PAYLOADS '{' plines '}' ';'
 	| MODULE STR '{' mlines '}' ';' {
+		confcache_rec_module(CC_MODULE, (const char *)$2, NULL);
 		scan_collectkeyval((const char *)$2);
 	}
 	;
@@ -86,11 +88,13 @@ mlines:
 
 g_statement:
 	WORD ':' STR ';' {
+		confcache_rec_opt(CC_OPT, (const char *)$1, (const char *)$3, 0);
 		if (MAIN && (eptr=scan_optmap((const char *)$1, (const char *)$3)) != NULL) {
 			uuerror(eptr);
 		}
 	}
 	| WORD ':' NUMBER ';' {
+		confcache_rec_opt(CC_OPTI, (const char *)$1, NULL, $3);
 		if (MAIN && (eptr=scan_optmapi((const char *)$1, $3)) != NULL) {
 			uuerror(eptr);
 		}
@@ -99,16 +103,19 @@ g_statement:
 		if ($3 > INT_MAX) {
 			uuerror("number out of range");
 		}
+		confcache_rec_opt(CC_OPTI, (const char *)$1, NULL, (int)$3);
 		if (MAIN && (eptr=scan_optmapi((const char *)$1, (int)$3)) != NULL) {
 			uuerror(eptr);
 		}
 	}
 	| WORD ':' BOOL ';' {
+		confcache_rec_opt(CC_OPTI, (const char *)$1, NULL, (int)$3);
 		if (MAIN && (eptr=scan_optmapi((const char *)$1, (int)$3)) != NULL) {
 			uuerror(eptr);
 		}
 	}
 	| WORD ':' WORD ';' {
+		confcache_rec_opt(CC_OPT, (const char *)$1, (const char *)$3, 0);
 		if (MAIN && (eptr=scan_optmap((const char *)$1, (const char *)$3)) != NULL) {
 			uuerror(eptr);
 		}
@@ -123,6 +130,7 @@ g_statement:
 		memcpy(string, data.ptr, data.len);
 		string[data.len]='\0';
 
+		confcache_rec_opt(CC_OPTBLK, (const char *)$1, (const char *)string, 0);
 		if ((eptr=scan_optmap((const char *)$1, (const char *)string)) != NULL) {
 			uuerror(eptr);
 		}
@@ -192,27 +200,33 @@ p_statement:
 			PANIC("im confused in %s with proto %u from configuration", ((MAIN) ? "Main" : "Send"), proto);
 		}
 
+		confcache_rec_payload(proto, ($2 == -1 ? -1 : (int32_t)dstport), $3, plg, (const uint8_t *)data.ptr, (uint32_t)data.len);
+
 		pbuffer_reset();
 	}
 	;
 
 m_statement:
 	WORD ':' WORD ';' {
+		confcache_rec_module(CC_MODKV, (const char *)$1, (const char *)$3);
 		scan_modaddkeyval((const char *)$1, (const char *)$3);
 	}
 	| WORD ':' NUMBER ';' {
 		char numbuf[16];
 
 		snprintf(numbuf, sizeof(numbuf) -1, "%d", $3);
+		confcache_rec_module(CC_MODKV, (const char *)$1, (const char *)numbuf);
 		scan_modaddkeyval((const char *)$1, (const char *)numbuf);
 	}
 	| WORD ':' BOOL ';' {
 		char numbuf[16];
 
 		snprintf(numbuf, sizeof(numbuf) -1, "%d", $3);
+		confcache_rec_module(CC_MODKV, (const char *)$1, (const char *)numbuf);
 		scan_modaddkeyval((const char *)$1, (const char *)numbuf);
 	}
 	| WORD ':' STR ';' {
+		confcache_rec_module(CC_MODKV, (const char *)$1, (const char *)$3);
 		scan_modaddkeyval((const char *)$1, (const char *)$3);
 	}
 	| multi_line_str ';' {
@@ -228,6 +242,7 @@ m_statement:
 			memcpy(mtls, data.ptr, data.len);
 			mtls[data.len]='\0';
 
+			confcache_rec_module(CC_MODKV, "DATA", (const char *)mtls);
 			scan_modaddkeyval("DATA", (const char *)mtls);
 		}
 
@@ -45,6 +45,7 @@
 #include <unilib/xipc.h>
 #include <unilib/xpoll.h>
 #include <unilib/pktutil.h>
+#include <unilib/wanbatch.h>
 
 /* Payload port encoding functions now in scan_export.h */
 
@@ -648,9 +649,7 @@ static void send_connect(uint64_t state_key, connection_status_t *c, void *pri_w
 
 void connect_wait(void *pri_work) {
 	drone_t *d=NULL;
-	xpoll_t spdf[8];
-	unsigned int spdf_off=0;
-	int pret=0, getret=0;
+	int getret=0;
 	uint8_t msg_type=0, status=0;
 	size_t msg_len=0;
 	uint8_t *ptr=NULL;
@@ -663,16 +662,8 @@ void connect_wait(void *pri_work) {
 	}
 
 	for (s_time=time(NULL);;) {
-		int livesocks=0;
-
-		for (d=s->dlh->head, spdf_off=0; d != NULL; d=d->next, spdf_off++) {
-			if (d->s) livesocks++;
-			spdf[spdf_off].fd=d->s;
-		}
-
-		DBG(M_CON, "polling %d sockets......", livesocks);
-
-		if ((pret=xpoll(&spdf[0], s->dlh->size, 5000)) < 0) {
+		/* sets s_rw on every drone still alive, same as the master loop */
+		if (drone_poll(5000) < 0) {
 			ERR("poll drone fd's fail: %s", strerror(errno));
 		}
 
@@ -682,16 +673,6 @@ void connect_wait(void *pri_work) {
 			break;
 		}
 
-		for (d=s->dlh->head, spdf_off=0; d != NULL; d=d->next, spdf_off++) {
-                        d->s_rw=0;
-                        if (d->status != DRONE_STATUS_DEAD && d->status != DRONE_STATUS_DONE) {
-                                d->s_rw=spdf[spdf_off].rw;
-                        }
-                        if (spdf[spdf_off].rw & XPOLL_READABLE) {
-                                DBG(M_CON, "socket type %s is readable", strdronetype(d->type));
-                        }
-                }
-
 		for (d=s->dlh->head; d != NULL; d=d->next) {
 			DBG(M_CON, "drone type %s drone status %s", strdronetype(d->type), strdronestatus(d->status));
 			if (d->type == DRONE_TYPE_LISTENER && (d->status == DRONE_STATUS_READY || d->status == DRONE_STATUS_WORKING)) {
@@ -716,6 +697,12 @@ void connect_wait(void *pri_work) {
 						else if (msg_type == MSG_OUTPUT) {
 							deal_with_output(ptr, msg_len);
 						}
+						else if (msg_type == MSG_OUTBATCH) {
+							wanbatch_unpack(ptr, msg_len, &deal_with_output);
+						}
+						else if (msg_type == MSG_NOP) {
+							;
+						}
 						else {
 							ERR("unhandled message from Listener drone message type `%s' with status %d", strmsgtype(msg_type), status);
 						}
@@ -0,0 +1,361 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <pcap.h>
+
+#include <settings.h>
+
+#include <unilib/output.h>
+#include <unilib/xmalloc.h>
+#include <scan_progs/dumpwriter.h>
+
+/* on disk sizes, the file header and the per record header (32 bit timeval) */
+#define SF_FILEHDR_LEN	24
+#define SF_RECHDR_LEN	16
+
+typedef struct dw_slot_t {
+	struct pcap_pkthdr hdr;
+	uint8_t *data;
+} dw_slot_t;
+
+static pthread_mutex_t dw_lock=PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t dw_cond=PTHREAD_COND_INITIALIZER;
+static pthread_t dw_thread;
+
+/* ring, head is only advanced by the capture side, tail only by the writer */
+static dw_slot_t *ring=NULL;
+static uint8_t *ring_data=NULL;
+static uint32_t ring_slots=0, slot_len=0;
+static uint64_t ring_head=0, ring_tail=0;
+static int dw_stop=0;
+
+static pcap_t *dead=NULL;
+static pcap_dumper_t *cur=NULL;
+static uint64_t cur_bytes=0;
+static time_t cur_start=0;
+
+/* rotation */
+static int dir_fd=-1;
+static char base_name[256];
+static uint64_t rot_bytes=0;
+static time_t rot_secs=0;
+
+static dumpwriter_stats_t dw_stats;
+
+static void *dumpwriter_thread(void *);
+static void dumpwriter_rotate(void);
+
+int dumpwriter_open(pcap_t *pdev, const char *fname) {
+	char dir_name[256], *slash=NULL;
+	uint32_t j=0;
+	int snap=0, ret=0;
+
+	assert(pdev != NULL && fname != NULL);
+
+	snap=pcap_snapshot(pdev);
+	if (snap < 1) {
+		snap=0xffff;
+	}
+	if (s->pcap_dumpsnap > 0 && s->pcap_dumpsnap < (uint32_t)snap) {
+		snap=(int)s->pcap_dumpsnap;
+	}
+	slot_len=(uint32_t)snap;
+
+	/*
+	 * the savefile gets its own dead handle, so the writer thread never touches the live
+	 * capture handle, and the file header reflects the snaplen we actually write
+	 */
+	dead=pcap_open_dead(pcap_datalink(pdev), snap);
+	if (dead == NULL) {
+		ERR("cant open dead pcap handle for savefile");
+		return -1;
+	}
+
+	cur=pcap_dump_open(dead, fname);
+	if (cur == NULL) {
+		ERR("cant log to pcap file `%s': %s", fname, pcap_geterr(dead));
+		pcap_close(dead);
+		dead=NULL;
+		return -1;
+	}
+	cur_bytes=SF_FILEHDR_LEN;
+	cur_start=time(NULL);
+
+	memset(&dw_stats, 0, sizeof(dw_stats));
+	dw_stats.files=1;
+
+	rot_bytes=(uint64_t)s->pcap_dumpsize * 1024 * 1024;
+	rot_secs=(time_t)s->pcap_dumpsecs;
+
+	if (rot_bytes > 0 || rot_secs > 0) {
+		snprintf(dir_name, sizeof(dir_name) -1, "%s", fname);
+		slash=strrchr(dir_name, '/');
+		if (slash == NULL) {
+			snprintf(base_name, sizeof(base_name) -1, "%s", fname);
+			snprintf(dir_name, sizeof(dir_name) -1, ".");
+		}
+		else {
+			snprintf(base_name, sizeof(base_name) -1, "%s", slash + 1);
+			if (slash == dir_name) {
+				slash++;
+			}
+			*slash='\0';
+		}
+
+		/* held open so rotation still works after we chroot */
+		dir_fd=open(dir_name, O_RDONLY);
+		if (dir_fd < 0) {
+			ERR("cant open savefile directory `%s' for rotation: %s, not rotating", dir_name, strerror(errno));
+			rot_bytes=0;
+			rot_secs=0;
+		}
+		else {
+			VRB(1, "rotating pcap log every %u MB / %u seconds (0 is never)", s->pcap_dumpsize, s->pcap_dumpsecs);
+		}
+	}
+
+	ring_slots=DUMPWRITER_RINGBYTES / slot_len;
+	if (ring_slots < DUMPWRITER_MINSLOTS) {
+		ring_slots=DUMPWRITER_MINSLOTS;
+	}
+
+	ring=(dw_slot_t *)xmalloc(sizeof(dw_slot_t) * ring_slots);
+	ring_data=(uint8_t *)xmalloc((size_t)slot_len * ring_slots);
+	for (j=0; j < ring_slots; j++) {
+		ring[j].data=ring_data + ((size_t)slot_len * j);
+	}
+	ring_head=0;
+	ring_tail=0;
+	dw_stop=0;
+
+	DBG(M_CLD, "pcap log ring has %u slots of %u bytes", ring_slots, slot_len);
+
+	ret=pthread_create(&dw_thread, NULL, &dumpwriter_thread, NULL);
+	if (ret != 0) {
+		ERR("cant start pcap log writer thread: %s", strerror(ret));
+		pcap_dump_close(cur);
+		cur=NULL;
+		pcap_close(dead);
+		dead=NULL;
+		xfree(ring);
+		xfree(ring_data);
+		ring=NULL;
+		ring_data=NULL;
+		if (dir_fd >= 0) {
+			close(dir_fd);
+			dir_fd=-1;
+		}
+		return -1;
+	}
+
+	return 1;
+}
+
+void dumpwriter_frame(const struct pcap_pkthdr *phdr, const uint8_t *packet) {
+	dw_slot_t *slot=NULL;
+
+	if (ring == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&dw_lock);
+
+	if ((ring_head - ring_tail) >= ring_slots) {
+		/* writer is behind, lose the frame from the log, not from the scan */
+		dw_stats.frames_dropped++;
+		pthread_mutex_unlock(&dw_lock);
+		return;
+	}
+
+	slot=&ring[ring_head % ring_slots];
+	memcpy(&slot->hdr, phdr, sizeof(struct pcap_pkthdr));
+	if (slot->hdr.caplen > slot_len) {
+		slot->hdr.caplen=slot_len;
+	}
+	memcpy(slot->data, packet, slot->hdr.caplen);
+
+	ring_head++;
+	pthread_cond_signal(&dw_cond);
+
+	pthread_mutex_unlock(&dw_lock);
+
+	return;
+}
+
+static void *dumpwriter_thread(void *unused) {
+	uint64_t end=0, j=0;
+	struct timespec ts;
+	dw_slot_t *slot=NULL;
+
+	pthread_mutex_lock(&dw_lock);
+
+	for (;;) {
+		while (ring_head == ring_tail && dw_stop == 0) {
+			if (rot_secs == 0) {
+				pthread_cond_wait(&dw_cond, &dw_lock);
+				continue;
+			}
+
+			/* wake up now and then so time based rotation happens on a quiet link */
+			ts.tv_sec=time(NULL) + 1;
+			ts.tv_nsec=0;
+			pthread_cond_timedwait(&dw_cond, &dw_lock, &ts);
+			break;
+		}
+
+		if (ring_head == ring_tail && dw_stop) {
+			break;
+		}
+
+		end=ring_head;
+		pthread_mutex_unlock(&dw_lock);
+
+		if (rot_secs > 0 && (time(NULL) - cur_start) >= rot_secs) {
+			dumpwriter_rotate();
+		}
+
+		for (j=ring_tail; j < end; j++) {
+			slot=&ring[j % ring_slots];
+
+			if (rot_bytes > 0 && cur_bytes > SF_FILEHDR_LEN &&
+			(cur_bytes + SF_RECHDR_LEN + slot->hdr.caplen) > rot_bytes) {
+				dumpwriter_rotate();
+			}
+
+			pcap_dump((uint8_t *)cur, &slot->hdr, slot->data);
+			cur_bytes += SF_RECHDR_LEN + slot->hdr.caplen;
+		}
+
+		if (end != ring_tail) {
+			pcap_dump_flush(cur);
+		}
+
+		pthread_mutex_lock(&dw_lock);
+		dw_stats.frames_written += (uint32_t)(end - ring_tail);
+		ring_tail=end;
+	}
+
+	pthread_mutex_unlock(&dw_lock);
+
+	return unused;
+}
+
+/*
+ * runs on the writer thread only, on failure we keep appending to the current
+ * file rather than losing frames
+ */
+static void dumpwriter_rotate(void) {
+	char fname[300];
+	pcap_dumper_t *next=NULL;
+	FILE *fp=NULL;
+	int fd=-1;
+
+	snprintf(fname, sizeof(fname) -1, "%s.%u", base_name, dw_stats.files);
+
+	fd=openat(dir_fd, fname, O_CREAT|O_WRONLY|O_TRUNC, S_IRUSR|S_IWUSR);
+	if (fd < 0) {
+		ERR("cant open rotated pcap log `%s': %s, no longer rotating", fname, strerror(errno));
+		rot_bytes=0;
+		rot_secs=0;
+		return;
+	}
+
+	fp=fdopen(fd, "w");
+	if (fp == NULL) {
+		ERR("fdopen fails for rotated pcap log `%s': %s, no longer rotating", fname, strerror(errno));
+		close(fd);
+		rot_bytes=0;
+		rot_secs=0;
+		return;
+	}
+
+	next=pcap_dump_fopen(dead, fp);
+	if (next == NULL) {
+		ERR("cant start rotated pcap log `%s': %s, no longer rotating", fname, pcap_geterr(dead));
+		fclose(fp);
+		rot_bytes=0;
+		rot_secs=0;
+		return;
+	}
+
+	pcap_dump_close(cur);
+	cur=next;
+	cur_bytes=SF_FILEHDR_LEN;
+	cur_start=time(NULL);
+
+	pthread_mutex_lock(&dw_lock);
+	dw_stats.files++;
+	pthread_mutex_unlock(&dw_lock);
+
+	DBG(M_CLD, "rotated pcap log to `%s'", fname);
+
+	return;
+}
+
+void dumpwriter_getstats(dumpwriter_stats_t *st) {
+
+	assert(st != NULL);
+
+	pthread_mutex_lock(&dw_lock);
+	memcpy(st, &dw_stats, sizeof(dumpwriter_stats_t));
+	pthread_mutex_unlock(&dw_lock);
+
+	return;
+}
+
+void dumpwriter_close(void) {
+
+	if (ring == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&dw_lock);
+	dw_stop=1;
+	pthread_cond_signal(&dw_cond);
+	pthread_mutex_unlock(&dw_lock);
+
+	pthread_join(dw_thread, NULL);
+
+	pcap_dump_close(cur);
+	cur=NULL;
+	pcap_close(dead);
+	dead=NULL;
+
+	if (dir_fd >= 0) {
+		close(dir_fd);
+		dir_fd=-1;
+	}
+
+	VRB(1, "pcap log: %u frames written to %u file(s), %u frames dropped by the log writer",
+		dw_stats.frames_written, dw_stats.files, dw_stats.frames_dropped
+	);
+
+	xfree(ring);
+	xfree(ring_data);
+	ring=NULL;
+	ring_data=NULL;
+
+	return;
+}
@@ -0,0 +1,54 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#ifndef _DUMPWRITER_H
+# define _DUMPWRITER_H
+
+#include <pcap.h>
+
+/*
+ * the pcap savefile (-w) is written by a background thread so a slow disk
+ * never stalls the capture loop, frames are copied into a fixed ring and
+ * if the writer falls behind new frames are dropped from the log (only)
+ */
+
+/* total bytes of frame data the ring may hold, slot count is derived from this */
+#define DUMPWRITER_RINGBYTES	(8 * 1024 * 1024)
+#define DUMPWRITER_MINSLOTS	64
+
+typedef struct dumpwriter_stats_t {
+	uint32_t frames_written;
+	uint32_t frames_dropped;
+	uint32_t files;
+} dumpwriter_stats_t;
+
+/*
+ * must be called before privs are dropped, rotation files are created relative
+ * to the directory of the first savefile using a descriptor held open from here
+ */
+int dumpwriter_open(pcap_t * /* capture dev */, const char * /* savefile */);
+
+/* called from the capture callback, never blocks on the disk */
+void dumpwriter_frame(const struct pcap_pkthdr * /* phdr */, const uint8_t * /* packet */);
+
+void dumpwriter_getstats(dumpwriter_stats_t *);
+
+/* drains whatever is queued, then stops the writer and closes the savefile */
+void dumpwriter_close(void);
+
+#endif
@@ -107,7 +107,7 @@ int main(int argc, char **argv) {
 #elif defined(BUILD_IDENT_RECV)
 	run_mode=&recv_packet;
 
-	if (argc != 10) {
+	if (argc != 12) {
 		terminate("arguments are incorrect for this program");
 	}
 
@@ -188,6 +188,17 @@ int main(int argc, char **argv) {
 
 	s->ipcuri=xstrdup(argv[9]);
 
+	/* savefile rotate size:rotate time:snaplen */
+	if (sscanf(argv[10], "%u:%u:%u", &s->pcap_dumpsize, &s->pcap_dumpsecs, &s->pcap_dumpsnap) != 3) {
+		terminate("bad savefile options `%s'", argv[10]);
+	}
+
+	if (strcmp(argv[11], "none") != 0) {
+		if (scan_setreadfile(argv[11]) < 0) {
+			terminate("can't replay file `%s'", argv[11]);
+		}
+	}
+
 #else
  #error BUILD_IDENT_SEND or BUILD_IDENT_RECV must be set
 #endif
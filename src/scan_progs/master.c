@@ -38,6 +38,8 @@
 #include <scan_progs/report.h>
 #include <scan_progs/phase_filter.h>
 #include <scan_progs/trace_session.h>
+#include <scan_progs/telemetry.h>
+#include <scan_progs/metrics_srv.h>
 #include <unilib/drone.h>
 #include <unilib/qfifo.h>
 #include <unilib/chtbl.h>
@@ -49,6 +51,8 @@
 #include <unilib/terminate.h>
 #include <unilib/socktrans.h>
 #include <unilib/modules.h>
+#include <unilib/wanbatch.h>
+#include <unilib/standard_dns.h>
 
 #define MASTER_START			0
 #define MASTER_SENT_LISTEN_WORKUNITS	1
@@ -63,11 +67,37 @@ static trace_session_t *trace_sess=NULL;	/* traceroute session bookkeeping */
 static int listener_stats=0;
 static int lwu_mixed=0;  /* moved from dispatch_work_units() for phase reset */
 
-static void master_read_drones(void);
+/* pipelined compound mode, arp responders not yet turned into workunits */
+#define PIPELINE_FLUSH_MS	250
+static int pipe_on=0;
+static char *pipe_ports=NULL;
+static uint32_t *pipe_ips=NULL, pipe_cnt=0, pipe_size=0, pipe_queued=0;
+static struct timeval pipe_last;
+
+/*
+ * --adaptive-wait, the recv timeout ends once the slowest rtt the listeners
+ * measured has passed twice over since the last probe went out and nothing
+ * has come back in a while. -L stays the upper bound
+ */
+#define ADAPTIVE_MIN_SAMPLES	8
+#define ADAPTIVE_FLOOR_MS	500
+static struct timeval wait_stv, out_last;
+
+/* --selective-retry, what answered since the last pass through the loop */
+#define ANSWERED_CHUNK		8192	/* per MSG_ANSWERED, well under IPC_DSIZE */
+static send_answered_t *ans_pend=NULL;
+static uint32_t ans_cnt=0, ans_size=0;
+
+static int master_read_drones(void);
 static void master_updatestate(int );
 static int dispatch_work_units(void);
 static int senders_done(void);
+static void requeue_dead_senders(void);
 static void terminate_listeners(void);
+static void pipeline_flush(int /* now */);
+static int adaptive_wait_done(void);
+static void answered_add(uint32_t /* host */, uint16_t /* port */);
+static void answered_flush(void);
 
 /*
  * Reset master state for a new phase in compound mode.
@@ -83,6 +113,72 @@ void master_reset_phase_state(void) {
 	DBG(M_MST, "master_reset_phase_state: reset counters for new phase");
 }
 
+void master_pipeline_start(const char *port_spec) {
+
+	pipe_on=1;
+	pipe_ports=(port_spec != NULL ? xstrdup(port_spec) : NULL);
+	pipe_cnt=0;
+	pipe_queued=0;
+	gettimeofday(&pipe_last, NULL);
+
+	return;
+}
+
+uint32_t master_pipeline_stop(void) {
+
+	if (pipe_cnt > 0) {
+		VRB(1, "%u hosts answered arp after the scan was over, they are not probed", pipe_cnt);
+	}
+
+	if (pipe_ips != NULL) {
+		xfree(pipe_ips);
+		pipe_ips=NULL;
+	}
+	if (pipe_ports != NULL) {
+		xfree(pipe_ports);
+		pipe_ports=NULL;
+	}
+	pipe_cnt=0;
+	pipe_size=0;
+	pipe_on=0;
+
+	return pipe_queued;
+}
+
+/*
+ * hand the responders gathered since the last flush to the workunit code,
+ * batched so neighbours end up in one cidr workunit. if the senders were
+ * already out of work (or we were waiting out the recv timeout) go back to
+ * dispatching, the timeout starts over once these are sent
+ */
+static void pipeline_flush(int now) {
+	struct timeval tv;
+
+	if (pipe_cnt == 0) {
+		return;
+	}
+
+	gettimeofday(&tv, NULL);
+
+	if (now == 0 && ((tv.tv_sec - pipe_last.tv_sec) * 1000 + (tv.tv_usec - pipe_last.tv_usec) / 1000) < PIPELINE_FLUSH_MS) {
+		return;
+	}
+
+	DBG(M_MST, "queueing %u arp responders for %s", pipe_cnt, strscanmode(scan_getmode()));
+
+	workunit_add_hosts(pipe_ips, pipe_cnt, pipe_ports);
+	pipe_queued += pipe_cnt;
+	pipe_cnt=0;
+	pipe_last=tv;
+
+	if (master_state >= MASTER_SENT_SENDER_WORKUNITS && master_state <= MASTER_IN_TIMEOUT) {
+		DBG(M_MST, "back to dispatching sender workunits from state %d", master_state);
+		master_state=MASTER_SENT_LISTEN_WORKUNITS;
+	}
+
+	return;
+}
+
 static void master_updatestate(int state) {
 
 	DBG(M_MST, "switching from state %d to %d", master_state, state);
@@ -250,8 +346,6 @@ void run_scan(void) {
 
 	s->pri_work=fifo_init();
 
-	assert(s->dlh->size <= MAX_CONNS);
-
 	if (s->dlh->size < 1) {
 		ERR("no drones to do work, exiting");
 		return;
@@ -273,6 +367,19 @@ void run_scan(void) {
 		DBG(M_TRC, "traceroute session created ttl %u-%u", s->ss->minttl, s->ss->maxttl);
 	}
 
+	if (GET_ADAPTIVEWAIT()) {
+		drone_t *d=NULL;
+
+		/* the listeners start their histograms over with the workunit, so do we */
+		for (d=s->dlh->head; d != NULL; d=d->next) {
+			d->rtt_samples=0;
+			d->rtt_p50=0;
+			d->rtt_p99=0;
+		}
+	}
+
+	telemetry_begin();
+
 	{
 	time_t last_progress=time(NULL);
 
@@ -306,13 +413,25 @@ void run_scan(void) {
 
 		/* fill in the drone list with socket readable information */
 		readable=drone_poll(s->master_tickrate);
-		if (readable) {
-			master_read_drones();
+		if (readable && master_read_drones() > 0) {
 			time(&last_progress);
 		}
 
+		requeue_dead_senders();
+
+		if (ans_cnt > 0) {
+			answered_flush();
+		}
+
+		if (pipe_on) {
+			pipeline_flush(master_state >= MASTER_WAIT_SENDER);
+		}
+
+		telemetry_tick(master_state == MASTER_IN_TIMEOUT ? wait_stime + s->ss->recv_timeout : 0);
+
 		if (master_state == MASTER_WAIT_SENDER && senders_done()) {
 			time(&wait_stime);
+			gettimeofday(&wait_stv, NULL);
 			master_updatestate(MASTER_IN_TIMEOUT);
 		}
 
@@ -320,7 +439,7 @@ void run_scan(void) {
 			time_t tnow;
 
 			time(&tnow);
-			if ((tnow - wait_stime) > s->ss->recv_timeout) {
+			if ((tnow - wait_stime) > s->ss->recv_timeout || (GET_ADAPTIVEWAIT() && adaptive_wait_done())) {
 				if (GET_DOCONNECT()) {
 					/* cant wait if we are connecting, in case a connection hasnt started yet */
 					connect_closeopen(s->pri_work);
@@ -364,6 +483,11 @@ void run_scan(void) {
 				master_read_drones();
 			}
 
+			/* pri_work is gone, the endpoint serves the last snapshot from here */
+			if (s->metrics_uri != NULL) {
+				metrics_srv_poll();
+			}
+
 			/* hard timeout guard: bail out if we have been spinning too long */
 			time(&tnow);
 			if (tnow >= deadline) {
@@ -404,14 +528,22 @@ void run_scan(void) {
 	return;
 }
 
-static void master_read_drones(void) {
+/*
+ * returns how many of the messages read show the scan is alive, for the stall
+ * watchdog. progress reports only count from a sender holding a workunit,
+ * listener progress and keepalives never do
+ */
+static int master_read_drones(void) {
 	uint8_t msg_type=0, status=0;
 	size_t msg_len=0;
 	drone_t *c=NULL;
+	int moved=0;
 	union {
 		uint8_t *p;
 		send_stats_t *s;
 		recv_stats_t *r;
+		send_progress_t *sp;
+		recv_progress_t *rp;
 	} d_u;
 
 	for (c=s->dlh->head; c != NULL; c=c->next) {
@@ -452,6 +584,9 @@ static void master_read_drones(void) {
 					strdronetype(c->type),
 					c->s
 				);
+				if (msg_type != MSG_PROGRESS && msg_type != MSG_NOP) {
+					moved++;
+				}
 				if (msg_type == MSG_ERROR || status != MSG_STATUS_OK) {
 					ERR("drone on fd %d is dead, closing socket and marking dead", c->s);
 					drone_updatestate(c, DRONE_STATUS_DEAD);
@@ -471,6 +606,7 @@ static void master_read_drones(void) {
 
 						if (msg_len != sizeof(send_stats_t)) {
 							ERR("bad send status message, too short");
+							c->wid=0;
 							drone_updatestate(c, DRONE_STATUS_DEAD);
 							break;
 						}
@@ -488,6 +624,10 @@ static void master_read_drones(void) {
 
 						VRB(0, "sender statistics %s", smsg);
 
+						c->pkts_done += d_u.s->packets_sent;
+						c->pkts_cur=0;
+						c->pps=0;
+
 						send_workunits_complete++;
 						DBG(M_MST, "setting sender back to ready state after workdone message");
 						c->status=DRONE_STATUS_READY;
@@ -504,10 +644,11 @@ static void master_read_drones(void) {
 						}
 
 						snprintf(smsg, sizeof(smsg) -1,
-							"%u packets recieved %u packets droped and %u interface drops",
+							"%u packets recieved %u packets droped and %u interface drops (%u savefile drops)",
 							d_u.r->packets_recv,
 							d_u.r->packets_dropped,
-							d_u.r->interface_dropped
+							d_u.r->interface_dropped,
+							d_u.r->dump_dropped
 						);
 
 						ws.magic=WKS_RECV_MAGIC;
@@ -532,6 +673,49 @@ static void master_read_drones(void) {
 						break;
 					}
 				}
+				else if (msg_type == MSG_OUTBATCH && c->type == DRONE_TYPE_LISTENER) {
+					if (wanbatch_unpack(d_u.p, msg_len, &deal_with_output) < 0) {
+						ERR("cant deal with batched output from drone, marking as dead");
+						drone_updatestate(c, DRONE_STATUS_DEAD);
+						break;
+					}
+				}
+				else if (msg_type == MSG_PROGRESS && c->type == DRONE_TYPE_SENDER) {
+					if (msg_len != sizeof(send_progress_t) || d_u.sp->magic != DRONE_PROGRESS_MAGIC) {
+						ERR("bad progress message from sender, marking as dead");
+						drone_updatestate(c, DRONE_STATUS_DEAD);
+						break;
+					}
+					if (c->wid != 0) {
+						workunit_progress_sp(c->wid, d_u.sp->done);
+					}
+					/* a sender thats working reports every DRONE_PROGRESS_SECS, even when paused */
+					if (c->wid != 0) {
+						moved++;
+					}
+					c->pkts_cur=d_u.sp->packets_sent;
+					c->pps=(uint32_t)d_u.sp->pps;
+				}
+				else if (msg_type == MSG_PROGRESS && c->type == DRONE_TYPE_LISTENER) {
+					if (msg_len != sizeof(recv_progress_t) || d_u.rp->st.magic != DRONE_RPROGRESS_MAGIC) {
+						ERR("bad progress message from listener, marking as dead");
+						drone_updatestate(c, DRONE_STATUS_DEAD);
+						break;
+					}
+					c->recv_pkts=d_u.rp->st.packets_recv;
+					c->recv_drops=d_u.rp->st.packets_dropped;
+					c->recv_ifdrops=d_u.rp->st.interface_dropped;
+					c->queue_depth=d_u.rp->queue_depth;
+					c->parse_issues=d_u.rp->parse_issues;
+					c->parse_truncated=d_u.rp->parse_truncated;
+					c->parse_frags=d_u.rp->parse_frags;
+					c->rtt_samples=d_u.rp->rtt_samples;
+					c->rtt_p50=d_u.rp->rtt_p50;
+					c->rtt_p99=d_u.rp->rtt_p99;
+				}
+				else if (msg_type == MSG_NOP) {
+					DBG(M_MST, "keepalive from %s drone on fd %d", strdronetype(c->type), c->s);
+				}
 				else {
 					ERR("unhandled message from `%s' drone message type `%s' with status %d",
 						strdronetype(c->type),
@@ -544,7 +728,14 @@ static void master_read_drones(void) {
 		} /* readable fd */
 	} /* for each drone */
 
-	return;
+	/* -I and --stream lines from this pass go out together */
+	report_flush();
+
+	if (GET_DODNS()) {
+		stddns_poll(s->dns);
+	}
+
+	return moved;
 }
 
 /*
@@ -562,6 +753,19 @@ int deal_with_output(void *msg, size_t msg_len) {
 
 	r_u.ptr=msg;
 
+	if (GET_ADAPTIVEWAIT()) {
+		gettimeofday(&out_last, NULL);
+	}
+
+	if (GET_SELECTRETRY() && s->repeats > 1 && master_state < MASTER_IN_TIMEOUT) {
+		if (*r_u.magic == IP_REPORT_MAGIC) {
+			answered_add(r_u.i->host_addr, r_u.i->sport);
+		}
+		else if (*r_u.magic == ARP_REPORT_MAGIC) {
+			answered_add(r_u.a->ipaddr, 0);
+		}
+	}
+
 	if (*r_u.magic == IP_REPORT_MAGIC) {
 		if (r_u.i->doff > s->vi[0]->mtu) {
 			ERR("impossible packet length %u with mtu %u", r_u.i->doff, s->vi[0]->mtu);
@@ -659,6 +863,14 @@ int deal_with_output(void *msg, size_t msg_len) {
 
 		/* Store ARP response in phase filter cache for compound mode */
 		if (s->num_phases > 1) {
+			/* pipelined, the first reply from a host queues it for the next phase right away */
+			if (pipe_on && phase_filter_check(r_u.a->ipaddr) == 0) {
+				if (pipe_cnt == pipe_size) {
+					pipe_size=(pipe_size == 0 ? 64 : pipe_size * 2);
+					pipe_ips=(uint32_t *)xrealloc(pipe_ips, pipe_size * sizeof(uint32_t));
+				}
+				pipe_ips[pipe_cnt++]=ntohl(r_u.a->ipaddr);
+			}
 			phase_filter_store(r_u.a->ipaddr, r_u.a->hwaddr);
 		}
 
@@ -677,6 +889,133 @@ int deal_with_output(void *msg, size_t msg_len) {
 	return 1;
 }
 
+/*
+ * a sender that died in the middle of a workunit leaves it behind, put what
+ * it didnt get to back in the queue and start dispatching again if we had stopped
+ */
+static void requeue_dead_senders(void) {
+	drone_t *c=NULL;
+	int requeued=0;
+
+	for (c=s->dlh->head; c != NULL; c=c->next) {
+		if (c->type == DRONE_TYPE_SENDER && c->status == DRONE_STATUS_DEAD && c->wid != 0) {
+			workunit_reject_sp(c->wid);
+			c->wid=0;
+			requeued++;
+		}
+	}
+
+	if (requeued == 0) {
+		return;
+	}
+
+	if (s->senders < 1) {
+		ERR("no senders left to finish %d requeued workunit(s)", requeued);
+		return;
+	}
+
+	if (master_state == MASTER_SENT_SENDER_WORKUNITS || master_state == MASTER_WAIT_SENDER) {
+		DBG(M_MST, "back to dispatching sender workunits from state %d", master_state);
+		master_state=MASTER_SENT_LISTEN_WORKUNITS;
+	}
+
+	return;
+}
+
+static void answered_add(uint32_t host, uint16_t port) {
+
+	if (ans_cnt == ans_size) {
+		ans_size=(ans_size == 0 ? 256 : ans_size * 2);
+		ans_pend=(send_answered_t *)xrealloc(ans_pend, sizeof(send_answered_t) * ans_size);
+	}
+
+	ans_pend[ans_cnt].host=host;
+	ans_pend[ans_cnt].port=port;
+	ans_cnt++;
+
+	return;
+}
+
+/*
+ * every sender still working hears about every answer, they have no idea
+ * whose chunk it came from and its cheaper to look than to work that out
+ */
+static void answered_flush(void) {
+	drone_t *c=NULL;
+	uint32_t off=0, chunk=0;
+
+	for (c=s->dlh->head; c != NULL; c=c->next) {
+		if (c->type != DRONE_TYPE_SENDER || c->status != DRONE_STATUS_WORKING) {
+			continue;
+		}
+		for (off=0; off < ans_cnt; off += chunk) {
+			chunk=MIN(ans_cnt - off, ANSWERED_CHUNK);
+			if (send_message(c->s, MSG_ANSWERED, MSG_STATUS_OK, (const uint8_t *)&ans_pend[off], sizeof(send_answered_t) * chunk) < 0) {
+				ERR("cant send answered list to sender on fd %d, marking dead", c->s);
+				drone_updatestate(c, DRONE_STATUS_DEAD);
+				break;
+			}
+		}
+	}
+
+	DBG(M_MST, "passed %u answers on to the senders", ans_cnt);
+	ans_cnt=0;
+
+	return;
+}
+
+static int adaptive_wait_done(void) {
+	drone_t *c=NULL;
+	struct timeval now;
+	uint32_t samples=0, p50=0, p99=0, waited=0, quiet=0, need=0;
+
+	/* connections (and their banners) go at the other side's pace, not the rtt's */
+	if (GET_DOCONNECT()) {
+		return 0;
+	}
+
+	for (c=s->dlh->head; c != NULL; c=c->next) {
+		if (c->type != DRONE_TYPE_LISTENER) {
+			continue;
+		}
+		samples += c->rtt_samples;
+		if (c->rtt_p99 > p99) {
+			p99=c->rtt_p99;
+		}
+		if (c->rtt_p50 > p50) {
+			p50=c->rtt_p50;
+		}
+	}
+
+	if (samples < ADAPTIVE_MIN_SAMPLES) {
+		return 0;
+	}
+
+	gettimeofday(&now, NULL);
+	waited=(uint32_t)((now.tv_sec - wait_stv.tv_sec) * 1000 + (now.tv_usec - wait_stv.tv_usec) / 1000);
+	if (timercmp(&out_last, &wait_stv, >)) {
+		quiet=(uint32_t)((now.tv_sec - out_last.tv_sec) * 1000 + (now.tv_usec - out_last.tv_usec) / 1000);
+	}
+	else {
+		quiet=waited;
+	}
+
+	need=p99 * 2;
+	if (need < ADAPTIVE_FLOOR_MS) {
+		need=ADAPTIVE_FLOOR_MS;
+	}
+
+	if (waited < need || quiet < need) {
+		return 0;
+	}
+
+	VRB(1, "rtt p50 %u ms p99 %u ms over %u samples, done waiting after %u ms instead of %u s",
+		p50, p99, samples, waited, s->ss->recv_timeout
+	);
+
+	return 1;
+}
+
 static int senders_done(void) {
 	int ret=0;
 
@@ -22,6 +22,9 @@
 void run_drone(void);
 void run_scan(void);
 void master_reset_phase_state(void); /* reset counters for compound mode phases */
+/* pipelined compound mode, new arp responders get queued for the current mode during run_scan */
+void master_pipeline_start(const char * /* port spec or NULL */);
+uint32_t master_pipeline_stop(void); /* returns hosts queued */
 int dispatch_pri_work(void);
 int deal_with_output(void * /* msg */, size_t /* msg_len */);
 void deal_with_workunit(const void * /* workunit */, uint32_t /* wid */);
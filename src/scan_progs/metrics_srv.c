@@ -0,0 +1,531 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <scan_progs/scanopts.h>
+#include <settings.h>
+#include <scan_progs/telemetry.h>
+#include <scan_progs/metrics_srv.h>
+#include <unilib/drone.h>
+#include <unilib/metrics.h>
+#include <unilib/xmalloc.h>
+#include <unilib/output.h>
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+typedef struct mbuf_t {
+	char *buf;
+	size_t len;
+	size_t size;
+} mbuf_t;
+
+typedef struct mclient_t {
+	int fd;
+	time_t start;
+	size_t reqlen;
+	char req[METRICS_REQMAX];
+	mbuf_t out;
+	size_t outoff;
+} mclient_t;
+
+static int m_lsock=-1;
+static int m_failed=0;
+static int m_unix=0;
+static mclient_t m_clients[METRICS_MAXCLIENTS];
+static int m_nclients=0;
+
+/* the connect stream counters in s->stats, by the name they get in the output */
+static const struct {
+	const char *name;
+	size_t off;
+} m_stream[]={
+	{"segments_sent",		offsetof(settings_t, stats.stream_segments_sent)		},
+	{"reassembly_abort_badpkt",	offsetof(settings_t, stats.stream_reassembly_abort_badpkt)	},
+	{"remote_abort",		offsetof(settings_t, stats.stream_remote_abort)			},
+	{"closed_alien_pkt",		offsetof(settings_t, stats.stream_closed_alien_pkt)		},
+	{"out_of_window_pkt",		offsetof(settings_t, stats.stream_out_of_window_pkt)		},
+	{"trunc_past_window",		offsetof(settings_t, stats.stream_trunc_past_window)		},
+	{"out_of_order_segment",	offsetof(settings_t, stats.stream_out_of_order_segment)		},
+	{"connections_est",		offsetof(settings_t, stats.stream_connections_est)		},
+	{"triggers_sent",		offsetof(settings_t, stats.stream_triggers_sent)		},
+	{"dynamic_triggers_sent",	offsetof(settings_t, stats.stream_dynamic_triggers_sent)	},
+	{"completely_alien_packet",	offsetof(settings_t, stats.stream_completely_alien_packet)	},
+};
+
+static int metrics_parseuri(const char *, struct sockaddr_un *, struct sockaddr_in *);
+static void mb_printf(mbuf_t *, const char *, ...) _PRINTF23_;
+static void mb_head(mbuf_t *, const char * /* name */, const char * /* type */, const char * /* help */);
+static void mb_drone(mbuf_t *, const char * /* name */, const drone_t *, const char * /* extra label */, uint64_t);
+static void metrics_render(mbuf_t *);
+static void metrics_respond(mclient_t *);
+static void metrics_drop(int);
+
+int metrics_srv_checkuri(const char *uri) {
+	struct sockaddr_un sun;
+	struct sockaddr_in sin;
+
+	return metrics_parseuri(uri, &sun, &sin) < 0 ? -1 : 1;
+}
+
+void metrics_srv_open(void) {
+	union {
+		struct sockaddr_un u;
+		struct sockaddr_in i;
+		struct sockaddr sa;
+	} s_u;
+	struct sockaddr_in sin;
+	socklen_t slen=0;
+	int ptype=0, fl=0, on=1;
+
+	if (m_lsock >= 0 || m_failed) {
+		return;
+	}
+
+	memset(&s_u, 0, sizeof(s_u));
+	ptype=metrics_parseuri(s->metrics_uri, &s_u.u, &sin);
+	if (ptype < 0) {
+		ERR("bad metrics uri `%s'", s->metrics_uri);
+		m_failed=1;
+		return;
+	}
+	if (ptype == 1) {
+		m_unix=1;
+		slen=(socklen_t)sizeof(struct sockaddr_un);
+		unlink(s_u.u.sun_path);
+	}
+	else {
+		m_unix=0;
+		memcpy(&s_u.i, &sin, sizeof(sin));
+		slen=(socklen_t)sizeof(struct sockaddr_in);
+	}
+
+	if ((m_lsock=socket(s_u.sa.sa_family, SOCK_STREAM, 0)) < 0) {
+		ERR("cant create metrics socket: %s", strerror(errno));
+		m_failed=1;
+		return;
+	}
+
+	if (m_unix == 0) {
+		setsockopt(m_lsock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	}
+
+	if (bind(m_lsock, &s_u.sa, slen) < 0 || listen(m_lsock, METRICS_MAXCLIENTS) < 0) {
+		ERR("cant listen for metrics on `%s': %s", s->metrics_uri, strerror(errno));
+		close(m_lsock);
+		m_lsock=-1;
+		m_failed=1;
+		return;
+	}
+
+	fl=fcntl(m_lsock, F_GETFL);
+	if (fl < 0 || fcntl(m_lsock, F_SETFL, fl | O_NONBLOCK) < 0) {
+		ERR("cant make metrics socket non-blocking: %s", strerror(errno));
+		metrics_srv_close();
+		m_failed=1;
+		return;
+	}
+
+	VRB(1, "serving metrics on `%s'", s->metrics_uri);
+
+	return;
+}
+
+void metrics_srv_poll(void) {
+	int cfd=-1, fl=0, j=0;
+	ssize_t ret=0;
+	time_t tnow=0;
+
+	if (m_lsock < 0) {
+		return;
+	}
+
+	time(&tnow);
+
+	while (m_nclients < METRICS_MAXCLIENTS && (cfd=accept(m_lsock, NULL, NULL)) >= 0) {
+		fl=fcntl(cfd, F_GETFL);
+		if (fl < 0 || fcntl(cfd, F_SETFL, fl | O_NONBLOCK) < 0) {
+			close(cfd);
+			continue;
+		}
+#ifdef SO_NOSIGPIPE
+		fl=1;
+		setsockopt(cfd, SOL_SOCKET, SO_NOSIGPIPE, &fl, sizeof(fl));
+#endif
+		memset(&m_clients[m_nclients], 0, sizeof(mclient_t));
+		m_clients[m_nclients].fd=cfd;
+		m_clients[m_nclients].start=tnow;
+		m_nclients++;
+	}
+
+	for (j=0; j < m_nclients; ) {
+		mclient_t *c=&m_clients[j];
+
+		if (tnow - c->start > METRICS_TIMEOUT) {
+			DBG(M_MST, "metrics: client on fd %d timed out", c->fd);
+			metrics_drop(j);
+			continue;
+		}
+
+		if (c->out.buf == NULL) {
+			ret=recv(c->fd, c->req + c->reqlen, sizeof(c->req) - 1 - c->reqlen, MSG_DONTWAIT);
+			if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+				j++;
+				continue;
+			}
+			if (ret < 1) {
+				metrics_drop(j);
+				continue;
+			}
+			c->reqlen += (size_t)ret;
+			c->req[c->reqlen]='\0';
+
+			if (strstr(c->req, "\r\n\r\n") == NULL && strstr(c->req, "\n\n") == NULL) {
+				if (c->reqlen == sizeof(c->req) - 1) {
+					metrics_drop(j);
+					continue;
+				}
+				j++;
+				continue;
+			}
+
+			metrics_respond(c);
+		}
+
+		ret=send(c->fd, c->out.buf + c->outoff, c->out.len - c->outoff, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+			j++;
+			continue;
+		}
+		if (ret < 0) {
+			metrics_drop(j);
+			continue;
+		}
+		c->outoff += (size_t)ret;
+		if (c->outoff == c->out.len) {
+			metrics_drop(j);
+			continue;
+		}
+		j++;
+	}
+
+	return;
+}
+
+void metrics_srv_close(void) {
+
+	while (m_nclients > 0) {
+		metrics_drop(0);
+	}
+
+	if (m_lsock >= 0) {
+		close(m_lsock);
+		m_lsock=-1;
+		if (m_unix) {
+			unlink(s->metrics_uri + 5);
+		}
+	}
+
+	return;
+}
+
+/* 1 unix, 2 inet, -1 bad */
+static int metrics_parseuri(const char *uri, struct sockaddr_un *sun, struct sockaddr_in *sin) {
+	char addr[64];
+	const char *port=NULL;
+	char *end=NULL;
+	unsigned long int pnum=0;
+
+	if (uri == NULL || strlen(uri) < 1) {
+		return -1;
+	}
+
+	if (strncmp(uri, "unix:", 5) == 0) {
+		if (strlen(uri + 5) < 1 || strlen(uri + 5) >= sizeof(sun->sun_path)) {
+			return -1;
+		}
+		memset(sun, 0, sizeof(struct sockaddr_un));
+		sun->sun_family=AF_UNIX;
+		strncpy(sun->sun_path, uri + 5, sizeof(sun->sun_path) -1);
+		return 1;
+	}
+
+	memset(sin, 0, sizeof(struct sockaddr_in));
+	sin->sin_family=AF_INET;
+
+	if ((port=strrchr(uri, ':')) != NULL) {
+		if ((size_t)(port - uri) >= sizeof(addr) || port == uri) {
+			return -1;
+		}
+		memcpy(addr, uri, (size_t)(port - uri));
+		addr[port - uri]='\0';
+		port++;
+	}
+	else {
+		strcpy(addr, "127.0.0.1");
+		port=uri;
+	}
+
+	if (inet_pton(AF_INET, addr, &sin->sin_addr) != 1) {
+		return -1;
+	}
+
+	pnum=strtoul(port, &end, 10);
+	if (end == NULL || *end != '\0' || pnum < 1 || pnum > 0xffff) {
+		return -1;
+	}
+	sin->sin_port=htons((uint16_t)pnum);
+
+	return 2;
+}
+
+static void metrics_respond(mclient_t *c) {
+	mbuf_t body;
+	const char *status="200 OK";
+
+	memset(&body, 0, sizeof(body));
+
+	if (strncmp(c->req, "GET ", 4) != 0) {
+		status="405 Method Not Allowed";
+	}
+	else if (strncmp(c->req + 4, "/metrics", 8) != 0 && strncmp(c->req + 4, "/ ", 2) != 0) {
+		status="404 Not Found";
+	}
+	else {
+		metrics_render(&body);
+	}
+
+	mb_printf(&c->out,
+		"HTTP/1.0 %s\r\n"
+		"Content-Type: text/plain; version=0.0.4\r\n"
+		"Content-Length: " STFMT "\r\n"
+		"Connection: close\r\n"
+		"\r\n",
+		status, body.len
+	);
+	if (body.len > 0) {
+		mb_printf(&c->out, "%s", body.buf);
+	}
+	if (body.buf != NULL) {
+		xfree(body.buf);
+	}
+	c->outoff=0;
+
+	return;
+}
+
+static void metrics_render(mbuf_t *mb) {
+	telemetry_snap_t ts;
+	const drone_t *d=NULL;
+	unsigned int j=0;
+
+	telemetry_snapshot(&ts);
+
+	mb_head(mb, "unicornscan_scan_iteration", "gauge", "scan iteration being run");
+	mb_printf(mb, "unicornscan_scan_iteration %u\n", s->cur_iter);
+	mb_head(mb, "unicornscan_scan_phase", "gauge", "scan phase being run, from 1");
+	mb_printf(mb, "unicornscan_scan_phase %u\n", (unsigned int)s->cur_phase + 1);
+	mb_head(mb, "unicornscan_scan_packets_sent", "gauge", "packets sent so far this phase");
+	mb_printf(mb, "unicornscan_scan_packets_sent %" PRIu64 "\n", ts.sent);
+	mb_head(mb, "unicornscan_scan_packets_expected", "gauge", "packets the estimate says this phase sends");
+	mb_printf(mb, "unicornscan_scan_packets_expected %" PRIu64 "\n", ts.expected);
+	mb_head(mb, "unicornscan_scan_pps", "gauge", "packets per second all senders are doing now");
+	mb_printf(mb, "unicornscan_scan_pps %u\n", ts.pps);
+	mb_head(mb, "unicornscan_scan_eta_seconds", "gauge", "seconds until this phase is done, -1 unknown");
+	mb_printf(mb, "unicornscan_scan_eta_seconds %ld\n", ts.eta);
+	mb_head(mb, "unicornscan_master_pri_work", "gauge", "priority (connect) workunits waiting in the master");
+	mb_printf(mb, "unicornscan_master_pri_work %u\n", ts.pri);
+	mb_head(mb, "unicornscan_drones", "gauge", "drones still working, by type");
+	mb_printf(mb, "unicornscan_drones{type=\"sender\"} %d\nunicornscan_drones{type=\"listener\"} %d\n", s->senders, s->listeners);
+
+	mb_head(mb, "unicornscan_ipc_messages_total", "counter", "ipc messages the master sent and read");
+	mb_printf(mb, "unicornscan_ipc_messages_total{dir=\"sent\"} %" PRIu64 "\n", metrics_get(MET_IPC_MSGS_SENT));
+	mb_printf(mb, "unicornscan_ipc_messages_total{dir=\"recv\"} %" PRIu64 "\n", metrics_get(MET_IPC_MSGS_RECV));
+	mb_head(mb, "unicornscan_ipc_bytes_total", "counter", "ipc bytes the master sent and read, headers included");
+	mb_printf(mb, "unicornscan_ipc_bytes_total{dir=\"sent\"} %" PRIu64 "\n", metrics_get(MET_IPC_BYTES_SENT));
+	mb_printf(mb, "unicornscan_ipc_bytes_total{dir=\"recv\"} %" PRIu64 "\n", metrics_get(MET_IPC_BYTES_RECV));
+
+	mb_head(mb, "unicornscan_connect_stream_total", "counter", "connect mode tcp stream events");
+	for (j=0; j < sizeof(m_stream) / sizeof(m_stream[0]); j++) {
+		union {
+			const settings_t *s;
+			const uint8_t *p;
+			const int *i;
+		} st_u;
+
+		st_u.s=s;
+		st_u.p += m_stream[j].off;
+		mb_printf(mb, "unicornscan_connect_stream_total{event=\"%s\"} %d\n", m_stream[j].name, *st_u.i);
+	}
+
+	mb_head(mb, "unicornscan_geoip_cache_lookups_total", "counter", "geoip cache lookups in the database output module");
+	mb_printf(mb, "unicornscan_geoip_cache_lookups_total{result=\"hit\"} %" PRIu64 "\n", metrics_get(MET_GEOIP_HITS));
+	mb_printf(mb, "unicornscan_geoip_cache_lookups_total{result=\"miss\"} %" PRIu64 "\n", metrics_get(MET_GEOIP_MISSES));
+	mb_head(mb, "unicornscan_geoip_cache_entries", "gauge", "network ranges in the geoip cache");
+	mb_printf(mb, "unicornscan_geoip_cache_entries %" PRIu64 "\n", metrics_get(MET_GEOIP_CACHED));
+	mb_head(mb, "unicornscan_geoip_lookup_seconds_total", "counter", "time spent in geoip lookups, misses include the provider");
+	mb_printf(mb, "unicornscan_geoip_lookup_seconds_total{result=\"hit\"} %.9f\n", (double)metrics_get(MET_GEOIP_HIT_NS) / 1e9);
+	mb_printf(mb, "unicornscan_geoip_lookup_seconds_total{result=\"miss\"} %.9f\n", (double)metrics_get(MET_GEOIP_MISS_NS) / 1e9);
+
+	mb_head(mb, "unicornscan_db_queue_batches", "gauge", "result batches queued for the database writer thread");
+	mb_printf(mb, "unicornscan_db_queue_batches %" PRIu64 "\n", metrics_get(MET_DBQ_DEPTH));
+	mb_head(mb, "unicornscan_db_queue_bytes", "gauge", "bytes of results queued for the database writer thread");
+	mb_printf(mb, "unicornscan_db_queue_bytes %" PRIu64 "\n", metrics_get(MET_DBQ_BYTES));
+	mb_head(mb, "unicornscan_db_flushes_total", "counter", "result batches the database writer stored");
+	mb_printf(mb, "unicornscan_db_flushes_total %" PRIu64 "\n", metrics_get(MET_DB_FLUSHES));
+	mb_head(mb, "unicornscan_db_flush_seconds_total", "counter", "time the database writer spent storing batches");
+	mb_printf(mb, "unicornscan_db_flush_seconds_total %.9f\n", (double)metrics_get(MET_DB_FLUSH_NS) / 1e9);
+	mb_head(mb, "unicornscan_db_flush_last_seconds", "gauge", "how long the last batch took to store");
+	mb_printf(mb, "unicornscan_db_flush_last_seconds %.9f\n", (double)metrics_get(MET_DB_FLUSH_LAST_NS) / 1e9);
+	mb_head(mb, "unicornscan_db_stalls_total", "counter", "times result output waited on a full database queue");
+	mb_printf(mb, "unicornscan_db_stalls_total %" PRIu64 "\n", metrics_get(MET_DB_STALLS));
+	mb_head(mb, "unicornscan_db_stall_seconds_total", "counter", "time result output spent waiting on the database queue");
+	mb_printf(mb, "unicornscan_db_stall_seconds_total %.9f\n", (double)metrics_get(MET_DB_STALL_NS) / 1e9);
+
+	mb_head(mb, "unicornscan_drone_up", "gauge", "1 unless the drone died");
+	for (d=s->dlh->head; d != NULL; d=d->next) {
+		mb_drone(mb, "unicornscan_drone_up", d, NULL, d->status == DRONE_STATUS_DEAD ? 0 : 1);
+	}
+	mb_head(mb, "unicornscan_drone_packets_sent", "gauge", "packets a sender sent this phase");
+	for (d=s->dlh->head; d != NULL; d=d->next) {
+		if (d->type == DRONE_TYPE_SENDER) {
+			mb_drone(mb, "unicornscan_drone_packets_sent", d, NULL, d->pkts_done + d->pkts_cur);
+		}
+	}
+	mb_head(mb, "unicornscan_drone_pps", "gauge", "packets per second a sender last reported");
+	for (d=s->dlh->head; d != NULL; d=d->next) {
+		if (d->type == DRONE_TYPE_SENDER) {
+			mb_drone(mb, "unicornscan_drone_pps", d, NULL, d->pps);
+		}
+	}
+	mb_head(mb, "unicornscan_drone_packets_received_total", "counter", "packets a listener's pcap handle saw");
+	for (d=s->dlh->head; d != NULL; d=d->next) {
+		if (d->type == DRONE_TYPE_LISTENER) {
+			mb_drone(mb, "unicornscan_drone_packets_received_total", d, NULL, d->recv_pkts);
+		}
+	}
+	mb_head(mb, "unicornscan_drone_packets_dropped_total", "counter", "packets a listener lost, in pcap or the interface");
+	for (d=s->dlh->head; d != NULL; d=d->next) {
+		if (d->type == DRONE_TYPE_LISTENER) {
+			mb_drone(mb, "unicornscan_drone_packets_dropped_total", d, "where=\"pcap\"", d->recv_drops);
+			mb_drone(mb, "unicornscan_drone_packets_dropped_total", d, "where=\"interface\"", d->recv_ifdrops);
+		}
+	}
+	mb_head(mb, "unicornscan_drone_queue_depth", "gauge", "deepest the listener report queue got in the last second");
+	for (d=s->dlh->head; d != NULL; d=d->next) {
+		if (d->type == DRONE_TYPE_LISTENER) {
+			mb_drone(mb, "unicornscan_drone_queue_depth", d, NULL, d->queue_depth);
+		}
+	}
+	mb_head(mb, "unicornscan_drone_malformed_packets_total", "counter", "packets a listener's parser skipped");
+	for (d=s->dlh->head; d != NULL; d=d->next) {
+		if (d->type == DRONE_TYPE_LISTENER) {
+			mb_drone(mb, "unicornscan_drone_malformed_packets_total", d, "kind=\"total\"", d->parse_issues);
+			mb_drone(mb, "unicornscan_drone_malformed_packets_total", d, "kind=\"truncated\"", d->parse_truncated);
+			mb_drone(mb, "unicornscan_drone_malformed_packets_total", d, "kind=\"fragment\"", d->parse_frags);
+		}
+	}
+
+	return;
+}
+
+static void mb_head(mbuf_t *mb, const char *name, const char *type, const char *help) {
+
+	mb_printf(mb, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+
+	return;
+}
+
+static void mb_drone(mbuf_t *mb, const char *name, const drone_t *d, const char *extra, uint64_t val) {
+	char uri[256];
+	const char *p=NULL;
+	size_t off=0;
+
+	/* label values need \ " and newlines escaped */
+	for (p=(d->uri != NULL ? d->uri : ""); *p != '\0' && off < sizeof(uri) - 3; p++) {
+		if (*p == '\\' || *p == '"') {
+			uri[off++]='\\';
+			uri[off++]=*p;
+		}
+		else if (*p == '\n') {
+			uri[off++]='\\';
+			uri[off++]='n';
+		}
+		else {
+			uri[off++]=*p;
+		}
+	}
+	uri[off]='\0';
+
+	mb_printf(mb, "%s{drone=\"%s\",type=\"%s\"%s%s} %" PRIu64 "\n",
+		name, uri, strdronetype(d->type), (extra != NULL ? "," : ""), (extra != NULL ? extra : ""), val
+	);
+
+	return;
+}
+
+static void mb_printf(mbuf_t *mb, const char *fmt, ...) {
+	va_list ap;
+	int ret=0;
+
+	for (;;) {
+		if (mb->size - mb->len < 256) {
+			mb->size=(mb->size == 0 ? 4096 : mb->size * 2);
+			mb->buf=(char *)xrealloc(mb->buf, mb->size);
+		}
+
+		va_start(ap, fmt);
+		ret=vsnprintf(mb->buf + mb->len, mb->size - mb->len, fmt, ap);
+		va_end(ap);
+
+		assert(ret >= 0);
+
+		if ((size_t)ret < mb->size - mb->len) {
+			mb->len += (size_t)ret;
+			return;
+		}
+
+		mb->size += (size_t)ret;
+		mb->buf=(char *)xrealloc(mb->buf, mb->size);
+	}
+}
+
+static void metrics_drop(int idx) {
+
+	close(m_clients[idx].fd);
+	if (m_clients[idx].out.buf != NULL) {
+		xfree(m_clients[idx].out.buf);
+	}
+
+	m_clients[idx]=m_clients[--m_nclients];
+
+	return;
+}
@@ -0,0 +1,44 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#ifndef _METRICS_SRV_H
+# define _METRICS_SRV_H
+
+/*
+ * the --metrics endpoint.  the master answers plain http GETs in the
+ * prometheus text format, on a loopback tcp port or a unix socket, from
+ * its own scan loop.  nothing here is touched by the code that counts,
+ * it only reads unilib/metrics.h slots, s->stats, the drone list and the
+ * last telemetry snapshot when a request comes in
+ *
+ * the uri is unix:/some/path or [addr:]port, addr defaults to 127.0.0.1
+ */
+
+#define METRICS_MAXCLIENTS	8
+#define METRICS_REQMAX		2048	/* request headers we bother reading	*/
+#define METRICS_TIMEOUT		5	/* seconds a client gets to ask and read	*/
+
+/* 1 if the uri looks usable, -1 if not */
+int metrics_srv_checkuri(const char *);
+
+void metrics_srv_open(void);
+/* accepts, reads and answers whatever is ready, never blocks */
+void metrics_srv_poll(void);
+void metrics_srv_close(void);
+
+#endif
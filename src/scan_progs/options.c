@@ -33,6 +33,9 @@
 
 #include <scan_progs/scan_export.h>
 #include <scan_progs/options.h>
+#include <scan_progs/metrics_srv.h>
+#include <scan_progs/report.h>
+#include <daemon.h>
 
 static keyval_t *kv_list=NULL;
 
@@ -593,6 +596,162 @@ int scan_setprocdups(int proc) {
 	return 1;
 }
 
+int scan_setipcshm(int shm) {
+	if (shm) {
+		SET_IPCSHM(1);
+	}
+	else {
+		SET_IPCSHM(0);
+	}
+
+	return 1;
+}
+
+int scan_setpipeline(int pipe) {
+	if (pipe) {
+		SET_PIPELINE(1);
+	}
+	else {
+		SET_PIPELINE(0);
+	}
+
+	return 1;
+}
+
+/*
+ * the sender stamps a clock into the tcp timestamp option, the listener
+ * measures rtts off the echo, and the master uses them to cut the wait short
+ */
+int scan_setadaptivewait(int adapt) {
+	if (adapt) {
+		SET_ADAPTIVEWAIT(1);
+		SET_TSTAMPCLOCK(1);
+		SET_MEASURERTT(1);
+	}
+	else {
+		SET_ADAPTIVEWAIT(0);
+		SET_TSTAMPCLOCK(0);
+		SET_MEASURERTT(0);
+	}
+
+	return 1;
+}
+
+/* later -R rounds only go to what hasnt answered, gap is ms to wait before the 2nd */
+int scan_setselectretry(int gap) {
+
+	if (gap < 0 || gap > 0xffff) {
+		ERR("retry gap out of range, 0 to 65535 ms");
+		return -1;
+	}
+
+	SET_SELECTRETRY(1);
+	s->retry_gap=(uint16_t)gap;
+
+	return 1;
+}
+
+int scan_setprogresssock(const char *path) {
+
+	if (path == NULL || strlen(path) < 1) {
+		return -1;
+	}
+
+	if (s->progress_sock != NULL) {
+		xfree(s->progress_sock);
+	}
+
+	s->progress_sock=xstrdup(path);
+
+	return 1;
+}
+
+int scan_setdaemon(const char *path) {
+
+	if (path == NULL || strlen(path) < 1) {
+		return -1;
+	}
+
+	if (s->daemon_sock != NULL) {
+		xfree(s->daemon_sock);
+	}
+
+	s->daemon_sock=xstrdup(path);
+
+	return 1;
+}
+
+/* write results as they arrive, mb is the duplicate filter size */
+int scan_setstream(int mb) {
+
+	if (mb < 1 || mb > STREAM_MAXMB) {
+		ERR("stream filter size out of range, 1 to %d MB", STREAM_MAXMB);
+		return -1;
+	}
+
+	SET_STREAM(1);
+	s->stream_mb=(uint16_t)mb;
+
+	return 1;
+}
+
+/* where -N reverse lookups go, addr[:port], or system for getnameinfo */
+int scan_setresolver(const char *srv) {
+
+	if (srv == NULL || strlen(srv) < 1) {
+		return -1;
+	}
+
+	if (s->dns_server != NULL) {
+		xfree(s->dns_server);
+	}
+
+	s->dns_server=xstrdup(srv);
+
+	return 1;
+}
+
+/* sorted report, but write runs to disk once mb of results are held */
+int scan_setspill(int mb) {
+
+	if (mb < 1 || mb > SPILL_MAXMB) {
+		ERR("spill size out of range, 1 to %d MB", SPILL_MAXMB);
+		return -1;
+	}
+
+	s->spill_mb=(uint32_t)mb;
+
+	return 1;
+}
+
+int scan_setdaemonjobs(int jobs) {
+
+	if (jobs < 1 || jobs > DAEMON_MAXJOBS) {
+		ERR("daemon jobs out of range, 1 to %d", DAEMON_MAXJOBS);
+		return -1;
+	}
+
+	s->daemon_jobs=(uint8_t)jobs;
+
+	return 1;
+}
+
+int scan_setmetricsuri(const char *uri) {
+
+	if (metrics_srv_checkuri(uri) < 0) {
+		ERR("metrics uri `%s' should be unix:/path or [addr:]port", uri != NULL ? uri : "");
+		return -1;
+	}
+
+	if (s->metrics_uri != NULL) {
+		xfree(s->metrics_uri);
+	}
+
+	s->metrics_uri=xstrdup(uri);
+
+	return 1;
+}
+
 int scan_setprocerrors(int proc) {
 	if (proc) {
 		SET_PROCERRORS(1);
@@ -626,6 +785,42 @@ int scan_setreportquiet(int quiet) {
 	return 1;
 }
 
+int scan_setsavefilesize(int mb) {
+
+	if (mb < 0) {
+		ERR("savefile rotation size cannot be negative");
+		return -1;
+	}
+
+	s->pcap_dumpsize=(uint32_t)mb;
+
+	return 1;
+}
+
+int scan_setsavefiletime(int secs) {
+
+	if (secs < 0) {
+		ERR("savefile rotation time cannot be negative");
+		return -1;
+	}
+
+	s->pcap_dumpsecs=(uint32_t)secs;
+
+	return 1;
+}
+
+int scan_setsavefilesnap(int snap) {
+
+	if (snap < 0 || snap > 0x40000) {
+		ERR("savefile snaplen out of range");
+		return -1;
+	}
+
+	s->pcap_dumpsnap=(uint32_t)snap;
+
+	return 1;
+}
+
 int scan_setsenddrone(int sendd) {
 
 	if (sendd) {
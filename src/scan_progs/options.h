@@ -49,9 +49,23 @@ int scan_setimmediate(int);
 int scan_setlistendrone(int);
 int scan_setppsi(int);
 int scan_setprocdups(int);
+int scan_setipcshm(int);
+int scan_setpipeline(int);
+int scan_setadaptivewait(int);
+int scan_setselectretry(int);
+int scan_setstream(int);
+int scan_setspill(int);
+int scan_setresolver(const char *);
+int scan_setdaemon(const char *);
+int scan_setdaemonjobs(int);
+int scan_setprogresssock(const char *);
+int scan_setmetricsuri(const char *);
 int scan_setprocerrors(int);
 int scan_setrepeats(int);
 int scan_setreportquiet(int);
+int scan_setsavefilesize(int);
+int scan_setsavefiletime(int);
+int scan_setsavefilesnap(int);
 int scan_setsenddrone(int);
 int scan_setshuffle(int);
 int scan_setsniff(int);
@@ -34,6 +34,7 @@
 #include <pcap.h>
 
 #include <scan_progs/packet_parse.h>
+#include <scan_progs/dumpwriter.h>
 
 static void report_init(int /* type */, const struct timeval * /* pcap recv time */);
 static void packet_init(const uint8_t * /* packet */, size_t /* pk_len */);
@@ -80,6 +81,20 @@ static struct {
 	uint32_t since_last_log;                           /* Count since last rate-limited log */
 } malformed_stats = {0};
 
+/*
+ * rtts taken off echoed tcp timestamps (--adaptive-wait), the sender puts
+ * its ms clock in the tsval. log scale buckets, 4 to an octave, so a
+ * percentile comes out within 25% without keeping every sample
+ */
+#define RTT_BUCKETS	80
+
+static struct {
+	uint32_t samples;
+	uint32_t bucket[RTT_BUCKETS];
+} rtt_hist;
+
+static void rtt_sample(uint32_t /* echoed tsval */);
+
 /* Update malformed packet statistics */
 static void update_malformed_stats(uint32_t saddr) {
 	int i, min_idx = 0;
@@ -151,11 +166,97 @@ void packet_parse_print_stats(void) {
 	}
 }
 
+/* Counters only, for the listener progress message */
+void packet_parse_get_stats(uint32_t *total, uint32_t *truncated, uint32_t *fragments) {
+	*total = malformed_stats.total_count;
+	*truncated = malformed_stats.bad_iplen_count;
+	*fragments = malformed_stats.bad_fragment_count;
+}
+
 /* Reset statistics (for multiple scan runs) */
 void packet_parse_reset_stats(void) {
 	memset(&malformed_stats, 0, sizeof(malformed_stats));
 }
 
+static unsigned int rtt_bucket(uint32_t ms) {
+	unsigned int msb=0;
+
+	if (ms < 4) {
+		return ms;
+	}
+	for (msb=2; (ms >> (msb + 1)) != 0; msb++) {
+		;
+	}
+	msb=4 + ((msb - 2) * 4) + ((ms >> (msb - 2)) & 3);
+
+	return msb < RTT_BUCKETS ? msb : RTT_BUCKETS - 1;
+}
+
+/* the largest rtt that lands in bucket b */
+static uint32_t rtt_bucket_top(unsigned int b) {
+	unsigned int shift=0;
+
+	if (b < 4) {
+		return b;
+	}
+	shift=(b - 4) / 4;
+
+	return ((uint32_t)(4 + ((b - 4) % 4) + 1) << shift) - 1;
+}
+
+static void rtt_sample(uint32_t tsecr) {
+	uint32_t now=0, rtt=0;
+
+	now=(uint32_t)((uint64_t)r_u.i.recv_time.tv_sec * 1000 + r_u.i.recv_time.tv_usec / 1000);
+	rtt=now - tsecr;
+
+	/* not our clock (random tsval, another host's drone, a stale probe), ignore it */
+	if (rtt > (uint32_t)s->ss->recv_timeout * 1000) {
+		DBG(M_PKT, "tsecr %u is %u ms old, not an rtt", tsecr, rtt);
+		return;
+	}
+
+	rtt_hist.samples++;
+	rtt_hist.bucket[rtt_bucket(rtt)]++;
+
+	return;
+}
+
+static uint32_t rtt_percentile(unsigned int pct) {
+	uint32_t want=0, seen=0;
+	unsigned int j=0;
+
+	want=(uint32_t)(((uint64_t)rtt_hist.samples * pct + 99) / 100);
+
+	for (j=0; j < RTT_BUCKETS; j++) {
+		seen += rtt_hist.bucket[j];
+		if (seen >= want) {
+			return rtt_bucket_top(j);
+		}
+	}
+
+	return rtt_bucket_top(RTT_BUCKETS - 1);
+}
+
+/* for the listener progress message, rtts in ms, 0 samples means nothing measured */
+void packet_parse_get_rtt(uint32_t *samples, uint32_t *p50, uint32_t *p99) {
+	*samples=rtt_hist.samples;
+	*p50=0;
+	*p99=0;
+
+	if (rtt_hist.samples > 0) {
+		*p50=rtt_percentile(50);
+		*p99=rtt_percentile(99);
+	}
+
+	return;
+}
+
+/* every workunit starts over, so the master sees this phase only */
+void packet_parse_reset_rtt(void) {
+	memset(&rtt_hist, 0, sizeof(rtt_hist));
+}
+
 static void packet_init(const uint8_t *packet, size_t pk_len) {
 	p_ptr=packet;
 	p_len=pk_len;
@@ -271,8 +372,7 @@ static void report_push(void) {
 
 void parse_packet(uint8_t *notused, const struct pcap_pkthdr *phdr, const uint8_t *packet) {
 	size_t pk_len=0;
-	int pk_layer=0;
-	extern pcap_dumper_t *pdump;
+	int pk_layer=0, is_arp=0;
 
 	if (packet == NULL || phdr == NULL) {
 		ERR("%s is null", packet == NULL ? "packet" : "pcap header");
@@ -281,7 +381,7 @@ void parse_packet(uint8_t *notused, const struct pcap_pkthdr *phdr, const uint8_
 
 	/* when you forget to put this here, it makes for really dull pcap log files */
 	if (s->pcap_dumpfile) {
-		pcap_dump((uint8_t *)pdump, phdr, packet);
+		dumpwriter_frame(phdr, packet);
 	}
 
 	pk_len=phdr->caplen;
@@ -301,12 +401,23 @@ void parse_packet(uint8_t *notused, const struct pcap_pkthdr *phdr, const uint8_
 		const struct my6etherheader *eth = (const struct my6etherheader *)packet;
 		memcpy(saved_eth_shost, eth->ether_shost, 6);
 		saved_eth_valid = 1;
+		if (GET_ARPALSO() && ntohs(eth->ether_type) == ETHERTYPE_ARP) {
+			is_arp=1;
+		}
 	}
 
 	pk_len -= s->ss->header_len;
 	packet += s->ss->header_len;
 	pk_layer++;
 
+	/* a pipelined compound scan gets arp replies mixed in with its ip responses */
+	if (is_arp) {
+		report_init(REPORT_TYPE_ARP, &phdr->ts);
+		packet_init(packet, pk_len);
+		decode_arp(packet, pk_len, pk_layer);
+		return;
+	}
+
 	switch (s->ss->mode) {
 		case MODE_ARPSCAN:
 			report_init(REPORT_TYPE_ARP, &phdr->ts);
@@ -759,7 +870,7 @@ static void decode_tcp (const uint8_t *packet, size_t pk_len, int pk_layer) {
 	packet += sizeof(struct mytcphdr);
 	pk_len -= sizeof(struct mytcphdr);
 
-	if (tcpopt_len && (ISDBG(M_PKT) || GET_SNIFF())) {
+	if (tcpopt_len && (ISDBG(M_PKT) || GET_SNIFF() || GET_MEASURERTT())) {
 		decode_tcpopts(packet, tcpopt_len);
 	}
 
@@ -792,6 +903,9 @@ static void decode_tcp (const uint8_t *packet, size_t pk_len, int pk_layer) {
 		if (bad_cksum) {
 			r_u.i.flags |= REPORT_BADTRANSPORT_CKSUM;
 		}
+		else if (GET_MEASURERTT() && t_u.t->syn && t_u.t->ack && r_u.i.m_tstamp != 0) {
+			rtt_sample(r_u.i.m_tstamp);
+		}
 
 		if (GET_WATCHERRORS() || GET_LDOCONNECT()) {
 			report_push();
@@ -29,5 +29,10 @@ void decode_ipopts (const uint8_t * /* data */, size_t /* len */);
 /* Statistics for malformed/skipped packets */
 void packet_parse_print_stats(void);
 void packet_parse_reset_stats(void);
+void packet_parse_get_stats(uint32_t * /* total */, uint32_t * /* truncated */, uint32_t * /* fragments */);
+
+/* rtt histogram from echoed tcp timestamps, ms */
+void packet_parse_get_rtt(uint32_t * /* samples */, uint32_t * /* p50 */, uint32_t * /* p99 */);
+void packet_parse_reset_rtt(void);
 
 #endif
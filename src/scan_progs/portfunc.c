@@ -25,9 +25,10 @@
 
 #include <unilib/output.h>
 #include <unilib/xmalloc.h>
-#include <unilib/prng.h>
 #include <unilib/rbtree.h>
 
+#include <parse/confcache.h>
+
 static int32_t *ports=NULL;
 static uint32_t num_ports=0;
 static int32_t *user_index=0;
@@ -53,10 +54,15 @@ int get_nextport(int32_t *in) {
 	return 1;
 }
 
-void shuffle_ports(void) {
-	uint32_t ss=0, d=0, indx=0;
+/* xorshift32, seeded per workunit so a resumed one walks the ports in the same order */
+#define SHUF_NEXT(x)	((x) ^= (x) << 13, (x) ^= (x) >> 17, (x) ^= (x) << 5)
+
+void shuffle_ports(uint32_t seed) {
+	uint32_t ss=0, d=0, indx=0, x=0;
 	int j=0;
 
+	x=(seed != 0 ? seed : 0x9e3779b9);
+
 	DBG(M_PRT, "shuffle ports at depth %u", num_ports);
 
 	if (num_ports < 2) {
@@ -66,8 +72,8 @@ void shuffle_ports(void) {
 	for (j=0; j < 2; j++) {
 		for (indx=0; indx < num_ports; indx++) {
 
-			ss=(prng_get32() % num_ports);
-			d=(prng_get32() % num_ports);
+			ss=(SHUF_NEXT(x) % num_ports);
+			d=(SHUF_NEXT(x) % num_ports);
 
 			if (ss == d) {
 				continue;
@@ -253,6 +259,7 @@ char *getservname(uint16_t port) {
 		uint64_t key;
 	} key_u;
 	char tmpstr[256];
+	const char *cname=NULL;
 	int sport=0;
 	uint8_t proto=0;
 	static FILE *uniservices=NULL;
@@ -271,6 +278,12 @@ char *getservname(uint16_t port) {
 		return &_name[0];
 	}
 
+	/* --compile-cache made a table of these already */
+	if ((cname=confcache_servname(proto, port)) != NULL) {
+		snprintf(_name, sizeof(_name), "%s", cname);
+		return _name;
+	}
+
 	if (sncache == NULL) {
 		sncache=rbinit(111);
 	}
@@ -346,9 +359,15 @@ cacheit:
 
 char *getouiname(uint8_t a, uint8_t b, uint8_t c) {
 	char tmpstr[256];
+	const char *cname=NULL;
 	static FILE *ouiconf=NULL;
 	static char oui_name[64];
 
+	if ((cname=confcache_ouiname(a, b, c)) != NULL) {
+		snprintf(oui_name, sizeof(oui_name), "%s", cname);
+		return oui_name;
+	}
+
 	/* this is slow and bad, but its not critical so here it is */
 
 	if (ouiconf == NULL) {
@@ -35,7 +35,7 @@
 
 void init_portsquick(void);
 void reset_getnextport(void);
-void shuffle_ports(void);
+void shuffle_ports(uint32_t /* seed, same seed same order */);
 int get_nextport(int32_t *);
 int parse_pstr(const char *, uint32_t * /* if not null only calculate number of ports couted and exit */);
 char *getservname(uint16_t );
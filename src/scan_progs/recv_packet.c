@@ -35,14 +35,17 @@
 #include <unilib/qfifo.h>
 #include <unilib/output.h>
 #include <unilib/pcaputil.h>
+#include <unilib/pcapmap.h>
 #include <unilib/modules.h>
 #include <unilib/drone.h>
 #include <unilib/socktrans.h>
 #include <unilib/cidr.h>
+#include <unilib/wanbatch.h>
 #include <scan_progs/recv_packet.h>
 #include <scan_progs/workunits.h>
 #include <scan_progs/portfunc.h>
 #include <scan_progs/packet_parse.h>
+#include <scan_progs/dumpwriter.h>
 #include <scan_progs/entry.h>
 
 #define UDP_PFILTER "udp"
@@ -62,12 +65,24 @@
 static int lc_s;
 static char *get_pcapfilterstr(void);
 static void drain_pqueue(void);
+static void fill_recv_stats(recv_stats_t *);
+static void send_recv_progress(uint32_t /* queue depth */);
 static void extract_pcapfilter(const uint8_t *, size_t);
+static uint32_t replay_file(const struct bpf_program *);
 
-pcap_dumper_t *pdump;
 static pcap_t *pdev;
 static int pcap_fd;
 
+/* offline replay, the readfile is mapped and fed straight to parse_packet */
+#define REPLAY_BATCH	256
+static pcapmap_t *pmap=NULL;
+static int replay_done=0;
+static uint32_t replay_frames=0;
+
+/* MSG_PROGRESS pacing, and the deepest the report queue got in between */
+static time_t prog_tlast=0;
+static uint32_t prog_qdepth=0;
+
 /* Listen address/mask from workunit - this is the IP/CIDR to filter responses for */
 static struct sockaddr_storage listen_addr;
 static struct sockaddr_storage listen_mask;
@@ -103,7 +118,6 @@ void recv_packet(void) {
 		uint8_t *ptr;
 	} d_u;
 	drone_version_t dv;
-	struct pcap_stat pcs;
 
 	r_queue=fifo_init();
 
@@ -120,6 +134,7 @@ void recv_packet(void) {
 	dv.magic=DRONE_MAGIC;
 	dv.maj=DRONE_MAJ;
 	dv.min=DRONE_MIN;
+	dv.caps=wanbatch_caps();
 	recv_stats_t recv_stats;
 
 	/* heh */
@@ -157,6 +172,11 @@ void recv_packet(void) {
 		ERR("got an unknown message type `%s' or bad status %d from parent, exiting", strmsgtype(msg_type), status);
 	}
 
+	/* a remote master asks for batched results by putting the caps it wants in the ack */
+	if (msg_len == 1 && (ptr[0] & DRONE_CAP_BATCH)) {
+		wanbatch_start(lc_s, ptr[0]);
+	}
+
 	DBG(M_IPC, "sending ready message to parent");
 
 	l_u.l=(listener_info_t *)xmalloc(sizeof(listener_info_t));
@@ -235,6 +255,12 @@ void recv_packet(void) {
 			}
 			terminate("informed parent, exiting");
 		}
+
+		/* pdev is still used for the linktype and filter, pcapng files fall back to pcap_dispatch */
+		pmap=pcapmap_open(s->pcap_readfile);
+		if (pmap == NULL) {
+			VRB(1, "cant map `%s', replaying through libpcap", s->pcap_readfile);
+		}
 	}
 
 	ret=util_getheadersize(pdev, errbuf);
@@ -251,9 +277,7 @@ void recv_packet(void) {
 
 	if (s->pcap_dumpfile != NULL) {
 		VRB(0, "opening `%s' for pcap log", s->pcap_dumpfile);
-		pdump=pcap_dump_open(pdev, s->pcap_dumpfile);
-		if (pdump == NULL) {
-			ERR("cant log to pcap file `%s'", pcap_geterr(pdev));
+		if (dumpwriter_open(pdev, s->pcap_dumpfile) < 0) {
 
 			DBG(M_IPC, "sending ready error message to parent");
 			if (send_message(lc_s, MSG_READY, MSG_STATUS_ERROR, NULL, 0) < 0) {
@@ -347,6 +371,7 @@ void recv_packet(void) {
 		s->ss->ret_layers=wk_u.r->ret_layers;
 		s->recv_opts=wk_u.r->recv_opts;
 		s->ss->window_size=wk_u.r->window_size;
+		packet_parse_reset_rtt();
 
 		s->ss->syn_key=wk_u.r->syn_key;
 
@@ -391,7 +416,7 @@ void recv_packet(void) {
 
 		DBG(M_IPC, "from ipc, got workunit: %s", strworkunit((const void *)wk_u.cr, msg_len));
 
-		if (s->ss->mode == MODE_ARPSCAN) {
+		if (s->ss->mode == MODE_ARPSCAN || GET_ARPALSO()) {
 			if (s->ss->header_len != 14) {
 
 				DBG(M_IPC, "sending msg error");
@@ -408,6 +433,12 @@ void recv_packet(void) {
 		}
 
 		pfilter=get_pcapfilterstr();
+		if (pfilter == NULL) {
+			if (send_message(lc_s, MSG_READY, MSG_STATUS_ERROR, NULL, 0) < 0) {
+				ERR("cant send message ready error");
+			}
+			terminate("cant build pcap filter");
+		}
 
 		VRB(1, "using pcap filter: `%s'", pfilter);
 
@@ -430,8 +461,6 @@ void recv_packet(void) {
 			terminate("cant set compiled pcap filter");
 		}
 
-		pcap_freecode(&filter);
-
 		if (s->ss->ret_layers > 0) {
 			DBG(M_IPC, "returning whole packet via ipc");
 		}
@@ -446,9 +475,22 @@ void recv_packet(void) {
 			terminate("cant send message ready");
 		}
 
+		/* a mapped readfile is replayed once, up front, nothing to dispatch after that */
+		if (pmap != NULL && replay_done == 0) {
+			replay_frames=replay_file(&filter);
+			replay_done=1;
+		}
+
+		pcap_freecode(&filter);
+
 		DBG(M_CLD, "entering main loop: lc_s=%d pcap_fd=%d", lc_s, pcap_fd);
 
+		prog_tlast=time(NULL);
+		prog_qdepth=0;
+
 		while (1) {
+			uint32_t qdepth=0;
+
 			spdf[0].fd=lc_s;
 			spdf[1].fd=pcap_fd;
 
@@ -463,11 +505,24 @@ void recv_packet(void) {
 			}
 
 			/* Always try to dispatch packets - don't rely on poll() for pcap */
-			pcap_dispatch(pdev, 10, parse_packet, NULL);
+			if (pmap == NULL) {
+				pcap_dispatch(pdev, (s->pcap_readfile == NULL ? 10 : -1), parse_packet, NULL);
+			}
+
+			qdepth=fifo_length(r_queue);
+			if (qdepth > prog_qdepth) {
+				prog_qdepth=qdepth;
+			}
 
 			/* no packets, better drain the queue */
 			drain_pqueue();
 
+			if (time(NULL) - prog_tlast >= DRONE_RPROGRESS_SECS) {
+				send_recv_progress(prog_qdepth);
+				prog_tlast=time(NULL);
+				prog_qdepth=0;
+			}
+
 			if (spdf[0].rw & XPOLL_READABLE) {
 				if (get_singlemessage(lc_s, &msg_type, &status, &ptr, &msg_len) != 1) {
 					ERR("unexpected sequence of messages from parent in main read loop, exiting");
@@ -492,13 +547,11 @@ void recv_packet(void) {
 			}
 		}
 
-		memset(&recv_stats, 0, sizeof(recv_stats));
+		fill_recv_stats(&recv_stats);
 
-		if (pcap_stats(pdev, &pcs) != -1) {
-
-			recv_stats.packets_recv=pcs.ps_recv;
-			recv_stats.packets_dropped=pcs.ps_drop;
-			recv_stats.packets_dropped=pcs.ps_ifdrop;
+		/* results have to be there before the stats that end the workunit */
+		if (wanbatch_flush() < 0) {
+			terminate("cant send results to parent, exiting");
 		}
 
 		if (send_message(lc_s, MSG_WORKDONE, MSG_STATUS_OK, (void *)&recv_stats, sizeof(recv_stats)) < 0) {
@@ -511,8 +564,9 @@ void recv_packet(void) {
 	packet_parse_print_stats();
 
 	pcap_close(pdev);
+	pcapmap_close(pmap);
 	if (s->pcap_dumpfile) {
-		pcap_dump_close(pdump);
+		dumpwriter_close();
 	}
 
 	/* Restore NIC offload settings if we disabled them */
@@ -522,16 +576,18 @@ void recv_packet(void) {
 		}
 	}
 
+	wanbatch_stop();
+
 	DBG(M_CLD, "listener exiting");
 
 	shutdown(lc_s, SHUT_RDWR);
-	close(lc_s);
+	socktrans_close(lc_s);
  
 	uexit(0);
 }
 
 static char *get_pcapfilterstr(void) {
-	static char base_filter[128], addr_filter[192], pfilter[512];
+	static char base_filter[128], addr_filter[192], pfilter[1024];
 
 	CLEAR(base_filter); CLEAR(addr_filter); CLEAR(pfilter);
 
@@ -600,7 +656,14 @@ static char *get_pcapfilterstr(void) {
 	if (s->ss->mode == MODE_TCPSCAN || s->ss->mode == MODE_UDPSCAN || s->ss->mode == MODE_TCPTRACE) {
 		/* XXX multicast */
 		if (s->extra_pcapfilter != NULL && strlen(s->extra_pcapfilter)) {
-			snprintf(pfilter, sizeof(pfilter) -1, "%s and (%s and %s)", addr_filter, base_filter, s->extra_pcapfilter);
+			int flen=0;
+
+			/* cut short it would still compile, and let through what it was meant to keep out */
+			flen=snprintf(pfilter, sizeof(pfilter) -1, "%s and (%s and %s)", addr_filter, base_filter, s->extra_pcapfilter);
+			if (flen < 0 || (size_t)flen >= sizeof(pfilter) -1) {
+				ERR("pcap filter `%s' is too long", s->extra_pcapfilter);
+				return NULL;
+			}
 		}
 		else {
 			if (s->pcap_readfile == NULL) {
@@ -616,9 +679,132 @@ static char *get_pcapfilterstr(void) {
 		snprintf(pfilter, sizeof(pfilter) -1, "%s", base_filter);
 	}
 
+	/* pipelined compound scan, the arp replies come to this listener too */
+	if (GET_ARPALSO() && s->ss->mode != MODE_ARPSCAN) {
+		char ip_filter[sizeof(pfilter)];
+		int flen=0;
+
+		memcpy(ip_filter, pfilter, sizeof(ip_filter));
+		flen=snprintf(pfilter, sizeof(pfilter), "(%s) or %s", ip_filter, ARP_PFILTER);
+		if (flen < 0 || (size_t)flen >= sizeof(pfilter)) {
+			ERR("pcap filter `%s' is too long to add arp replies to", ip_filter);
+			return NULL;
+		}
+	}
+
 	return pfilter;
 }
 
+/*
+ * push every frame of the mapped readfile through the filter and parse_packet
+ * as fast as we can, handing reports to the master every REPLAY_BATCH frames
+ */
+static uint32_t replay_file(const struct bpf_program *filter) {
+	struct pcap_pkthdr phdr;
+	const uint8_t *packet=NULL;
+	struct timeval start, mid, end;
+	double t_parse=0.0, t_ipc=0.0, tt=0.0;
+	uint32_t frames=0, matched=0, batch=0;
+	int ret=0;
+
+	assert(pmap != NULL && filter != NULL);
+
+	VRB(1, "replaying `%s' from memory", s->pcap_readfile);
+
+	gettimeofday(&start, NULL);
+	mid=start;
+
+	for (;;) {
+		ret=pcapmap_next(pmap, &phdr, &packet);
+		if (ret != 1) {
+			break;
+		}
+		frames++;
+
+		if (pcap_offline_filter(filter, &phdr, packet) == 0) {
+			continue;
+		}
+		matched++;
+
+		parse_packet(NULL, &phdr, packet);
+
+		if (++batch == REPLAY_BATCH) {
+			gettimeofday(&end, NULL);
+			t_parse += (end.tv_sec - mid.tv_sec) + ((double)(end.tv_usec - mid.tv_usec) / 1000000);
+
+			drain_pqueue();
+
+			gettimeofday(&mid, NULL);
+			t_ipc += (mid.tv_sec - end.tv_sec) + ((double)(mid.tv_usec - end.tv_usec) / 1000000);
+			batch=0;
+		}
+	}
+
+	gettimeofday(&end, NULL);
+	t_parse += (end.tv_sec - mid.tv_sec) + ((double)(end.tv_usec - mid.tv_usec) / 1000000);
+
+	drain_pqueue();
+
+	gettimeofday(&mid, NULL);
+	t_ipc += (mid.tv_sec - end.tv_sec) + ((double)(mid.tv_usec - end.tv_usec) / 1000000);
+
+	if (ret < 0) {
+		ERR("replay of `%s' stopped early at frame %u", s->pcap_readfile, frames);
+	}
+
+	tt=(mid.tv_sec - start.tv_sec) + ((double)(mid.tv_usec - start.tv_usec) / 1000000);
+
+	VRB(0, "replayed %u frames (%u passed filter) in %.3f secs, %.0f frames/sec",
+		frames, matched, tt, (tt > 0.0 ? frames / tt : 0.0)
+	);
+	VRB(1, "replay stages: filter+parse %.3f secs, report ipc %.3f secs", t_parse, t_ipc);
+
+	return frames;
+}
+
+static void fill_recv_stats(recv_stats_t *rs) {
+	struct pcap_stat pcs;
+
+	memset(rs, 0, sizeof(recv_stats_t));
+	rs->magic=DRONE_STATS_MAGIC;
+
+	if (pcap_stats(pdev, &pcs) != -1) {
+		rs->packets_recv=pcs.ps_recv;
+		rs->packets_dropped=pcs.ps_drop;
+		rs->interface_dropped=pcs.ps_ifdrop;
+	}
+	else if (pmap != NULL) {
+		rs->packets_recv=replay_frames;
+	}
+
+	if (s->pcap_dumpfile != NULL) {
+		dumpwriter_stats_t dws;
+
+		dumpwriter_getstats(&dws);
+		rs->dump_dropped=dws.frames_dropped;
+	}
+
+	return;
+}
+
+static void send_recv_progress(uint32_t qdepth) {
+	recv_progress_t rp;
+
+	fill_recv_stats(&rp.st);
+	rp.st.magic=DRONE_RPROGRESS_MAGIC;
+	rp.queue_depth=qdepth;
+	packet_parse_get_stats(&rp.parse_issues, &rp.parse_truncated, &rp.parse_frags);
+	packet_parse_get_rtt(&rp.rtt_samples, &rp.rtt_p50, &rp.rtt_p99);
+
+	DBG(M_CLD, "progress %u recv %u dropped queue depth %u", rp.st.packets_recv, rp.st.packets_dropped, qdepth);
+
+	if (send_message(lc_s, MSG_PROGRESS, MSG_STATUS_OK, (const uint8_t *)&rp, sizeof(rp)) < 0) {
+		terminate("cant send progress message to parent, exiting");
+	}
+
+	return;
+}
+
 static void drain_pqueue() {
 	union {
 		void *ptr;
@@ -667,13 +853,23 @@ static void drain_pqueue() {
 			memcpy(nr_u.data, (const void *)r_u.ptr, r_size);
 			memcpy(nr_u.inc + r_size, (const void *)packet_u.data, pk_len + sizeof(pk_len));
 
-			if (send_message(lc_s, MSG_OUTPUT, MSG_STATUS_OK, nr_u.inc, r_size + pk_len + sizeof(pk_len)) < 0) {
+			if (wanbatch_active()) {
+				if (wanbatch_add(nr_u.inc, r_size + pk_len + sizeof(pk_len)) < 0) {
+					terminate("cant send message output");
+				}
+			}
+			else if (send_message(lc_s, MSG_OUTPUT, MSG_STATUS_OK, nr_u.inc, r_size + pk_len + sizeof(pk_len)) < 0) {
 				terminate("cant send message output");
 			}
 
 			xfree(nr_u.data);
 			xfree(packet_u.data);
 		}
+		else if (wanbatch_active()) {
+			if (wanbatch_add(r_u.cr, r_size) < 0) {
+				terminate("cant send message output");
+			}
+		}
 		else {
 			if (send_message(lc_s, MSG_OUTPUT, MSG_STATUS_OK, r_u.cr, r_size) < 0) {
 				terminate("cant send message output");
@@ -682,6 +878,11 @@ static void drain_pqueue() {
 		xfree(r_u.ptr);
 	} /* while we can ipc a packet */
 
+	/* ship a batch thats been waiting long enough, or tell an idle master we are still here */
+	if (wanbatch_tick() < 0) {
+		terminate("cant send message output");
+	}
+
 	return;
 }
 
@@ -33,7 +33,7 @@
 #include <unilib/output.h>
 #include <unilib/modules.h>
 #include <unilib/qfifo.h>
-#include <unilib/rbtree.h>
+#include <unilib/arena.h>
 #include <unilib/pktutil.h>
 #include <unilib/standard_dns.h>
 
@@ -70,7 +70,172 @@ static const char *mmdb_search_paths[] = {
 
 #endif
 
-static void *report_t=NULL;
+/*
+ * the results.  reports are copied into an arena and indexed by an open
+ * addressing table on the report key, walking them sorts a copy of the
+ * index so output comes out in key order (by host, then port) and the
+ * whole thing goes away in one arena_destroy
+ */
+typedef struct rslot_t {
+	uint64_t key;
+	void *rec;		/* NULL is an empty slot */
+} rslot_t;
+
+static struct {
+	void *arena;
+	rslot_t *tbl;
+	uint32_t size;		/* power of 2	*/
+	uint32_t cnt;
+} rs;
+
+#define RS_INITSIZE	4096
+#define RS_SLOT(k, sz)	((uint32_t)(((k) * 0x9e3779b97f4a7c15ULL) >> 32) & ((sz) - 1))
+
+/*
+ * --stream keeps no results, just the keys of recent ones so duplicates can
+ * be dropped.  set associative, STREAM_WAYS keys a set, a new key pushes
+ * the least recently seen one in its set out.  so it never drops a result
+ * it hasnt seen, but a duplicate of something pushed out long ago goes out
+ * again.  the size is fixed when the scan starts
+ */
+#define STREAM_WAYS	4
+
+static struct {
+	uint64_t *keys;
+	uint32_t sets;		/* power of 2	*/
+	uint64_t sent;
+	uint64_t dups;
+} sf;
+
+/*
+ * --spill caps what the table above may hold, past that the table is sorted
+ * and written out as a run to an unlinked temp file and emptied.  report_do
+ * merges the runs and what is still in memory back in key order, so the
+ * output is the same as if it had all stayed in memory.  the first record of
+ * a key wins, later ones are chained onto it with -c and dropped without.
+ * at SPILL_MAXRUNS open runs they are merged into one before the next is
+ * written, and if a run cant be written the rest stays in memory.  once a
+ * run is out a key missing from the table may be on disk, so without -c
+ * (where every duplicate is printed anyhow) -I stops printing
+ */
+#define SPILL_MAXRUNS	64
+#define SPILL_IMMEDIATE() (sp.nruns == 0 || GET_PROCDUPS())
+
+typedef struct _PACKED_ spill_hdr_t {
+	uint64_t key;
+	uint32_t len;		/* report and packet				*/
+	uint16_t odcnt;		/* spill_od_t entries following the report	*/
+} spill_hdr_t;
+
+typedef struct _PACKED_ spill_od_t {
+	uint8_t type;		/* OD_TYPE_					*/
+	uint16_t len;		/* string following, no nul			*/
+} spill_od_t;
+
+typedef struct spill_src_t {
+	FILE *f;		/* NULL for the table in memory	*/
+	uint64_t key;
+	void *rec;		/* NULL once the run is done	*/
+} spill_src_t;
+
+static struct {
+	uint64_t limit;		/* bytes, 0 no spilling		*/
+	FILE **runs;
+	uint32_t nruns;
+	uint64_t spilled;
+	uint64_t dups;
+	rslot_t *midx;		/* the table in key order, while merging	*/
+	uint32_t mpos;
+} sp;
+
+static int stream_seen(uint64_t /* key */);
+static int report_stream(void * /* report */);
+
+static int rs_find(uint64_t /* key */, void ** /* record */);
+static void rs_insert(uint64_t /* key */, void * /* record */);
+static void *rs_copy(const void * /* report */, size_t /* length */);
+static rslot_t *rs_sorted(void);
+static void rs_walk(int (*)(uint64_t, void *, void *), int /* callback cleans up */);
+
+static void spill_run(void);
+static FILE *spill_open(void);
+static int spill_compact(void);
+static int spill_write(FILE *, uint64_t /* key */, const void * /* report */);
+static int spill_od(FILE *, void * /* od_q */);
+static void *spill_read(FILE *, uint64_t * /* key */);
+static void *spill_next(spill_src_t *, uint64_t * /* key */);
+static void spill_sift(spill_src_t *, uint32_t * /* heap */, uint32_t /* n */, uint32_t /* j */);
+static void *spill_pop(spill_src_t *, uint32_t * /* heap */, uint32_t * /* n */, uint64_t * /* key */, uint32_t * /* from */);
+static void spill_merge(int (*)(uint64_t, void *, void *), int /* callback cleans up */);
+
+/*
+ * format strings are compiled once per scan into a list of ops, so printing
+ * a report is a walk down the list writing straight into the output buffer.
+ * same language as always: %[-0 ][width]<field>[n] and \ escapes
+ */
+#define FOP_LIT		0	/* text, lit[off] for len bytes	*/
+#define FOP_COUNTRY	1	/* C		*/
+#define FOP_HOST	2	/* h hn		*/
+#define FOP_LPORT	3	/* L Ln		*/
+#define FOP_MAC		4	/* M		*/
+#define FOP_OUI		5	/* o		*/
+#define FOP_PORT	6	/* p pn		*/
+#define FOP_RESP	7	/* r		*/
+#define FOP_SRC		8	/* s sn		*/
+#define FOP_SEQ		9	/* S		*/
+#define FOP_TTL		10	/* t		*/
+#define FOP_TRACE	11	/* T Tn		*/
+#define FOP_WIN		12	/* w		*/
+
+#define FOPF_LEFT	1	/* -		*/
+#define FOPF_ZERO	2	/* 0, numbers only, like printf	*/
+#define FOPF_NAME	4	/* trailing n	*/
+
+typedef struct fmt_op_t {
+	uint8_t type;
+	uint8_t flags;
+	uint16_t width;
+	uint32_t off;
+	uint32_t len;
+} fmt_op_t;
+
+typedef struct fmt_prog_t {
+	fmt_op_t *ops;
+	uint32_t nops;
+	char *lit;
+} fmt_prog_t;
+
+static struct {
+	fmt_prog_t *ip;
+	fmt_prog_t *imip;
+	fmt_prog_t *arp;
+	fmt_prog_t *imarp;
+	int names;		/* FN_ addresses some format wants a name for */
+} fmts;
+
+#define FN_HOST		1
+#define FN_SRC		2
+#define FN_TRACE	4
+
+/*
+ * report lines pile up here and go out in one write when there are enough
+ * of them, at the end of the report, or when the master asks via report_flush
+ */
+#define REPORT_OBUF	65536
+
+static struct {
+	char *buf;
+	size_t len;
+	size_t size;
+} ob;
+
+static fmt_prog_t *fmt_compile(const char * /* format string */);
+static void fmt_free(fmt_prog_t *);
+static void fmt_run(const fmt_prog_t *, const void * /* report */);
+static int fmt_names(const fmt_prog_t *);
+static void report_prefetch(const void * /* report */);
+static void ob_put(const char *, size_t);
+static void ob_endline(void);
 
 /*
  * Track last reported IP for visual grouping in compound mode.
@@ -83,7 +248,6 @@ static int do_arpreport_nodefunc(uint64_t, void *, void *);
 static void clean_report_extra(void *);
 static char *get_report_extra(ip_report_t *);
 static char *fmtcat_ip4addr(int /* dodns */, uint32_t /* addr */);
-static char *fmtcat(const char * /* format string */, const void * /* report item */);
 static char *strresptype(const ip_report_t *);
 static const char *ipproto_tostr(int /* proto */);
 
@@ -102,7 +266,39 @@ void report_init(void) {
 	int found = 0;
 #endif
 
-	report_t=rbinit(123);
+	rs.arena=arena_init(0);
+	rs.size=RS_INITSIZE;
+	rs.cnt=0;
+	rs.tbl=(rslot_t *)xmalloc(sizeof(rslot_t) * rs.size);
+	memset(rs.tbl, 0, sizeof(rslot_t) * rs.size);
+
+	if (GET_STREAM()) {
+		uint64_t bytes=0;
+
+		bytes=(uint64_t)(s->stream_mb != 0 ? s->stream_mb : STREAM_DEFMB) * 1024 * 1024;
+		for (sf.sets=1; ((uint64_t)sf.sets * 2 * STREAM_WAYS * sizeof(uint64_t)) <= bytes; sf.sets *= 2) {
+			;
+		}
+		sf.keys=(uint64_t *)xmalloc((size_t)sf.sets * STREAM_WAYS * sizeof(uint64_t));
+		memset(sf.keys, 0, (size_t)sf.sets * STREAM_WAYS * sizeof(uint64_t));
+		sf.sent=0;
+		sf.dups=0;
+		DBG(M_RPT, "stream filter of %u sets of %d", sf.sets, STREAM_WAYS);
+	}
+
+	fmts.ip=fmt_compile(s->ip_report_fmt);
+	fmts.imip=fmt_compile(s->ip_imreport_fmt);
+	fmts.arp=fmt_compile(s->arp_report_fmt);
+	fmts.imarp=fmt_compile(s->arp_imreport_fmt);
+	fmts.names=fmt_names(fmts.ip) | fmt_names(fmts.imip) | fmt_names(fmts.arp) | fmt_names(fmts.imarp);
+
+	/* VRB and OUT lines go straight to s->_stdout, ours have to be out before them */
+	output_setflush(&report_flush);
+
+	memset(&sp, 0, sizeof(sp));
+	if (s->spill_mb != 0 && ! GET_STREAM()) {
+		sp.limit=(uint64_t)s->spill_mb * 1024 * 1024;
+	}
 
 #ifdef HAVE_LIBMAXMINDDB
 	/*
@@ -173,18 +369,27 @@ void report_init(void) {
 
 void report_do(void) {
 
+	if (GET_STREAM()) {
+		VRB(1, "%" PRIu64 " results streamed, %" PRIu64 " duplicates dropped", sf.sent, sf.dups);
+	}
+
 	DBG(M_RPT, "formats are ip `%s' imip `%s' arp `%s' imarp `%s', you should see %u results",
 		s->ip_report_fmt,
 		s->ip_imreport_fmt,
 		s->arp_report_fmt,
 		s->arp_imreport_fmt,
-		rbsize(report_t)
+		rs.cnt
 	);
 
 	/* reset IP grouping state for fresh output */
 	last_reported_ip=0;
 
-	rbwalk(report_t, do_report_nodefunc, 1, NULL);
+	rs_walk(do_report_nodefunc, 1);
+	report_flush();
+
+	if (sp.nruns > 0) {
+		VRB(1, "%" PRIu64 " results merged back from %u runs on disk, %" PRIu64 " duplicates dropped", sp.spilled, sp.nruns, sp.dups);
+	}
 
 	return;
 }
@@ -197,21 +402,53 @@ void report_do(void) {
 void report_do_arp(void) {
 
 	DBG(M_RPT, "compound mode: outputting ARP reports sorted by IP, %u total reports",
-		rbsize(report_t)
+		rs.cnt
 	);
 
-	rbwalk(report_t, do_arpreport_nodefunc, 1, NULL);
+	rs_walk(do_arpreport_nodefunc, 0);
+	report_flush();
 
 	return;
 }
 
 void report_destroy(void) {
 
-	/* XXX
-	 * rbdestroy(report_t);
-	 */
+	if (rs.arena != NULL) {
+		DBG(M_RPT, "releasing " STFMT " bytes of reports", arena_used(rs.arena));
+		arena_destroy(rs.arena);
+	}
+	if (rs.tbl != NULL) {
+		xfree(rs.tbl);
+	}
+	memset(&rs, 0, sizeof(rs));
 
-	report_t=NULL;
+	if (sf.keys != NULL) {
+		xfree(sf.keys);
+	}
+	memset(&sf, 0, sizeof(sf));
+
+	if (sp.runs != NULL) {
+		uint32_t j=0;
+
+		for (j=0; j < sp.nruns; j++) {
+			fclose(sp.runs[j]);
+		}
+		xfree(sp.runs);
+	}
+	memset(&sp, 0, sizeof(sp));
+
+	output_setflush(NULL);
+	report_flush();
+	if (ob.buf != NULL) {
+		xfree(ob.buf);
+	}
+	memset(&ob, 0, sizeof(ob));
+
+	fmt_free(fmts.ip);
+	fmt_free(fmts.imip);
+	fmt_free(fmts.arp);
+	fmt_free(fmts.imarp);
+	memset(&fmts, 0, sizeof(fmts));
 
 #ifdef HAVE_LIBMAXMINDDB
 	if (mmdb_open) {
@@ -239,14 +476,21 @@ int report_add(void *o, size_t o_len) {
 	char addr_str[INET_ADDRSTRLEN];
 	uint64_t rkey=0;
 	void *dummy=NULL;
-	char *line=NULL;
 
 	o_u.ptr=o;
 
-	if (report_t == NULL) {
+	if (rs.tbl == NULL) {
 		PANIC("cannot add to NULL report structure");
 	}
 
+	if (GET_DODNS() && fmts.names != 0) {
+		report_prefetch(o);
+	}
+
+	if (sf.keys != NULL) {
+		return report_stream(o);
+	}
+
 	if (*o_u.magic == IP_REPORT_MAGIC) {
 
 		ia.s_addr=o_u.i->host_addr;
@@ -255,18 +499,14 @@ int report_add(void *o, size_t o_len) {
 
 		if (port_open(o_u.i->proto, o_u.i->type, o_u.i->subtype)) {
 
-			if (rbfind(report_t, rkey, &dummy) != 1) {
+			if (rs_find(rkey, &dummy) != 1) {
 
-				oc_u.ptr=xmalloc(o_len);
-				memcpy(oc_u.ptr, o_u.ptr, o_len);
-				rbinsert(report_t, rkey, oc_u.ptr);
+				oc_u.ptr=rs_copy(o_u.ptr, o_len);
+				rs_insert(rkey, oc_u.ptr);
 
-				if (GET_IMMEDIATE()) {
-					line=fmtcat(s->ip_imreport_fmt, o_u.i);
-					if (line != NULL) {
-						OUT("%s", line);
-						xfree(line);
-					}
+				if (GET_IMMEDIATE() && SPILL_IMMEDIATE() && fmts.imip != NULL) {
+					fmt_run(fmts.imip, o_u.i);
+					ob_endline();
 				}
 			}
 			else if (GET_PROCDUPS()) {
@@ -281,18 +521,13 @@ int report_add(void *o, size_t o_len) {
 				for (walk=r_u.r; walk->next != NULL; walk=walk->next) {
 					;
 				}
-				walk->next=(ip_report_t *)xmalloc(o_len);
-				memset(walk->next, 0, o_len);
+				walk->next=(ip_report_t *)rs_copy(o_u.ptr, o_len);
 				walk=walk->next;
-				memcpy(walk, o_u.ptr, o_len);
 				walk->next=NULL;		/* just to be sure */
 
-				if (GET_IMMEDIATE()) {
-					line=fmtcat(s->ip_imreport_fmt, o_u.i);
-					if (line != NULL) {
-						OUT("%s", line);
-						xfree(line);
-					}
+				if (GET_IMMEDIATE() && fmts.imip != NULL) {
+					fmt_run(fmts.imip, o_u.i);
+					ob_endline();
 				}
 			}
 			else {
@@ -302,18 +537,14 @@ int report_add(void *o, size_t o_len) {
 		}
 		else if (GET_PROCERRORS()) {
 
-			if (rbfind(report_t, rkey, &dummy) != 1) {
+			if (rs_find(rkey, &dummy) != 1) {
 
-				oc_u.ptr=xmalloc(o_len);
-				memcpy(oc_u.ptr, o_u.ptr, o_len);
-				rbinsert(report_t, rkey, oc_u.ptr);
+				oc_u.ptr=rs_copy(o_u.ptr, o_len);
+				rs_insert(rkey, oc_u.ptr);
 
-				if (GET_IMMEDIATE()) {
-					line=fmtcat(s->ip_imreport_fmt, o_u.i);
-					if (line != NULL) {
-						OUT("%s", line);
-						xfree(line);
-					}
+				if (GET_IMMEDIATE() && SPILL_IMMEDIATE() && fmts.imip != NULL) {
+					fmt_run(fmts.imip, o_u.i);
+					ob_endline();
 				}
 			}
 			else if (GET_PROCDUPS()) {
@@ -328,18 +559,13 @@ int report_add(void *o, size_t o_len) {
 				for (walk=r_u.r; walk->next != NULL; walk=walk->next) {
 					;
 				}
-				walk->next=(ip_report_t *)xmalloc(o_len);
-				memset(walk->next, 0, o_len);
+				walk->next=(ip_report_t *)rs_copy(o_u.ptr, o_len);
 				walk=walk->next;
-				memcpy(walk, o_u.ptr, o_len);
 				walk->next=NULL;		/* just to be sure */
 
-				if (GET_IMMEDIATE()) {
-					line=fmtcat(s->ip_imreport_fmt, o_u.i);
-					if (line != NULL) {
-						OUT("%s", line);
-						xfree(line);
-					}
+				if (GET_IMMEDIATE() && fmts.imip != NULL) {
+					fmt_run(fmts.imip, o_u.i);
+					ob_endline();
 				}
 			}
 			else {
@@ -351,23 +577,19 @@ int report_add(void *o, size_t o_len) {
 	else if (*o_u.magic == ARP_REPORT_MAGIC) {
 		rkey=get_arpreport_key(o_u.a->ipaddr, o_u.a->hwaddr);
 
-		if (rbfind(report_t, rkey, &dummy) != 1) {
+		if (rs_find(rkey, &dummy) != 1) {
 
-			oc_u.ptr=xmalloc(o_len);
-			memcpy(oc_u.ptr, o_u.ptr, o_len);
-			rbinsert(report_t, rkey, oc_u.ptr);
+			oc_u.ptr=rs_copy(o_u.ptr, o_len);
+			rs_insert(rkey, oc_u.ptr);
 
 			/*
 			 * In compound mode, suppress immediate ARP output.
 			 * ARP results will be output sorted by IP via report_do_arp()
 			 * after the ARP phase completes.
 			 */
-			if (GET_IMMEDIATE() && s->num_phases <= 1) {
-				line=fmtcat(s->arp_imreport_fmt, o_u.a);
-				if (line != NULL) {
-					OUT("%s", line);
-					xfree(line);
-				}
+			if (GET_IMMEDIATE() && SPILL_IMMEDIATE() && s->num_phases <= 1 && fmts.imarp != NULL) {
+				fmt_run(fmts.imarp, o_u.a);
+				ob_endline();
 			}
 		}
 		else if (GET_PROCDUPS()) {
@@ -380,6 +602,10 @@ int report_add(void *o, size_t o_len) {
 		return -1;
 	}
 
+	if (sp.limit != 0 && (uint64_t)arena_used(rs.arena) + sizeof(rslot_t) * rs.size >= sp.limit) {
+		spill_run();
+	}
+
 	return 1;
 }
 
@@ -390,7 +616,8 @@ static void display_report(void *p) {
 		ip_report_t *i;
 		uint32_t *magic;
 	} r_u;
-	char *extra=NULL, *line=NULL, *fmt=NULL;
+	char *extra=NULL;
+	const fmt_prog_t *prog=NULL;
 
 	if (p == NULL) {
 		PANIC("NULL ip report");
@@ -400,20 +627,23 @@ static void display_report(void *p) {
 
 	if (*r_u.magic == IP_REPORT_MAGIC) {
 		extra=get_report_extra(r_u.i);
-		fmt=s->ip_report_fmt;
+		prog=fmts.ip;
 	}
 	else if (*r_u.magic == ARP_REPORT_MAGIC) {
-		fmt=s->arp_report_fmt;
+		prog=fmts.arp;
 	}
 	else {
 		ERR("unknown report format %08x", *r_u.magic);
 		return;
 	}
 
-	line=fmtcat(fmt, p);
-	if (line != NULL) {
-		OUT("%s %s", line, extra != NULL ? extra : "");
-		xfree(line);
+	if (prog != NULL) {
+		fmt_run(prog, p);
+		ob_put(" ", 1);
+		if (extra != NULL) {
+			ob_put(extra, strlen(extra));
+		}
+		ob_endline();
 	}
 
 	return;
@@ -450,7 +680,7 @@ static int do_report_nodefunc(uint64_t rkey, void *ptr, void *cbdata) {
 		 */
 		if (this_ip != last_reported_ip && last_reported_ip != 0) {
 			if ( ! GET_REPORTQUIET()) {
-				OUT("%s", "");
+				ob_endline();
 			}
 		}
 		last_reported_ip=this_ip;
@@ -494,7 +724,7 @@ static int do_report_nodefunc(uint64_t rkey, void *ptr, void *cbdata) {
 	}
 
 	clean_report_extra(r_u.ptr);
-	xfree(r_u.ptr);
+	/* the record itself stays in the arena until report_destroy */
 
 	return 1;
 }
@@ -532,445 +762,1224 @@ static int do_arpreport_nodefunc(uint64_t rkey, void *ptr, void *cbdata) {
 	return 1;
 }
 
-static void clean_report_extra(void *r) {
+/* 1 if key was seen lately, either way its the most recent in its set after */
+static int stream_seen(uint64_t key) {
+	uint64_t *set=NULL;
+	unsigned int j=0;
+	int found=0;
+
+	set=&sf.keys[(size_t)RS_SLOT(key, sf.sets) * STREAM_WAYS];
+
+	for (j=0; j < STREAM_WAYS; j++) {
+		if (set[j] == key) {
+			found=1;
+			break;
+		}
+	}
+	if (j == STREAM_WAYS) {
+		j=STREAM_WAYS - 1;	/* the oldest goes */
+	}
+
+	memmove(&set[1], &set[0], sizeof(uint64_t) * j);
+	set[0]=key;
+
+	return found;
+}
+
+/*
+ * --stream, what report_add and do_report_nodefunc do together, minus the
+ * keeping.  same rules for what is worth reporting, printed in the
+ * immediate format since there is no end of scan report to wait for
+ */
+static int report_stream(void *r) {
 	union {
-		ip_report_t *ir;
-		arp_report_t *ar;
 		void *ptr;
+		arp_report_t *a;
+		ip_report_t *i;
 		uint32_t *magic;
 	} r_u;
-	union {
-		void *ptr;
-		output_data_t *d;
-	} d_u;
-
-	assert(r != NULL);
+	uint64_t rkey=0;
+	const fmt_prog_t *prog=NULL;
 
 	r_u.ptr=r;
 
-	if (*r_u.magic != IP_REPORT_MAGIC || r_u.ir->od_q == NULL) {
-		return;
+	if (*r_u.magic == IP_REPORT_MAGIC) {
+		if (! port_open(r_u.i->proto, r_u.i->type, r_u.i->subtype) && ! GET_PROCERRORS()) {
+			clean_report_extra(r_u.ptr);
+			return 1;
+		}
+		rkey=get_ipreport_key(r_u.i->host_addr, r_u.i->sport, r_u.i->send_addr);
+		prog=fmts.imip;
+	}
+	else if (*r_u.magic == ARP_REPORT_MAGIC) {
+		rkey=get_arpreport_key(r_u.a->ipaddr, r_u.a->hwaddr);
+		prog=fmts.imarp;
+	}
+	else {
+		ERR("unknown report format %08x", *r_u.magic);
+		return -1;
 	}
 
-	while ((d_u.ptr=fifo_pop(r_u.ir->od_q)) != NULL) {
-		xfree(d_u.ptr);
+	if (! GET_PROCDUPS() && stream_seen(rkey)) {
+		sf.dups++;
+		clean_report_extra(r_u.ptr);
+		return 1;
 	}
+	sf.sent++;
 
-	fifo_destroy(r_u.ir->od_q);
+	push_report_modules((const void *)r_u.ptr);
+	push_output_modules((const void *)r_u.ptr);
 
-	return;
-}
+	if ( ! GET_REPORTQUIET() && s->ss->mode != MODE_TCPTRACE && prog != NULL) {
+		fmt_run(prog, r_u.ptr);
+		ob_endline();
+	}
 
-/*
- * deal with a 32 bit network address, possibly looking up DNS depending on GET_DODNS and the format string
- * dodns means that the format string had a trailing n inside it (1 = yes)
- */
-static char *fmtcat_ip4addr(int dodns, uint32_t addr) {
-	struct sockaddr_in tsin;
-	char *thost=NULL;
-	struct in_addr ia;
-	static char addr_str[INET_ADDRSTRLEN];
+	clean_report_extra(r_u.ptr);
 
-	if (dodns == 1 && GET_DODNS()) {
-		tsin.sin_family=AF_INET;
-		tsin.sin_port=0;
-		tsin.sin_addr.s_addr=addr;
+	return 1;
+}
 
-		thost=stddns_getname(s->dns, (const struct sockaddr *)&tsin);
-		if (thost != NULL) {
-			return thost;
-		}
-	}
+static void *rs_copy(const void *r, size_t len) {
+	void *ret=NULL;
 
-	/* if dodns == 1 and GET_DODNS == 0
-	 * they have a format string asking for dns, but want to skip doing DNS
-	 * well override the format string with the lacking `do dns' option
-	 */
+	ret=arena_alloc(rs.arena, len);
+	memcpy(ret, r, len);
 
-	ia.s_addr=addr;
-	inet_ntop(AF_INET, &ia, addr_str, sizeof(addr_str));
-	return addr_str;
+	return ret;
 }
 
-static char *fmtcat(const char *fmt, const void *report) {
-	int state=0;
-	char *outline=NULL;
-	const char *end=NULL;
-	size_t outoff=0, cursz=0;
-	union {
-		const arp_report_t *a;
-		const ip_report_t *i;
-		const void *p;
-		const uint32_t *magic;
-	} r_u;
+static int rs_find(uint64_t key, void **rec) {
+	uint32_t j=0;
 
-	if (fmt == NULL || strlen(fmt) < 1) {
-		return NULL;
+	for (j=RS_SLOT(key, rs.size); rs.tbl[j].rec != NULL; j=(j + 1) & (rs.size - 1)) {
+		if (rs.tbl[j].key == key) {
+			*rec=rs.tbl[j].rec;
+			return 1;
+		}
 	}
 
-	r_u.p=report;
+	return 0;
+}
 
-	cursz=128;
-	outline=xmalloc(cursz);
+/* key must not be in the table already, see rs_find */
+static void rs_insert(uint64_t key, void *rec) {
+	uint32_t j=0;
 
-#define KEH(x) \
-	if (outoff + 2 > cursz) { \
-		assert((cursz * 2) > cursz); \
-		cursz *= 2; \
-		outline=realloc(outline, cursz); \
-	} \
-	outline[outoff++]=x
-
-#define KEHSTR(x) \
-	if ((outoff + 1 + strlen((x))) > cursz) { \
-		size_t newlen=cursz + (2 * (strlen((x)) + 1)); \
-		\
-		assert(newlen > cursz); \
-		outline=realloc(outline, newlen); \
-		cursz=newlen; \
-	} \
-	memcpy(outline + outoff, (x), strlen((x))); \
-	outoff += strlen((x))
+	assert(rec != NULL);
 
-	for (end=fmt + strlen(fmt); *fmt != '\0'; fmt++) {
-		if (state == 0) {
-			if (*fmt == '%') {
-				state=1;
-			}
-			else if (*fmt == '\\') {
-				state=2;
+	if ((rs.cnt + 1) * 2 > rs.size) {
+		rslot_t *old=rs.tbl;
+		uint32_t osize=rs.size, k=0;
+
+		rs.size *= 2;
+		rs.tbl=(rslot_t *)xmalloc(sizeof(rslot_t) * rs.size);
+		memset(rs.tbl, 0, sizeof(rslot_t) * rs.size);
+
+		for (k=0; k < osize; k++) {
+			if (old[k].rec == NULL) {
+				continue;
 			}
-			else {
-				KEH(*fmt);
+			for (j=RS_SLOT(old[k].key, rs.size); rs.tbl[j].rec != NULL; j=(j + 1) & (rs.size - 1)) {
+				;
 			}
+			rs.tbl[j]=old[k];
 		}
-		else if (state == 1) {
-			/*
-			 * dodge as much work as possible ;], printf already does this
-			 */
-			uint32_t taddr=0;
-			char ofmt[128], tmp[1024], *tptr=NULL;
-			unsigned int noff=0;
-			struct in_addr ia;
-			int doname=0;
+		xfree(old);
+	}
 
-			ofmt[0]='%';
-			ofmt[1]='\0';
+	for (j=RS_SLOT(key, rs.size); rs.tbl[j].rec != NULL; j=(j + 1) & (rs.size - 1)) {
+		;
+	}
+	rs.tbl[j].key=key;
+	rs.tbl[j].rec=rec;
+	rs.cnt++;
 
-			state=0;
+	return;
+}
 
-			if (*fmt == '-' || *fmt == '0' || *fmt == ' ') {
-				ofmt[1]=*fmt;
-				ofmt[2]='\0';
-				fmt++;
-				if (fmt == end) {
-					continue;
-				}
-			}
+static int rs_keycmp(const void *a, const void *b) {
+	const rslot_t *sa=(const rslot_t *)a, *sb=(const rslot_t *)b;
 
-			/* dont support large lengths, 999 is big enough */
-			for (noff=0; fmt < end && isdigit(*fmt) && noff < 3; noff++, fmt++) {
-				;
-			}
+	if (sa->key < sb->key) {
+		return -1;
+	}
 
-			if (noff > 0) {
-				char buf[16];
+	return sa->key > sb->key ? 1 : 0;
+}
 
-				memcpy(buf, fmt - noff, noff);
-				buf[noff]='\0';
-				strncat(ofmt, buf, sizeof(buf) - 1);
-			}
+/* the occupied slots in key order, rs.cnt of them */
+static rslot_t *rs_sorted(void) {
+	rslot_t *idx=NULL;
+	uint32_t j=0, n=0;
 
-			doname=0;
+	idx=(rslot_t *)xmalloc(sizeof(rslot_t) * (rs.cnt > 0 ? rs.cnt : 1));
 
-			switch (*fmt) {
-				case '%':
-					KEH(*fmt);
-					break;
+	for (j=0; j < rs.size; j++) {
+		if (rs.tbl[j].rec != NULL) {
+			idx[n++]=rs.tbl[j];
+		}
+	}
+	assert(n == rs.cnt);
 
-				case 'C': /* country */
-					if (*r_u.magic == IP_REPORT_MAGIC) {
-						ia.s_addr=r_u.i->host_addr;
-					}
-					else if (*r_u.magic == ARP_REPORT_MAGIC) {
-						ia.s_addr=r_u.a->ipaddr;
-					}
-					else {
-						break;
-					}
-					strcat(ofmt, "s");
-#ifdef HAVE_LIBMAXMINDDB
-					if (mmdb_open) {
-						int mmdb_error;
-						MMDB_lookup_result_s result;
-						MMDB_entry_data_s entry_data;
-						struct sockaddr_in sa;
-
-						sa.sin_family = AF_INET;
-						sa.sin_addr = ia;
-						result = MMDB_lookup_sockaddr(&mmdb, (struct sockaddr *)&sa, &mmdb_error);
-						if (mmdb_error == MMDB_SUCCESS && result.found_entry) {
-							if (MMDB_get_value(&result.entry, &entry_data,
-							    "country", "iso_code", NULL) == MMDB_SUCCESS &&
-							    entry_data.has_data && entry_data.type == MMDB_DATA_TYPE_UTF8_STRING) {
-								/* entry_data.utf8_string is not null-terminated */
-								char cc[4] = {0};
-								size_t len = entry_data.data_size < 3 ? entry_data.data_size : 2;
-								memcpy(cc, entry_data.utf8_string, len);
-								snprintf(tmp, sizeof(tmp) - 1, ofmt, cc);
-							} else {
-								snprintf(tmp, sizeof(tmp) - 1, ofmt, "??");
-							}
-						} else {
-							snprintf(tmp, sizeof(tmp) - 1, ofmt, "??");
-						}
-					} else {
-						snprintf(tmp, sizeof(tmp) - 1, ofmt, "??");
-					}
-					KEHSTR(tmp);
-#else
-					snprintf(tmp, sizeof(tmp) - 1, ofmt, "??");
-					KEHSTR(tmp);
-#endif
+	qsort(idx, n, sizeof(rslot_t), &rs_keycmp);
 
-					break;
+	return idx;
+}
 
-				case 'h': /* host address (followed by n means dns name if possible) */
-					if (*(fmt + 1) == 'n') {
-						doname=1;
-						fmt++;
-					}
-					if (*r_u.magic == IP_REPORT_MAGIC) {
-						taddr=r_u.i->host_addr;
-					}
-					else if (*r_u.magic == ARP_REPORT_MAGIC) {
-						taddr=r_u.a->ipaddr;
-					}
-					else {
-						break;
-					}
-					strcat(ofmt, "s");
+/*
+ * in key order, like the red black tree this replaced.  owned is 1 if the
+ * callback cleans up the report extras itself (do_report_nodefunc does)
+ */
+static void rs_walk(int (*wf)(uint64_t, void *, void *), int owned) {
+	rslot_t *idx=NULL;
+	uint32_t j=0;
 
-					tptr=fmtcat_ip4addr(doname, taddr);
-					if (tptr != NULL) {
-						snprintf(tmp, sizeof(tmp) - 1, ofmt, tptr);
-						KEHSTR(tmp);
-					}
-					break;
+	if (sp.nruns > 0) {
+		spill_merge(wf, owned);
+		return;
+	}
 
-				case 'L': /* local port */
-					if (*(fmt + 1) == 'n') {
-						doname=1;
-						fmt++;
-					}
-					if (*r_u.magic != IP_REPORT_MAGIC) {
-						break;
-					}
+	if (rs.cnt == 0) {
+		return;
+	}
 
-					if (doname == 1) {
-						strcat(ofmt, "s");
-						snprintf(tmp, sizeof(tmp) - 1, ofmt, getservname(r_u.i->dport));
-					}
-					else {
-						strcat(ofmt, "hu");
-						snprintf(tmp, sizeof(tmp) -1, ofmt, r_u.i->dport);
-					}
-					KEHSTR(tmp);
-					break;
+	idx=rs_sorted();
 
-				case 'M': /* link address */
-					if (*r_u.magic == ARP_REPORT_MAGIC) {
-						char hwstr[64];
-
-						snprintf(hwstr, sizeof(hwstr) -1, "%02x:%02x:%02x:%02x:%02x:%02x",
-							r_u.a->hwaddr[0], r_u.a->hwaddr[1], r_u.a->hwaddr[2],
-							r_u.a->hwaddr[3], r_u.a->hwaddr[4], r_u.a->hwaddr[5]
-						);
-						strcat(ofmt, "s");
-						snprintf(tmp, sizeof(tmp) -1, ofmt, hwstr);
-						KEHSTR(tmp);
-					}
-					/* v9: Display Ethernet source MAC for local network IP reports */
-					else if (*r_u.magic == IP_REPORT_MAGIC && r_u.i->eth_hwaddr_valid) {
-						char hwstr[64];
-
-						snprintf(hwstr, sizeof(hwstr) -1, "%02x:%02x:%02x:%02x:%02x:%02x",
-							r_u.i->eth_hwaddr[0], r_u.i->eth_hwaddr[1], r_u.i->eth_hwaddr[2],
-							r_u.i->eth_hwaddr[3], r_u.i->eth_hwaddr[4], r_u.i->eth_hwaddr[5]
-						);
-						strcat(ofmt, "s");
-						snprintf(tmp, sizeof(tmp) -1, ofmt, hwstr);
-						KEHSTR(tmp);
-					}
-					break;
+	for (j=0; j < rs.cnt; j++) {
+		if (wf(idx[j].key, idx[j].rec, NULL) < 1) {
+			break;
+		}
+	}
 
-				case 'o': /* macaddr OUI name */
-					if (*r_u.magic == ARP_REPORT_MAGIC) {
-						const char *vend=NULL;
-
-						vend=getouiname(r_u.a->hwaddr[0], r_u.a->hwaddr[1], r_u.a->hwaddr[2]);
-						if (vend == NULL) {
-							vend="unknown";
-						}
-						strcat(ofmt, "s");
-						snprintf(tmp, sizeof(tmp) -1, ofmt, vend);
-						KEHSTR(tmp);
-					}
-					/* v9: OUI lookup for local network IP reports with MAC */
-					else if (*r_u.magic == IP_REPORT_MAGIC && r_u.i->eth_hwaddr_valid) {
-						const char *vend=NULL;
-
-						vend=getouiname(r_u.i->eth_hwaddr[0], r_u.i->eth_hwaddr[1], r_u.i->eth_hwaddr[2]);
-						if (vend == NULL) {
-							vend="unknown";
-						}
-						strcat(ofmt, "s");
-						snprintf(tmp, sizeof(tmp) -1, ofmt, vend);
-						KEHSTR(tmp);
-					}
-					break;
+	xfree(idx);
 
-				case 'p': /* port */
-					if (*(fmt + 1) == 'n') {
-						doname=1;
-						fmt++;
-					}
-					if (*r_u.magic != IP_REPORT_MAGIC) {
-						break;
-					}
+	return;
+}
 
-					if (doname == 1) {
-						strcat(ofmt, "s");
-						snprintf(tmp, sizeof(tmp) - 1, ofmt, getservname(r_u.i->sport));
-					}
-					else {
-						strcat(ofmt, "hu");
-						snprintf(tmp, sizeof(tmp) -1, ofmt, r_u.i->sport);
-					}
+/*
+ * write the table out sorted as a new run and empty it.  if that cant be
+ * done, nothing is lost, spilling just stops and the table keeps growing
+ */
+static void spill_run(void) {
+	rslot_t *idx=NULL;
+	FILE *f=NULL;
+	uint32_t j=0;
+	uint64_t cnt=0;
+	int ok=1;
+	union {
+		void *ptr;
+		ip_report_t *ir;
+		uint32_t *magic;
+	} r_u;
 
-					KEHSTR(tmp);
-					break;
+	if (rs.cnt == 0) {
+		return;
+	}
 
-				case 'r': /* response type */
-					if (*r_u.magic == IP_REPORT_MAGIC) {
-						strcat(ofmt, "s");
-						snprintf(tmp, sizeof(tmp) -1, ofmt, strresptype(r_u.i));
-						KEHSTR(tmp);
-					}
-					break;
+	if (sp.nruns >= SPILL_MAXRUNS && spill_compact() < 0) {
+		ERR("cant merge the spill runs, keeping the rest of the results in memory");
+		sp.limit=0;
+		return;
+	}
 
-				case 's': /* source address */
-					if (*(fmt + 1) == 'n') {
-						doname=1;
-						fmt++;
-					}
-					if (*r_u.magic != IP_REPORT_MAGIC) {
-						break;
-					}
-					strcat(ofmt, "s");
+	f=spill_open();
+	if (f == NULL) {
+		ERR("keeping the rest of the results in memory");
+		sp.limit=0;
+		return;
+	}
 
-					tptr=fmtcat_ip4addr(doname, r_u.i->send_addr);
-					if (tptr != NULL) {
-						snprintf(tmp, sizeof(tmp) -1, ofmt, tptr);
-						KEHSTR(tmp);
-					}
-					break;
+	idx=rs_sorted();
 
-				case 'S': /* remote sequence number */
-					if (*r_u.magic == IP_REPORT_MAGIC && r_u.i->proto == IPPROTO_TCP) {
-						strcat(ofmt, "x");
-						snprintf(tmp, sizeof(tmp) -1, ofmt, r_u.i->tseq);
-						KEHSTR(tmp);
-					}
-					break;
+	for (j=0; ok && j < rs.cnt; j++) {
+		for (r_u.ptr=idx[j].rec; r_u.ptr != NULL; ) {
+			if (spill_write(f, idx[j].key, r_u.ptr) < 0) {
+				ok=0;
+				break;
+			}
+			cnt++;
+			r_u.ptr=(*r_u.magic == IP_REPORT_MAGIC ? (void *)r_u.ir->next : NULL);
+		}
+	}
 
-				case 't': /* ttl */
-					if (*r_u.magic != IP_REPORT_MAGIC) {
-						break;
-					}
-					strcat(ofmt, "hu");
-					snprintf(tmp, sizeof(tmp) - 1, ofmt, r_u.i->ttl);
-					KEHSTR(tmp);
-					break;
+	if (! ok || fflush(f) != 0) {
+		ERR("cant write spill file: %s, keeping the rest of the results in memory", strerror(errno));
+		fclose(f);
+		xfree(idx);
+		sp.limit=0;
+		return;
+	}
 
-				case 'T': /* trace address */
-					if (*(fmt + 1) == 'n') {
-						doname=1;
-						fmt++;
-					}
-					if (*r_u.magic != IP_REPORT_MAGIC) {
-						break;
-					}
+	DBG(M_RPT, "spilled %u results, " STFMT " bytes of memory, run %u", rs.cnt, arena_used(rs.arena), sp.nruns);
 
-					if (r_u.i->trace_addr == r_u.i->host_addr) {
-						break;
-					}
+	if (sp.nruns == 0 && GET_IMMEDIATE() && ! GET_PROCDUPS()) {
+		VRB(0, "results are going to disk, the rest show up in the report at the end");
+	}
 
-					tptr=fmtcat_ip4addr(doname, r_u.i->trace_addr);
-					if (tptr != NULL) {
-						strcat(ofmt, "s");
-						snprintf(tmp, sizeof(tmp) - 1, ofmt, tptr);
-						KEHSTR(tmp);
-					}
-					break;
+	sp.runs=(FILE **)xrealloc(sp.runs, sizeof(FILE *) * (sp.nruns + 1));
+	sp.runs[sp.nruns++]=f;
+	sp.spilled += cnt;
 
-				case 'w': /* window size */
-					if (*r_u.magic == IP_REPORT_MAGIC && r_u.i->proto == IPPROTO_TCP) {
-						strcat(ofmt, "u");
-						snprintf(tmp, sizeof(tmp) -1, ofmt, r_u.i->window_size);
-						KEHSTR(tmp);
-					}
-					break;
+	/* its all on disk now, output data included */
+	for (j=0; j < rs.cnt; j++) {
+		for (r_u.ptr=idx[j].rec; r_u.ptr != NULL; ) {
+			clean_report_extra(r_u.ptr);
+			r_u.ptr=(*r_u.magic == IP_REPORT_MAGIC ? (void *)r_u.ir->next : NULL);
+		}
+	}
 
-				default:
-					fprintf(stderr, "unknown format string character `%c'\n", *fmt);
-					break;
-			}
-		} /* if state */
-		else if (state == 2) {
-			switch (*fmt) {
-				case 'v':
-					KEH('\v');
-					break;
+	xfree(idx);
 
-				case 't':
-					KEH('\t');
-					break;
+	arena_destroy(rs.arena);
+	rs.arena=arena_init(0);
+	memset(rs.tbl, 0, sizeof(rslot_t) * rs.size);
+	rs.cnt=0;
 
-				case 'n':
-					KEH('\n');
-					break;
+	return;
+}
 
-				case 'a':
-					KEH('\a');
-					break;
+/* an unlinked temp file, nothing to clean up after us if we die */
+static FILE *spill_open(void) {
+	char path[PATH_MAX];
+	const char *tmpdir=NULL;
+	FILE *f=NULL;
+	int fd=-1;
 
-				case 'b':
-					KEH('\b');
-					break;
+	tmpdir=getenv("TMPDIR");
+	if (tmpdir == NULL || *tmpdir == '\0') {
+		tmpdir="/tmp";
+	}
+	snprintf(path, sizeof(path) - 1, "%s/unicornscan-spill.XXXXXX", tmpdir);
+
+	fd=mkstemp(path);
+	if (fd < 0 || (f=fdopen(fd, "w+b")) == NULL) {
+		ERR("cant create spill file in %s: %s", tmpdir, strerror(errno));
+		if (fd >= 0) {
+			unlink(path);
+			close(fd);
+		}
+		return NULL;
+	}
+	unlink(path);
 
-				case 'f':
-					KEH('\f');
-					break;
+	return f;
+}
+
+/*
+ * merge all the runs into one so they dont each hold a file open.  records
+ * keep their run order within a key, so the first seen still wins later.
+ * -1 and the runs are as they were if the merged one cant be written
+ */
+static int spill_compact(void) {
+	spill_src_t *src=NULL;
+	uint32_t *heap=NULL, n=0, j=0, from=0;
+	uint64_t key=0;
+	void *rec=NULL;
+	FILE *f=NULL;
+	int ret=1;
+
+	f=spill_open();
+	if (f == NULL) {
+		return -1;
+	}
+
+	src=(spill_src_t *)xmalloc(sizeof(spill_src_t) * sp.nruns);
+	heap=(uint32_t *)xmalloc(sizeof(uint32_t) * sp.nruns);
+
+	for (j=0; j < sp.nruns; j++) {
+		src[j].f=sp.runs[j];
+		rewind(src[j].f);
+		src[j].rec=spill_next(&src[j], &src[j].key);
+		if (src[j].rec != NULL) {
+			heap[n++]=j;
+		}
+	}
+	for (j=n / 2; j > 0; j--) {
+		spill_sift(src, heap, n, j - 1);
+	}
+
+	while (n > 0) {
+		rec=spill_pop(src, heap, &n, &key, &from);
+		if (ret > 0 && spill_write(f, key, rec) < 0) {
+			ret=-1;
+		}
+		clean_report_extra(rec);
+		xfree(rec);
+	}
+
+	if (ret > 0 && fflush(f) != 0) {
+		ret=-1;
+	}
+
+	xfree(src);
+	xfree(heap);
+
+	if (ret < 0) {
+		ERR("cant write spill file: %s", strerror(errno));
+		fclose(f);
+		return -1;
+	}
+
+	DBG(M_RPT, "merged %u spill runs into one", sp.nruns);
+
+	for (j=0; j < sp.nruns; j++) {
+		fclose(sp.runs[j]);
+	}
+	sp.runs[0]=f;
+	sp.nruns=1;
+
+	return 1;
+}
+
+/* one report and its output data, the report is left as it was */
+static int spill_write(FILE *f, uint64_t key, const void *r) {
+	spill_hdr_t h;
+	void *od_q=NULL;
+	union {
+		const void *ptr;
+		const ip_report_t *ir;
+		const arp_report_t *ar;
+		const uint32_t *magic;
+	} r_u;
+
+	r_u.ptr=r;
+	h.key=key;
+
+	if (*r_u.magic == IP_REPORT_MAGIC) {
+		h.len=sizeof(ip_report_t) + r_u.ir->doff;
+		od_q=r_u.ir->od_q;
+	}
+	else {
+		h.len=sizeof(arp_report_t) + r_u.ar->doff;
+		od_q=r_u.ar->od_q;
+	}
+	h.odcnt=od_q == NULL ? 0 : (uint16_t)fifo_length(od_q);
+
+	if (fwrite(&h, sizeof(h), 1, f) != 1 || fwrite(r_u.ptr, h.len, 1, f) != 1) {
+		return -1;
+	}
+
+	return spill_od(f, od_q);
+}
 
-				case 'r':
-					KEH('\r');
+/* writes the output data out, each goes back on the end of the queue so its as it was */
+static int spill_od(FILE *f, void *od_q) {
+	spill_od_t o;
+	union {
+		void *ptr;
+		output_data_t *d;
+	} d_u;
+	const char *str=NULL;
+	uint16_t cnt=0;
+	int ret=1;
+
+	if (od_q == NULL) {
+		return 1;
+	}
+
+	/* the header said this many */
+	for (cnt=(uint16_t)fifo_length(od_q); cnt > 0 && (d_u.ptr=fifo_pop(od_q)) != NULL; cnt--) {
+		str=(d_u.d->type == OD_TYPE_OS ? d_u.d->t_u.os : d_u.d->t_u.banner);
+		if (str == NULL) {
+			str="";
+		}
+		o.type=d_u.d->type;
+		o.len=(uint16_t)MIN(strlen(str), 0xffff);
+
+		if (ret > 0 && (fwrite(&o, sizeof(o), 1, f) != 1 || (o.len > 0 && fwrite(str, o.len, 1, f) != 1))) {
+			ret=-1;
+		}
+		fifo_push(od_q, d_u.ptr);
+	}
+
+	return ret;
+}
+
+/*
+ * the next record of a run as a report of its own, NULL at the end.  the
+ * output data comes back with each string in the same allocation as its
+ * output_data_t, so clean_report_extra frees it all
+ */
+static void *spill_read(FILE *f, uint64_t *key) {
+	spill_hdr_t h;
+	spill_od_t o;
+	void *od_q=NULL;
+	uint16_t j=0;
+	union {
+		void *ptr;
+		ip_report_t *ir;
+		arp_report_t *ar;
+		uint32_t *magic;
+	} r_u;
+	union {
+		void *ptr;
+		output_data_t *d;
+	} d_u;
+
+	if (fread(&h, sizeof(h), 1, f) != 1) {
+		if (ferror(f)) {
+			ERR("cant read spill file: %s", strerror(errno));
+		}
+		return NULL;
+	}
+
+	r_u.ptr=xmalloc(h.len);
+	if (fread(r_u.ptr, h.len, 1, f) != 1) {
+		ERR("spill file is short");
+		xfree(r_u.ptr);
+		return NULL;
+	}
+
+	od_q=fifo_init();
+
+	for (j=0; j < h.odcnt; j++) {
+		if (fread(&o, sizeof(o), 1, f) != 1) {
+			ERR("spill file is short");
+			break;
+		}
+		d_u.ptr=xmalloc(sizeof(output_data_t) + o.len + 1);
+		d_u.d->type=o.type;
+		d_u.d->t_u.os=(char *)d_u.ptr + sizeof(output_data_t);
+		if (o.len > 0 && fread(d_u.d->t_u.os, o.len, 1, f) != 1) {
+			ERR("spill file is short");
+			xfree(d_u.ptr);
+			break;
+		}
+		d_u.d->t_u.os[o.len]='\0';
+		fifo_push(od_q, d_u.ptr);
+	}
+
+	if (*r_u.magic == IP_REPORT_MAGIC) {
+		r_u.ir->od_q=od_q;
+		r_u.ir->next=NULL;
+	}
+	else {
+		r_u.ar->od_q=od_q;
+	}
+
+	*key=h.key;
+
+	return r_u.ptr;
+}
+
+/* is run a before run b, ties go to the older run so the first seen stays first */
+#define SPILL_LESS(a, b) (src[(a)].key < src[(b)].key || (src[(a)].key == src[(b)].key && (a) < (b)))
+
+static void spill_sift(spill_src_t *src, uint32_t *heap, uint32_t n, uint32_t j) {
+	uint32_t c=0, tmp=0;
+
+	for (;;) {
+		c=j * 2 + 1;
+		if (c >= n) {
+			break;
+		}
+		if (c + 1 < n && SPILL_LESS(heap[c + 1], heap[c])) {
+			c++;
+		}
+		if (! SPILL_LESS(heap[c], heap[j])) {
+			break;
+		}
+		tmp=heap[c]; heap[c]=heap[j]; heap[j]=tmp;
+		j=c;
+	}
+
+	return;
+}
+
+/* the next record of a source, a run on disk or the table in memory */
+static void *spill_next(spill_src_t *src, uint64_t *key) {
+	void *rec=NULL;
+
+	if (src->f != NULL) {
+		return spill_read(src->f, key);
+	}
+
+	if (sp.mpos >= rs.cnt) {
+		return NULL;
+	}
+	*key=sp.midx[sp.mpos].key;
+	rec=sp.midx[sp.mpos].rec;
+	sp.mpos++;
+
+	return rec;
+}
+
+/* the lowest record left, oldest source first on a tie, *from is which source */
+static void *spill_pop(spill_src_t *src, uint32_t *heap, uint32_t *n, uint64_t *key, uint32_t *from) {
+	void *rec=NULL;
+	uint32_t j=0;
+
+	j=heap[0];
+	*key=src[j].key;
+	*from=j;
+	rec=src[j].rec;
+
+	src[j].rec=spill_next(&src[j], &src[j].key);
+	if (src[j].rec == NULL) {
+		heap[0]=heap[--(*n)];
+	}
+	spill_sift(src, heap, *n, 0);
+
+	return rec;
+}
+
+/*
+ * k way merge of the runs and the table still in memory, the newest source.
+ * one report per run is in memory at a time, plus the chain for the key
+ * being reported.  records from the table are in the arena, so they arent
+ * freed here and their output data is only cleaned up if owned says the
+ * callback does that too, a later walk still needs it otherwise.  they are
+ * always last in a chain, the table being the newest source with one entry
+ * per key
+ */
+static void spill_merge(int (*wf)(uint64_t, void *, void *), int owned) {
+	spill_src_t *src=NULL;
+	uint32_t *heap=NULL, n=0, j=0, from=0, nsrc=0;
+	uint64_t key=0;
+	ip_report_t *tail=NULL;
+	void *head=NULL, *rec=NULL, *next=NULL, *mem=NULL;
+	int stop=0;
+
+	nsrc=sp.nruns + 1;
+	src=(spill_src_t *)xmalloc(sizeof(spill_src_t) * nsrc);
+	heap=(uint32_t *)xmalloc(sizeof(uint32_t) * nsrc);
+
+	sp.midx=rs_sorted();
+	sp.mpos=0;
+
+	for (j=0; j < nsrc; j++) {
+		src[j].f=(j < sp.nruns ? sp.runs[j] : NULL);
+		if (src[j].f != NULL) {
+			rewind(src[j].f);
+		}
+		src[j].rec=spill_next(&src[j], &src[j].key);
+		if (src[j].rec != NULL) {
+			heap[n++]=j;
+		}
+	}
+	for (j=n / 2; j > 0; j--) {
+		spill_sift(src, heap, n, j - 1);
+	}
+
+	while (n > 0) {
+		head=NULL;
+		tail=NULL;
+		mem=NULL;
+
+		/* everything with the lowest key, oldest run first */
+		do {
+			rec=spill_pop(src, heap, &n, &key, &from);
+
+			if (head == NULL) {
+				head=rec;
+				tail=(*(uint32_t *)rec == IP_REPORT_MAGIC ? (ip_report_t *)rec : NULL);
+				if (src[from].f == NULL) {
+					mem=rec;
+				}
+			}
+			else if (GET_PROCDUPS() && tail != NULL && *(uint32_t *)rec == IP_REPORT_MAGIC) {
+				tail->next=(ip_report_t *)rec;
+				tail=tail->next;
+				if (src[from].f == NULL) {
+					mem=rec;
+				}
+			}
+			else {
+				sp.dups++;
+				if (src[from].f != NULL || owned) {
+					clean_report_extra(rec);
+				}
+				if (src[from].f != NULL) {
+					xfree(rec);
+				}
+			}
+		} while (n > 0 && src[heap[0]].key == key);
+
+		stop=(wf(key, head, NULL) < 1);
+
+		for (rec=head; rec != NULL && rec != mem; rec=next) {
+			next=(*(uint32_t *)rec == IP_REPORT_MAGIC ? (void *)((ip_report_t *)rec)->next : NULL);
+			if (! owned) {
+				clean_report_extra(rec);
+			}
+			xfree(rec);
+		}
+
+		if (stop) {
+			break;
+		}
+	}
+
+	for (j=0; j < nsrc; j++) {
+		if (src[j].rec != NULL && src[j].f != NULL) {
+			clean_report_extra(src[j].rec);
+			xfree(src[j].rec);
+		}
+	}
+
+	xfree(sp.midx);
+	sp.midx=NULL;
+	xfree(src);
+	xfree(heap);
+
+	return;
+}
+
+static void clean_report_extra(void *r) {
+	union {
+		ip_report_t *ir;
+		arp_report_t *ar;
+		void *ptr;
+		uint32_t *magic;
+	} r_u;
+	union {
+		void *ptr;
+		output_data_t *d;
+	} d_u;
+	void *od_q=NULL;
+
+	assert(r != NULL);
+
+	r_u.ptr=r;
+
+	if (*r_u.magic == IP_REPORT_MAGIC) {
+		od_q=r_u.ir->od_q;
+	}
+	else if (*r_u.magic == ARP_REPORT_MAGIC) {
+		od_q=r_u.ar->od_q;
+	}
+
+	if (od_q == NULL) {
+		return;
+	}
+
+	while ((d_u.ptr=fifo_pop(od_q)) != NULL) {
+		xfree(d_u.ptr);
+	}
+
+	fifo_destroy(od_q);
+
+	return;
+}
+
+/* dotted quad of a network order address into out, no nul, returns the length */
+static size_t fmt_ip4(char *out, uint32_t addr) {
+	const uint8_t *oct=(const uint8_t *)&addr;
+	size_t len=0;
+	int j=0;
+
+	for (j=0; j < 4; j++) {
+		if (j > 0) {
+			out[len++]='.';
+		}
+		if (oct[j] >= 100) {
+			out[len++]='0' + oct[j] / 100;
+		}
+		if (oct[j] >= 10) {
+			out[len++]='0' + (oct[j] / 10) % 10;
+		}
+		out[len++]='0' + oct[j] % 10;
+	}
+
+	return len;
+}
+
+/*
+ * deal with a 32 bit network address, possibly looking up DNS depending on GET_DODNS and the format string
+ * dodns means that the format string had a trailing n inside it (1 = yes)
+ */
+static char *fmtcat_ip4addr(int dodns, uint32_t addr) {
+	struct sockaddr_in tsin;
+	char *thost=NULL;
+	static char addr_str[INET_ADDRSTRLEN];
+
+	if (dodns == 1 && GET_DODNS()) {
+		tsin.sin_family=AF_INET;
+		tsin.sin_port=0;
+		tsin.sin_addr.s_addr=addr;
+
+		thost=stddns_getname(s->dns, (const struct sockaddr *)&tsin);
+		if (thost != NULL) {
+			return thost;
+		}
+	}
+
+	/* if dodns == 1 and GET_DODNS == 0
+	 * they have a format string asking for dns, but want to skip doing DNS
+	 * well override the format string with the lacking `do dns' option
+	 */
+
+	addr_str[fmt_ip4(addr_str, addr)]='\0';
+	return addr_str;
+}
+
+/* two letter country code for a network order address, ?? if there isnt one */
+static const char *fmt_country(uint32_t addr) {
+#ifdef HAVE_LIBMAXMINDDB
+	static char cc[4];
+	int mmdb_error;
+	MMDB_lookup_result_s result;
+	MMDB_entry_data_s entry_data;
+	struct sockaddr_in sa;
+
+	if (mmdb_open) {
+		memset(&sa, 0, sizeof(sa));
+		sa.sin_family = AF_INET;
+		sa.sin_addr.s_addr = addr;
+		result = MMDB_lookup_sockaddr(&mmdb, (struct sockaddr *)&sa, &mmdb_error);
+		if (mmdb_error == MMDB_SUCCESS && result.found_entry) {
+			if (MMDB_get_value(&result.entry, &entry_data,
+			    "country", "iso_code", NULL) == MMDB_SUCCESS &&
+			    entry_data.has_data && entry_data.type == MMDB_DATA_TYPE_UTF8_STRING) {
+				/* entry_data.utf8_string is not null-terminated */
+				size_t len = entry_data.data_size < 3 ? entry_data.data_size : 2;
+
+				memset(cc, 0, sizeof(cc));
+				memcpy(cc, entry_data.utf8_string, len);
+				return cc;
+			}
+		}
+	}
+#endif
+	return "??";
+}
+
+static fmt_prog_t *fmt_compile(const char *fmt) {
+	fmt_prog_t *prog=NULL;
+	fmt_op_t op;
+	size_t flen=0;
+	const char *end=NULL;
+	unsigned int noff=0;
+
+	if (fmt == NULL || (flen=strlen(fmt)) < 1) {
+		return NULL;
+	}
+
+	prog=(fmt_prog_t *)xmalloc(sizeof(fmt_prog_t));
+	/* never more ops than format characters, never more text either */
+	prog->ops=(fmt_op_t *)xmalloc(sizeof(fmt_op_t) * flen);
+	prog->lit=(char *)xmalloc(flen);
+	prog->nops=0;
+
+#define FOP_ADD(x) \
+	if ((x).type == FOP_LIT && prog->nops > 0 && prog->ops[prog->nops - 1].type == FOP_LIT) { \
+		prog->ops[prog->nops - 1].len += (x).len; \
+	} \
+	else { \
+		prog->ops[prog->nops++]=(x); \
+	}
+
+#define FOP_LITCHR(c) \
+	memset(&op, 0, sizeof(op)); \
+	op.type=FOP_LIT; \
+	op.off=litoff; \
+	op.len=1; \
+	prog->lit[litoff++]=(c); \
+	FOP_ADD(op)
+
+	{
+		uint32_t litoff=0;
+
+		for (end=fmt + flen; fmt < end; fmt++) {
+			if (*fmt == '\\') {
+				if (++fmt == end) {
 					break;
+				}
+				switch (*fmt) {
+					case 'v': FOP_LITCHR('\v'); break;
+					case 't': FOP_LITCHR('\t'); break;
+					case 'n': FOP_LITCHR('\n'); break;
+					case 'a': FOP_LITCHR('\a'); break;
+					case 'b': FOP_LITCHR('\b'); break;
+					case 'f': FOP_LITCHR('\f'); break;
+					case 'r': FOP_LITCHR('\r'); break;
+					case '\\': FOP_LITCHR('\\'); break;
+					default:
+						fprintf(stderr, "Unknown escape char %c, ignoring\n", *fmt);
+						break;
+				}
+				continue;
+			}
+			if (*fmt != '%') {
+				FOP_LITCHR(*fmt);
+				continue;
+			}
 
-				case '\\':
-					KEH('\\');
+			if (++fmt == end) {
+				break;
+			}
+
+			memset(&op, 0, sizeof(op));
+
+			if (*fmt == '-' || *fmt == '0' || *fmt == ' ') {
+				op.flags |= (*fmt == '-' ? FOPF_LEFT : (*fmt == '0' ? FOPF_ZERO : 0));
+				if (++fmt == end) {
 					break;
+				}
+			}
 
+			/* dont support large lengths, 999 is big enough */
+			for (noff=0; fmt < end && isdigit(*fmt) && noff < 3; noff++, fmt++) {
+				op.width=op.width * 10 + (*fmt - '0');
+			}
+			if (fmt == end) {
+				break;
+			}
+
+			switch (*fmt) {
+				case '%': FOP_LITCHR('%'); continue;
+				case 'C': op.type=FOP_COUNTRY; break;
+				case 'h': op.type=FOP_HOST; break;
+				case 'L': op.type=FOP_LPORT; break;
+				case 'M': op.type=FOP_MAC; break;
+				case 'o': op.type=FOP_OUI; break;
+				case 'p': op.type=FOP_PORT; break;
+				case 'r': op.type=FOP_RESP; break;
+				case 's': op.type=FOP_SRC; break;
+				case 'S': op.type=FOP_SEQ; break;
+				case 't': op.type=FOP_TTL; break;
+				case 'T': op.type=FOP_TRACE; break;
+				case 'w': op.type=FOP_WIN; break;
 				default:
-					fprintf(stderr, "Unknown escape char %c, ignoring\n", *fmt);
+					fprintf(stderr, "unknown format string character `%c'\n", *fmt);
+					continue;
+			}
+
+			if ((op.type == FOP_HOST || op.type == FOP_LPORT || op.type == FOP_PORT ||
+			    op.type == FOP_SRC || op.type == FOP_TRACE) && *(fmt + 1) == 'n') {
+				op.flags |= FOPF_NAME;
+				fmt++;
 			}
-			state=0;
+
+			FOP_ADD(op);
+		}
+	}
+
+#undef FOP_LITCHR
+#undef FOP_ADD
+
+	return prog;
+}
+
+static int fmt_names(const fmt_prog_t *prog) {
+	uint32_t j=0;
+	int ret=0;
+
+	for (j=0; prog != NULL && j < prog->nops; j++) {
+		if (! (prog->ops[j].flags & FOPF_NAME)) {
+			continue;
+		}
+		switch (prog->ops[j].type) {
+			case FOP_HOST:	ret |= FN_HOST; break;
+			case FOP_SRC:	ret |= FN_SRC; break;
+			case FOP_TRACE:	ret |= FN_TRACE; break;
+			default:	break;
+		}
+	}
+
+	return ret;
+}
+
+/*
+ * start the reverse lookups a report will need as it comes in, so the names
+ * are back by the time it gets printed
+ */
+static void report_prefetch(const void *r) {
+	struct sockaddr_in sin;
+	union {
+		const void *ptr;
+		const arp_report_t *a;
+		const ip_report_t *i;
+		const uint32_t *magic;
+	} r_u;
+
+	r_u.ptr=r;
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family=AF_INET;
+
+	if (*r_u.magic == ARP_REPORT_MAGIC) {
+		if (fmts.names & FN_HOST) {
+			sin.sin_addr.s_addr=r_u.a->ipaddr;
+			stddns_prefetch(s->dns, (const struct sockaddr *)&sin);
+		}
+		return;
+	}
+
+	if (*r_u.magic != IP_REPORT_MAGIC) {
+		return;
+	}
+	if (! port_open(r_u.i->proto, r_u.i->type, r_u.i->subtype) && ! GET_PROCERRORS()) {
+		return;
+	}
+
+	if (fmts.names & FN_HOST) {
+		sin.sin_addr.s_addr=r_u.i->host_addr;
+		stddns_prefetch(s->dns, (const struct sockaddr *)&sin);
+	}
+	if (fmts.names & FN_SRC) {
+		sin.sin_addr.s_addr=r_u.i->send_addr;
+		stddns_prefetch(s->dns, (const struct sockaddr *)&sin);
+	}
+	if ((fmts.names & FN_TRACE) && r_u.i->trace_addr != r_u.i->host_addr) {
+		sin.sin_addr.s_addr=r_u.i->trace_addr;
+		stddns_prefetch(s->dns, (const struct sockaddr *)&sin);
+	}
+
+	return;
+}
+
+static void fmt_free(fmt_prog_t *prog) {
+
+	if (prog == NULL) {
+		return;
+	}
+
+	xfree(prog->ops);
+	xfree(prog->lit);
+	xfree(prog);
+
+	return;
+}
+
+static void ob_put(const char *str, size_t len) {
+
+	if (ob.len + len > ob.size) {
+		while (ob.len + len > ob.size) {
+			ob.size=(ob.size == 0 ? REPORT_OBUF * 2 : ob.size * 2);
 		}
-	} /* for each character in format */
+		ob.buf=(char *)xrealloc(ob.buf, ob.size);
+	}
+	memcpy(ob.buf + ob.len, str, len);
+	ob.len += len;
+
+	return;
+}
 
-	outline[outoff]='\0';
+static void ob_endline(void) {
 
-	return outline;
+	ob_put("\n", 1);
+
+	if (ob.len >= REPORT_OBUF) {
+		report_flush();
+	}
+
+	return;
+}
+
+void report_flush(void) {
+
+	if (ob.len == 0) {
+		return;
+	}
+
+	if (fwrite(ob.buf, ob.len, 1, s->_stdout) != 1) {
+		ERR("cant write report output: %s", strerror(errno));
+	}
+	fflush(s->_stdout);
+	ob.len=0;
+
+	return;
+}
+
+/* a field, padded out to the width the format asked for */
+static void ob_field(const fmt_op_t *op, const char *str, size_t len, int numeric) {
+	static const char pad[]="0000000000000000                ";
+	size_t fill=0, chunk=0;
+	const char *pc=NULL;
+
+	if (op->width <= len) {
+		ob_put(str, len);
+		return;
+	}
+
+	fill=op->width - len;
+	pc=((op->flags & FOPF_ZERO) && numeric && ! (op->flags & FOPF_LEFT)) ? pad : pad + 16;
+
+	if (op->flags & FOPF_LEFT) {
+		ob_put(str, len);
+	}
+	for (; fill > 0; fill -= chunk) {
+		chunk=MIN(fill, 16);
+		ob_put(pc, chunk);
+	}
+	if (! (op->flags & FOPF_LEFT)) {
+		ob_put(str, len);
+	}
+
+	return;
+}
+
+static void ob_str(const fmt_op_t *op, const char *str) {
+
+	ob_field(op, str, strlen(str), 0);
+
+	return;
+}
+
+static void ob_uint(const fmt_op_t *op, uint32_t val, int hex) {
+	static const char digits[]="0123456789abcdef";
+	char tmp[16];
+	size_t off=sizeof(tmp);
+
+	do {
+		tmp[--off]=digits[hex ? (val & 0xf) : (val % 10)];
+		val=(hex ? val >> 4 : val / 10);
+	} while (val != 0);
+
+	ob_field(op, &tmp[off], sizeof(tmp) - off, 1);
+
+	return;
+}
+
+static void ob_addr(const fmt_op_t *op, uint32_t addr) {
+	char tmp[INET_ADDRSTRLEN];
+
+	if (op->flags & FOPF_NAME) {
+		ob_str(op, fmtcat_ip4addr(1, addr));
+		return;
+	}
+
+	ob_field(op, tmp, fmt_ip4(tmp, addr), 0);
+
+	return;
+}
+
+static void ob_mac(const fmt_op_t *op, const uint8_t *hw) {
+	static const char digits[]="0123456789abcdef";
+	char tmp[17];
+	int j=0;
+
+	for (j=0; j < 6; j++) {
+		tmp[j * 3]=digits[hw[j] >> 4];
+		tmp[j * 3 + 1]=digits[hw[j] & 0xf];
+		if (j < 5) {
+			tmp[j * 3 + 2]=':';
+		}
+	}
+
+	ob_field(op, tmp, sizeof(tmp), 0);
+
+	return;
+}
+
+/* appends the line for report to the output buffer, without the newline */
+static void fmt_run(const fmt_prog_t *prog, const void *report) {
+	const fmt_op_t *op=NULL;
+	const char *vend=NULL;
+	uint32_t j=0;
+	union {
+		const arp_report_t *a;
+		const ip_report_t *i;
+		const void *p;
+		const uint32_t *magic;
+	} r_u;
+	int isip=0, isarp=0;
+
+	r_u.p=report;
+	isip=(*r_u.magic == IP_REPORT_MAGIC);
+	isarp=(*r_u.magic == ARP_REPORT_MAGIC);
+
+	for (j=0, op=prog->ops; j < prog->nops; j++, op++) {
+		switch (op->type) {
+			case FOP_LIT:
+				ob_put(prog->lit + op->off, op->len);
+				break;
+
+			case FOP_COUNTRY:
+				if (isip || isarp) {
+					ob_str(op, fmt_country(isip ? r_u.i->host_addr : r_u.a->ipaddr));
+				}
+				break;
+
+			case FOP_HOST:
+				if (isip || isarp) {
+					ob_addr(op, isip ? r_u.i->host_addr : r_u.a->ipaddr);
+				}
+				break;
+
+			case FOP_LPORT:
+			case FOP_PORT:
+				if (! isip) {
+					break;
+				}
+				if (op->flags & FOPF_NAME) {
+					ob_str(op, getservname(op->type == FOP_PORT ? r_u.i->sport : r_u.i->dport));
+				}
+				else {
+					ob_uint(op, op->type == FOP_PORT ? r_u.i->sport : r_u.i->dport, 0);
+				}
+				break;
+
+			case FOP_MAC:
+				if (isarp) {
+					ob_mac(op, r_u.a->hwaddr);
+				}
+				/* v9: Display Ethernet source MAC for local network IP reports */
+				else if (isip && r_u.i->eth_hwaddr_valid) {
+					ob_mac(op, r_u.i->eth_hwaddr);
+				}
+				break;
+
+			case FOP_OUI:
+				vend=NULL;
+				if (isarp) {
+					vend=getouiname(r_u.a->hwaddr[0], r_u.a->hwaddr[1], r_u.a->hwaddr[2]);
+				}
+				/* v9: OUI lookup for local network IP reports with MAC */
+				else if (isip && r_u.i->eth_hwaddr_valid) {
+					vend=getouiname(r_u.i->eth_hwaddr[0], r_u.i->eth_hwaddr[1], r_u.i->eth_hwaddr[2]);
+				}
+				else {
+					break;
+				}
+				ob_str(op, vend != NULL ? vend : "unknown");
+				break;
+
+			case FOP_RESP:
+				if (isip) {
+					ob_str(op, strresptype(r_u.i));
+				}
+				break;
+
+			case FOP_SRC:
+				if (isip) {
+					ob_addr(op, r_u.i->send_addr);
+				}
+				break;
+
+			case FOP_SEQ:
+				if (isip && r_u.i->proto == IPPROTO_TCP) {
+					ob_uint(op, r_u.i->tseq, 1);
+				}
+				break;
+
+			case FOP_TTL:
+				if (isip) {
+					ob_uint(op, r_u.i->ttl, 0);
+				}
+				break;
+
+			case FOP_TRACE:
+				if (isip && r_u.i->trace_addr != r_u.i->host_addr) {
+					ob_addr(op, r_u.i->trace_addr);
+				}
+				break;
+
+			case FOP_WIN:
+				if (isip && r_u.i->proto == IPPROTO_TCP) {
+					ob_uint(op, r_u.i->window_size, 0);
+				}
+				break;
+
+			default:
+				PANIC("bad format op %u", op->type);
+				break;
+		}
+	}
+
+	return;
 }
 
 static char *strresptype(const ip_report_t *ir) {
@@ -1142,6 +2151,9 @@ void report_trace_path(const trace_session_t *ts) {
 		return;
 	}
 
+	/* whatever came before goes out first */
+	report_flush();
+
 	/* display header with target info */
 	ia.s_addr=ts->target_addr;
 	inet_ntop(AF_INET, &ia, target_str, sizeof(target_str));
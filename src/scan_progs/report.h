@@ -21,11 +21,20 @@
 
 struct trace_session_t;	/* forward declaration */
 
+/* --stream duplicate filter, in MB */
+#define STREAM_DEFMB	16
+#define STREAM_MAXMB	4096
+
+/* --spill, results kept in memory before a run goes to disk, in MB */
+#define SPILL_MAXMB	(1024 * 1024)
+
 void report_do(void);
 void report_do_arp(void);	/* compound mode: output arp sorted by IP */
 void report_init(void);
 int report_add(void * /* report_msg */, size_t /* length of msg */);
 void report_destroy(void);
+/* writes out buffered report lines */
+void report_flush(void);
 void report_trace_path(const struct trace_session_t *ts);
 
 #endif
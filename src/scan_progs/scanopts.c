@@ -871,13 +871,16 @@ int load_phase_settings(int phase_index) {
 	 * Preserve flags that must persist across phases:
 	 * - S_SRC_OVERRIDE: tells drone_setup to keep user's source address
 	 * - S_DEFAULT_PAYLOAD: enables default TCP payload for banner grabbing
+	 * - S_TSTAMP_CLOCK: timestamp option carries the send clock (--adaptive-wait)
+	 * - S_SELECT_RETRY: later -R rounds skip what answered (--selective-retry)
 	 * - L_USE_PROMISC: enables promiscuous mode to see phantom IP responses
+	 * - L_MEASURE_RTT: listener keeps rtt samples (--adaptive-wait)
 	 */
 	{
-		uint16_t preserve_send = s->send_opts & (S_SRC_OVERRIDE | S_DEFAULT_PAYLOAD);
-		uint16_t preserve_promisc = s->recv_opts & L_USE_PROMISC;
+		uint16_t preserve_send = s->send_opts & (S_SRC_OVERRIDE | S_DEFAULT_PAYLOAD | S_TSTAMP_CLOCK | S_SELECT_RETRY);
+		uint16_t preserve_recv = s->recv_opts & (L_USE_PROMISC | L_MEASURE_RTT);
 		s->send_opts = phase->send_opts | preserve_send;
-		s->recv_opts = phase->recv_opts | preserve_promisc;
+		s->recv_opts = phase->recv_opts | preserve_recv;
 	}
 
 	/* Apply phase-specific PPS if set, otherwise restore global -r rate */
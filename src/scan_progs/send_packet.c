@@ -61,11 +61,15 @@
 #include <scan_progs/tcphash.h>
 #include <scan_progs/entry.h>
 #include <parse/parse.h>
+#include <parse/confcache.h>
 #include <unilib/arch.h>
 
 #define CTVOID 1
 #define CTPAYL 2
 
+/* at most this many check_master polls and progress checks a second while sending, about 1ms apart at any -r */
+#define MASTER_CHECK_HZ	1000
+
 typedef struct fl_t {
 	void (*init)(void);
 	uint8_t c_t;
@@ -91,6 +95,14 @@ static struct {
 	struct sockaddr_storage	curhost;
 	uint32_t ipv4_mix;
 	struct sockaddr_storage curhost_cnt;	/* 1 -> 255 for example		*/
+	uint32_t host_first;			/* chunk of the block to send to	*/
+	uint32_t host_count;
+	uint64_t host_left;
+
+	uint64_t done;				/* host loop trips this workunit	*/
+	uint64_t skip;				/* of those, sent by a sender before us	*/
+	uint64_t prog_sent;			/* packets_sent at the last report	*/
+	struct timeval prog_tv;			/* and when that was			*/
 
 	int32_t curport;
 	int16_t plindex;
@@ -112,8 +124,13 @@ static struct {
 
 	uint8_t esrc[THE_ONLY_SUPPORTED_HWADDR_LEN];
 
+	int tsclock_off;			/* tsval offset in tcpoptions, -1 none	*/
+
 	uint64_t packets_sent;
 
+	uint32_t check_every;			/* packets between master checks	*/
+	uint32_t check_left;
+
 	int sockmode;
 #define SOCK_LL 1
 #define SOCK_IP 2
@@ -123,6 +140,21 @@ static struct {
 	} s_u;
 } sl;
 
+/*
+ * --selective-retry, (host, port) pairs the master says already answered.
+ * open addressing on host << 16 | port, 0 is never a real key since no
+ * target is 0.0.0.0. only later -R rounds look at it
+ */
+static struct {
+	uint64_t *keys;
+	uint32_t size;				/* power of 2, or 0		*/
+	uint32_t cnt;
+	uint64_t skipped;			/* probes not sent because of it	*/
+} ans;
+
+#define ANS_KEY(h, p)	(((uint64_t)(h) << 16) | (uint64_t)(p))
+#define ANS_SLOT(k, sz)	((uint32_t)(((k) * 0x9e3779b97f4a7c15ULL) >> 32) & ((sz) - 1))
+
 #undef IDENT
 #define IDENT "[SEND]"
 
@@ -144,6 +176,13 @@ static void  inc_payload(void);
 static void init_tcp_payload(void);
 static int   cmp_tcp_payload(void);
 static void  inc_tcp_payload(void);
+static void send_progress(void);
+static void init_tsclock(void);
+static int check_master(int /* timeout ms */);
+static void retry_pause(void);
+static void ans_reset(void);
+static void ans_add(uint32_t /* host */, uint16_t /* port */);
+static int ans_find(uint32_t /* host */, uint16_t /* port */);
 
 /* for ( init; cmp; inc ) { logic for ttl requested */
 static void init_nextttl(void) {
@@ -175,6 +214,10 @@ static int   cmp_nextround(void) {
 
 static void  inc_nextround(void) {
 	++sl.curround;
+
+	if (GET_SELECTRETRY() && sl.curround < s->repeats) {
+		retry_pause();
+	}
 }
 
 /* for ( init; cmp; inc ) { logic for scan port list requested */
@@ -253,18 +296,33 @@ static void init_nexthost(void) {
 			struct sockaddr_in *sin;
 			struct sockaddr_storage *ss;
 		} curhost_u, cnt_u, targetmask_u;
+		uint64_t pass=0, skipped=0;
 
 		cnt_u.ss=&sl.curhost_cnt;
 
 		targetmask_u.ss=&s->ss->targetmask;
 
-		sl.ipv4_mix=prng_get32() & ~(targetmask_u.sin->sin_addr.s_addr);
+		/* the master picks the mix so every chunk of a block agrees on it */
+		sl.ipv4_mix &= ~(targetmask_u.sin->sin_addr.s_addr);
 
 		memcpy(&sl.curhost_cnt, &s->ss->target, sizeof(struct sockaddr_storage));
 
 		curhost_u.ss=&sl.curhost;
 		cnt_u.ss=&sl.curhost_cnt;
 
+		if (sl.host_count != 0) {
+			pass=sl.host_count;
+		}
+		else {
+			pass=(uint64_t)(~ntohl(targetmask_u.sin->sin_addr.s_addr)) + 1 - sl.host_first;
+		}
+
+		/* picking up after a dead sender, passes it finished go by without a packet */
+		skipped=drone_progress_skip(&sl.skip, pass);
+
+		cnt_u.sin->sin_addr.s_addr=htonl(ntohl(cnt_u.sin->sin_addr.s_addr) + sl.host_first + (uint32_t)skipped);
+		sl.host_left=pass - skipped;
+
 		curhost_u.sin->sin_addr.s_addr=cnt_u.sin->sin_addr.s_addr ^ sl.ipv4_mix;
 	}
 	else {
@@ -276,6 +334,10 @@ static void init_nexthost(void) {
 
 static int   cmp_nexthost(void) {
 
+	if (sl.host_left == 0) {
+		return 0;
+	}
+
 	return cidr_within((const struct sockaddr *)&sl.curhost_cnt, (const struct sockaddr *)&s->ss->target, (const struct sockaddr *)&s->ss->targetmask);
 
 }
@@ -292,6 +354,14 @@ static void  inc_nexthost(void) {
 		} cur_u, cnt_u;
 
 		cidr_inchost((struct sockaddr *)&sl.curhost_cnt);
+		if (sl.host_left > 0) {
+			sl.host_left--;
+		}
+
+		sl.done++;
+		if (drone_progress_due(sl.done)) {
+			send_progress();
+		}
 
 		cur_u.ss=&sl.curhost;
 		cnt_u.ss=&sl.curhost_cnt;
@@ -324,6 +394,7 @@ void send_packet(void) {
 		uint32_t *magic;
 	} wk_u;
 	size_t wku_len=0, port_str_len=0;
+	uint32_t shuffle_seed=0;
 	struct timeval start, end, total_time;
 	fl_t fnew;
 	send_stats_t send_stats;
@@ -395,7 +466,7 @@ void send_packet(void) {
 
 	/* get some payloads from the config files hopefully */
 	snprintf(conffile, sizeof(conffile) -1, CONF_FILE, s->profile);
-	readconf(conffile);
+	confcache_readconf(conffile);
 
 	if (send_message(sl.c_socket, MSG_READY, MSG_STATUS_OK, NULL, 0) < 0) {
 		terminate("cant send ready message to parent");
@@ -421,6 +492,12 @@ void send_packet(void) {
 				break;
 			}
 
+			if (msg_type == MSG_ANSWERED) {
+				/* the workunit it was for is over */
+				DBG(M_IPC, "late answered list, ignoring");
+				continue;
+			}
+
 			if (msg_type != MSG_WORKUNIT) {
 				ERR("i was expecting a work unit or quit message, i got a `%s' message, ignoring", strmsgtype(msg_type));
 				continue;
@@ -497,6 +574,8 @@ void send_packet(void) {
 
 			s->repeats=wk_u.s->repeats;
 			s->send_opts=wk_u.s->send_opts;
+			s->retry_gap=wk_u.s->retry_gap;
+			ans_reset();
 			s->pps=wk_u.s->pps;
 			s->delay_type_exp=wk_u.s->delay_type;
 			memcpy(&s->vi[0]->myaddr, &wk_u.s->myaddr, sizeof(struct sockaddr_storage));
@@ -506,6 +585,15 @@ void send_packet(void) {
 
 			memcpy(&s->ss->target, &wk_u.s->target, sizeof(struct sockaddr_storage));
 			memcpy(&s->ss->targetmask, &wk_u.s->targetmask, sizeof(struct sockaddr_storage));
+			sl.ipv4_mix=wk_u.s->host_mix;
+			sl.host_first=wk_u.s->host_first;
+			sl.host_count=wk_u.s->host_count;
+			sl.skip=wk_u.s->resume_at;
+			sl.done=wk_u.s->resume_at;
+			drone_progress_start(sl.done);
+			sl.prog_sent=0;
+			gettimeofday(&sl.prog_tv, NULL);
+			shuffle_seed=wk_u.s->shuffle_seed;
 			s->ss->tos=wk_u.s->tos;
 			s->ss->minttl=wk_u.s->minttl;
 			s->ss->maxttl=wk_u.s->maxttl;
@@ -579,8 +667,12 @@ void send_packet(void) {
 			if (s->pps < 1) PANIC("pps too low");
 
 			init_packet(); /* setup tcpoptions, ip chars etc */
+			init_tsclock();
 			init_tslot(s->pps, s->delay_type_exp);
 
+			sl.check_every=s->pps > MASTER_CHECK_HZ ? s->pps / MASTER_CHECK_HZ : 1;
+			sl.check_left=0;
+
 			if (s->ss->mode == MODE_TCPSCAN || s->ss->mode == MODE_UDPSCAN || s->ss->mode == MODE_TCPTRACE) {
 				uint8_t *psrc=NULL;
 
@@ -629,7 +721,7 @@ void send_packet(void) {
 				}
 
 				if (GET_SHUFFLE()) {
-					shuffle_ports();
+					shuffle_ports(shuffle_seed);
 				}
 			}
 
@@ -727,6 +819,10 @@ void send_packet(void) {
 			send_stats.pps=pps;
 			send_stats.packets_sent=sl.packets_sent;
 
+			if (GET_SELECTRETRY()) {
+				VRB(1, "%" PRIu64 " probes not resent, their targets had already answered", ans.skipped);
+			}
+
 			DBG(M_IPC, "sender sending message done");
 
 			if (send_message(sl.c_socket, MSG_WORKDONE, MSG_STATUS_OK, (void *)&send_stats, sizeof(send_stats)) < 0) {
@@ -749,70 +845,17 @@ static void _send_packet(void) {
 
 	start_tslot();
 
-	if (GET_SENDERINTR()) {
-		xpoll_t intrp;
-		int getret=0;
-		uint8_t msg_type=0, status=0;
-		size_t msg_len=0;
-		union {
-			uint8_t *ptr;
-			send_pri_workunit_t *w;
-		} w_u;
-
-		DBG(M_IPC, "sender can be interupted, checking for data");
-		intrp.fd=sl.c_socket;
-
-		if (xpoll(&intrp, 1, 0) < 0) {
-			ERR("xpoll fails: %s", strerror(errno));
+	if (sl.check_left == 0) {
+		sl.check_left=sl.check_every;
+		if ((GET_SENDERINTR() || GET_SELECTRETRY()) && check_master(0) < 0) {
+			return;
 		}
-
-		if (intrp.rw & XPOLL_READABLE) {
-			if (recv_messages(sl.c_socket) < 0) {
-				ERR("recv messages fails in send prio loop");
-				return;
-			}
-			while (1) {
-				getret=get_message(sl.c_socket, &msg_type, &status, &w_u.ptr, &msg_len);
-				if (getret < 1) {
-					break;
-				}
-				if (msg_type == MSG_WORKUNIT) {
-					struct in_addr ia;
-					char addr_str[INET_ADDRSTRLEN];
-
-					if (msg_len < sizeof(send_pri_workunit_t)) {
-						ERR("pri workunit too short");
-						break;
-					}
-					if (w_u.w->magic != PRI_4SEND_MAGIC) {
-						ERR("pri workunit has wrong magic %08x", w_u.w->magic);
-						break;
-					}
-
-					ia.s_addr=w_u.w->dhost;
-					inet_ntop(AF_INET, &ia, addr_str, sizeof(addr_str));
-
-					DBG(M_WRK, "send %s to host seq %08x %u -> %s:%u flags %08x seq %u window size %u",
-						strtcpflgs(w_u.w->flags),
-						w_u.w->mseq,
-						w_u.w->sport,
-						addr_str,
-						w_u.w->dport,
-						w_u.w->flags,
-						w_u.w->tseq,
-						w_u.w->window_size
-					);
-					priority_send_packet((const send_pri_workunit_t *)w_u.w);
-
-					end_tslot();
-					start_tslot();
-				}
-				else {
-					ERR("unknown workunit type `%s', ignoring", strmsgtype(msg_type));
-				}
-			}
+		/* one host with many ttls or payloads can outlast the masters stall watchdog at a slow -r */
+		if (drone_progress_due(sl.done)) {
+			send_progress();
 		}
 	}
+	sl.check_left--;
 
 	ipvchk.ss=&s->vi[0]->myaddr;
 	if (ipvchk.fs->family == AF_INET) {
@@ -837,6 +880,13 @@ static void _send_packet(void) {
 
 	target_u.ss=&sl.curhost;
 
+	if (sl.curround > 0 && ans.cnt > 0 && ipv4 == 1 && s->ss->mode != MODE_TCPTRACE) {
+		if (ans_find(target_u.sin->sin_addr.s_addr, s->ss->mode == MODE_ARPSCAN ? 0 : PORT_VALUE(sl.curport))) {
+			ans.skipped++;
+			return;
+		}
+	}
+
 	if (s->ss->mode == MODE_TCPSCAN || s->ss->mode == MODE_UDPSCAN || s->ss->mode == MODE_TCPTRACE) {
 		rport=PORT_VALUE(sl.curport);
 
@@ -970,6 +1020,15 @@ static void _send_packet(void) {
 		DBG(M_PKT, "SEND TCPHASHTRACK: seq=%08x target=%08x rport=%u local_port=%u syn_key=%08x",
 			seq, target_u.sin->sin_addr.s_addr, rport, sl.local_port, s->ss->syn_key);
 
+		if (sl.tsclock_off >= 0) {
+			struct timeval tv;
+			uint32_t tsval=0;
+
+			gettimeofday(&tv, NULL);
+			tsval=htonl((uint32_t)((uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000));
+			memcpy(s->ss->tcpoptions + sl.tsclock_off, &tsval, sizeof(tsval));
+		}
+
 		makepkt_build_tcp(	(uint16_t)sl.local_port,
 					rport,
 					t_chksum,
@@ -1131,6 +1190,257 @@ static int add_loop_logic(const fl_t *fnew) {
 	return 1;
 }
 
+static void send_progress(void) {
+	send_progress_t sp;
+	struct timeval now;
+	double tt=0.0;
+
+	memset(&sp, 0, sizeof(sp));
+	sp.magic=DRONE_PROGRESS_MAGIC;
+	sp.done=sl.done;
+	sp.packets_sent=sl.packets_sent;
+
+	gettimeofday(&now, NULL);
+	tt=(double)(now.tv_sec - sl.prog_tv.tv_sec) + ((double)(now.tv_usec - sl.prog_tv.tv_usec) / 1000000);
+	if (tt > 0.0) {
+		sp.pps=(float)((double)(sl.packets_sent - sl.prog_sent) / tt);
+	}
+	sl.prog_sent=sl.packets_sent;
+	sl.prog_tv=now;
+
+	DBG(M_SND, "progress %" PRIu64 " with %" PRIu64 " packets sent, %.1f pps", sl.done, sl.packets_sent, sp.pps);
+
+	if (send_message(sl.c_socket, MSG_PROGRESS, MSG_STATUS_OK, (const uint8_t *)&sp, sizeof(sp)) < 0) {
+		terminate("cant send progress message to parent, exiting");
+	}
+
+	return;
+}
+
+/*
+ * --adaptive-wait, the tsval of every tcp probe is our clock in ms so the
+ * listener can take the rtt off the echo. fingerprints without a timestamp
+ * option get one tacked on the end, if it fits
+ */
+static void init_tsclock(void) {
+	size_t off=0;
+
+	sl.tsclock_off=-1;
+
+	if (!(GET_TSTAMPCLOCK()) || (s->ss->mode != MODE_TCPSCAN && s->ss->mode != MODE_TCPTRACE)) {
+		return;
+	}
+
+	for (off=0; off < s->ss->tcpoptions_len;) {
+		if (s->ss->tcpoptions[off] == TCPOPT_EOL) {
+			break;
+		}
+		if (s->ss->tcpoptions[off] == TCPOPT_NOP) {
+			off++;
+			continue;
+		}
+		if ((off + 1) >= s->ss->tcpoptions_len || s->ss->tcpoptions[off + 1] < 2) {
+			break;
+		}
+		if (s->ss->tcpoptions[off] == TCPOPT_TIMESTAMP && s->ss->tcpoptions[off + 1] == 10 && (off + 10) <= s->ss->tcpoptions_len) {
+			sl.tsclock_off=(int)(off + 2);
+			return;
+		}
+		off += s->ss->tcpoptions[off + 1];
+	}
+
+	if ((s->ss->tcpoptions_len % 4) != 0 || (s->ss->tcpoptions_len + 12) > 40) {
+		VRB(1, "no room for a timestamp option in this fingerprint, rtts wont be measured");
+		return;
+	}
+
+	off=s->ss->tcpoptions_len;
+	s->ss->tcpoptions[off]=TCPOPT_NOP; s->ss->tcpoptions[off + 1]=TCPOPT_NOP;
+	s->ss->tcpoptions[off + 2]=TCPOPT_TIMESTAMP; s->ss->tcpoptions[off + 3]=10;
+	memset(s->ss->tcpoptions + off + 4, 0, 8);
+	s->ss->tcpoptions_len += 12;
+	sl.tsclock_off=(int)(off + 4);
+
+	return;
+}
+
+/*
+ * read whatever the master sent while we are in the middle of a workunit,
+ * priority sends (connect mode) and answered lists (--selective-retry)
+ */
+static int check_master(int timeout) {
+	xpoll_t intrp;
+	int getret=0;
+	uint8_t msg_type=0, status=0;
+	size_t msg_len=0, j=0;
+	union {
+		uint8_t *ptr;
+		send_pri_workunit_t *w;
+		send_answered_t *a;
+	} w_u;
+
+	DBG(M_IPC, "sender can be interupted, checking for data");
+	intrp.fd=sl.c_socket;
+
+	if (xpoll(&intrp, 1, timeout) < 0) {
+		ERR("xpoll fails: %s", strerror(errno));
+	}
+
+	if (!(intrp.rw & XPOLL_READABLE)) {
+		return 0;
+	}
+
+	if (recv_messages(sl.c_socket) < 0) {
+		ERR("recv messages fails in send prio loop");
+		return -1;
+	}
+
+	while (1) {
+		getret=get_message(sl.c_socket, &msg_type, &status, &w_u.ptr, &msg_len);
+		if (getret < 1) {
+			break;
+		}
+		if (msg_type == MSG_WORKUNIT) {
+			struct in_addr ia;
+			char addr_str[INET_ADDRSTRLEN];
+
+			if (msg_len < sizeof(send_pri_workunit_t)) {
+				ERR("pri workunit too short");
+				break;
+			}
+			if (w_u.w->magic != PRI_4SEND_MAGIC) {
+				ERR("pri workunit has wrong magic %08x", w_u.w->magic);
+				break;
+			}
+
+			ia.s_addr=w_u.w->dhost;
+			inet_ntop(AF_INET, &ia, addr_str, sizeof(addr_str));
+
+			DBG(M_WRK, "send %s to host seq %08x %u -> %s:%u flags %08x seq %u window size %u",
+				strtcpflgs(w_u.w->flags),
+				w_u.w->mseq,
+				w_u.w->sport,
+				addr_str,
+				w_u.w->dport,
+				w_u.w->flags,
+				w_u.w->tseq,
+				w_u.w->window_size
+			);
+			priority_send_packet((const send_pri_workunit_t *)w_u.w);
+
+			end_tslot();
+			start_tslot();
+		}
+		else if (msg_type == MSG_ANSWERED) {
+			if ((msg_len % sizeof(send_answered_t)) != 0) {
+				ERR("answered list of odd length " STFMT ", ignoring", msg_len);
+				continue;
+			}
+			for (j=0; j < msg_len / sizeof(send_answered_t); j++) {
+				ans_add(w_u.a[j].host, w_u.a[j].port);
+			}
+			DBG(M_WRK, "%u answered pairs now", ans.cnt);
+		}
+		else {
+			ERR("unknown workunit type `%s', ignoring", strmsgtype(msg_type));
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * before each -R round after the first, give the answers to the one before
+ * it time to come back, doubling each round (capped at 16x)
+ */
+static void retry_pause(void) {
+	uint32_t gap=0;
+
+	gap=(uint32_t)s->retry_gap << (sl.curround > 5 ? 4 : sl.curround - 1);
+
+	DBG(M_SND, "round %u, waiting %u ms for answers first", sl.curround, gap);
+
+	/* the wait can be far longer than the masters stall watchdog, so keep reporting through it */
+	drone_progress_wait(sl.done, (int)gap, &check_master, &send_progress);
+
+	return;
+}
+
+static void ans_reset(void) {
+
+	if (ans.keys != NULL) {
+		xfree(ans.keys);
+	}
+	memset(&ans, 0, sizeof(ans));
+
+	return;
+}
+
+static void ans_add(uint32_t host, uint16_t port) {
+	uint64_t key=0;
+	uint32_t j=0;
+
+	if (host == 0) {
+		return;
+	}
+
+	if ((ans.cnt + 1) * 2 > ans.size) {
+		uint64_t *old=ans.keys;
+		uint32_t osize=ans.size;
+
+		ans.size=(osize == 0 ? 1024 : osize * 2);
+		ans.keys=(uint64_t *)xmalloc(sizeof(uint64_t) * ans.size);
+		memset(ans.keys, 0, sizeof(uint64_t) * ans.size);
+
+		for (j=0; j < osize; j++) {
+			uint32_t slot=0;
+
+			if (old[j] == 0) {
+				continue;
+			}
+			for (slot=ANS_SLOT(old[j], ans.size); ans.keys[slot] != 0; slot=(slot + 1) & (ans.size - 1)) {
+				;
+			}
+			ans.keys[slot]=old[j];
+		}
+
+		if (old != NULL) {
+			xfree(old);
+		}
+	}
+
+	key=ANS_KEY(host, port);
+
+	for (j=ANS_SLOT(key, ans.size); ans.keys[j] != 0; j=(j + 1) & (ans.size - 1)) {
+		if (ans.keys[j] == key) {
+			return;
+		}
+	}
+	ans.keys[j]=key;
+	ans.cnt++;
+
+	return;
+}
+
+static int ans_find(uint32_t host, uint16_t port) {
+	uint64_t key=0;
+	uint32_t j=0;
+
+	if (ans.size == 0) {
+		return 0;
+	}
+
+	key=ANS_KEY(host, port);
+
+	for (j=ANS_SLOT(key, ans.size); ans.keys[j] != 0; j=(j + 1) & (ans.size - 1)) {
+		if (ans.keys[j] == key) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
 void loop_list(fl_t *node) {
 	assert(node != NULL);
 
@@ -0,0 +1,335 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#include <config.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <inttypes.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include <scan_progs/scanopts.h>
+#include <settings.h>
+#include <scan_progs/scan_export.h>
+#include <scan_progs/workunits.h>
+#include <scan_progs/phase_filter.h>
+#include <scan_progs/telemetry.h>
+#include <scan_progs/metrics_srv.h>
+#include <unilib/drone.h>
+#include <unilib/qfifo.h>
+#include <unilib/output.h>
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+static int t_lsock=-1;
+static int t_clients[TELEMETRY_MAXCLIENTS];
+static int t_nclients=0;
+static int t_failed=0;
+
+static time_t t_start=0, t_lastpub=0, t_lastscreen=0;
+static uint32_t t_estsecs=0;
+static uint64_t t_expected=0;
+
+static telemetry_snap_t t_snap;
+
+static void telemetry_update(time_t, time_t);
+static void telemetry_open(void);
+static void telemetry_accept(void);
+static void telemetry_publish(const char *, size_t);
+
+void telemetry_begin(void) {
+	double hosts=0.0;
+	drone_t *d=NULL;
+
+	if (s->progress_sock != NULL && t_lsock < 0 && t_failed == 0) {
+		telemetry_open();
+	}
+
+	if (s->metrics_uri != NULL) {
+		metrics_srv_open();
+	}
+
+	/*
+	 * past the arp phase of a compound scan only the hosts that answered get
+	 * probed, and that is what main printed the estimate for as well
+	 */
+	hosts=s->num_hosts;
+	if (s->num_phases > 1 && s->cur_phase > 0 && phase_filter_count() > 0) {
+		hosts=(double)phase_filter_count();
+	}
+
+	t_estsecs=calculate_phase_estimate(s->num_phases > 1 ? (int)s->cur_phase : -1, hosts, NULL);
+	t_expected=0;
+	if (t_estsecs > s->ss->recv_timeout) {
+		t_expected=(uint64_t)(t_estsecs - s->ss->recv_timeout) * s->pps;
+	}
+
+	time(&t_start);
+	t_lastpub=t_start;
+	t_lastscreen=t_start;
+	memset(&t_snap, 0, sizeof(t_snap));
+	t_snap.expected=t_expected;
+	t_snap.eta=(long int)t_estsecs;
+
+	for (d=s->dlh->head; d != NULL; d=d->next) {
+		d->pps=0;
+		d->pkts_done=0;
+		d->pkts_cur=0;
+		d->recv_pkts=0;
+		d->recv_drops=0;
+		d->recv_ifdrops=0;
+		d->queue_depth=0;
+	}
+
+	DBG(M_MST, "telemetry: estimate %u secs, %" PRIu64 " packets for %.0f hosts", t_estsecs, t_expected, hosts);
+
+	return;
+}
+
+void telemetry_tick(time_t tdone) {
+	time_t tnow=0;
+	telemetry_snap_t *ts=&t_snap;
+	char line[512];
+	int len=0;
+
+	time(&tnow);
+
+	if (t_lsock >= 0) {
+		telemetry_accept();
+	}
+
+	if (s->metrics_uri != NULL) {
+		metrics_srv_poll();
+	}
+
+	if (tnow - t_lastpub < 1) {
+		return;
+	}
+	t_lastpub=tnow;
+
+	telemetry_update(tnow, tdone);
+
+	if (t_nclients > 0) {
+		len=snprintf(line, sizeof(line) -1,
+			"progress time=%ld iter=%u phase=%u sent=%" PRIu64 " expected=%" PRIu64 " pct=%.1f pps=%u "
+			"recv=%u drops=%u qdepth=%u pri=%u senders=%d listeners=%d eta=%ld\n",
+			(long int)tnow, s->cur_iter, (unsigned int)s->cur_phase + 1, ts->sent, ts->expected, ts->pct, ts->pps,
+			ts->recv, ts->drops, ts->qdepth, ts->pri, s->senders, s->listeners, ts->eta
+		);
+		if (len > 0 && (size_t)len < sizeof(line) -1) {
+			telemetry_publish(line, (size_t)len);
+		}
+	}
+
+	if (s->verbose > 0 && tnow - t_lastscreen >= TELEMETRY_SCREEN_SECS) {
+		t_lastscreen=tnow;
+
+		if (ts->eta < 0) {
+			VRB(1, "progress %.1f%% %" PRIu64 " of %" PRIu64 " packets at %u pps, %u recieved %u dropped",
+				ts->pct, ts->sent, ts->expected, ts->pps, ts->recv, ts->drops
+			);
+		}
+		else {
+			VRB(1, "progress %.1f%% %" PRIu64 " of %" PRIu64 " packets at %u pps, %u recieved %u dropped, about %ld:%02ld left",
+				ts->pct, ts->sent, ts->expected, ts->pps, ts->recv, ts->drops, ts->eta / 60, ts->eta % 60
+			);
+		}
+	}
+
+	return;
+}
+
+void telemetry_snapshot(telemetry_snap_t *ts) {
+
+	memcpy(ts, &t_snap, sizeof(telemetry_snap_t));
+
+	return;
+}
+
+static void telemetry_update(time_t tnow, time_t tdone) {
+	time_t elapsed=0;
+	long int eta=-1;
+	uint64_t sent=0, expected=0;
+	uint32_t pps=0, recv=0, drops=0, qdepth=0, pri=0;
+	double pct=0.0;
+	drone_t *d=NULL;
+
+	for (d=s->dlh->head; d != NULL; d=d->next) {
+		if (d->type == DRONE_TYPE_SENDER) {
+			sent += d->pkts_done + d->pkts_cur;
+			if (d->status == DRONE_STATUS_WORKING) {
+				pps += d->pps;
+			}
+		}
+		else if (d->type == DRONE_TYPE_LISTENER) {
+			recv += d->recv_pkts;
+			drops += d->recv_drops + d->recv_ifdrops;
+			qdepth += d->queue_depth;
+		}
+	}
+
+	if (s->pri_work != NULL) {
+		pri=fifo_length(s->pri_work);
+	}
+
+	/* the estimate is only an estimate, never say more than 100% */
+	expected=(sent > t_expected ? sent : t_expected);
+	if (expected > 0) {
+		pct=((double)sent * 100.0) / (double)expected;
+	}
+
+	elapsed=tnow - t_start;
+	if (tdone != 0) {
+		eta=(tdone > tnow ? (long int)(tdone - tnow) : 0);
+	}
+	else if (pps > 0 && expected > 0) {
+		eta=(long int)((expected - sent) / pps) + s->ss->recv_timeout;
+	}
+	else if (t_estsecs > 0) {
+		eta=(elapsed < (time_t)t_estsecs ? (long int)(t_estsecs - elapsed) : 0);
+	}
+
+	t_snap.sent=sent;
+	t_snap.expected=expected;
+	t_snap.pct=pct;
+	t_snap.pps=pps;
+	t_snap.recv=recv;
+	t_snap.drops=drops;
+	t_snap.qdepth=qdepth;
+	t_snap.pri=pri;
+	t_snap.eta=eta;
+
+	return;
+}
+
+void telemetry_fini(void) {
+	int j=0;
+
+	for (j=0; j < t_nclients; j++) {
+		close(t_clients[j]);
+	}
+	t_nclients=0;
+
+	if (t_lsock >= 0) {
+		close(t_lsock);
+		t_lsock=-1;
+		unlink(s->progress_sock);
+	}
+
+	if (s->metrics_uri != NULL) {
+		metrics_srv_close();
+	}
+
+	return;
+}
+
+static void telemetry_open(void) {
+	struct sockaddr_un sun;
+	int fl=0;
+
+	if (strlen(s->progress_sock) >= sizeof(sun.sun_path)) {
+		ERR("progress socket path `%s' is too long", s->progress_sock);
+		t_failed=1;
+		return;
+	}
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family=AF_UNIX;
+	strncpy(sun.sun_path, s->progress_sock, sizeof(sun.sun_path) -1);
+
+	if ((t_lsock=socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+		ERR("cant create progress socket: %s", strerror(errno));
+		t_failed=1;
+		return;
+	}
+
+	unlink(sun.sun_path);
+
+	if (bind(t_lsock, (const struct sockaddr *)&sun, (socklen_t)sizeof(sun)) < 0 || listen(t_lsock, TELEMETRY_MAXCLIENTS) < 0) {
+		ERR("cant listen on progress socket `%s': %s", s->progress_sock, strerror(errno));
+		close(t_lsock);
+		t_lsock=-1;
+		t_failed=1;
+		return;
+	}
+
+	fl=fcntl(t_lsock, F_GETFL);
+	if (fl < 0 || fcntl(t_lsock, F_SETFL, fl | O_NONBLOCK) < 0) {
+		ERR("cant make progress socket non-blocking: %s", strerror(errno));
+		telemetry_fini();
+		t_failed=1;
+		return;
+	}
+
+	VRB(1, "publishing scan progress on `%s'", s->progress_sock);
+
+	return;
+}
+
+static void telemetry_accept(void) {
+	int cfd=-1, fl=0;
+
+	while ((cfd=accept(t_lsock, NULL, NULL)) >= 0) {
+		if (t_nclients == TELEMETRY_MAXCLIENTS) {
+			DBG(M_MST, "telemetry: too many progress clients, dropping new one");
+			close(cfd);
+			continue;
+		}
+
+		fl=fcntl(cfd, F_GETFL);
+		if (fl < 0 || fcntl(cfd, F_SETFL, fl | O_NONBLOCK) < 0) {
+			close(cfd);
+			continue;
+		}
+#ifdef SO_NOSIGPIPE
+		fl=1;
+		setsockopt(cfd, SOL_SOCKET, SO_NOSIGPIPE, &fl, sizeof(fl));
+#endif
+
+		DBG(M_MST, "telemetry: progress client on fd %d", cfd);
+		t_clients[t_nclients++]=cfd;
+	}
+
+	return;
+}
+
+/*
+ * a client that cant take a whole line right now is too slow to be
+ * watching, it gets closed instead of holding up the scan
+ */
+static void telemetry_publish(const char *line, size_t len) {
+	int j=0;
+	ssize_t ret=0;
+
+	for (j=0; j < t_nclients; ) {
+		ret=send(t_clients[j], line, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (ret < 0 || (size_t)ret != len) {
+			DBG(M_MST, "telemetry: dropping progress client on fd %d", t_clients[j]);
+			close(t_clients[j]);
+			t_clients[j]=t_clients[--t_nclients];
+			continue;
+		}
+		j++;
+	}
+
+	return;
+}
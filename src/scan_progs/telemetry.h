@@ -0,0 +1,64 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#ifndef _TELEMETRY_H
+# define _TELEMETRY_H
+
+/*
+ * live progress for the master.  senders and listeners send MSG_PROGRESS
+ * while they work, master_read_drones keeps the latest numbers in each
+ * drone_t, and telemetry_tick() adds them up against what
+ * calculate_phase_estimate() says the scan is going to send
+ *
+ * the result goes to the screen with -v, and with --progress-socket to
+ * anyone connected to that unix socket, one line a second like:
+ *
+ * progress time=1760000000 iter=1 phase=1 sent=12288 expected=65536 pct=18.8 pps=1000
+ *   recv=301 drops=0 qdepth=2 pri=0 senders=1 listeners=1 eta=58
+ *
+ * (on one line) eta is in seconds, -1 when there is nothing to go on yet
+ */
+
+#define TELEMETRY_SCREEN_SECS	5
+#define TELEMETRY_MAXCLIENTS	8
+
+/* what the last tick added up, for the --metrics endpoint */
+typedef struct telemetry_snap_t {
+	uint64_t sent;
+	uint64_t expected;
+	double pct;
+	uint32_t pps;
+	uint32_t recv;
+	uint32_t drops;
+	uint32_t qdepth;
+	uint32_t pri;
+	long int eta;
+} telemetry_snap_t;
+
+/* call at the start of run_scan, opens the progress socket the first time */
+void telemetry_begin(void);
+
+/* call every trip through the run_scan loop, tdone is when the listeners get stopped, 0 if not known yet */
+void telemetry_tick(time_t /* tdone */);
+
+void telemetry_snapshot(telemetry_snap_t *);
+
+/* closes the progress and metrics sockets and takes them out of the filesystem */
+void telemetry_fini(void);
+
+#endif
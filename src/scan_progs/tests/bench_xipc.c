@@ -0,0 +1,141 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+/*
+ * xipc throughput micro-benchmark
+ *
+ * bench_xipc [-n messages] [-s payload size] [-m]
+ *
+ * a child process pushes messages down a unix socketpair (or the shared memory
+ * rings with -m) with send_message()
+ * and we drain them with recv_messages()/get_message() the way master.c does,
+ * then print the message rate, bandwidth and our peak resident size
+ */
+#include <config.h>
+
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <settings.h>
+#include <unilib/xmalloc.h>
+#include <unilib/xipc.h>
+#include <unilib/shmtrans.h>
+
+settings_t *s=NULL;
+const char *ident_name_ptr="bench_xipc";
+int ident=0;
+
+int main(int argc, char **argv) {
+	struct timeval start, end;
+	struct rusage ru;
+	uint8_t type=0, status=0, *data=NULL, *payload=NULL;
+	size_t len=0, size=64, got=0, count=1000000, j=0;
+	double tt=0.0;
+	int sv[2], ch=0, shm=0, tx=-1, rx=-1;
+	pid_t pid;
+
+	while ((ch=getopt(argc, argv, "n:s:m")) != -1) {
+		switch (ch) {
+			case 'n':
+				count=(size_t)strtoul(optarg, NULL, 10);
+				break;
+			case 's':
+				size=(size_t)strtoul(optarg, NULL, 10);
+				break;
+			case 'm':
+				shm=1;
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n messages] [-s payload size] [-m]\n", argv[0]);
+				exit(1);
+		}
+	}
+
+	s=(settings_t *)xmalloc(sizeof(settings_t));
+	memset(s, 0, sizeof(settings_t));
+	s->_stdout=stdout;
+	s->_stderr=stderr;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0) {
+		perror("socketpair");
+		exit(1);
+	}
+
+	ipc_init();
+
+	tx=sv[0];
+	rx=sv[1];
+	if (shm) {
+		tx=shmtrans_connect(sv[0]);
+		rx=shmtrans_accept(sv[1]);
+		if (tx < 0 || rx < 0) {
+			fprintf(stderr, "shm setup fails\n");
+			exit(1);
+		}
+	}
+
+	payload=(uint8_t *)xmalloc(size + 1);
+	memset(payload, 0x41, size + 1);
+
+	gettimeofday(&start, NULL);
+
+	pid=fork();
+	if (pid == 0) {
+		if (! shm) {
+			close(sv[1]);
+		}
+		for (j=0; j < count; j++) {
+			if (send_message(tx, MSG_OUTPUT, MSG_STATUS_OK, payload, size) < 0) {
+				_exit(1);
+			}
+		}
+		_exit(0);
+	}
+	if (! shm) {
+		close(sv[0]);
+	}
+
+	while (got < count) {
+		if (recv_messages(rx) < 1) {
+			fprintf(stderr, "recv_messages fails after " STFMT " messages\n", got);
+			break;
+		}
+		while (get_message(rx, &type, &status, &data, &len) > 0) {
+			if (type != MSG_OUTPUT || len != size) {
+				fprintf(stderr, "bad message type %u len " STFMT "\n", type, len);
+				exit(1);
+			}
+			got++;
+		}
+	}
+
+	gettimeofday(&end, NULL);
+	waitpid(pid, NULL, 0);
+
+	tt=(end.tv_sec - start.tv_sec) + ((double)(end.tv_usec - start.tv_usec) / 1000000);
+	getrusage(RUSAGE_SELF, &ru);
+
+	printf(STFMT " messages of " STFMT " bytes in %.3f secs, %.0f msgs/sec, %.1f MB/sec, max rss %ld KB\n",
+		got, size, tt, (tt > 0.0 ? got / tt : 0.0),
+		(tt > 0.0 ? ((double)got * size) / tt / (1024 * 1024) : 0.0),
+		ru.ru_maxrss
+	);
+
+	exit(0);
+}
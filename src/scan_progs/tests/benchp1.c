@@ -0,0 +1,186 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#include <config.h>
+
+#include <scan_progs/scanopts.h>
+#include <scan_progs/scan_export.h>
+#include <settings.h>
+
+#include <unilib/terminate.h>
+#include <unilib/output.h>
+#include <unilib/xmalloc.h>
+#include <unilib/qfifo.h>
+#include <unilib/pcapmap.h>
+#include <unilib/prng.h>
+#include <scan_progs/packet_parse.h>
+
+/*
+ * packet_parse throughput benchmark
+ *
+ * benchp1 [-n iterations] file ...
+ *
+ * each file is either a classic pcap file (ethernet) or a single raw ethernet
+ * frame like the pkt*.dat vectors made from pkt*.xxd, every frame is pushed
+ * through parse_packet `iterations' times and the reports are thrown away
+ */
+
+#define MAX_FRAMES	65536
+
+const char *ident_name_ptr=NULL;
+int ident=0;
+
+settings_t *s=NULL;
+void *r_queue=NULL, *p_queue=NULL;
+
+static struct pcap_pkthdr fh[MAX_FRAMES];
+static const uint8_t *fp[MAX_FRAMES];
+static size_t frames=0;
+
+static void startit(void);
+static void load_file(const char *);
+static void drain(void);
+
+int main(int argc, char **argv) {
+	struct timeval start, end;
+	uint64_t done=0;
+	double tt=0.0;
+	size_t j=0;
+	int iter=1000, it=0, ch=0;
+
+	startit();
+
+	while ((ch=getopt(argc, argv, "n:")) != -1) {
+		switch (ch) {
+			case 'n':
+				iter=atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "usage: %s [-n iterations] file ...\n", argv[0]);
+				exit(1);
+		}
+	}
+
+	for (; optind < argc; optind++) {
+		load_file(argv[optind]);
+	}
+
+	if (frames == 0 || iter < 1) {
+		fprintf(stderr, "usage: %s [-n iterations] file ...\n", argv[0]);
+		exit(1);
+	}
+
+	gettimeofday(&start, NULL);
+
+	for (it=0; it < iter; it++) {
+		for (j=0; j < frames; j++) {
+			parse_packet(NULL, &fh[j], fp[j]);
+		}
+		drain();
+		done += frames;
+	}
+
+	gettimeofday(&end, NULL);
+
+	tt=(end.tv_sec - start.tv_sec) + ((double)(end.tv_usec - start.tv_usec) / 1000000);
+
+	printf("%llu frames (%u unique) in %.3f secs, %.0f frames/sec\n",
+		(unsigned long long)done, (unsigned int)frames, tt, (tt > 0.0 ? done / tt : 0.0)
+	);
+
+	exit(0);
+}
+
+/* like common.c, minus the crash handler that only exists in debug builds */
+static void startit(void) {
+	ident=IDENT_ANY;
+	ident_name_ptr=IDENT_ANY_NAME;
+
+	s=xmalloc(sizeof(settings_t));
+	memset(s, 0, sizeof(settings_t));
+	s->vi=(interface_info_t **)xmalloc(sizeof(interface_info_t *));
+	s->vi[0]=(interface_info_t *)xmalloc(sizeof(interface_info_t));
+	prng_init();
+	memset(s->vi[0], 0, sizeof(interface_info_t));
+	s->ss=xmalloc(sizeof(scan_settings_t));
+	memset(s->ss, 0, sizeof(scan_settings_t));
+	s->_stdout=stdout;
+	s->_stderr=stderr;
+
+	s->ss->mode=MODE_TCPSCAN;
+	s->ss->header_len=14;
+	s->recv_opts=L_IGNORE_SEQ|L_WATCH_ERRORS;
+
+	r_queue=fifo_init();
+	p_queue=fifo_init();
+
+	return;
+}
+
+static void load_file(const char *file) {
+	pcapmap_t *pm=NULL;
+	struct pcap_pkthdr ph;
+	const uint8_t *pkt=NULL;
+	uint8_t *buf=NULL;
+	ssize_t rsize=0;
+	int fd=-1;
+
+	pm=pcapmap_open(file);
+	if (pm != NULL) {
+		/* the mapping is kept for the life of the benchmark */
+		while (frames < MAX_FRAMES && pcapmap_next(pm, &ph, &pkt) == 1) {
+			fh[frames]=ph;
+			fp[frames]=pkt;
+			frames++;
+		}
+		return;
+	}
+
+	if ((fd=open(file, O_RDONLY)) < 0) {
+		terminate("cant open `%s'", file);
+	}
+
+	buf=xmalloc(0xffff);
+	if ((rsize=read(fd, buf, 0xffff)) < 0) {
+		terminate("cant read `%s'", file);
+	}
+	close(fd);
+
+	if (frames < MAX_FRAMES) {
+		memset(&fh[frames], 0, sizeof(struct pcap_pkthdr));
+		fh[frames].caplen=(uint32_t)rsize;
+		fh[frames].len=(uint32_t)rsize;
+		fp[frames]=buf;
+		frames++;
+	}
+
+	return;
+}
+
+static void drain(void) {
+	void *ptr=NULL;
+
+	while ((ptr=fifo_pop(r_queue)) != NULL) {
+		xfree(ptr);
+	}
+	while ((ptr=fifo_pop(p_queue)) != NULL) {
+		xfree(ptr);
+	}
+
+	return;
+}
@@ -0,0 +1,727 @@
+/**********************************************************************
+ * Copyright (C) 2026 Robert E. Lee <robert@unicornscan.org>          *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+
+/**
+ * @file test_report.c
+ * @brief Tests for the result store, --stream, --spill and report formats
+ *
+ * report.c is built into the test so its static functions can be driven
+ * directly.  This test suite covers:
+ * - Result table growth and key ordered walks, -c chains
+ * - The --stream duplicate filter and its eviction order
+ * - --spill runs and their merge matching the in memory report
+ * - Compiled format strings matching what fmtcat used to print
+ */
+
+#include <config.h>
+
+#include "../report.c"
+
+/*===========================================================================
+ * GLOBAL STUBS FOR STANDALONE TESTING
+ *===========================================================================*/
+
+settings_t *s = NULL;
+
+const char *ident_name_ptr = "test_report";
+
+int ident = 0;
+
+void push_report_modules(const void *r __attribute__((unused))) { }
+void push_output_modules(const void *r __attribute__((unused))) { }
+void connect_grabbanners(ip_report_t *r __attribute__((unused))) { }
+void stddns_prefetch(void *c __attribute__((unused)), const struct sockaddr *sa __attribute__((unused))) { }
+
+int trace_session_to_path_report(const trace_session_t *ts __attribute__((unused)),
+                                 struct trace_path_report_t *tpr __attribute__((unused))) {
+    return 0;
+}
+
+char *getservname(uint16_t port) {
+    static char http[] = "http", unknown[] = "unknown";
+    return port == 80 ? http : unknown;
+}
+
+char *getouiname(uint8_t a, uint8_t b, uint8_t c) {
+    static char vendor[] = "Acme";
+    return (a == 0x00 && b == 0x11 && c == 0x22) ? vendor : NULL;
+}
+
+char *strtcpflgs(int f) {
+    static char buf[16];
+    snprintf(buf, sizeof(buf), "%s%s%s", f & TH_SYN ? "S" : "", f & TH_ACK ? "A" : "", f & TH_RST ? "R" : "");
+    return buf;
+}
+
+/* only 10.0.0.5 has a name */
+char *stddns_getname(void *c __attribute__((unused)), const struct sockaddr *sa) {
+    static char name[] = "five.example";
+    return ((const struct sockaddr_in *)sa)->sin_addr.s_addr == htonl(0x0a000005) ? name : NULL;
+}
+
+/* Test framework macros */
+#define TEST_PASS() do { \
+    printf("  [PASS] %s\n", __func__); \
+    tests_passed++; \
+} while(0)
+
+#define ASSERT_EQ(expected, actual, msg) do { \
+    if ((expected) != (actual)) { \
+        printf("  [FAIL] %s: %s (expected %d, got %d)\n", \
+               __func__, msg, (int)(expected), (int)(actual)); \
+        tests_failed++; \
+        return; \
+    } \
+} while(0)
+
+#define ASSERT_STR_EQ(expected, actual, msg) do { \
+    if (strcmp((expected), (actual)) != 0) { \
+        printf("  [FAIL] %s: %s (expected '%s', got '%s')\n", \
+               __func__, msg, (expected), (actual)); \
+        tests_failed++; \
+        return; \
+    } \
+} while(0)
+
+#define ASSERT_TRUE(cond, msg) do { \
+    if (!(cond)) { \
+        printf("  [FAIL] %s: %s\n", __func__, msg); \
+        tests_failed++; \
+        return; \
+    } \
+} while(0)
+
+/* Global test counters */
+static int tests_passed = 0;
+static int tests_failed = 0;
+
+/*===========================================================================
+ * FIXTURES
+ *===========================================================================*/
+
+static settings_t rt_s;
+static scan_settings_t rt_ss;
+
+/* report output goes to a temp file, read back with rt_output */
+static void rt_setup(uint32_t options) {
+    memset(&rt_s, 0, sizeof(rt_s));
+    memset(&rt_ss, 0, sizeof(rt_ss));
+    s = &rt_s;
+    s->ss = &rt_ss;
+    s->options = options;
+    s->num_phases = 1;
+    s->openstr = (char *)"open";
+    s->closedstr = (char *)"closed";
+    s->ip_report_fmt = (char *)"%h:%p %t";
+    s->ip_imreport_fmt = (char *)"im %h:%p %t";
+    s->arp_report_fmt = (char *)"%M %h";
+    s->arp_imreport_fmt = (char *)"im %M %h";
+    s->stream_mb = 1;
+    s->_stdout = tmpfile();
+    s->_stderr = stderr;
+    rt_ss.mode = MODE_TCPSCAN;
+
+    report_init();
+}
+
+/* everything written since the last call */
+static char *rt_output(void) {
+    static char *buf = NULL;
+    long len;
+
+    report_flush();
+    len = ftell(s->_stdout);
+    buf = (char *)realloc(buf, (size_t)len + 1);
+    rewind(s->_stdout);
+    len = (long)fread(buf, 1, (size_t)len, s->_stdout);
+    buf[len] = '\0';
+    rewind(s->_stdout);
+    if (ftruncate(fileno(s->_stdout), 0) < 0) {
+        buf[0] = '\0';
+    }
+
+    return buf;
+}
+
+static void rt_teardown(void) {
+    report_destroy();
+    fclose(s->_stdout);
+    s = NULL;
+}
+
+/* an open (or closed) tcp result from host 10.x.y.z, optionally with a banner */
+static void rt_add(uint32_t host, uint16_t port, uint8_t ttl, int open, const char *banner) {
+    ip_report_t ir;
+    output_data_t *od;
+
+    memset(&ir, 0, sizeof(ir));
+    ir.magic = IP_REPORT_MAGIC;
+    ir.proto = IPPROTO_TCP;
+    ir.type = open ? (TH_SYN|TH_ACK) : (TH_RST|TH_ACK);
+    ir.sport = port;
+    ir.dport = 40000;
+    ir.host_addr = htonl(0x0a000000 | host);
+    ir.send_addr = htonl(0x0a000001);
+    ir.trace_addr = ir.host_addr;
+    ir.ttl = ttl;
+    ir.od_q = fifo_init();
+
+    if (banner != NULL) {
+        /* one allocation, as spill_read makes them */
+        od = (output_data_t *)xmalloc(sizeof(output_data_t) + strlen(banner) + 1);
+        od->type = OD_TYPE_BANNER;
+        od->t_u.banner = (char *)od + sizeof(output_data_t);
+        strcpy(od->t_u.banner, banner);
+        fifo_push(ir.od_q, od);
+    }
+
+    report_add(&ir, sizeof(ir));
+}
+
+/*===========================================================================
+ * RESULT STORE TESTS
+ *===========================================================================*/
+
+#define RT_MANY 5000
+
+static uint64_t rt_keys[RT_MANY];
+static uint32_t rt_nkeys = 0;
+
+static int rt_keywalk(uint64_t key, void *rec __attribute__((unused)), void *cb __attribute__((unused))) {
+    if (rt_nkeys < RT_MANY) {
+        rt_keys[rt_nkeys] = key;
+    }
+    rt_nkeys++;
+    return 1;
+}
+
+/**
+ * Test: the table grows past RS_INITSIZE without losing a result, and a
+ * walk comes out in ascending key order, as the red black tree did
+ */
+static void test_rs_grow_walk(void) {
+    uint32_t j, h;
+    void *rec;
+
+    rt_setup(0);
+
+    /* a stride that visits every host once, out of order */
+    for (j = 0, h = 0; j < RT_MANY; j++) {
+        h = (h + 2741) % RT_MANY;
+        rt_add(h + 1, (uint16_t)(h % 3 == 0 ? 443 : 80), 64, 1, NULL);
+    }
+
+    ASSERT_EQ(RT_MANY, rs.cnt, "every result kept");
+    ASSERT_TRUE(rs.size > RS_INITSIZE && rs.cnt * 2 <= rs.size, "table grew, half full at most");
+    for (h = 0; h < RT_MANY; h++) {
+        ASSERT_EQ(1, rs_find(get_ipreport_key(htonl(0x0a000000 | (h + 1)), (uint16_t)(h % 3 == 0 ? 443 : 80),
+                  htonl(0x0a000001)), &rec), "result found after growing");
+    }
+
+    rt_nkeys = 0;
+    rs_walk(&rt_keywalk, 0);
+    ASSERT_EQ(RT_MANY, rt_nkeys, "walk visits every result");
+    for (j = 1; j < RT_MANY; j++) {
+        ASSERT_TRUE(rt_keys[j - 1] < rt_keys[j], "walk is in ascending key order");
+    }
+
+    rt_teardown();
+
+    TEST_PASS();
+}
+
+/**
+ * Test: with -c a key keeps every result in arrival order, without it the
+ * first one wins
+ */
+static void test_rs_chain_order(void) {
+    rt_setup(M_PROC_DUPS);
+
+    rt_add(9, 80, 3, 1, NULL);
+    rt_add(2, 80, 1, 1, NULL);
+    rt_add(9, 80, 1, 1, NULL);
+    rt_add(9, 80, 2, 1, NULL);
+    report_do();
+    ASSERT_STR_EQ("10.0.0.2:80 1 \n10.0.0.9:80 3 \n10.0.0.9:80 1 \n10.0.0.9:80 2 \n", rt_output(), "-c chain");
+    rt_teardown();
+
+    rt_setup(0);
+    rt_add(9, 80, 3, 1, NULL);
+    rt_add(9, 80, 1, 1, NULL);
+    report_do();
+    ASSERT_STR_EQ("10.0.0.9:80 3 \n", rt_output(), "first result wins");
+    rt_teardown();
+
+    TEST_PASS();
+}
+
+/*===========================================================================
+ * STREAM TESTS
+ *===========================================================================*/
+
+/* n keys that all land in the set of the first */
+static void rt_sameset(uint64_t *keys, unsigned int n) {
+    uint32_t h, set = 0;
+    unsigned int got = 0;
+    uint64_t key;
+
+    for (h = 1; got < n; h++) {
+        key = get_ipreport_key(htonl(h), 80, 0);
+        if (got == 0) {
+            set = RS_SLOT(key, sf.sets);
+        }
+        if (RS_SLOT(key, sf.sets) == set) {
+            keys[got++] = key;
+        }
+    }
+}
+
+/**
+ * Test: a set keeps its STREAM_WAYS most recently seen keys, a hit moves
+ * a key to the front and a new key pushes the oldest out
+ */
+static void test_stream_evict(void) {
+    uint64_t k[STREAM_WAYS + 1], *set;
+    unsigned int j;
+
+    rt_setup(M_STREAM);
+    rt_sameset(k, STREAM_WAYS + 1);
+    set = &sf.keys[(size_t)RS_SLOT(k[0], sf.sets) * STREAM_WAYS];
+
+    for (j = 0; j < STREAM_WAYS; j++) {
+        ASSERT_EQ(0, stream_seen(k[j]), "new key");
+    }
+    ASSERT_EQ(1, stream_seen(k[0]), "seen key");
+    ASSERT_TRUE(set[0] == k[0] && set[1] == k[3] && set[2] == k[2] && set[3] == k[1], "hit moves to the front");
+
+    /* k[1] is the oldest now */
+    ASSERT_EQ(0, stream_seen(k[4]), "new key in a full set");
+    ASSERT_TRUE(set[0] == k[4] && set[1] == k[0] && set[2] == k[3] && set[3] == k[2], "oldest pushed out");
+    ASSERT_EQ(0, stream_seen(k[1]), "pushed out key is new again");
+    ASSERT_EQ(1, stream_seen(k[0]), "recently seen key stays");
+
+    rt_teardown();
+
+    TEST_PASS();
+}
+
+/**
+ * Test: --stream prints each result once as it arrives, drops what is not
+ * worth reporting, and with -c prints every duplicate
+ */
+static void test_stream_report(void) {
+    rt_setup(M_STREAM);
+    rt_add(1, 80, 64, 1, NULL);
+    rt_add(1, 80, 63, 1, NULL);
+    rt_add(2, 80, 64, 0, NULL);
+    rt_add(1, 443, 64, 1, NULL);
+    rt_add(1, 80, 62, 1, NULL);
+    ASSERT_STR_EQ("im 10.0.0.1:80 64\nim 10.0.0.1:443 64\n", rt_output(), "duplicates and closed ports dropped");
+    ASSERT_EQ(2, (int)sf.sent, "sent");
+    ASSERT_EQ(2, (int)sf.dups, "duplicates");
+    rt_teardown();
+
+    rt_setup(M_STREAM|M_PROC_DUPS);
+    rt_add(1, 80, 64, 1, NULL);
+    rt_add(1, 80, 63, 1, NULL);
+    ASSERT_STR_EQ("im 10.0.0.1:80 64\nim 10.0.0.1:80 63\n", rt_output(), "-c prints duplicates");
+    ASSERT_EQ(0, (int)sf.dups, "-c skips the filter");
+    rt_teardown();
+
+    TEST_PASS();
+}
+
+/*===========================================================================
+ * SPILL TESTS
+ *===========================================================================*/
+
+#define RT_SPILL_HOSTS 300
+
+static char rt_chains[65536];
+static size_t rt_chlen = 0;
+
+/* each key and its chain, so the merge can be compared with the table */
+static int rt_chainwalk(uint64_t key, void *rec, void *cb __attribute__((unused))) {
+    ip_report_t *r;
+
+    rt_chlen += (size_t)snprintf(rt_chains + rt_chlen, sizeof(rt_chains) - rt_chlen, "%016llx", (unsigned long long)key);
+    for (r = (ip_report_t *)rec; r != NULL && rt_chlen < sizeof(rt_chains); r = r->next) {
+        rt_chlen += (size_t)snprintf(rt_chains + rt_chlen, sizeof(rt_chains) - rt_chlen, " %u/%u",
+                                     r->ttl, r->od_q == NULL ? 0 : (unsigned int)fifo_length(r->od_q));
+    }
+    if (rt_chlen < sizeof(rt_chains) - 1) {
+        rt_chains[rt_chlen++] = '\n';
+    }
+    rt_chains[rt_chlen] = '\0';
+
+    return 1;
+}
+
+/*
+ * the same results every time, duplicates of a key arrive well after the
+ * first, so with a small limit they land in other runs.  returns the report
+ */
+static char *rt_spill_scan(uint32_t options, uint64_t limit, uint32_t *nruns) {
+    char banner[32];
+    uint32_t j, h;
+
+    rt_setup(options);
+    sp.limit = limit;
+
+    for (j = 0, h = 0; j < RT_SPILL_HOSTS; j++) {
+        h = (h + 97) % RT_SPILL_HOSTS;
+        snprintf(banner, sizeof(banner), "svc %u", h);
+        rt_add(h + 1, 80, 64, 1, h % 5 == 0 ? banner : NULL);
+    }
+    for (j = 0; j < RT_SPILL_HOSTS; j += 7) {
+        rt_add(j + 1, 80, 32, 1, "again");
+        rt_add(j + 1, 80, 16, 1, NULL);
+    }
+    *nruns = sp.nruns;
+
+    rt_chlen = 0;
+    rt_chains[0] = '\0';
+    rs_walk(&rt_chainwalk, 0);
+
+    report_do();
+    return rt_output();
+}
+
+/**
+ * Test: past the limit results go to disk, and the report and -c chains
+ * merged back are byte for byte what the in memory report gives, with
+ * a run for every result (compacted at SPILL_MAXRUNS) and a few a run
+ */
+static void test_spill_matches_memory(void) {
+    static char mem_out[65536], mem_chains[65536];
+    static const uint32_t options[] = { M_PROC_DUPS, 0 };
+    uint32_t nruns, j;
+    char *out;
+
+    for (j = 0; j < sizeof(options) / sizeof(options[0]); j++) {
+        out = rt_spill_scan(options[j], 0, &nruns);
+        ASSERT_EQ(0, nruns, "no limit, no runs");
+        snprintf(mem_out, sizeof(mem_out), "%s", out);
+        snprintf(mem_chains, sizeof(mem_chains), "%s", rt_chains);
+        rt_teardown();
+
+        /* every add is over the limit, more runs than SPILL_MAXRUNS */
+        out = rt_spill_scan(options[j], 1, &nruns);
+        ASSERT_TRUE(nruns > 1 && nruns <= SPILL_MAXRUNS, "runs compacted");
+        ASSERT_STR_EQ(mem_chains, rt_chains, "chains, a run a result");
+        ASSERT_STR_EQ(mem_out, out, "report, a run a result");
+        rt_teardown();
+
+        /* the bare table is most of the limit, a handful of results a run */
+        out = rt_spill_scan(options[j], sizeof(rslot_t) * RS_INITSIZE + 2048, &nruns);
+        ASSERT_TRUE(nruns > 1, "several runs");
+        ASSERT_STR_EQ(mem_chains, rt_chains, "chains, a few results a run");
+        ASSERT_STR_EQ(mem_out, out, "report, a few results a run");
+        rt_teardown();
+    }
+
+    TEST_PASS();
+}
+
+/**
+ * Test: with -I a result is printed as it arrives once, a duplicate of one
+ * already on disk is not printed again
+ */
+static void test_spill_immediate(void) {
+    char *out;
+
+    rt_setup(M_IMMEDIATE);
+    sp.limit = 1;
+    rt_add(1, 80, 64, 1, NULL);
+    rt_add(1, 80, 63, 1, NULL);
+    rt_add(2, 80, 64, 1, NULL);
+    out = rt_output();
+    ASSERT_TRUE(strstr(out, "im 10.0.0.1:80 64\n") != NULL, "first result printed");
+    ASSERT_TRUE(strstr(out, "im 10.0.0.1:80 63\n") == NULL, "duplicate on disk not printed");
+    ASSERT_TRUE(strstr(out, "10.0.0.2") == NULL, "nothing printed it cant tell is new");
+    report_do();
+    ASSERT_STR_EQ("10.0.0.1:80 64 \n10.0.0.2:80 64 \n", rt_output(), "report");
+    rt_teardown();
+
+    TEST_PASS();
+}
+
+/*===========================================================================
+ * FORMAT TESTS
+ *===========================================================================*/
+
+static const char *rt_ipfmts[] = {
+    "%-8r\t[%5p]\tFrom %h %T ttl %t",
+    "%h:%-6p|%6L|%pn|%Ln|%hn|%sn|%Tn|%s|%T",
+    "%03t %-3t %3t %0t %08w %S %w %-08w|",
+    "100%% \\\\ \\t\\n\\a\\b\\f\\r\\v %q%zend",
+    "%M %o %-20M| %20o|%C|",
+    "%-10hn|%20hn|%-16h|%16s|",
+    "%1234p|%9999t|",
+    "%r %-12r|%12r|",
+    "bad \\x escape %% %",
+};
+
+static const char *rt_arpfmts[] = {
+    "%M %h %o %-18M|%p%r%t%S%w%T",
+    "%-16h%M %20o|%hn|",
+};
+
+#define RT_NIPFMTS (sizeof(rt_ipfmts) / sizeof(rt_ipfmts[0]))
+#define RT_NARPFMTS (sizeof(rt_arpfmts) / sizeof(rt_arpfmts[0]))
+
+/* what fmtcat printed for the reports below, each ip format then each arp one */
+static const char *rt_fmtcat[3][RT_NIPFMTS * 3 + RT_NARPFMTS] = {
+    /* options 0 */
+    {
+        "TCPSA   \t[   80]\tFrom 10.0.0.5 10.0.9.9 ttl 7",
+        "ICMP:T03C03\t[    0]\tFrom 192.168.1.1  ttl 255",
+        "IP:P17T0000S0000\t[   53]\tFrom 8.8.8.8  ttl 64",
+        "10.0.0.5:80    | 40000|http|unknown|10.0.0.5|10.0.0.1|10.0.9.9|10.0.0.1|10.0.9.9",
+        "192.168.1.1:0     |     0|unknown|unknown|192.168.1.1|10.0.0.1||10.0.0.1|",
+        "8.8.8.8:53    |  1234|unknown|unknown|8.8.8.8|10.0.0.1||10.0.0.1|",
+        "007 7     7 7 00005840 deadbeef 5840 5840    |",
+        "255 255 255 255    |",
+        "064 64   64 64    |",
+        "100% \\ \t\n\a\b\f\r\v end",
+        "100% \\ \t\n\a\b\f\r\v end",
+        "100% \\ \t\n\a\b\f\r\v end",
+        "00:11:22:aa:bb:cc Acme 00:11:22:aa:bb:cc   |                 Acme|??|",
+        "  | |??|",
+        "  | |??|",
+        "10.0.0.5  |            10.0.0.5|10.0.0.5        |        10.0.0.1|",
+        "192.168.1.1|         192.168.1.1|192.168.1.1     |        10.0.0.1|",
+        "8.8.8.8   |             8.8.8.8|8.8.8.8         |        10.0.0.1|",
+        "p|t|",
+        "p|t|",
+        "p|t|",
+        "TCPSA TCPSA       |       TCPSA|",
+        "ICMP:T03C03 ICMP:T03C03 | ICMP:T03C03|",
+        "IP:P17T0000S0000 IP:P17T0000S0000|IP:P17T0000S0000|",
+        "bad  escape % ",
+        "bad  escape % ",
+        "bad  escape % ",
+        "00:11:22:33:44:55 10.0.0.5 Acme 00:11:22:33:44:55 |",
+        "10.0.0.5        00:11:22:33:44:55                 Acme|10.0.0.5|",
+    },
+    /* options M_DO_TRANS */
+    {
+        "TCP open\t[   80]\tFrom 10.0.0.5 10.0.9.9 ttl 7",
+        "ICMP closed\t[    0]\tFrom 192.168.1.1  ttl 255",
+        "UDP open\t[   53]\tFrom 8.8.8.8  ttl 64",
+        "10.0.0.5:80    | 40000|http|unknown|10.0.0.5|10.0.0.1|10.0.9.9|10.0.0.1|10.0.9.9",
+        "192.168.1.1:0     |     0|unknown|unknown|192.168.1.1|10.0.0.1||10.0.0.1|",
+        "8.8.8.8:53    |  1234|unknown|unknown|8.8.8.8|10.0.0.1||10.0.0.1|",
+        "007 7     7 7 00005840 deadbeef 5840 5840    |",
+        "255 255 255 255    |",
+        "064 64   64 64    |",
+        "100% \\ \t\n\a\b\f\r\v end",
+        "100% \\ \t\n\a\b\f\r\v end",
+        "100% \\ \t\n\a\b\f\r\v end",
+        "00:11:22:aa:bb:cc Acme 00:11:22:aa:bb:cc   |                 Acme|??|",
+        "  | |??|",
+        "  | |??|",
+        "10.0.0.5  |            10.0.0.5|10.0.0.5        |        10.0.0.1|",
+        "192.168.1.1|         192.168.1.1|192.168.1.1     |        10.0.0.1|",
+        "8.8.8.8   |             8.8.8.8|8.8.8.8         |        10.0.0.1|",
+        "p|t|",
+        "p|t|",
+        "p|t|",
+        "TCP open TCP open    |    TCP open|",
+        "ICMP closed ICMP closed | ICMP closed|",
+        "UDP open UDP open    |    UDP open|",
+        "bad  escape % ",
+        "bad  escape % ",
+        "bad  escape % ",
+        "00:11:22:33:44:55 10.0.0.5 Acme 00:11:22:33:44:55 |",
+        "10.0.0.5        00:11:22:33:44:55                 Acme|10.0.0.5|",
+    },
+    /* options M_DO_DNS */
+    {
+        "TCPSA   \t[   80]\tFrom 10.0.0.5 10.0.9.9 ttl 7",
+        "ICMP:T03C03\t[    0]\tFrom 192.168.1.1  ttl 255",
+        "IP:P17T0000S0000\t[   53]\tFrom 8.8.8.8  ttl 64",
+        "10.0.0.5:80    | 40000|http|unknown|five.example|10.0.0.1|10.0.9.9|10.0.0.1|10.0.9.9",
+        "192.168.1.1:0     |     0|unknown|unknown|192.168.1.1|10.0.0.1||10.0.0.1|",
+        "8.8.8.8:53    |  1234|unknown|unknown|8.8.8.8|10.0.0.1||10.0.0.1|",
+        "007 7     7 7 00005840 deadbeef 5840 5840    |",
+        "255 255 255 255    |",
+        "064 64   64 64    |",
+        "100% \\ \t\n\a\b\f\r\v end",
+        "100% \\ \t\n\a\b\f\r\v end",
+        "100% \\ \t\n\a\b\f\r\v end",
+        "00:11:22:aa:bb:cc Acme 00:11:22:aa:bb:cc   |                 Acme|??|",
+        "  | |??|",
+        "  | |??|",
+        "five.example|        five.example|10.0.0.5        |        10.0.0.1|",
+        "192.168.1.1|         192.168.1.1|192.168.1.1     |        10.0.0.1|",
+        "8.8.8.8   |             8.8.8.8|8.8.8.8         |        10.0.0.1|",
+        "p|t|",
+        "p|t|",
+        "p|t|",
+        "TCPSA TCPSA       |       TCPSA|",
+        "ICMP:T03C03 ICMP:T03C03 | ICMP:T03C03|",
+        "IP:P17T0000S0000 IP:P17T0000S0000|IP:P17T0000S0000|",
+        "bad  escape % ",
+        "bad  escape % ",
+        "bad  escape % ",
+        "00:11:22:33:44:55 10.0.0.5 Acme 00:11:22:33:44:55 |",
+        "10.0.0.5        00:11:22:33:44:55                 Acme|five.example|",
+    },
+};
+
+static const uint32_t rt_fmtopts[3] = { 0, M_DO_TRANS, M_DO_DNS };
+
+static int rt_fmtcheck(const char *fmt, const void *report, const char *want) {
+    fmt_prog_t *prog;
+    char got[512];
+
+    prog = fmt_compile(fmt);
+    ob.len = 0;
+    if (prog != NULL) {
+        fmt_run(prog, report);
+    }
+    snprintf(got, sizeof(got), "%.*s", (int)ob.len, ob.buf != NULL ? ob.buf : "");
+    ob.len = 0;
+    fmt_free(prog);
+
+    if (strcmp(want, got) != 0) {
+        printf("  format `%s' gave '%s', fmtcat gave '%s'\n", fmt, got, want);
+        return -1;
+    }
+
+    return 1;
+}
+
+/**
+ * Test: compiled formats print what fmtcat did, widths, the - and 0
+ * flags, n names, escapes, %% and unknown characters included
+ */
+static void test_fmt_matches_fmtcat(void) {
+    ip_report_t ir[3];
+    arp_report_t ar;
+    unsigned int m, j, k, n;
+    int nfd, efd, bad = 0;
+
+    memset(ir, 0, sizeof(ir));
+    ir[0].magic = IP_REPORT_MAGIC;
+    ir[0].proto = IPPROTO_TCP;
+    ir[0].type = TH_SYN|TH_ACK;
+    ir[0].sport = 80;
+    ir[0].dport = 40000;
+    ir[0].host_addr = htonl(0x0a000005);
+    ir[0].send_addr = htonl(0x0a000001);
+    ir[0].trace_addr = htonl(0x0a000909);
+    ir[0].ttl = 7;
+    ir[0].window_size = 5840;
+    ir[0].tseq = 0xdeadbeef;
+    ir[0].eth_hwaddr_valid = 1;
+    memcpy(ir[0].eth_hwaddr, "\x00\x11\x22\xaa\xbb\xcc", 6);
+
+    ir[1].magic = IP_REPORT_MAGIC;
+    ir[1].proto = IPPROTO_ICMP;
+    ir[1].type = 3;
+    ir[1].subtype = 3;
+    ir[1].host_addr = htonl(0xc0a80101);
+    ir[1].send_addr = htonl(0x0a000001);
+    ir[1].trace_addr = ir[1].host_addr;
+    ir[1].ttl = 255;
+
+    ir[2].magic = IP_REPORT_MAGIC;
+    ir[2].proto = IPPROTO_UDP;
+    ir[2].sport = 53;
+    ir[2].dport = 1234;
+    ir[2].host_addr = htonl(0x08080808);
+    ir[2].send_addr = htonl(0x0a000001);
+    ir[2].trace_addr = ir[2].host_addr;
+    ir[2].ttl = 64;
+
+    memset(&ar, 0, sizeof(ar));
+    ar.magic = ARP_REPORT_MAGIC;
+    ar.ipaddr = htonl(0x0a000005);
+    memcpy(ar.hwaddr, "\x00\x11\x22\x33\x44\x55", 6);
+
+    rt_setup(0);
+
+    /* the compiler complains about the unknown characters on stderr, as fmtcat did */
+    fflush(stderr);
+    efd = dup(STDERR_FILENO);
+    nfd = open("/dev/null", O_WRONLY);
+    dup2(nfd, STDERR_FILENO);
+    close(nfd);
+
+    for (m = 0; m < 3; m++) {
+        s->options = rt_fmtopts[m];
+        for (j = 0, n = 0; j < RT_NIPFMTS; j++) {
+            for (k = 0; k < 3; k++, n++) {
+                if (rt_fmtcheck(rt_ipfmts[j], &ir[k], rt_fmtcat[m][n]) < 0) {
+                    bad++;
+                }
+            }
+        }
+        for (j = 0; j < RT_NARPFMTS; j++, n++) {
+            if (rt_fmtcheck(rt_arpfmts[j], &ar, rt_fmtcat[m][n]) < 0) {
+                bad++;
+            }
+        }
+    }
+
+    fflush(stderr);
+    dup2(efd, STDERR_FILENO);
+    close(efd);
+
+    s->options = 0;
+    rt_teardown();
+
+    ASSERT_EQ(0, bad, "formats that differ from fmtcat");
+
+    TEST_PASS();
+}
+
+/*===========================================================================
+ * MAIN TEST RUNNER
+ *===========================================================================*/
+
+int main(int argc, char **argv) {
+    (void)argc; (void)argv;
+
+    printf("========================================\n");
+    printf("  Unicornscan Report Test Suite\n");
+    printf("========================================\n\n");
+
+    printf("[Result Store Tests]\n");
+    test_rs_grow_walk();
+    test_rs_chain_order();
+
+    printf("\n[Stream Tests]\n");
+    test_stream_evict();
+    test_stream_report();
+
+    printf("\n[Spill Tests]\n");
+    test_spill_matches_memory();
+    test_spill_immediate();
+
+    printf("\n[Format Tests]\n");
+    test_fmt_matches_fmtcat();
+
+    printf("\n  Passed:  %d\n", tests_passed);
+    printf("  Failed:  %d\n", tests_failed);
+
+    return tests_failed > 0 ? 1 : 0;
+}
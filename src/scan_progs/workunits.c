@@ -33,6 +33,7 @@
 #include <unilib/cidr.h>
 #include <unilib/route.h>
 #include <unilib/modules.h>
+#include <unilib/prng.h>
 
 #include <arpa/inet.h>
 
@@ -139,6 +140,7 @@ static int workunit_match_wid (const void *, const void *);
 static void balance_send_workunits(void *);
 static void balance_recv_workunits(void *);
 static void workunit_append_interface(void *);
+static void workunit_chunk_sp(struct wk_s *);
 
 int workunit_init(void) {
 	s->swu=fifo_init();
@@ -588,6 +590,7 @@ int workunit_add(const char *targets, char **estr) {
 
 	sw_u.s->magic=send_magic;
 	sw_u.s->repeats=s->repeats;
+	sw_u.s->retry_gap=s->retry_gap;
 	sw_u.s->send_opts=send_opts;
 	sw_u.s->pps=pps;
 	sw_u.s->delay_type=s->delay_type_exp != 0 ? s->delay_type_exp : delay_getdef(pps);
@@ -615,6 +618,20 @@ int workunit_add(const char *targets, char **estr) {
 	sw_u.s->window_size=s->ss->window_size;
 	sw_u.s->syn_key=s->ss->syn_key;
 
+	if (netid.ss_family == AF_INET) {
+		union {
+			struct sockaddr_storage *ss;
+			struct sockaddr_in *sin;
+		} m_u;
+
+		m_u.ss=&mask;
+		sw_u.s->host_mix=prng_get32() & ~(m_u.sin->sin_addr.s_addr);
+	}
+	sw_u.s->host_first=0;
+	sw_u.s->host_count=0;
+	sw_u.s->resume_at=0;
+	sw_u.s->shuffle_seed=prng_get32();
+
 	sw_u.s->port_str_len=port_str_len;
 
 	if (port_str_len > 0) {
@@ -634,6 +651,404 @@ int workunit_add(const char *targets, char **estr) {
 	return 1;
 }
 
+/*
+ * CIDR Aggregation for Phase 2+ Workunits
+ *
+ * Instead of creating one /32 workunit per ARP responder, we aggregate
+ * responding hosts into optimal CIDR blocks. This reduces workunit count
+ * while still only scanning hosts that responded to ARP.
+ *
+ * Example: if .40, .41, .42, .43 all responded, we create one /30 instead
+ * of four /32s. The algorithm finds the largest valid CIDR at each position.
+ */
+
+/* qsort comparison for uint32_t */
+static int compare_u32(const void *a, const void *b) {
+	uint32_t va=*(const uint32_t *)a;
+	uint32_t vb=*(const uint32_t *)b;
+
+	if (va < vb) return -1;
+	if (va > vb) return 1;
+	return 0;
+}
+
+/*
+ * Binary search to check if an IP is in the sorted array.
+ * Returns 1 if found, 0 if not.
+ */
+static int ip_in_set(const uint32_t *ips, uint32_t count, uint32_t ip) {
+	uint32_t lo=0, hi=count;
+
+	while (lo < hi) {
+		uint32_t mid=(lo + hi) / 2;
+
+		if (ips[mid] == ip) {
+			return 1;
+		}
+		if (ips[mid] < ip) {
+			lo=mid + 1;
+		}
+		else {
+			hi=mid;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Find the largest CIDR block starting at base_ip where all hosts
+ * in the block are present in our set. Returns the CIDR prefix length.
+ *
+ * A CIDR /N block contains 2^(32-N) hosts and must be aligned to
+ * that boundary (base_ip % block_size == 0).
+ */
+static int find_largest_cidr(const uint32_t *ips, uint32_t count,
+			     uint32_t base_ip, uint32_t max_ip) {
+	int cidr=0;
+
+	/*
+	 * Try progressively larger blocks from /31 down to /24.
+	 * Stop at /24 since larger blocks are impractical for local scans.
+	 */
+	for (cidr=31; cidr >= 24; cidr--) {
+		uint32_t block_size=1U << (32 - cidr);
+		uint32_t block_mask=~(block_size - 1);
+		uint32_t block_base=base_ip & block_mask;
+		uint32_t block_end=block_base + block_size - 1;
+		uint32_t i=0;
+		int all_present=1;
+
+		/* block must start at base_ip (aligned) */
+		if (block_base != base_ip) {
+			continue;
+		}
+
+		/* block must not exceed our IP range */
+		if (block_end > max_ip) {
+			continue;
+		}
+
+		/* check if all hosts in block are in our set */
+		for (i=0; i < block_size; i++) {
+			if (!ip_in_set(ips, count, block_base + i)) {
+				all_present=0;
+				break;
+			}
+		}
+
+		if (all_present) {
+			return cidr;
+		}
+	}
+
+	/* fallback to /32 */
+	return 32;
+}
+
+/*
+ * Create a workunit for a CIDR block with optional port specification.
+ */
+static void create_cidr_workunit(uint32_t host_ip, int cidr,
+				 const char *port_spec) {
+	char ip_str[80];
+	char *estr=NULL;
+	uint32_t net_ip=htonl(host_ip);
+
+	if (cidr == 32) {
+		/* /32 - single host, no CIDR suffix needed */
+		if (port_spec != NULL && strlen(port_spec) > 0) {
+			snprintf(ip_str, sizeof(ip_str), "%u.%u.%u.%u:%s",
+				(net_ip >> 0) & 0xff, (net_ip >> 8) & 0xff,
+				(net_ip >> 16) & 0xff, (net_ip >> 24) & 0xff,
+				port_spec);
+		}
+		else {
+			snprintf(ip_str, sizeof(ip_str), "%u.%u.%u.%u",
+				(net_ip >> 0) & 0xff, (net_ip >> 8) & 0xff,
+				(net_ip >> 16) & 0xff, (net_ip >> 24) & 0xff);
+		}
+	}
+	else {
+		/* CIDR block */
+		if (port_spec != NULL && strlen(port_spec) > 0) {
+			snprintf(ip_str, sizeof(ip_str), "%u.%u.%u.%u/%d:%s",
+				(net_ip >> 0) & 0xff, (net_ip >> 8) & 0xff,
+				(net_ip >> 16) & 0xff, (net_ip >> 24) & 0xff,
+				cidr, port_spec);
+		}
+		else {
+			snprintf(ip_str, sizeof(ip_str), "%u.%u.%u.%u/%d",
+				(net_ip >> 0) & 0xff, (net_ip >> 8) & 0xff,
+				(net_ip >> 16) & 0xff, (net_ip >> 24) & 0xff,
+				cidr);
+		}
+	}
+
+	if (workunit_add(ip_str, &estr) < 0) {
+		ERR("failed to add workunit %s: %s", ip_str, estr);
+	}
+}
+
+/*
+ * Aggregate IPs into optimal CIDRs and create workunits.
+ *
+ * Algorithm: sort the IPs, then at each position find the largest valid
+ * CIDR block where all hosts responded to ARP. This greedily produces
+ * the minimal number of workunits. ips is in host byte order and gets
+ * sorted in place.
+ */
+void workunit_add_hosts(uint32_t *ips, uint32_t count, const char *port_spec) {
+	uint32_t i=0;
+	uint32_t workunits=0;
+	uint32_t max_ip=0;
+	uint8_t *covered=NULL;
+
+	if (count == 0) {
+		return;
+	}
+
+	qsort(ips, count, sizeof(uint32_t), compare_u32);
+
+	max_ip=ips[count - 1];
+	covered=(uint8_t *)xmalloc(count);
+	memset(covered, 0, count);
+
+	for (i=0; i < count; i++) {
+		uint32_t block_size=0;
+		int cidr=0;
+		uint32_t j=0;
+
+		if (covered[i]) {
+			continue;
+		}
+
+		/* find largest CIDR block starting at this IP */
+		cidr=find_largest_cidr(ips, count, ips[i], max_ip);
+		block_size=1U << (32 - cidr);
+
+		/* create workunit for this block */
+		create_cidr_workunit(ips[i], cidr, port_spec);
+		workunits++;
+
+		/* mark all IPs in this block as covered */
+		for (j=i; j < count && ips[j] < ips[i] + block_size; j++) {
+			covered[j]=1;
+		}
+	}
+
+	VRB(1, "phase 2+: aggregated %u hosts into %u CIDR workunits",
+		count, workunits);
+
+	xfree(covered);
+}
+
+static uint32_t pipe_lmagic=0;
+static int pipe_lcount=0;
+
+static void pipeline_lp(void *wptr) {
+	union {
+		struct wk_s *w;
+		void *ptr;
+	} w_u;
+
+	w_u.ptr=wptr;
+	assert(w_u.w->magic == WK_MAGIC);
+
+	if (w_u.w->iter != s->cur_iter || w_u.w->used || w_u.w->r->magic != ARP_RECV_MAGIC) {
+		return;
+	}
+
+	w_u.w->r->magic=pipe_lmagic;
+	w_u.w->r->recv_opts=s->recv_opts;
+	w_u.w->r->window_size=s->ss->window_size;
+	w_u.w->r->recv_timeout=s->ss->recv_timeout;
+	w_u.w->r->ret_layers=s->ss->ret_layers;
+	w_u.w->r->syn_key=s->ss->syn_key;
+
+	DBG(M_WRK, "listener workunit wid %u now %s and arp", w_u.w->wid, strscanmode(scan_getmode()));
+	pipe_lcount++;
+
+	return;
+}
+
+/*
+ * pipelined compound mode runs the arp phase and the phase after it as one
+ * scan group. the arp listener workunits already queued for this iteration
+ * are rewritten for the mode loaded now, with L_ARP_ALSO so the listener
+ * keeps passing arp replies back. workunit_add() for the hosts found later
+ * matches these with lwu_compare and so lands in the same group
+ */
+int workunit_pipeline_lp(void) {
+
+	switch (scan_getmode()) {
+		case MODE_TCPSCAN:
+			pipe_lmagic=TCP_RECV_MAGIC;
+			break;
+
+		case MODE_UDPSCAN:
+			pipe_lmagic=UDP_RECV_MAGIC;
+			break;
+
+		default:
+			ERR("cant pipeline arp into %s mode", strscanmode(scan_getmode()));
+			return -1;
+	}
+
+	SET_ARPALSO(1);
+
+	pipe_lcount=0;
+	fifo_walk(s->lwu, &pipeline_lp);
+
+	return pipe_lcount;
+}
+
+static uint32_t *tgt_nets=NULL, *tgt_masks=NULL;
+static int tgt_max=0, tgt_cnt=0;
+
+static void target_sp(void *wptr) {
+	union {
+		struct wk_s *w;
+		void *ptr;
+	} w_u;
+	struct sockaddr_storage net, mask;
+	union sock_u n_u, m_u;
+	int j=0;
+
+	w_u.ptr=wptr;
+	assert(w_u.w->magic == WK_MAGIC && w_u.w->s != NULL);
+
+	if (tgt_cnt < 0) {
+		return;
+	}
+
+	/* packed for ipc, copy them out before looking inside */
+	memcpy(&net, &w_u.w->s->target, sizeof(net));
+	memcpy(&mask, &w_u.w->s->targetmask, sizeof(mask));
+	n_u.ss=&net;
+	m_u.ss=&mask;
+
+	if (n_u.fs->family != AF_INET) {
+		tgt_cnt=-1;
+		return;
+	}
+
+	for (j=0; j < tgt_cnt; j++) {
+		if (tgt_nets[j] == n_u.sin->sin_addr.s_addr && tgt_masks[j] == m_u.sin->sin_addr.s_addr) {
+			return;
+		}
+	}
+	if (tgt_cnt == tgt_max) {
+		tgt_cnt=-1;
+		return;
+	}
+
+	tgt_nets[tgt_cnt]=n_u.sin->sin_addr.s_addr;
+	tgt_masks[tgt_cnt]=m_u.sin->sin_addr.s_addr;
+	tgt_cnt++;
+
+	return;
+}
+
+int workunit_get_targets(uint32_t *nets, uint32_t *masks, int max) {
+
+	assert(nets != NULL && masks != NULL && max > 0);
+
+	tgt_nets=nets;
+	tgt_masks=masks;
+	tgt_max=max;
+	tgt_cnt=0;
+
+	fifo_walk(s->swu, &target_sp);
+
+	return tgt_cnt;
+}
+
+int workunit_target_pcapfilter(const uint32_t *nets, const uint32_t *masks, int cnt, char *out, size_t out_len) {
+	char net_s[INET_ADDRSTRLEN];
+	struct sockaddr_in mask_sin;
+	struct in_addr ia;
+	size_t off=0;
+	int j=0, sret=0;
+
+	assert(nets != NULL && masks != NULL && cnt > 0 && out != NULL && out_len > 0);
+
+	if (s->extra_pcapfilter != NULL) {
+		sret=snprintf(out, out_len, "(%s) and (", s->extra_pcapfilter);
+	}
+	else {
+		sret=snprintf(out, out_len, "(");
+	}
+	if (sret < 0 || (size_t)sret >= out_len) {
+		return -1;
+	}
+	off=(size_t)sret;
+
+	for (j=0; j < cnt; j++) {
+		/* pcap refuses a net with host bits set */
+		ia.s_addr=nets[j] & masks[j];
+		inet_ntop(AF_INET, &ia, net_s, sizeof(net_s));
+		memset(&mask_sin, 0, sizeof(mask_sin));
+		mask_sin.sin_family=AF_INET;
+		mask_sin.sin_addr.s_addr=masks[j];
+
+		/* replies from the targets, and icmp errors about what we sent them, the quoted ip dst */
+		sret=snprintf(out + off, out_len - off, "%ssrc net %s/%u or icmp[24:4] & 0x%08x = 0x%08x",
+			j > 0 ? " or " : "",
+			net_s,
+			cidr_getmask((const struct sockaddr *)&mask_sin),
+			ntohl(masks[j]),
+			ntohl(ia.s_addr)
+		);
+		if (sret < 0 || (size_t)sret >= out_len - off) {
+			return -1;
+		}
+		off += (size_t)sret;
+	}
+
+	if (off + 2 > out_len) {
+		return -1;
+	}
+	out[off++]=')';
+	out[off]='\0';
+
+	return 1;
+}
+
+static void refilter_lp(void *wptr) {
+	union {
+		struct wk_s *w;
+		void *ptr;
+	} w_u;
+	union {
+		recv_workunit_t *r;
+		uint8_t *inc;
+	} rw_u;
+	size_t pcaplen=0;
+
+	w_u.ptr=wptr;
+	assert(w_u.w->magic == WK_MAGIC && w_u.w->r != NULL);
+
+	pcaplen=s->extra_pcapfilter != NULL ? strlen(s->extra_pcapfilter) : 0;
+
+	w_u.w->len=sizeof(recv_workunit_t) + pcaplen;
+	rw_u.r=(recv_workunit_t *)xrealloc(w_u.w->r, w_u.w->len);
+	rw_u.r->pcap_len=pcaplen;
+	if (pcaplen > 0) {
+		memcpy(rw_u.inc + sizeof(recv_workunit_t), s->extra_pcapfilter, pcaplen);
+	}
+	w_u.w->r=rw_u.r;
+
+	return;
+}
+
+void workunit_refilter_lp(void) {
+
+	fifo_walk(s->lwu, &refilter_lp);
+
+	return;
+}
+
 recv_workunit_t *workunit_get_lp(size_t *wk_len, uint32_t *wid) {
 	union {
 		struct wk_s *w;
@@ -681,6 +1096,9 @@ send_workunit_t *workunit_get_sp(size_t *wk_len, uint32_t *wid) {
 
 	if ((w_u.ptr=fifo_find(s->swu, &srch, &workunit_match_slp)) != NULL) {
 		assert(w_u.w->magic == WK_MAGIC);
+		if (s->senders > 1 || (GET_PIPELINE() && w_u.w->s->magic == ARP_SEND_MAGIC)) {
+			workunit_chunk_sp(w_u.w);
+		}
 		w_u.w->used=1;
 		swu_s++;
 		DBG(M_WRK, "sending S workunit with wid %u", w_u.w->wid);
@@ -695,6 +1113,71 @@ send_workunit_t *workunit_get_sp(size_t *wk_len, uint32_t *wid) {
 	return NULL;
 }
 
+/*
+ * cut the front off an unused send workunit, what is left goes back in the
+ * queue as a new workunit with its own wid for the next idle sender to pick up
+ */
+static void workunit_chunk_sp(struct wk_s *w) {
+	union {
+		struct sockaddr_storage *ss;
+		struct sockaddr_in *sin;
+	} m_u;
+	struct sockaddr_storage mask;
+	struct wk_s *rest=NULL;
+	uint64_t left=0, piece=0;
+
+	assert(w != NULL && w->s != NULL);
+
+	/* the workunit is packed, dont point into it */
+	memcpy(&mask, &w->s->targetmask, sizeof(mask));
+	m_u.ss=&mask;
+
+	/* a resumed workunit is a position in the whole loop, not a host range */
+	if (mask.ss_family != AF_INET || w->s->resume_at != 0) {
+		return;
+	}
+
+	if (w->s->host_count != 0) {
+		left=w->s->host_count;
+	}
+	else {
+		left=(uint64_t)(~ntohl(m_u.sin->sin_addr.s_addr)) + 1 - w->s->host_first;
+	}
+
+	/* a pipelined arp sweep hands the sender back often, so probes for what it found get a turn */
+	if (GET_PIPELINE() && w->s->magic == ARP_SEND_MAGIC) {
+		piece=WORKUNIT_CHUNK_MIN;
+	}
+	else {
+		piece=left / ((uint64_t)s->senders * WORKUNIT_CHUNK_DIV);
+		if (piece < WORKUNIT_CHUNK_MIN) {
+			piece=WORKUNIT_CHUNK_MIN;
+		}
+	}
+
+	if (piece >= left) {
+		return;
+	}
+
+	rest=(struct wk_s *)xmalloc(sizeof(struct wk_s));
+	memcpy(rest, w, sizeof(struct wk_s));
+	rest->s=(send_workunit_t *)xmalloc(w->len);
+	memcpy(rest->s, w->s, w->len);
+	rest->used=0;
+	rest->done=0;
+	rest->wid=++s->wk_seq;
+
+	rest->s->host_first=w->s->host_first + (uint32_t)piece;
+	rest->s->host_count=(w->s->host_count != 0 ? w->s->host_count - (uint32_t)piece : 0);
+	w->s->host_count=(uint32_t)piece;
+
+	DBG(M_WRK, "chunked wid %u to %u hosts from %u, rest is wid %u", w->wid, w->s->host_count, w->s->host_first, rest->wid);
+
+	fifo_push(s->swu, rest);
+
+	return;
+}
+
 static char interfaces[128];
 unsigned int interfaces_off=0;
 
@@ -847,7 +1330,57 @@ static void balance_recv_workunits(void *wptr) {
 }
 
 void workunit_reject_sp(uint32_t wid) {
-	assert((1 + 1) == 5);
+	union {
+		struct wk_s *w;
+		void *ptr;
+	} w_u;
+	struct wk_s srch;
+
+	memset(&srch, 0, sizeof(srch));
+	srch.wid=wid;
+	srch.magic=WK_MAGIC;
+
+	if ((w_u.ptr=fifo_find(s->swu, &srch, &workunit_match_wid)) == NULL) {
+		ERR("cant find rejected send workunit %u", wid);
+		return;
+	}
+	assert(w_u.w->magic == WK_MAGIC && w_u.w->s != NULL);
+
+	/*
+	 * a new wid, the old one is already recorded as handed out and the
+	 * output modules see this one as a workunit of its own
+	 */
+	w_u.w->s->resume_at=w_u.w->done;
+	w_u.w->used=0;
+	w_u.w->wid=++s->wk_seq;
+	swu_s--;
+
+	VRB(0, "sender workunit %u requeued as %u, resuming at %" PRIu64, wid, w_u.w->wid, w_u.w->done);
+
+	return;
+}
+
+void workunit_progress_sp(uint32_t wid, uint64_t done) {
+	union {
+		struct wk_s *w;
+		void *ptr;
+	} w_u;
+	struct wk_s srch;
+
+	memset(&srch, 0, sizeof(srch));
+	srch.wid=wid;
+	srch.magic=WK_MAGIC;
+
+	if ((w_u.ptr=fifo_find(s->swu, &srch, &workunit_match_wid)) == NULL) {
+		DBG(M_WRK, "progress for unknown send workunit %u", wid);
+		return;
+	}
+
+	if (done > w_u.w->done) {
+		w_u.w->done=done;
+	}
+
+	return;
 }
 
 void workunit_reject_lp(uint32_t wid) {
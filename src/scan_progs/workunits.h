@@ -38,6 +38,14 @@
 #define  WKS_SEND_MAGIC 0x33cd1a1a
 #define  WKS_RECV_MAGIC 0x32cc1919
 
+/*
+ * with more than one sender a send workunit is handed out a chunk at a time,
+ * each chunk being whats left of the block divided by senders * CHUNK_DIV, so
+ * chunks shrink toward the end and the senders run out of work together
+ */
+#define WORKUNIT_CHUNK_DIV	2
+#define WORKUNIT_CHUNK_MIN	256	/* hosts, less isnt worth a workunit round trip */
+
 #define WORKUNIT_STATUS_OUTSTANDING	0
 #define WORKUNIT_STATUS_COMPLETE	1
 #define WORKUNIT_STATUS_ERROR		-1
@@ -70,6 +78,25 @@ typedef struct _PACKED_ send_workunit_t {
 	uint16_t window_size;	/* without WS, hence the 16 wide version */
 	uint32_t syn_key;
 
+	/*
+	 * which hosts of target/targetmask this unit covers, as indexes into the
+	 * block.  host_mix is xored onto the index to pick the address, its the
+	 * same for every chunk cut from one block so chunks never overlap
+	 */
+	uint32_t host_mix;
+	uint32_t host_first;
+	uint32_t host_count;	/* 0 is through the end of the block */
+
+	/*
+	 * a workunit taken back from a dead sender, the new sender skips this
+	 * many trips through the host loop, see send_progress_t.  the port
+	 * shuffle is seeded from the workunit so both senders agree on the order
+	 */
+	uint64_t resume_at;
+	uint32_t shuffle_seed;
+
+	uint16_t retry_gap;	/* ms before the 2nd -R round with S_SELECT_RETRY */
+
 	uint16_t port_str_len;
 } send_workunit_t;
 
@@ -102,6 +129,15 @@ typedef struct _PACKED_ send_ipv4_pri_workunit_t {
 	uint16_t doff;
 } send_pri_workunit_t;
 
+/*
+ * --selective-retry, the master passes on what answered while senders are
+ * still working, a MSG_ANSWERED is an array of these.  port is 0 for arp
+ */
+typedef struct _PACKED_ send_answered_t {
+	uint32_t host;
+	uint16_t port;
+} send_answered_t;
+
 struct wk_s {
 	uint32_t magic;
 	size_t len;
@@ -110,6 +146,7 @@ struct wk_s {
 	int iter;
 	int used;
 	uint32_t wid;
+	uint64_t done;		/* last MSG_PROGRESS from the sender working it */
 };
 
 typedef struct workunit_stats_t {
@@ -130,8 +167,24 @@ void workunit_reinit(void);
 void workunit_dump(void);
 
 int  workunit_add(const char *, char ** /* error message if < 0 */);
-
+/* host order ips, sorted in place, aggregated into as few cidr workunits as possible */
+void workunit_add_hosts(uint32_t * /* ips */, uint32_t /* count */, const char * /* port spec or NULL */);
+/* turn the arp listener workunits of this iteration into ones for the current mode that still take arp */
+int  workunit_pipeline_lp(void);
+
+/*
+ * the ipv4 networks the send workunits so far go to, each once, network
+ * order, up to max of them. -1 if there are more or any isnt ipv4
+ */
+int  workunit_get_targets(uint32_t * /* nets */, uint32_t * /* masks */, int /* max */);
+/* a pcap filter for just the replies about those networks, anded with -P, -1 if it doesnt fit */
+int  workunit_target_pcapfilter(const uint32_t *, const uint32_t *, int, char * /* out */, size_t /* out len */);
+/* put s->extra_pcapfilter into the listener workunits made so far */
+void workunit_refilter_lp(void);
+
+/* a sender died holding wid, queue whatever it didnt get to again */
 void workunit_reject_sp(uint32_t /* wid */);
+void workunit_progress_sp(uint32_t /* wid */, uint64_t /* done */);
 void workunit_reject_lp(uint32_t /* wid */);
 
 int  workunit_check_sp(void);
@@ -168,6 +168,7 @@ typedef struct settings_s {
 	uint32_t global_repeats;	/* original -R value before phase overrides */
 	uint32_t global_pps;		/* original -r value before phase overrides */
 	uint8_t global_recv_timeout;	/* original -L value before phase overrides */
+	uint16_t retry_gap;		/* --selective-retry, ms before the second -R round */
 
 	SCANSETTINGS *ss;
 
@@ -195,8 +196,19 @@ typedef struct settings_s {
 	int ipv6_lookup;
 
 	char *pcap_dumpfile;
+	uint32_t pcap_dumpsize;		/* rotate the savefile after this many MB, 0 never	*/
+	uint32_t pcap_dumpsecs;		/* rotate the savefile after this many seconds, 0 never	*/
+	uint32_t pcap_dumpsnap;		/* truncate logged frames to this length, 0 no cap	*/
 	char *pcap_readfile;
 	char *extra_pcapfilter;
+	char *progress_sock;		/* unix socket the master publishes progress lines on	*/
+	char *metrics_uri;		/* where the master serves prometheus metrics		*/
+	uint64_t *metrics;		/* MET_ counter slots, see unilib/metrics.h		*/
+	char *daemon_sock;		/* unix socket daemon mode takes jobs on		*/
+	uint8_t daemon_jobs;		/* jobs the daemon runs at once				*/
+	uint16_t stream_mb;		/* size of the --stream duplicate filter		*/
+	uint32_t spill_mb;		/* results past this many MB go to disk, 0 never	*/
+	char *dns_server;		/* reverse lookups go here, addr[:port] or system	*/
 
 	uint16_t master_tickrate;
 
@@ -267,6 +279,8 @@ extern settings_t *s;
 #define S_BROKEN_TRANS		8
 #define S_BROKEN_NET		16
 #define S_SENDER_INTR		32	/* we can interrupt the sender with new work (high priority)		*/
+#define S_TSTAMP_CLOCK		64	/* tcp timestamp option carries our ms clock, for rtt measurement	*/
+#define S_SELECT_RETRY		128	/* -R rounds after the first skip targets that already answered	*/
 
 #define GET_SHUFFLE()		(s->send_opts & S_SHUFFLE_PORTS)
 #define GET_OVERRIDE()		(s->send_opts & S_SRC_OVERRIDE)
@@ -274,6 +288,8 @@ extern settings_t *s;
 #define GET_BROKENTRANS()	(s->send_opts & S_BROKEN_TRANS)
 #define GET_BROKENNET()		(s->send_opts & S_BROKEN_NET)
 #define GET_SENDERINTR()	(s->send_opts & S_SENDER_INTR)
+#define GET_TSTAMPCLOCK()	(s->send_opts & S_TSTAMP_CLOCK)
+#define GET_SELECTRETRY()	(s->send_opts & S_SELECT_RETRY)
 
 #define SET_SHUFFLE(x)		((x) ? (s->send_opts |= S_SHUFFLE_PORTS)   : (s->send_opts &= ~(S_SHUFFLE_PORTS)))
 #define SET_OVERRIDE(x)		((x) ? (s->send_opts |= S_SRC_OVERRIDE)    : (s->send_opts &= ~(S_SRC_OVERRIDE)))
@@ -281,6 +297,8 @@ extern settings_t *s;
 #define SET_BROKENTRANS(x)	((x) ? (s->send_opts |= S_BROKEN_TRANS)    : (s->send_opts &= ~(S_BROKEN_TRANS)))
 #define SET_BROKENNET(x)	((x) ? (s->send_opts |= S_BROKEN_NET)      : (s->send_opts &= ~(S_BROKEN_NET)))
 #define SET_SENDERINTR(x)	((x) ? (s->send_opts |= S_SENDER_INTR)     : (s->send_opts &= ~(S_SENDER_INTR)))
+#define SET_TSTAMPCLOCK(x)	((x) ? (s->send_opts |= S_TSTAMP_CLOCK)    : (s->send_opts &= ~(S_TSTAMP_CLOCK)))
+#define SET_SELECTRETRY(x)	((x) ? (s->send_opts |= S_SELECT_RETRY)    : (s->send_opts &= ~(S_SELECT_RETRY)))
 
 /*
  * master thread constants
@@ -296,6 +314,10 @@ extern settings_t *s;
 #define M_DO_DNS		256	/* in reporting, do reverse dns lookups (at least)			*/
 #define M_DO_TRANS		512	/* translate open/closed						*/
 #define M_PROC_DUPS		1024	/* chain duplicate report structures					*/
+#define M_IPC_SHM		2048	/* talk to local children over shared memory rings			*/
+#define M_PIPELINE		4096	/* compound mode, probe arp responders while arp is still going	*/
+#define M_ADAPTIVE_WAIT		8192	/* end the recv timeout early once measured rtts have passed		*/
+#define M_STREAM		16384	/* results are written as they come, nothing is kept for the end	*/
 
 #define GET_PROCERRORS()	(s->options & M_PROC_ERRORS)
 #define GET_IMMEDIATE()		(s->options & M_IMMEDIATE)
@@ -308,6 +330,10 @@ extern settings_t *s;
 #define GET_DODNS()		(s->options & M_DO_DNS)
 #define GET_DOTRANS()		(s->options & M_DO_TRANS)
 #define GET_PROCDUPS()		(s->options & M_PROC_DUPS)
+#define GET_IPCSHM()		(s->options & M_IPC_SHM)
+#define GET_PIPELINE()		(s->options & M_PIPELINE)
+#define GET_ADAPTIVEWAIT()	(s->options & M_ADAPTIVE_WAIT)
+#define GET_STREAM()		(s->options & M_STREAM)
 
 #define SET_PROCERRORS(x)	((x) ? (s->options |= M_PROC_ERRORS)  : (s->options &= ~(M_PROC_ERRORS)))
 #define SET_IMMEDIATE(x)	((x) ? (s->options |= M_IMMEDIATE)    : (s->options &= ~(M_IMMEDIATE)))
@@ -320,6 +346,10 @@ extern settings_t *s;
 #define SET_DODNS(x)		((x) ? (s->options |= M_DO_DNS)       : (s->options &= ~(M_DO_DNS)))
 #define SET_DOTRANS(x)		((x) ? (s->options |= M_DO_TRANS)     : (s->options &= ~(M_DO_TRANS)))
 #define SET_PROCDUPS(x)		((x) ? (s->options |= M_PROC_DUPS)    : (s->options &= ~(M_PROC_DUPS)))
+#define SET_IPCSHM(x)		((x) ? (s->options |= M_IPC_SHM)      : (s->options &= ~(M_IPC_SHM)))
+#define SET_PIPELINE(x)		((x) ? (s->options |= M_PIPELINE)     : (s->options &= ~(M_PIPELINE)))
+#define SET_ADAPTIVEWAIT(x)	((x) ? (s->options |= M_ADAPTIVE_WAIT) : (s->options &= ~(M_ADAPTIVE_WAIT)))
+#define SET_STREAM(x)		((x) ? (s->options |= M_STREAM)       : (s->options &= ~(M_STREAM)))
 
 /*
  * recv thread constants
@@ -330,6 +360,8 @@ extern settings_t *s;
 #define L_IGNORE_RSEQ		8	/* ignore reset seq's, report anyhow (if watch errors is set anyhow)	*/
 #define L_IGNORE_SEQ		16	/* ignore ALL seq's...							*/
 #define L_SNIFF			32	/* display packet parsing information					*/
+#define L_ARP_ALSO		64	/* take arp replies too, for a pipelined compound scan			*/
+#define L_MEASURE_RTT		128	/* keep an rtt histogram from echoed tcp timestamps			*/
 
 #define GET_WATCHERRORS()	(s->recv_opts & L_WATCH_ERRORS)
 #define GET_PROMISC()		(s->recv_opts & L_USE_PROMISC)
@@ -337,6 +369,8 @@ extern settings_t *s;
 #define GET_IGNORERSEQ()	(s->recv_opts & L_IGNORE_RSEQ)
 #define GET_IGNORESEQ()		(s->recv_opts & L_IGNORE_SEQ)
 #define GET_SNIFF()		(s->recv_opts & L_SNIFF)
+#define GET_ARPALSO()		(s->recv_opts & L_ARP_ALSO)
+#define GET_MEASURERTT()	(s->recv_opts & L_MEASURE_RTT)
 
 #define SET_WATCHERRORS(x)	((x) ? (s->recv_opts |= L_WATCH_ERRORS) : (s->recv_opts &= ~(L_WATCH_ERRORS)))
 #define SET_PROMISC(x)		((x) ? (s->recv_opts |= L_USE_PROMISC)  : (s->recv_opts &= ~(L_USE_PROMISC)))
@@ -344,6 +378,8 @@ extern settings_t *s;
 #define SET_IGNORERSEQ(x)	((x) ? (s->recv_opts |= L_IGNORE_RSEQ)  : (s->recv_opts &= ~(L_IGNORE_RSEQ)))
 #define SET_IGNORESEQ(x)	((x) ? (s->recv_opts |= L_IGNORE_SEQ)   : (s->recv_opts &= ~(L_IGNORE_SEQ)))
 #define SET_SNIFF(x)		((x) ? (s->recv_opts |= L_SNIFF)        : (s->recv_opts &= ~(L_SNIFF)))
+#define SET_ARPALSO(x)		((x) ? (s->recv_opts |= L_ARP_ALSO)     : (s->recv_opts &= ~(L_ARP_ALSO)))
+#define SET_MEASURERTT(x)	((x) ? (s->recv_opts |= L_MEASURE_RTT)  : (s->recv_opts &= ~(L_MEASURE_RTT)))
 
 char *stroptions (uint16_t );
 char *strrecvopts(uint16_t );
@@ -0,0 +1,998 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#include <config.h>
+#include <getopt.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <scan_progs/scanopts.h>
+#include <scan_progs/scan_export.h>
+#include <settings.h>
+
+#include <unilib/output.h>
+#include <unilib/xmalloc.h>
+#include <unilib/pktutil.h>
+
+#include <output_modules/journal/journal.h>
+
+/*
+ * unijournal: turns result journals written by the journal output module
+ * back into text, JSON lines or CSV, or into a psql script that bulk
+ * loads them into the pgsqldb schema with COPY.  journals are mmaped and
+ * walked in place, nothing is copied on the way in.  scans can append to
+ * a journal at the same time, so each scan is read back by walking on
+ * from its scan record picking out the records with its number
+ */
+
+int ident;
+const char *ident_name_ptr;
+settings_t *s=NULL;
+
+#define OUT_TEXT	1
+#define OUT_JSON	2
+#define OUT_CSV		3
+#define OUT_SQL		4
+
+#define OUTBUF_SIZE	(1024 * 1024)
+
+typedef struct jmap_t {
+	const char *file;
+	uint8_t *base;		/* PROT_READ */
+	size_t len;
+	size_t start;		/* first record */
+	size_t end;		/* past the last whole record */
+} jmap_t;
+
+/* one scan's records, in the order they were appended */
+typedef struct jscan_t {
+	size_t start;		/* its JRN_REC_SCAN */
+	size_t off;
+	uint16_t scan;
+	int done;
+} jscan_t;
+
+static int outfmt=OUT_TEXT;
+static FILE *outfp=NULL;
+static unsigned int scan_no=0;
+
+static void usage(void) _NORETURN_;
+static int jmap_open(const char *, jmap_t *);
+static void jmap_close(jmap_t *);
+static const jrn_rec_t *jmap_next(const jmap_t *, size_t *);
+static void jscan_start(const jmap_t *, size_t, jscan_t *);
+static const jrn_rec_t *jscan_next(const jmap_t *, jscan_t *);
+static void dump_record(const jrn_rec_t *);
+static void sql_journal(const jmap_t *);
+
+static void usage(void) {
+
+	fprintf(stderr, "usage: unijournal [-f text|json|csv|sql] [-o file] [-h] journal [journal ...]\n"
+		"\t-f\toutput format, default text\n"
+		"\t\t  text\tone line per result, close to unicornscan's own\n"
+		"\t\t  json\tone JSON object per line\n"
+		"\t\t  csv\tone row per result (and per trace hop), with a header\n"
+		"\t\t  sql\ta psql script that loads each scan into the pgsqldb schema, try\n"
+		"\t\t\t  unijournal -f sql scans.ujrn | psql -v ON_ERROR_STOP=1 dbname\n"
+		"\t-o\twrite to file instead of stdout\n"
+		"\t-h\tthis help\n");
+
+	exit(1);
+}
+
+int main(int argc, char **argv) {
+	jmap_t jm;
+	jscan_t js;
+	const jrn_rec_t *rec=NULL;
+	size_t off=0, at=0;
+	char *outbuf=NULL;
+	int ch=0, ret=0;
+
+	ident=IDENT_ANY;
+	ident_name_ptr="Jrnl";
+
+	s=(settings_t *)xmalloc(sizeof(settings_t));
+	memset(s, 0, sizeof(settings_t));
+	s->_stdout=stdout;
+	s->_stderr=stderr;
+
+	outfp=stdout;
+
+	while ((ch=getopt(argc, argv, "f:o:h")) != -1) {
+		switch (ch) {
+			case 'f':
+				if (strcmp(optarg, "text") == 0) {
+					outfmt=OUT_TEXT;
+				}
+				else if (strcmp(optarg, "json") == 0) {
+					outfmt=OUT_JSON;
+				}
+				else if (strcmp(optarg, "csv") == 0) {
+					outfmt=OUT_CSV;
+				}
+				else if (strcmp(optarg, "sql") == 0) {
+					outfmt=OUT_SQL;
+				}
+				else {
+					usage();
+				}
+				break;
+
+			case 'o':
+				outfp=fopen(optarg, "w");
+				if (outfp == NULL) {
+					ERR("cant open output file `%s': %s", optarg, strerror(errno));
+					exit(1);
+				}
+				break;
+
+			case 'h':
+			default:
+				usage();
+				break;
+		}
+	}
+
+	if (optind >= argc) {
+		usage();
+	}
+
+	outbuf=(char *)xmalloc(OUTBUF_SIZE);
+	setvbuf(outfp, outbuf, _IOFBF, OUTBUF_SIZE);
+
+	if (outfmt == OUT_CSV) {
+		fprintf(outfp, "record,scan,tstamp,utstamp,host_addr,hwaddr,proto,sport,dport,type,subtype,state,"
+			"ttl,window_size,trace_addr,hop_number,rtt_us,banner,os\n");
+	}
+	else if (outfmt == OUT_SQL) {
+		fprintf(outfp, "-- generated by unijournal\n\\set ON_ERROR_STOP 1\nset standard_conforming_strings = on;\n");
+	}
+
+	for (; optind < argc; optind++) {
+		if (jmap_open(argv[optind], &jm) < 0) {
+			ret=1;
+			continue;
+		}
+
+		if (outfmt == OUT_SQL) {
+			sql_journal(&jm);
+		}
+		else {
+			for (off=jm.start; off < jm.end; ) {
+				at=off;
+				rec=jmap_next(&jm, &off);
+				if (rec->type != JRN_REC_SCAN) {
+					continue;
+				}
+				scan_no++;
+				for (jscan_start(&jm, at, &js); (rec=jscan_next(&jm, &js)) != NULL; ) {
+					dump_record(rec);
+				}
+			}
+		}
+
+		jmap_close(&jm);
+	}
+
+	if (fflush(outfp) != 0) {
+		ERR("write fails: %s", strerror(errno));
+		ret=1;
+	}
+	if (outfp != stdout) {
+		fclose(outfp);
+	}
+
+	exit(ret);
+}
+
+static int jmap_open(const char *file, jmap_t *jm) {
+	struct stat sb;
+	jrn_file_t hdr;
+	const jrn_rec_t *rec=NULL;
+	void *map=NULL;
+	int fd=-1;
+
+	memset(jm, 0, sizeof(*jm));
+	jm->file=file;
+
+	fd=open(file, O_RDONLY);
+	if (fd < 0) {
+		ERR("cant open `%s': %s", file, strerror(errno));
+		return -1;
+	}
+
+	if (fstat(fd, &sb) < 0 || (size_t)sb.st_size < sizeof(jrn_file_t)) {
+		ERR("`%s' is too short to be a result journal", file);
+		close(fd);
+		return -1;
+	}
+
+	map=mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		ERR("cant mmap `%s': %s", file, strerror(errno));
+		return -1;
+	}
+
+#ifdef MADV_SEQUENTIAL
+	madvise(map, (size_t)sb.st_size, MADV_SEQUENTIAL);
+#endif
+
+	jm->base=(uint8_t *)map;
+	jm->len=(size_t)sb.st_size;
+
+	memcpy(&hdr, jm->base, sizeof(hdr));
+	if (hdr.magic != JRN_MAGIC) {
+		ERR("`%s' is not a result journal", file);
+		jmap_close(jm);
+		return -1;
+	}
+	if (hdr.order != JRN_ORDER) {
+		ERR("`%s' was written on a host with the other byte order", file);
+		jmap_close(jm);
+		return -1;
+	}
+	if (hdr.version != JRN_VERSION || hdr.hdr_len < sizeof(jrn_file_t) || hdr.hdr_len > jm->len) {
+		ERR("`%s' is journal version %u, this reads version %u", file, hdr.version, JRN_VERSION);
+		jmap_close(jm);
+		return -1;
+	}
+
+	jm->start=hdr.hdr_len;
+
+	/*
+	 * a scan that died mid write can leave a torn record at the end (the
+	 * next scan to append cuts it off), say so once and read up to it
+	 */
+	for (jm->end=jm->start; jm->end + sizeof(jrn_rec_t) <= jm->len; jm->end += rec->len) {
+		rec=(const jrn_rec_t *)(jm->base + jm->end);
+		if (rec->len < sizeof(jrn_rec_t) || (rec->len % JRN_ALIGN) != 0 || rec->len > jm->len - jm->end) {
+			break;
+		}
+	}
+	if (jm->end != jm->len) {
+		ERR("`%s': torn record at offset " STFMT ", stopping there", file, jm->end);
+	}
+
+	return 1;
+}
+
+static void jmap_close(jmap_t *jm) {
+
+	if (jm->base != NULL) {
+		munmap(jm->base, jm->len);
+		jm->base=NULL;
+	}
+
+	return;
+}
+
+/* the record at *off, advancing *off past it, NULL at the end of the whole records */
+static const jrn_rec_t *jmap_next(const jmap_t *jm, size_t *off) {
+	const jrn_rec_t *rec=NULL;
+
+	if (*off >= jm->end) {
+		return NULL;
+	}
+
+	rec=(const jrn_rec_t *)(jm->base + *off);
+	*off += rec->len;
+
+	return rec;
+}
+
+static void jscan_start(const jmap_t *jm, size_t start, jscan_t *js) {
+	const jrn_rec_t *rec=NULL;
+
+	rec=(const jrn_rec_t *)(jm->base + start);
+
+	js->start=start;
+	js->off=start;
+	js->scan=rec->scan;
+	js->done=0;
+
+	return;
+}
+
+/*
+ * the next record of the scan, NULL after its end record, or at the next
+ * scan record with the same number (the numbers wrapped, or it never ended)
+ */
+static const jrn_rec_t *jscan_next(const jmap_t *jm, jscan_t *js) {
+	const jrn_rec_t *rec=NULL;
+	size_t at=0;
+
+	while (! js->done) {
+		at=js->off;
+		rec=jmap_next(jm, &js->off);
+		if (rec == NULL) {
+			js->done=1;
+			break;
+		}
+		if (rec->scan != js->scan) {
+			continue;
+		}
+		if (rec->type == JRN_REC_SCAN && at != js->start) {
+			js->done=1;
+			break;
+		}
+		if (rec->type == JRN_REC_END) {
+			js->done=1;
+		}
+		return rec;
+	}
+
+	return NULL;
+}
+
+/*
+ * records carry lengths for what follows them, make sure the record is
+ * really that long before anyone reads it
+ */
+static int rec_fits(const jrn_rec_t *rec, size_t fixed, size_t var) {
+
+	if (rec->len < fixed || rec->len - fixed < var) {
+		ERR("record type %u is shorter than its contents claim, skipping", rec->type);
+		return 0;
+	}
+
+	return 1;
+}
+
+static const char *ip4_str(uint32_t addr, char *buf, size_t blen) {
+	struct in_addr ia;
+
+	ia.s_addr=addr;
+	inet_ntop(AF_INET, &ia, buf, blen);
+
+	return buf;
+}
+
+static const char *mac_str(const uint8_t *mac, char *buf, size_t blen) {
+
+	snprintf(buf, blen, "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+	return buf;
+}
+
+static const char *proto_str(uint8_t proto) {
+
+	switch (proto) {
+		case IPPROTO_TCP:
+			return "TCP";
+		case IPPROTO_UDP:
+			return "UDP";
+		case IPPROTO_ICMP:
+			return "ICMP";
+		default:
+			break;
+	}
+
+	return "IP";
+}
+
+/* the same open/closed call report.c makes */
+static const char *state_str(const jrn_ip_t *r) {
+
+	switch (r->proto) {
+		case IPPROTO_TCP:
+			if ((r->type & (TH_SYN|TH_ACK)) == (TH_SYN|TH_ACK)) {
+				return "open";
+			}
+			if ((r->type & (TH_ACK|TH_RST)) == (TH_ACK|TH_RST)) {
+				return "closed";
+			}
+			break;
+
+		case IPPROTO_UDP:
+			return "open";
+
+		case IPPROTO_ICMP:
+			if (r->type == 3 && r->subtype == 3) {
+				return "closed";
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	return "other";
+}
+
+/* banners are whatever the far end sent, keep them on one line */
+static void put_text_str(const char *str, size_t len) {
+	size_t j=0;
+
+	for (j=0; j < len; j++) {
+		fputc(isprint((unsigned char)str[j]) ? str[j] : '.', outfp);
+	}
+
+	return;
+}
+
+static void put_json_str(const char *str, size_t len) {
+	size_t j=0;
+	unsigned char c=0;
+
+	fputc('"', outfp);
+	for (j=0; j < len; j++) {
+		c=(unsigned char)str[j];
+		if (c == '"' || c == '\\') {
+			fputc('\\', outfp);
+			fputc(c, outfp);
+		}
+		else if (c < 0x20 || c == 0x7f) {
+			fprintf(outfp, "\\u%04x", c);
+		}
+		else {
+			fputc(c, outfp);
+		}
+	}
+	fputc('"', outfp);
+
+	return;
+}
+
+static void put_csv_str(const char *str, size_t len) {
+	size_t j=0;
+
+	fputc('"', outfp);
+	for (j=0; j < len; j++) {
+		if (str[j] == '"') {
+			fputc('"', outfp);
+		}
+		fputc(str[j], outfp);
+	}
+	fputc('"', outfp);
+
+	return;
+}
+
+static void dump_scan(const jrn_scan_t *r) {
+	const char *str=(const char *)r + sizeof(jrn_scan_t);
+	static const char *names[JRN_STR_MAX]={ "profile", "drones", "modules", "user", "interface", "ports", "targets" };
+	size_t var=0;
+	time_t t=0;
+	int j=0;
+
+	for (j=0; j < JRN_STR_MAX; j++) {
+		var += r->str_len[j];
+	}
+	if (!rec_fits(&r->rec, sizeof(jrn_scan_t), var)) {
+		return;
+	}
+
+	switch (outfmt) {
+		case OUT_TEXT:
+			t=(time_t)r->s_time;
+			fprintf(outfp, "# scan %u %s started %s", scan_no, strscanmode(r->mode), ctime(&t));
+			for (j=0; j < JRN_STR_MAX; str += r->str_len[j], j++) {
+				if (r->str_len[j] > 0) {
+					fprintf(outfp, "#\t%s %.*s\n", names[j], (int)r->str_len[j], str);
+				}
+			}
+			break;
+
+		case OUT_JSON:
+			fprintf(outfp, "{\"record\":\"scan\",\"scan\":%u,\"s_time\":%llu,\"est_e_time\":%llu,\"mode\":%u,"
+				"\"options\":%u,\"send_opts\":%u,\"recv_opts\":%u,\"pps\":%u,\"repeats\":%u,"
+				"\"num_hosts\":%.0f,\"num_packets\":%.0f",
+				scan_no, (unsigned long long)r->s_time, (unsigned long long)r->est_e_time, r->mode,
+				r->options, r->send_opts, r->recv_opts, r->pps, r->repeats,
+				r->num_hosts, r->num_packets);
+			for (j=0; j < JRN_STR_MAX; str += r->str_len[j], j++) {
+				fprintf(outfp, ",\"%s\":", names[j]);
+				put_json_str(str, r->str_len[j]);
+			}
+			fprintf(outfp, "}\n");
+			break;
+
+		default:
+			/* csv is results only */
+			break;
+	}
+
+	return;
+}
+
+static void dump_ip(const jrn_ip_t *r) {
+	const char *banner=(const char *)r + sizeof(jrn_ip_t), *os=banner + r->banner_len;
+	char host[32], trace[32], mac[32];
+
+	if (!rec_fits(&r->rec, sizeof(jrn_ip_t), (size_t)r->banner_len + r->os_len + r->pkt_len)) {
+		return;
+	}
+
+	ip4_str(r->host_addr, host, sizeof(host));
+	ip4_str(r->trace_addr, trace, sizeof(trace));
+	mac[0]='\0';
+	if (r->eth_hwaddr_valid) {
+		mac_str(r->eth_hwaddr, mac, sizeof(mac));
+	}
+
+	switch (outfmt) {
+		case OUT_TEXT:
+			if (r->proto == IPPROTO_ICMP) {
+				fprintf(outfp, "ICMP:T%02uC%02u\tfrom %s", r->type, r->subtype, host);
+			}
+			else if (r->proto == IPPROTO_TCP && strcmp(state_str(r), "other") == 0) {
+				fprintf(outfp, "TCP%s\t[%5u]\tfrom %s", strtcpflgs(r->type), r->sport, host);
+			}
+			else {
+				fprintf(outfp, "%s %s\t[%5u]\tfrom %s", proto_str(r->proto), state_str(r), r->sport, host);
+			}
+			if (r->trace_addr != r->host_addr) {
+				fprintf(outfp, " (via %s)", trace);
+			}
+			fprintf(outfp, " ttl %u", r->ttl);
+			if (r->banner_len > 0) {
+				fprintf(outfp, " Banner: `");
+				put_text_str(banner, r->banner_len);
+				fputc('\'', outfp);
+			}
+			if (r->os_len > 0) {
+				fprintf(outfp, " OS: `");
+				put_text_str(os, r->os_len);
+				fputc('\'', outfp);
+			}
+			fputc('\n', outfp);
+			break;
+
+		case OUT_JSON:
+			fprintf(outfp, "{\"record\":\"ip\",\"scan\":%u,\"tstamp\":%u,\"utstamp\":%u,\"host_addr\":\"%s\","
+				"\"trace_addr\":\"%s\",\"proto\":%u,\"sport\":%u,\"dport\":%u,\"type\":%u,\"subtype\":%u,"
+				"\"state\":\"%s\",\"ttl\":%u,\"window_size\":%u,\"mseq\":%u,\"tseq\":%u,\"flags\":%u",
+				scan_no, r->tv_sec, r->tv_usec, host,
+				trace, r->proto, r->sport, r->dport, r->type, r->subtype,
+				state_str(r), r->ttl, r->window_size, r->mseq, r->tseq, r->flags);
+			if (r->eth_hwaddr_valid) {
+				fprintf(outfp, ",\"hwaddr\":\"%s\"", mac);
+			}
+			if (r->banner_len > 0) {
+				fprintf(outfp, ",\"banner\":");
+				put_json_str(banner, r->banner_len);
+			}
+			if (r->os_len > 0) {
+				fprintf(outfp, ",\"os\":");
+				put_json_str(os, r->os_len);
+			}
+			fprintf(outfp, "}\n");
+			break;
+
+		case OUT_CSV:
+			/* the listener's local port is sport, as in the reports */
+			fprintf(outfp, "ip,%u,%u,%u,%s,%s,%u,%u,%u,%u,%u,%s,%u,%u,%s,,,", scan_no, r->tv_sec, r->tv_usec,
+				host, mac, r->proto, r->sport, r->dport, r->type, r->subtype, state_str(r),
+				r->ttl, r->window_size, trace);
+			put_csv_str(banner, r->banner_len);
+			fputc(',', outfp);
+			put_csv_str(os, r->os_len);
+			fputc('\n', outfp);
+			break;
+
+		default:
+			break;
+	}
+
+	return;
+}
+
+static void dump_arp(const jrn_arp_t *r) {
+	char host[32], mac[32];
+
+	if (!rec_fits(&r->rec, sizeof(jrn_arp_t), r->pkt_len)) {
+		return;
+	}
+
+	ip4_str(r->ipaddr, host, sizeof(host));
+	mac_str(r->hwaddr, mac, sizeof(mac));
+
+	switch (outfmt) {
+		case OUT_TEXT:
+			fprintf(outfp, "ARP\t%s is %s\n", host, mac);
+			break;
+
+		case OUT_JSON:
+			fprintf(outfp, "{\"record\":\"arp\",\"scan\":%u,\"tstamp\":%u,\"utstamp\":%u,\"host_addr\":\"%s\",\"hwaddr\":\"%s\"}\n",
+				scan_no, r->tv_sec, r->tv_usec, host, mac);
+			break;
+
+		case OUT_CSV:
+			fprintf(outfp, "arp,%u,%u,%u,%s,%s,,,,,,,,,,,,,\n", scan_no, r->tv_sec, r->tv_usec, host, mac);
+			break;
+
+		default:
+			break;
+	}
+
+	return;
+}
+
+static void dump_trace(const jrn_trace_t *r) {
+	const jrn_hop_t *hop=(const jrn_hop_t *)((const uint8_t *)r + sizeof(jrn_trace_t));
+	char target[32], router[32];
+	unsigned int j=0;
+
+	if (!rec_fits(&r->rec, sizeof(jrn_trace_t), (size_t)r->hop_count * sizeof(jrn_hop_t))) {
+		return;
+	}
+
+	ip4_str(r->target_addr, target, sizeof(target));
+
+	switch (outfmt) {
+		case OUT_TEXT:
+			fprintf(outfp, "trace to %s:%u, %u hops%s\n", target, r->target_port, r->hop_count,
+				r->complete ? "" : " (incomplete)");
+			for (j=0; j < r->hop_count; j++) {
+				fprintf(outfp, "\t%2u  %-15s  %u.%03u ms\n", hop[j].hop_number,
+					ip4_str(hop[j].router_addr, router, sizeof(router)),
+					hop[j].rtt_us / 1000, hop[j].rtt_us % 1000);
+			}
+			break;
+
+		case OUT_JSON:
+			fprintf(outfp, "{\"record\":\"trace\",\"scan\":%u,\"target_addr\":\"%s\",\"target_port\":%u,\"complete\":%s,\"hops\":[",
+				scan_no, target, r->target_port, r->complete ? "true" : "false");
+			for (j=0; j < r->hop_count; j++) {
+				fprintf(outfp, "%s{\"hop_number\":%u,\"router_addr\":\"%s\",\"rtt_us\":%u}", j ? "," : "",
+					hop[j].hop_number, ip4_str(hop[j].router_addr, router, sizeof(router)), hop[j].rtt_us);
+			}
+			fprintf(outfp, "]}\n");
+			break;
+
+		case OUT_CSV:
+			for (j=0; j < r->hop_count; j++) {
+				fprintf(outfp, "hop,%u,,,%s,,,,%u,,,,,,%s,%u,%u,,\n", scan_no, target, r->target_port,
+					ip4_str(hop[j].router_addr, router, sizeof(router)), hop[j].hop_number, hop[j].rtt_us);
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	return;
+}
+
+static void dump_record(const jrn_rec_t *rec) {
+	union {
+		const jrn_rec_t *rec;
+		const jrn_scan_t *scan;
+		const jrn_end_t *end;
+		const jrn_ip_t *ip;
+		const jrn_arp_t *arp;
+		const jrn_trace_t *trace;
+	} r_u;
+
+	r_u.rec=rec;
+
+	switch (rec->type) {
+		case JRN_REC_SCAN:
+			dump_scan(r_u.scan);
+			break;
+
+		case JRN_REC_END:
+			if (!rec_fits(rec, sizeof(jrn_end_t), 0)) {
+				break;
+			}
+			if (outfmt == OUT_TEXT) {
+				time_t t=(time_t)r_u.end->e_time;
+
+				fprintf(outfp, "# scan %u done, %llu results, ended %s", scan_no,
+					(unsigned long long)r_u.end->records, ctime(&t));
+			}
+			else if (outfmt == OUT_JSON) {
+				fprintf(outfp, "{\"record\":\"end\",\"scan\":%u,\"e_time\":%llu,\"records\":%llu}\n", scan_no,
+					(unsigned long long)r_u.end->e_time, (unsigned long long)r_u.end->records);
+			}
+			break;
+
+		case JRN_REC_IP:
+			dump_ip(r_u.ip);
+			break;
+
+		case JRN_REC_ARP:
+			dump_arp(r_u.arp);
+			break;
+
+		case JRN_REC_TRACE:
+			dump_trace(r_u.trace);
+			break;
+
+		default:
+			/* newer writer, skip what we dont know */
+			break;
+	}
+
+	return;
+}
+
+/*
+ * psql script.  each scan becomes one transaction: a uni_scan row, its
+ * results COPYed into temp tables that draw report ids from the real
+ * sequences, then moved into the schema's tables with set based inserts.
+ * the mmaped scan is walked once per table, which costs nothing next to
+ * the database and keeps each COPY block contiguous
+ */
+static void sql_lit(const char *str, size_t len) {
+	size_t j=0;
+
+	fputc('\'', outfp);
+	for (j=0; j < len; j++) {
+		if (str[j] == '\'') {
+			fputc('\'', outfp);
+		}
+		fputc(str[j], outfp);
+	}
+	fputc('\'', outfp);
+
+	return;
+}
+
+/* a field in COPY text format */
+static void copy_str(const char *str, size_t len) {
+	size_t j=0;
+	unsigned char c=0;
+
+	if (len == 0) {
+		fputs("\\N", outfp);
+		return;
+	}
+
+	for (j=0; j < len; j++) {
+		c=(unsigned char)str[j];
+		if (c == '\\') {
+			fputs("\\\\", outfp);
+		}
+		else if (c < 0x20 || c == 0x7f) {
+			fprintf(outfp, "\\%03o", c);
+		}
+		else {
+			fputc(c, outfp);
+		}
+	}
+
+	return;
+}
+
+static void copy_bytea(const uint8_t *data, size_t len) {
+	static const char hex[]="0123456789abcdef";
+	size_t j=0;
+
+	if (len == 0) {
+		fputs("\\N", outfp);
+		return;
+	}
+
+	fputs("\\\\x", outfp);
+	for (j=0; j < len; j++) {
+		fputc(hex[data[j] >> 4], outfp);
+		fputc(hex[data[j] & 0xf], outfp);
+	}
+
+	return;
+}
+
+static const char *mode_str(uint8_t mode) {
+
+	switch (mode) {
+		case MODE_TCPSCAN:
+			return "T";
+		case MODE_UDPSCAN:
+			return "U";
+		case MODE_ARPSCAN:
+			return "A";
+		case MODE_ICMPSCAN:
+			return "I";
+		case MODE_IPSCAN:
+			return "P";
+		case MODE_TCPTRACE:
+			return "tr";
+		default:
+			break;
+	}
+
+	return "?";
+}
+
+static void sql_scan(const jmap_t *jm, size_t start) {
+	union {
+		const jrn_rec_t *rec;
+		const jrn_scan_t *scan;
+		const jrn_end_t *end;
+		const jrn_ip_t *ip;
+		const jrn_arp_t *arp;
+		const jrn_trace_t *trace;
+	} r_u;
+	const jrn_scan_t *sc=NULL;
+	const char *str[JRN_STR_MAX];
+	jscan_t js;
+	uint64_t e_time=0;
+	char a1[32], a2[32], a3[32], mac[32];
+	size_t var=0;
+	unsigned int j=0;
+
+	jscan_start(jm, start, &js);
+	r_u.rec=jscan_next(jm, &js);
+	sc=r_u.scan;
+	for (j=0; j < JRN_STR_MAX; j++) {
+		var += sc->str_len[j];
+	}
+	if (!rec_fits(r_u.rec, sizeof(jrn_scan_t), var)) {
+		return;
+	}
+	str[0]=(const char *)sc + sizeof(jrn_scan_t);
+	for (j=1; j < JRN_STR_MAX; j++) {
+		str[j]=str[j - 1] + sc->str_len[j - 1];
+	}
+
+	e_time=sc->est_e_time;
+	for (jscan_start(jm, start, &js); (r_u.rec=jscan_next(jm, &js)) != NULL; ) {
+		if (r_u.rec->type == JRN_REC_END && rec_fits(r_u.rec, sizeof(jrn_end_t), 0)) {
+			e_time=r_u.end->e_time;
+		}
+	}
+
+	fprintf(outfp, "\n-- `%s' scan %u\nbegin;\n", jm->file, scan_no);
+	fprintf(outfp, "insert into uni_scan (s_time, e_time, est_e_time, senders, listeners, scan_iter, profile, "
+		"options, payload_group, dronestr, covertness, modules, \"user\", tickrate, num_hosts, num_packets, "
+		"mode_str, mode_flags, num_phases, port_str, interface, tcpflags, send_opts, recv_opts, pps, "
+		"recv_timeout, repeats, target_str)\nvalues (%llu, %llu, %llu, %u, %u, %u, ",
+		(unsigned long long)sc->s_time, (unsigned long long)e_time, (unsigned long long)sc->est_e_time,
+		sc->senders, sc->listeners, sc->scan_iter);
+	sql_lit(str[JRN_STR_PROFILE], sc->str_len[JRN_STR_PROFILE]);
+	fprintf(outfp, ", %u, %u, ", sc->options, sc->payload_group);
+	sql_lit(str[JRN_STR_DRONES], sc->str_len[JRN_STR_DRONES]);
+	fprintf(outfp, ", %u, ", sc->covertness);
+	sql_lit(str[JRN_STR_MODULES], sc->str_len[JRN_STR_MODULES]);
+	fprintf(outfp, ", ");
+	sql_lit(str[JRN_STR_USER], sc->str_len[JRN_STR_USER]);
+	fprintf(outfp, ", %u, %f, %f, '%s', %u, %u, ", sc->tickrate, sc->num_hosts, sc->num_packets,
+		mode_str(sc->mode), sc->mode, sc->num_phases);
+	sql_lit(str[JRN_STR_PORTS], sc->str_len[JRN_STR_PORTS]);
+	fprintf(outfp, ", ");
+	sql_lit(str[JRN_STR_INTERFACE], sc->str_len[JRN_STR_INTERFACE]);
+	fprintf(outfp, ", %u, %u, %u, %u, %u, %u, ", sc->tcphdrflgs, sc->send_opts, sc->recv_opts, sc->pps,
+		sc->recv_timeout, sc->repeats);
+	sql_lit(str[JRN_STR_TARGETS], sc->str_len[JRN_STR_TARGETS]);
+	fprintf(outfp, ")\nreturning scan_id as jrn_scan_id \\gset\n");
+
+	fprintf(outfp, "create temp table jrn_ip (ipreport_id int8 default nextval('uni_ipreport_id_seq'), "
+		"sport int4, dport int4, proto int2, type int4, subtype int4, send_addr inet, host_addr inet, "
+		"trace_addr inet, ttl int2, tstamp int8, utstamp int8, flags int4, mseq int8, tseq int8, "
+		"window_size int4, t_tstamp int8, m_tstamp int8, eth_hwaddr macaddr, banner text, os text, "
+		"packet bytea) on commit drop;\n"
+		"copy jrn_ip (sport, dport, proto, type, subtype, send_addr, host_addr, trace_addr, ttl, tstamp, "
+		"utstamp, flags, mseq, tseq, window_size, t_tstamp, m_tstamp, eth_hwaddr, banner, os, packet) from stdin;\n");
+	for (jscan_start(jm, start, &js); (r_u.rec=jscan_next(jm, &js)) != NULL; ) {
+		const char *banner=NULL;
+
+		if (r_u.rec->type != JRN_REC_IP ||
+		    !rec_fits(r_u.rec, sizeof(jrn_ip_t), (size_t)r_u.ip->banner_len + r_u.ip->os_len + r_u.ip->pkt_len)) {
+			continue;
+		}
+		banner=(const char *)r_u.ip + sizeof(jrn_ip_t);
+
+		fprintf(outfp, "%u\t%u\t%u\t%u\t%u\t%s\t%s\t%s\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t%u\t",
+			r_u.ip->sport, r_u.ip->dport, r_u.ip->proto, r_u.ip->type, r_u.ip->subtype,
+			ip4_str(r_u.ip->send_addr, a1, sizeof(a1)), ip4_str(r_u.ip->host_addr, a2, sizeof(a2)),
+			ip4_str(r_u.ip->trace_addr, a3, sizeof(a3)), r_u.ip->ttl, r_u.ip->tv_sec, r_u.ip->tv_usec,
+			r_u.ip->flags, r_u.ip->mseq, r_u.ip->tseq, r_u.ip->window_size, r_u.ip->t_tstamp, r_u.ip->m_tstamp);
+		fputs(r_u.ip->eth_hwaddr_valid ? mac_str(r_u.ip->eth_hwaddr, mac, sizeof(mac)) : "\\N", outfp);
+		fputc('\t', outfp);
+		copy_str(banner, r_u.ip->banner_len);
+		fputc('\t', outfp);
+		copy_str(banner + r_u.ip->banner_len, r_u.ip->os_len);
+		fputc('\t', outfp);
+		copy_bytea((const uint8_t *)banner + r_u.ip->banner_len + r_u.ip->os_len, r_u.ip->pkt_len);
+		fputc('\n', outfp);
+	}
+	fprintf(outfp, "\\.\n");
+
+	fprintf(outfp, "create temp table jrn_arp (arpreport_id int8 default nextval('uni_arpreport_id_seq'), "
+		"host_addr inet, hwaddr macaddr, tstamp int8, utstamp int8, packet bytea) on commit drop;\n"
+		"copy jrn_arp (host_addr, hwaddr, tstamp, utstamp, packet) from stdin;\n");
+	for (jscan_start(jm, start, &js); (r_u.rec=jscan_next(jm, &js)) != NULL; ) {
+		if (r_u.rec->type != JRN_REC_ARP || !rec_fits(r_u.rec, sizeof(jrn_arp_t), r_u.arp->pkt_len)) {
+			continue;
+		}
+		fprintf(outfp, "%s\t%s\t%u\t%u\t", ip4_str(r_u.arp->ipaddr, a1, sizeof(a1)),
+			mac_str(r_u.arp->hwaddr, mac, sizeof(mac)), r_u.arp->tv_sec, r_u.arp->tv_usec);
+		copy_bytea((const uint8_t *)r_u.arp + sizeof(jrn_arp_t), r_u.arp->pkt_len);
+		fputc('\n', outfp);
+	}
+	fprintf(outfp, "\\.\n");
+
+	fprintf(outfp, "create temp table jrn_hop (target_addr inet, hop_addr inet, hop_number int2, rtt_us int4) on commit drop;\n"
+		"copy jrn_hop from stdin;\n");
+	for (jscan_start(jm, start, &js); (r_u.rec=jscan_next(jm, &js)) != NULL; ) {
+		const jrn_hop_t *hop=NULL;
+
+		if (r_u.rec->type != JRN_REC_TRACE ||
+		    !rec_fits(r_u.rec, sizeof(jrn_trace_t), (size_t)r_u.trace->hop_count * sizeof(jrn_hop_t))) {
+			continue;
+		}
+		hop=(const jrn_hop_t *)((const uint8_t *)r_u.trace + sizeof(jrn_trace_t));
+		ip4_str(r_u.trace->target_addr, a1, sizeof(a1));
+		for (j=0; j < r_u.trace->hop_count; j++) {
+			fprintf(outfp, "%s\t%s\t%u\t%u\n", a1, ip4_str(hop[j].router_addr, a2, sizeof(a2)),
+				hop[j].hop_number, hop[j].rtt_us);
+		}
+	}
+	fprintf(outfp, "\\.\n");
+
+	fprintf(outfp,
+		"insert into uni_ipreport (ipreport_id, scan_id, magic, sport, dport, proto, type, subtype, send_addr, "
+		"host_addr, trace_addr, ttl, tstamp, utstamp, flags, mseq, tseq, window_size, t_tstamp, m_tstamp, eth_hwaddr)\n"
+		"\tselect ipreport_id, :jrn_scan_id, %u, sport, dport, proto, type, subtype, send_addr, host_addr, "
+		"trace_addr, ttl, tstamp, utstamp, flags, mseq, tseq, window_size, t_tstamp, m_tstamp, eth_hwaddr from jrn_ip;\n"
+		"insert into uni_ipreportdata (ipreport_id, type, data) select ipreport_id, 1, banner from jrn_ip where banner is not null;\n"
+		"insert into uni_ipreportdata (ipreport_id, type, data) select ipreport_id, 2, os from jrn_ip where os is not null;\n"
+		"insert into uni_ippackets (ipreport_id, packet) select ipreport_id, packet from jrn_ip where packet is not null;\n",
+		IP_REPORT_MAGIC);
+	if (sc->mode != MODE_TCPTRACE) {
+		fprintf(outfp,
+			"insert into uni_hops (ipreport_id, scan_id, target_addr, hop_addr, ttl_observed)\n"
+			"\tselect ipreport_id, :jrn_scan_id, host_addr, trace_addr, ttl from jrn_ip "
+			"where trace_addr <> host_addr and trace_addr <> '0.0.0.0';\n");
+	}
+	fprintf(outfp,
+		"insert into uni_arpreport (arpreport_id, scan_id, magic, host_addr, hwaddr, tstamp, utstamp)\n"
+		"\tselect arpreport_id, :jrn_scan_id, %u, host_addr, hwaddr, tstamp, utstamp from jrn_arp;\n"
+		"insert into uni_arppackets (arpreport_id, packet) select arpreport_id, packet from jrn_arp where packet is not null;\n"
+		"insert into uni_hops (scan_id, target_addr, hop_addr, hop_number, ttl_observed, rtt_us)\n"
+		"\tselect :jrn_scan_id, target_addr, hop_addr, hop_number, hop_number, rtt_us from jrn_hop;\n",
+		ARP_REPORT_MAGIC);
+	/* the per host tables pgsqldb keeps up as it goes, here once per host */
+	fprintf(outfp,
+		"insert into uni_host_scans (host_id, scan_id, first_response, response_count)\n"
+		"\tselect fn_upsert_host(h.host_addr, h.hwaddr), :jrn_scan_id, now(), h.n from (\n"
+		"\t\tselect host_addr, (array_agg(hwaddr) filter (where hwaddr is not null))[1] as hwaddr, count(*) as n from (\n"
+		"\t\t\tselect host_addr, eth_hwaddr as hwaddr from jrn_ip union all select host_addr, hwaddr from jrn_arp\n"
+		"\t\t) r group by host_addr\n"
+		"\t) h\n"
+		"\ton conflict (host_id, scan_id) do update set response_count = uni_host_scans.response_count + excluded.response_count;\n"
+		"select fn_record_mac_ip(host_addr, hwaddr, :jrn_scan_id) from (\n"
+		"\tselect distinct host_addr, eth_hwaddr as hwaddr from jrn_ip where eth_hwaddr is not null\n"
+		"\tunion select distinct host_addr, hwaddr from jrn_arp\n"
+		") m \\g /dev/null\n"
+		"commit;\n");
+
+	return;
+}
+
+static void sql_journal(const jmap_t *jm) {
+	const jrn_rec_t *rec=NULL;
+	size_t off=0, at=0;
+
+	for (off=jm->start; off < jm->end; ) {
+		at=off;
+		rec=jmap_next(jm, &off);
+		if (rec->type == JRN_REC_SCAN) {
+			scan_no++;
+			sql_scan(jm, at);
+		}
+	}
+
+	return;
+}
@@ -71,6 +71,7 @@
 #define CONF_DIR	SYSCONFDIR "/" TARGETNAME
 
 #define CONF_FILE	CONF_DIR "/%s.conf"
+#define CONF_CACHE	CONF_DIR "/%s.cache"
 #define DEF_PROFILE	"unicorn"
 
 #define PORT_NUMBERS	CONF_DIR "/ports.txt"
@@ -82,7 +83,6 @@
 /* may or may not be used, depending */
 #define CHROOT_DIR LOCALSTATEDIR "/" TARGETNAME
 
-#define MAX_CONNS	32	/* MAX amount of ipc or pollable connections	*/
 #define IPC_DSIZE	65536	/* MAX amount of bytes for an ipc message chunk	*/
 
 /*
@@ -93,12 +93,14 @@
 # define _PRINTF45_ __attribute__((format(printf, 4, 5)))
 # define _PRINTF45NR_ __attribute__((format(printf, 4, 5), noreturn))
 # define _PRINTF12NR_ __attribute__((format(printf, 1, 2), noreturn))
+# define _PRINTF23_ __attribute__((format(printf, 2, 3)))
 # define _NORETURN_ __attribute__((noreturn))
 #else
 # define _PACKED_
 # define _PRINTF45_
 # define _PRINTF45NR_
 # define _PRINTF12NR_
+# define _PRINTF23_
 # define _NORETURN_
 #endif
 
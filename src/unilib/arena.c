@@ -0,0 +1,144 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#include <config.h>
+
+#include <unilib/xmalloc.h>
+#include <unilib/arena.h>
+
+#define ARENA_MAGIC	(uint32_t)0x4172e9a1
+#define ARENA_ALIGN(x)	(((x) + 7) & ~((size_t)7))
+
+typedef struct arena_chunk_t {
+	struct arena_chunk_t *next;
+	size_t size;
+	size_t off;
+	/* the memory follows, offset by ARENA_ALIGN(sizeof(arena_chunk_t)) */
+} arena_chunk_t;
+
+typedef struct arena_head_t {
+	uint32_t magic;
+	size_t chunk;
+	size_t used;
+	arena_chunk_t *cur;
+	arena_chunk_t *full;
+} arena_head_t;
+
+static arena_chunk_t *arena_newchunk(size_t size) {
+	arena_chunk_t *c=NULL;
+
+	c=(arena_chunk_t *)xmalloc(ARENA_ALIGN(sizeof(arena_chunk_t)) + size);
+	c->next=NULL;
+	c->size=size;
+	c->off=0;
+
+	return c;
+}
+
+void *arena_init(size_t chunk) {
+	arena_head_t *a=NULL;
+
+	a=(arena_head_t *)xmalloc(sizeof(arena_head_t));
+	memset(a, 0, sizeof(arena_head_t));
+
+	a->magic=ARENA_MAGIC;
+	a->chunk=(chunk == 0 ? ARENA_CHUNK : ARENA_ALIGN(chunk));
+
+	return a;
+}
+
+void *arena_alloc(void *ah, size_t len) {
+	union {
+		void *ptr;
+		arena_head_t *a;
+	} a_u;
+	arena_chunk_t *c=NULL;
+	void *ret=NULL;
+
+	assert(ah != NULL);
+	a_u.ptr=ah;
+	assert(a_u.a->magic == ARENA_MAGIC);
+
+	len=ARENA_ALIGN(len == 0 ? 1 : len);
+
+	/* too big to share a chunk with anything, it gets its own on the full list */
+	if (len > a_u.a->chunk / 4) {
+		c=arena_newchunk(len);
+		c->off=len;
+		c->next=a_u.a->full;
+		a_u.a->full=c;
+		a_u.a->used += len;
+
+		return (uint8_t *)c + ARENA_ALIGN(sizeof(arena_chunk_t));
+	}
+
+	if (a_u.a->cur == NULL || (a_u.a->cur->size - a_u.a->cur->off) < len) {
+		if (a_u.a->cur != NULL) {
+			a_u.a->cur->next=a_u.a->full;
+			a_u.a->full=a_u.a->cur;
+		}
+		a_u.a->cur=arena_newchunk(a_u.a->chunk);
+	}
+
+	c=a_u.a->cur;
+	ret=(uint8_t *)c + ARENA_ALIGN(sizeof(arena_chunk_t)) + c->off;
+	c->off += len;
+	a_u.a->used += len;
+
+	return ret;
+}
+
+size_t arena_used(void *ah) {
+	union {
+		void *ptr;
+		arena_head_t *a;
+	} a_u;
+
+	assert(ah != NULL);
+	a_u.ptr=ah;
+	assert(a_u.a->magic == ARENA_MAGIC);
+
+	return a_u.a->used;
+}
+
+void arena_destroy(void *ah) {
+	union {
+		void *ptr;
+		arena_head_t *a;
+	} a_u;
+	arena_chunk_t *c=NULL, *next=NULL;
+
+	if (ah == NULL) {
+		return;
+	}
+	a_u.ptr=ah;
+	assert(a_u.a->magic == ARENA_MAGIC);
+
+	if (a_u.a->cur != NULL) {
+		xfree(a_u.a->cur);
+	}
+	for (c=a_u.a->full; c != NULL; c=next) {
+		next=c->next;
+		xfree(c);
+	}
+
+	a_u.a->magic=0;
+	xfree(a_u.a);
+
+	return;
+}
@@ -0,0 +1,35 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#ifndef _ARENA_H
+# define _ARENA_H
+
+/*
+ * bump allocator for things that all die together.  memory comes from big
+ * chunks and is only ever given back all at once with arena_destroy, there
+ * is no free for a single allocation
+ */
+
+#define ARENA_CHUNK	(1024 * 1024)
+
+void   *arena_init(size_t /* chunk size, 0 for ARENA_CHUNK */);
+void   *arena_alloc(void * /* arena */, size_t /* bytes, 8 byte aligned */);
+size_t  arena_used(void * /* arena */);
+void    arena_destroy(void * /* arena */);
+
+#endif
@@ -239,17 +239,25 @@ void drone_destroylist(void) {
 int drone_poll(int timeout) {
 	int ret=0;
 	uint32_t d_offset=0;
-	xpoll_t p[MAX_CONNS];
+	static xpoll_t *p=NULL;
+	static uint32_t p_size=0;
 	drone_t *d=NULL;
 
 	if (s->dlh == NULL) {
 		PANIC("drone head NULL");
 	}
 
-	for (d=s->dlh->head, d_offset=0; d != NULL; d=d->next, d_offset++) {
-		if (d_offset > MAX_CONNS) {
-			PANIC("too many drones bob");
+	/* only ever grows, the drone list doesnt shrink during a run */
+	if (p == NULL || p_size < s->dlh->size) {
+		if (p != NULL) {
+			xfree(p);
 		}
+		p_size=(s->dlh->size > 0 ? s->dlh->size : 1);
+		p=(xpoll_t *)xmalloc(sizeof(xpoll_t) * p_size);
+	}
+
+	for (d=s->dlh->head, d_offset=0; d != NULL; d=d->next, d_offset++) {
+		assert(d_offset < p_size);
 		p[d_offset].fd=d->s;
 	}
 
@@ -276,7 +284,7 @@ void drone_updatestate(drone_t *d, int status) {
 
 	d->status=status;
 	shutdown(d->s, SHUT_RDWR);
-	close(d->s);
+	socktrans_close(d->s);
 	d->s=-1;
 	d->s_rw=0;
 
@@ -295,6 +303,93 @@ void drone_updatestate(drone_t *d, int status) {
 
 }
 
+static uint64_t prog_last=0;
+static time_t prog_tlast=0;
+
+void drone_progress_start(uint64_t done) {
+
+	prog_last=done;
+	prog_tlast=time(NULL);
+
+	return;
+}
+
+int drone_progress_due(uint64_t done) {
+	time_t tnow=0;
+
+	if (done - prog_last >= DRONE_PROGRESS_ITER) {
+		drone_progress_start(done);
+		return 1;
+	}
+
+	/*
+	 * always look at the clock, even when done hasnt moved, a sender stuck on
+	 * one host (slow -r with ttl or payload loops) or pausing between -R
+	 * rounds still has to tell the master its alive
+	 */
+	tnow=time(NULL);
+	if (tnow - prog_tlast >= DRONE_PROGRESS_SECS) {
+		drone_progress_start(done);
+		return 1;
+	}
+
+	return 0;
+}
+
+int drone_progress_wait(uint64_t done, int ms, int (*poll_master)(int), void (*progress)(void)) {
+	struct timeval now, until;
+	int left=0, step=0;
+
+	assert(poll_master != NULL && progress != NULL);
+
+	gettimeofday(&until, NULL);
+	until.tv_sec += ms / 1000;
+	until.tv_usec += (ms % 1000) * 1000;
+	if (until.tv_usec >= 1000000) {
+		until.tv_sec++;
+		until.tv_usec -= 1000000;
+	}
+
+	do {
+		gettimeofday(&now, NULL);
+		left=(int)((until.tv_sec - now.tv_sec) * 1000 + (until.tv_usec - now.tv_usec) / 1000);
+		if (left < 0) {
+			left=0;
+		}
+		step=(left > DRONE_PROGRESS_SECS * 1000 ? DRONE_PROGRESS_SECS * 1000 : left);
+
+		if (poll_master(step) < 0) {
+			return -1;
+		}
+		if (drone_progress_due(done)) {
+			progress();
+		}
+	} while (left > 0);
+
+	return 1;
+}
+
+uint64_t drone_progress_skip(uint64_t *skip, uint64_t pass) {
+	uint64_t ret=0;
+
+	assert(skip != NULL);
+
+	ret=(*skip < pass ? *skip : pass);
+	*skip -= ret;
+
+	return ret;
+}
+
+int drone_islocal(const drone_t *d) {
+	assert(d != NULL && d->uri != NULL);
+
+	if (strncmp(d->uri, "unix:", 5) == 0 || strncmp(d->uri, "shm:", 4) == 0) {
+		return 1;
+	}
+
+	return 0;
+}
+
 static int drone_validateuri(const char *uri) {
 	char host[256];
 	uint16_t port=0;
@@ -307,6 +402,11 @@ static int drone_validateuri(const char *uri) {
 		return 1;
 	}
 
+	/* local drone over shared memory, the path is its handshake socket */
+	if (sscanf(uri, "shm:%255s", host) == 1) {
+		return 1;
+	}
+
 	if (sscanf(uri, "%255[a-zA-Z0-9\\-_.]:%hu", host, &port) == 2) {
 		DBG(M_DRN, "drone host `%s' port %hu is valid!", host, port);
 		return 1;
@@ -41,6 +41,20 @@ typedef struct drone_t {
 
 	uint32_t pps;
 
+	/* running totals for the progress display, see scan_progs/telemetry.c */
+	uint64_t pkts_done;	/* sent in workunits this drone finished	*/
+	uint64_t pkts_cur;	/* sent so far in the one its working	*/
+	uint32_t recv_pkts;
+	uint32_t recv_drops;	/* pcap		*/
+	uint32_t recv_ifdrops;	/* interface	*/
+	uint32_t queue_depth;	/* reports the listener hasnt shipped yet	*/
+	uint32_t parse_issues;	/* malformed packets, see packet_parse.c	*/
+	uint32_t parse_truncated;
+	uint32_t parse_frags;
+	uint32_t rtt_samples;	/* from the listener, see packet_parse_get_rtt	*/
+	uint32_t rtt_p50;
+	uint32_t rtt_p99;
+
 	char *uri;
 
 	int s;
@@ -78,29 +92,89 @@ typedef struct send_stats_t {
 	uint64_t packets_sent;
 } send_stats_t;
 
+/*
+ * while working a workunit a sender says how far it got every so often
+ * (MSG_PROGRESS), so if it dies the master can give just the rest of the
+ * workunit to another sender.  done counts trips through the innermost
+ * (host) loop since the start of the workunit, resumed ones included,
+ * packets_sent and pps are for the progress display only
+ */
+#define DRONE_PROGRESS_MAGIC	0x4211dcce
+
+typedef struct send_progress_t {
+	uint32_t magic;
+	float pps;		/* since the last report		*/
+	uint64_t done;
+	uint64_t packets_sent;	/* in this workunit, by this sender	*/
+} send_progress_t;
+
+/* a sender reports after this many hosts or this many seconds, whichever is first */
+#define DRONE_PROGRESS_ITER	8192
+#define DRONE_PROGRESS_SECS	1
+
 typedef struct recv_stats_t {
 	uint32_t magic;
 	uint32_t packets_recv;
 	uint32_t packets_dropped;
 	uint32_t interface_dropped;
+	uint32_t dump_dropped;		/* frames the pcap savefile writer could not keep up with */
 } recv_stats_t;
 
+/*
+ * a listener sends one of these as a MSG_PROGRESS about once a second while
+ * it works, the stats are the same running pcap counters MSG_WORKDONE has
+ */
+#define DRONE_RPROGRESS_MAGIC	0x4211dccf
+
+typedef struct recv_progress_t {
+	recv_stats_t st;		/* st.magic is DRONE_RPROGRESS_MAGIC		*/
+	uint32_t queue_depth;		/* reports parsed but not sent to the master yet	*/
+	uint32_t parse_issues;		/* packet_parse malformed packet counters	*/
+	uint32_t parse_truncated;
+	uint32_t parse_frags;
+	uint32_t rtt_samples;		/* rtts measured this workunit, --adaptive-wait	*/
+	uint32_t rtt_p50;		/* ms						*/
+	uint32_t rtt_p99;
+} recv_progress_t;
+
+#define DRONE_RPROGRESS_SECS	1
+
 typedef struct drone_version_t {
 	uint32_t magic;
 #define DRONE_MAGIC 0x533f000d
 	uint8_t  maj;
 	uint16_t min;
-	uint8_t  res;
+	uint8_t  caps;		/* DRONE_CAP_ bits the drone can speak, see wanbatch.h */
 } drone_version_t;
 
 int drone_init(void);
 
+/* sender side, call at the start of a workunit, then after every host (or more), 1 means send a MSG_PROGRESS */
+void drone_progress_start(uint64_t /* done */);
+int drone_progress_due(uint64_t /* done */);
+
+/*
+ * sender side, wait ms milliseconds without going quiet: poll_master is
+ * given at most DRONE_PROGRESS_SECS at a time, progress is called whenever
+ * drone_progress_due says so, -1 if poll_master fails
+ */
+int drone_progress_wait(uint64_t /* done */, int /* ms */, int (*)(int /* timeout ms */), void (*)(void));
+
+/*
+ * resuming at some done count, the part of one pass through the host loop
+ * (of pass hosts) that was already sent, what it returns comes off *skip
+ */
+uint64_t drone_progress_skip(uint64_t * /* skip */, uint64_t /* pass */);
+
 /*
  * takes a string of drones to use for a scan, and constructs the drone_head structure in the settings structure
  */
 int drone_parselist(const char *);
 
 /* droneid or -1 fail */ int drone_add(const char *);
+
+/* 1 if the drone is on this box (unix or shm uri) */
+int drone_islocal(const drone_t *);
 int drone_remove(int /* doneid */);
 
 void drone_dumplist(void);
@@ -0,0 +1,45 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#include <config.h>
+
+#include <settings.h>
+
+#include <unilib/xmalloc.h>
+#include <unilib/metrics.h>
+
+void metrics_init(void) {
+
+	if (s->metrics == NULL) {
+		s->metrics=(uint64_t *)xmalloc(sizeof(uint64_t) * MET_MAX);
+		memset(s->metrics, 0, sizeof(uint64_t) * MET_MAX);
+	}
+
+	return;
+}
+
+uint64_t metrics_get(int idx) {
+
+	assert(idx >= 0 && idx < MET_MAX);
+
+	if (s->metrics == NULL) {
+		return 0;
+	}
+
+	return _METRIC_GET(&s->metrics[idx]);
+}
@@ -0,0 +1,65 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#ifndef _METRICS_H
+# define _METRICS_H
+
+/*
+ * process wide counters for the --metrics endpoint.  the slots hang off
+ * s->metrics so output modules, which carry their own copy of unilib,
+ * still count into the master's.  updates are single relaxed atomic adds
+ * or stores, nothing takes a lock, and with s->metrics NULL (drones) they
+ * cost one compare.  scan_progs/telemetry.c reads them when asked
+ */
+
+#define MET_IPC_MSGS_SENT	0
+#define MET_IPC_MSGS_RECV	1
+#define MET_IPC_BYTES_SENT	2
+#define MET_IPC_BYTES_RECV	3
+#define MET_GEOIP_HITS		4
+#define MET_GEOIP_MISSES	5
+#define MET_GEOIP_CACHED	6
+#define MET_GEOIP_HIT_NS	7
+#define MET_GEOIP_MISS_NS	8
+#define MET_DBQ_DEPTH		9	/* batches waiting on the database writer */
+#define MET_DBQ_BYTES		10
+#define MET_DB_FLUSHES		11
+#define MET_DB_FLUSH_NS		12
+#define MET_DB_FLUSH_LAST_NS	13
+#define MET_DB_STALLS		14	/* times the master waited on a full queue */
+#define MET_DB_STALL_NS		15
+#define MET_MAX			16
+
+#if defined(__GNUC__) && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+# define _METRIC_ADD(p, n)	__atomic_fetch_add((p), (n), __ATOMIC_RELAXED)
+# define _METRIC_SET(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELAXED)
+# define _METRIC_GET(p)		__atomic_load_n((p), __ATOMIC_RELAXED)
+#else
+# define _METRIC_ADD(p, n)	(*(p) += (n))
+# define _METRIC_SET(p, v)	(*(p)=(v))
+# define _METRIC_GET(p)		(*(p))
+#endif
+
+#define METRIC_ADD(idx, n)	do { if (s->metrics != NULL) _METRIC_ADD(&s->metrics[(idx)], (uint64_t)(n)); } while (0)
+#define METRIC_SET(idx, v)	do { if (s->metrics != NULL) _METRIC_SET(&s->metrics[(idx)], (uint64_t)(v)); } while (0)
+
+/* master only, sets up s->metrics */
+void metrics_init(void);
+uint64_t metrics_get(int /* MET_ */);
+
+#endif
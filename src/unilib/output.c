@@ -23,9 +23,27 @@
 #include <settings.h>
 #include <unilib/output.h>
 
+static void (*d_flush)(void)=NULL;
+
+void output_setflush(void (*flush)(void)) {
+
+	d_flush=flush;
+
+	return;
+}
+
 void _display(int type, const char *file, int lineno, const char *fmt, ...) {
 	va_list ap;
 	FILE *output=NULL;
+	void (*flush)(void)=NULL;
+
+	/* whatever is buffered was printed first, and may complain about it itself */
+	if (d_flush != NULL) {
+		flush=d_flush;
+		d_flush=NULL;
+		flush();
+		d_flush=flush;
+	}
 
 	output=s->_stdout;
 
@@ -27,6 +27,9 @@
 
 void _display(int, const char *, int, const char *, ...) _PRINTF45_;
 
+/* called before every _display, so output someone buffers stays in order with ours, NULL for none */
+void output_setflush(void (* /* flush */)(void));
+
 #define M_WRK	1	/* workunit		*/
 #define M_WRKSTR	"workunit"
 #define M_RTE	2	/* route/arp		*/
@@ -0,0 +1,169 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#include <config.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <pcap.h>
+
+#include <settings.h>
+
+#include <unilib/xmalloc.h>
+#include <unilib/output.h>
+#include <unilib/pcapmap.h>
+
+#define PM_MAGIC_USEC		0xa1b2c3d4
+#define PM_MAGIC_NSEC		0xa1b23c4d
+#define PM_MAGIC_USEC_SWAP	0xd4c3b2a1
+#define PM_MAGIC_NSEC_SWAP	0x4d3cb2a1
+
+#define PM_FILEHDR_LEN		24
+#define PM_RECHDR_LEN		16
+
+#define PM_SWAP32(x)	((((x) & 0xff) << 24) | (((x) & 0xff00) << 8) | (((x) >> 8) & 0xff00) | (((x) >> 24) & 0xff))
+
+static uint32_t pm_get32(const pcapmap_t *pm, const uint8_t *ptr) {
+	uint32_t ret=0;
+
+	memcpy(&ret, ptr, sizeof(ret));
+
+	return pm->swapped ? PM_SWAP32(ret) : ret;
+}
+
+pcapmap_t *pcapmap_open(const char *file) {
+	pcapmap_t *pm=NULL;
+	struct stat sb;
+	uint32_t magic=0;
+	void *map=NULL;
+	int fd=-1;
+
+	assert(file != NULL);
+
+	fd=open(file, O_RDONLY);
+	if (fd < 0) {
+		ERR("cant open `%s': %s", file, strerror(errno));
+		return NULL;
+	}
+
+	if (fstat(fd, &sb) < 0 || sb.st_size < PM_FILEHDR_LEN) {
+		DBG(M_PKT, "`%s' is too short to be a pcap file", file);
+		close(fd);
+		return NULL;
+	}
+
+	map=mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		ERR("cant mmap `%s': %s", file, strerror(errno));
+		return NULL;
+	}
+
+#ifdef MADV_SEQUENTIAL
+	madvise(map, (size_t)sb.st_size, MADV_SEQUENTIAL);
+#endif
+
+	pm=(pcapmap_t *)xmalloc(sizeof(pcapmap_t));
+	memset(pm, 0, sizeof(pcapmap_t));
+	pm->base=(uint8_t *)map;
+	pm->len=(size_t)sb.st_size;
+
+	memcpy(&magic, pm->base, sizeof(magic));
+	switch (magic) {
+		case PM_MAGIC_USEC:
+			break;
+		case PM_MAGIC_NSEC:
+			pm->nsec=1;
+			break;
+		case PM_MAGIC_USEC_SWAP:
+			pm->swapped=1;
+			break;
+		case PM_MAGIC_NSEC_SWAP:
+			pm->swapped=1; pm->nsec=1;
+			break;
+		default:
+			/* pcapng or something else, the caller can fall back to libpcap */
+			DBG(M_PKT, "`%s' has magic %08x, not a classic pcap file", file, magic);
+			munmap(map, pm->len);
+			xfree(pm);
+			return NULL;
+	}
+
+	pm->snaplen=pm_get32(pm, pm->base + 16);
+	pm->linktype=(int)(pm_get32(pm, pm->base + 20) & 0x0fffffff);
+	pm->off=PM_FILEHDR_LEN;
+
+	DBG(M_PKT, "mapped `%s' " STFMT " bytes linktype %d snaplen %u%s%s", file, pm->len, pm->linktype,
+		pm->snaplen, pm->swapped ? " swapped" : "", pm->nsec ? " nsec" : "");
+
+	return pm;
+}
+
+int pcapmap_next(pcapmap_t *pm, struct pcap_pkthdr *phdr, const uint8_t **packet) {
+	const uint8_t *rec=NULL;
+	uint32_t caplen=0;
+
+	assert(pm != NULL && phdr != NULL && packet != NULL);
+
+	if (pm->off == pm->len) {
+		return 0;
+	}
+
+	if ((pm->len - pm->off) < PM_RECHDR_LEN) {
+		ERR("truncated pcap record header at offset " STFMT, pm->off);
+		return -1;
+	}
+
+	rec=pm->base + pm->off;
+	caplen=pm_get32(pm, rec + 8);
+
+	if (caplen > (pm->len - pm->off - PM_RECHDR_LEN) || caplen > 0x40000) {
+		ERR("bad pcap record length %u at offset " STFMT, caplen, pm->off);
+		return -1;
+	}
+
+	phdr->ts.tv_sec=pm_get32(pm, rec);
+	phdr->ts.tv_usec=pm_get32(pm, rec + 4);
+	if (pm->nsec) {
+		phdr->ts.tv_usec /= 1000;
+	}
+	phdr->caplen=caplen;
+	phdr->len=pm_get32(pm, rec + 12);
+
+	*packet=rec + PM_RECHDR_LEN;
+
+	pm->off += PM_RECHDR_LEN + caplen;
+	pm->records++;
+
+	return 1;
+}
+
+void pcapmap_close(pcapmap_t *pm) {
+
+	if (pm == NULL) {
+		return;
+	}
+
+	munmap(pm->base, pm->len);
+	xfree(pm);
+
+	return;
+}
@@ -0,0 +1,46 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#ifndef _PCAPMAP_H
+# define _PCAPMAP_H
+
+/*
+ * walks a classic (non pcapng) pcap savefile that has been mmap'ed, handing
+ * back pointers into the mapping so replaying a capture costs no read() or copy
+ */
+
+typedef struct pcapmap_t {
+	uint8_t *base;	/* PROT_READ mapping, never written through	*/
+	size_t len;
+	size_t off;
+	int swapped;	/* file was written on the other endian	*/
+	int nsec;	/* timestamps are nanosecond resolution	*/
+	int linktype;
+	uint32_t snaplen;
+	uint64_t records;
+} pcapmap_t;
+
+/* returns NULL if the file cant be mapped or isnt a classic pcap file */
+pcapmap_t *pcapmap_open(const char * /* file */);
+
+/* 1 record returned, 0 end of file, -1 truncated or corrupt record */
+int pcapmap_next(pcapmap_t *, struct pcap_pkthdr * /* phdr */, const uint8_t ** /* packet */);
+
+void pcapmap_close(pcapmap_t *);
+
+#endif
@@ -48,13 +48,15 @@ char *strsendopts(uint16_t options) {
 
 	snprintf(optstr, sizeof(optstr) -1,
 			"shuffle ports %s, source override %s, def payload %s, broken trans crc %s, "
-			"broken network crc %s, sender interuptable %s",
+			"broken network crc %s, sender interuptable %s, timestamp clock %s, selective retry %s",
 		GET_SHUFFLE()		? "yes" : "no",
 		GET_OVERRIDE()		? "yes" : "no",
 		GET_DEFAULT()		? "yes" : "no",
 		GET_BROKENTRANS()	? "yes" : "no",
 		GET_BROKENNET()		? "yes" : "no",
-		GET_SENDERINTR()	? "yes" : "no"
+		GET_SENDERINTR()	? "yes" : "no",
+		GET_TSTAMPCLOCK()	? "yes" : "no",
+		GET_SELECTRETRY()	? "yes" : "no"
 	);
 
 	return optstr;
@@ -64,13 +66,16 @@ char *strrecvopts(uint16_t options) {
 	static char optstr[512];
 
 	snprintf(optstr, sizeof(optstr) -1,
-			"watch errors %s, promisc mode %s, do connect %s, ignore rseq %s, ignore seq %s, sniff %s",
+			"watch errors %s, promisc mode %s, do connect %s, ignore rseq %s, ignore seq %s, sniff %s, arp also %s, "
+			"measure rtt %s",
 		GET_WATCHERRORS()	? "yes" : "no",
 		GET_PROMISC()		? "yes" : "no",
 		GET_LDOCONNECT()	? "yes" : "no",
 		GET_IGNORERSEQ()	? "yes" : "no",
 		GET_IGNORESEQ()		? "yes" : "no",
-		GET_SNIFF()		? "yes" : "no"
+		GET_SNIFF()		? "yes" : "no",
+		GET_ARPALSO()		? "yes" : "no",
+		GET_MEASURERTT()	? "yes" : "no"
 	);
 
 	return optstr;
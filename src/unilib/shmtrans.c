@@ -0,0 +1,480 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#define _GNU_SOURCE
+#include <config.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include <settings.h>
+
+#include <unilib/output.h>
+#include <unilib/xmalloc.h>
+#include <unilib/shmtrans.h>
+
+#ifdef SHMTRANS_SUPPORTED
+
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#define SHM_MAGIC	0x73686d31	/* shm1 */
+#define SHM_HDRLEN	4096		/* both ring headers, data starts on the next page */
+
+/*
+ * head is only stored by the producer and tail only by the consumer, each on its
+ * own cache line so the two processes dont fight over it.  closed is set by the
+ * producer when it goes away
+ */
+typedef struct shm_ring_t {
+	uint64_t head;
+	uint8_t pad0[56];
+	uint64_t tail;
+	uint8_t pad1[56];
+	uint32_t closed;
+	uint8_t pad2[60];
+} shm_ring_t;
+
+typedef struct shm_hello_t {
+	uint32_t magic;
+	uint32_t ringsize;
+} shm_hello_t;
+
+typedef struct shm_conn_t {
+	int ctl;		/* handshake socket, kept so we notice the peer dying	*/
+	int tx_efd;		/* kicks the peer after we write			*/
+	shm_ring_t *rx;
+	shm_ring_t *tx;
+	uint8_t *rx_data;
+	uint8_t *tx_data;
+	void *map;
+} shm_conn_t;
+
+/* indexed by the rx eventfd, grown to the highest one we have seen, like xipc does */
+static shm_conn_t **conns=NULL;
+static size_t conns_size=0;
+
+static size_t shm_maplen(void);
+static int shm_register(int /* ctl */, int /* rx efd */, int /* tx efd */, void * /* map */, int /* 0 connector 1 acceptor */);
+static int shm_peergone(shm_conn_t *);
+
+static size_t shm_maplen(void) {
+	return SHM_HDRLEN + (2 * (size_t)SHMTRANS_RINGSIZE);
+}
+
+/* ring 0 carries connector -> acceptor, ring 1 the other way */
+static int shm_register(int ctl, int rx_efd, int tx_efd, void *map, int side) {
+	shm_conn_t *c=NULL, **nconns=NULL;
+	size_t nsize=0, j=0;
+	union {
+		void *p;
+		shm_ring_t *r;
+		uint8_t *ptr;
+	} m_u;
+
+	if (rx_efd < 0) {
+		ERR("shm eventfd %d out of range", rx_efd);
+		return -1;
+	}
+
+	if ((size_t)rx_efd >= conns_size) {
+		for (nsize=(conns_size > 0 ? conns_size : 64); nsize <= (size_t)rx_efd; nsize *= 2) {
+			;
+		}
+
+		nconns=(shm_conn_t **)xmalloc(nsize * sizeof(shm_conn_t *));
+		for (j=0; j < nsize; j++) {
+			nconns[j]=(j < conns_size ? conns[j] : NULL);
+		}
+		if (conns != NULL) {
+			xfree(conns);
+		}
+		conns=nconns;
+		conns_size=nsize;
+	}
+
+	m_u.p=map;
+
+	c=(shm_conn_t *)xmalloc(sizeof(shm_conn_t));
+	c->ctl=ctl;
+	c->tx_efd=tx_efd;
+	c->map=map;
+	c->rx=&m_u.r[side == 0 ? 1 : 0];
+	c->tx=&m_u.r[side == 0 ? 0 : 1];
+	c->rx_data=m_u.ptr + SHM_HDRLEN + (side == 0 ? SHMTRANS_RINGSIZE : 0);
+	c->tx_data=m_u.ptr + SHM_HDRLEN + (side == 0 ? 0 : SHMTRANS_RINGSIZE);
+
+	conns[rx_efd]=c;
+
+	DBG(M_SCK, "shm connection on fd %d ctl %d kick %d", rx_efd, ctl, tx_efd);
+
+	return rx_efd;
+}
+
+int shmtrans_connect(int ctl) {
+	int mfd=-1, efd[2]={-1, -1}, fds[3];
+	void *map=NULL;
+	shm_hello_t hello;
+	struct iovec iov;
+	struct msghdr mh;
+	struct cmsghdr *cmh=NULL;
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(fds))];
+	} c_u;
+
+	mfd=memfd_create("unicornscan-ipc", MFD_CLOEXEC);
+	if (mfd < 0) {
+		ERR("memfd_create fails: %s", strerror(errno));
+		return -1;
+	}
+
+	if (ftruncate(mfd, (off_t)shm_maplen()) < 0) {
+		ERR("cant size shm ipc region: %s", strerror(errno));
+		close(mfd);
+		return -1;
+	}
+
+	map=mmap(NULL, shm_maplen(), PROT_READ|PROT_WRITE, MAP_SHARED, mfd, 0);
+	if (map == MAP_FAILED) {
+		ERR("cant map shm ipc region: %s", strerror(errno));
+		close(mfd);
+		return -1;
+	}
+
+	efd[0]=eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+	efd[1]=eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+	if (efd[0] < 0 || efd[1] < 0) {
+		ERR("cant create eventfd: %s", strerror(errno));
+		goto bad;
+	}
+
+	hello.magic=SHM_MAGIC;
+	hello.ringsize=SHMTRANS_RINGSIZE;
+
+	/* region, acceptor wakeup, connector wakeup */
+	fds[0]=mfd;
+	fds[1]=efd[0];
+	fds[2]=efd[1];
+
+	memset(&mh, 0, sizeof(mh));
+	memset(&c_u, 0, sizeof(c_u));
+	iov.iov_base=&hello;
+	iov.iov_len=sizeof(hello);
+	mh.msg_iov=&iov;
+	mh.msg_iovlen=1;
+	mh.msg_control=c_u.buf;
+	mh.msg_controllen=sizeof(c_u.buf);
+
+	cmh=CMSG_FIRSTHDR(&mh);
+	cmh->cmsg_level=SOL_SOCKET;
+	cmh->cmsg_type=SCM_RIGHTS;
+	cmh->cmsg_len=CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmh), fds, sizeof(fds));
+
+	if (sendmsg(ctl, &mh, 0) != (ssize_t)sizeof(hello)) {
+		ERR("cant pass shm ipc region to peer: %s", strerror(errno));
+		goto bad;
+	}
+
+	/* the peer holds its own references now */
+	close(mfd);
+
+	if (shm_register(ctl, efd[1], efd[0], map, 0) < 0) {
+		munmap(map, shm_maplen());
+		close(efd[0]);
+		close(efd[1]);
+		return -1;
+	}
+
+	return efd[1];
+
+bad:
+	munmap(map, shm_maplen());
+	close(mfd);
+	if (efd[0] > -1) close(efd[0]);
+	if (efd[1] > -1) close(efd[1]);
+	return -1;
+}
+
+int shmtrans_accept(int ctl) {
+	int fds[3], nfds=0, j=0;
+	void *map=NULL;
+	shm_hello_t hello;
+	struct iovec iov;
+	struct msghdr mh;
+	struct cmsghdr *cmh=NULL;
+	ssize_t ret=0;
+	union {
+		struct cmsghdr align;
+		char buf[CMSG_SPACE(sizeof(fds))];
+	} c_u;
+
+	memset(&mh, 0, sizeof(mh));
+	memset(&c_u, 0, sizeof(c_u));
+	iov.iov_base=&hello;
+	iov.iov_len=sizeof(hello);
+	mh.msg_iov=&iov;
+	mh.msg_iovlen=1;
+	mh.msg_control=c_u.buf;
+	mh.msg_controllen=sizeof(c_u.buf);
+
+	do {
+		ret=recvmsg(ctl, &mh, MSG_CMSG_CLOEXEC);
+	} while (ret < 0 && errno == EINTR);
+
+	for (cmh=CMSG_FIRSTHDR(&mh); cmh != NULL; cmh=CMSG_NXTHDR(&mh, cmh)) {
+		if (cmh->cmsg_level == SOL_SOCKET && cmh->cmsg_type == SCM_RIGHTS) {
+			nfds=(int)((cmh->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+			if (nfds > 3) {
+				nfds=3;
+			}
+			memcpy(fds, CMSG_DATA(cmh), sizeof(int) * (size_t)nfds);
+			break;
+		}
+	}
+
+	if (ret != (ssize_t)sizeof(hello) || nfds != 3 || hello.magic != SHM_MAGIC) {
+		ERR("bad shm ipc handshake from peer");
+		goto bad;
+	}
+
+	if (hello.ringsize != SHMTRANS_RINGSIZE) {
+		ERR("shm ipc ring size mismatch, peer has %u we have %u", hello.ringsize, SHMTRANS_RINGSIZE);
+		goto bad;
+	}
+
+	map=mmap(NULL, shm_maplen(), PROT_READ|PROT_WRITE, MAP_SHARED, fds[0], 0);
+	if (map == MAP_FAILED) {
+		ERR("cant map shm ipc region: %s", strerror(errno));
+		goto bad;
+	}
+	close(fds[0]);
+
+	if (shm_register(ctl, fds[1], fds[2], map, 1) < 0) {
+		munmap(map, shm_maplen());
+		close(fds[1]);
+		close(fds[2]);
+		return -1;
+	}
+
+	return fds[1];
+
+bad:
+	for (j=0; j < nfds; j++) {
+		close(fds[j]);
+	}
+	return -1;
+}
+
+int shmtrans_isshm(int fd) {
+	return (fd > -1 && (size_t)fd < conns_size && conns[fd] != NULL) ? 1 : 0;
+}
+
+/* a crashed peer never sets closed, but its end of the handshake socket goes away */
+static int shm_peergone(shm_conn_t *c) {
+	char b;
+	ssize_t ret=0;
+
+	if (__atomic_load_n(&c->rx->closed, __ATOMIC_ACQUIRE)) {
+		return 1;
+	}
+
+	ret=recv(c->ctl, &b, 1, MSG_PEEK|MSG_DONTWAIT);
+	if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+		return 1;
+	}
+
+	return 0;
+}
+
+ssize_t shmtrans_read(int fd, void *buf, size_t len) {
+	shm_conn_t *c=NULL;
+	uint64_t head=0, tail=0, cnt=0;
+	size_t avail=0, off=0, first=0;
+	int woke=0;
+	struct pollfd pfd[2];
+
+	assert(shmtrans_isshm(fd) && buf != NULL);
+	c=conns[fd];
+
+	for (;;) {
+		/* clear the wakeup before looking, a write after this will set it again */
+		if (read(fd, &cnt, sizeof(cnt)) == (ssize_t)sizeof(cnt)) {
+			woke=1;
+		}
+
+		tail=c->rx->tail;
+		head=__atomic_load_n(&c->rx->head, __ATOMIC_ACQUIRE);
+
+		if (head != tail) {
+			break;
+		}
+
+		if (shm_peergone(c)) {
+			return 0;
+		}
+
+		if (woke) {
+			/* somebody already took what this wakeup was for */
+			errno=EAGAIN;
+			return -1;
+		}
+
+		pfd[0].fd=fd;
+		pfd[0].events=POLLIN;
+		pfd[1].fd=c->ctl;
+		pfd[1].events=POLLIN;
+		pfd[0].revents=pfd[1].revents=0;
+
+		if (poll(pfd, 2, -1) < 0 && errno != EINTR) {
+			return -1;
+		}
+		if (pfd[1].revents && shm_peergone(c)) {
+			/* might still have written something before it left */
+			woke=1;
+		}
+	}
+
+	avail=(size_t)(head - tail);
+	if (avail > len) {
+		avail=len;
+	}
+
+	off=(size_t)(tail % SHMTRANS_RINGSIZE);
+	first=MIN(avail, SHMTRANS_RINGSIZE - off);
+	memcpy(buf, c->rx_data + off, first);
+	if (first < avail) {
+		memcpy((uint8_t *)buf + first, c->rx_data, avail - first);
+	}
+
+	__atomic_store_n(&c->rx->tail, tail + avail, __ATOMIC_RELEASE);
+
+	return (ssize_t)avail;
+}
+
+ssize_t shmtrans_writev(int fd, const struct iovec *iov, int iovcnt) {
+	shm_conn_t *c=NULL;
+	uint64_t head=0, tail=0, one=1;
+	size_t total=0, off=0, first=0, len=0;
+	useconds_t backoff=10;
+	int j=0;
+
+	assert(shmtrans_isshm(fd) && iov != NULL);
+	c=conns[fd];
+
+	for (j=0; j < iovcnt; j++) {
+		total += iov[j].iov_len;
+	}
+
+	if (total > SHMTRANS_RINGSIZE) {
+		errno=EMSGSIZE;
+		return -1;
+	}
+
+	head=c->tx->head;
+
+	/* a full ring means the reader is already behind, so just back off and look again */
+	for (;;) {
+		tail=__atomic_load_n(&c->tx->tail, __ATOMIC_ACQUIRE);
+		if ((SHMTRANS_RINGSIZE - (size_t)(head - tail)) >= total) {
+			break;
+		}
+		if (shm_peergone(c)) {
+			errno=EPIPE;
+			return -1;
+		}
+		usleep(backoff);
+		if (backoff < 1000) {
+			backoff *= 2;
+		}
+	}
+
+	for (j=0; j < iovcnt; j++) {
+		len=iov[j].iov_len;
+		off=(size_t)(head % SHMTRANS_RINGSIZE);
+		first=MIN(len, SHMTRANS_RINGSIZE - off);
+		memcpy(c->tx_data + off, iov[j].iov_base, first);
+		if (first < len) {
+			memcpy(c->tx_data, (const uint8_t *)iov[j].iov_base + first, len - first);
+		}
+		head += len;
+	}
+
+	__atomic_store_n(&c->tx->head, head, __ATOMIC_RELEASE);
+
+	if (write(c->tx_efd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+		ERR("cant wake shm peer: %s", strerror(errno));
+	}
+
+	return (ssize_t)total;
+}
+
+void shmtrans_close(int fd) {
+	shm_conn_t *c=NULL;
+	uint64_t one=1;
+
+	if (! shmtrans_isshm(fd)) {
+		return;
+	}
+	c=conns[fd];
+	conns[fd]=NULL;
+
+	__atomic_store_n(&c->tx->closed, 1, __ATOMIC_RELEASE);
+	if (write(c->tx_efd, &one, sizeof(one)) < 0) {
+		DBG(M_SCK, "cant wake shm peer on close: %s", strerror(errno));
+	}
+
+	munmap(c->map, shm_maplen());
+	close(c->tx_efd);
+	close(c->ctl);
+	close(fd);
+
+	xfree(c);
+
+	return;
+}
+
+#else /* !SHMTRANS_SUPPORTED, socktrans never hands us anything */
+
+int shmtrans_connect(int ctl) {
+	return ctl;
+}
+
+int shmtrans_accept(int ctl) {
+	return ctl;
+}
+
+int shmtrans_isshm(int fd) {
+	return 0;
+}
+
+ssize_t shmtrans_read(int fd, void *buf, size_t len) {
+	return read(fd, buf, len);
+}
+
+ssize_t shmtrans_writev(int fd, const struct iovec *iov, int iovcnt) {
+	return writev(fd, iov, iovcnt);
+}
+
+void shmtrans_close(int fd) {
+	close(fd);
+}
+
+#endif
@@ -0,0 +1,63 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#ifndef _SHMTRANS_H
+# define _SHMTRANS_H
+
+#include <sys/uio.h>
+
+/*
+ * shm:/path uris, for drones on the same box.  the connecting side (master) dials
+ * the unix socket at path, creates a mapping holding one single producer / single
+ * consumer ring per direction plus an eventfd per direction, and hands all of it to
+ * the drone over the socket.  after that the unix socket is only kept to notice the
+ * peer going away, the ipc framing in xipc.c is the same as on a socket
+ *
+ * the descriptor handed back is the eventfd that fires when the peer has written,
+ * so it can go straight into xpoll like any socket
+ */
+
+#if defined(HAVE_SYS_EVENTFD_H) && defined(HAVE_MEMFD_CREATE)
+# define SHMTRANS_SUPPORTED 1
+#endif
+
+/* bytes of ring per direction, must hold at least one whole ipc message */
+#define SHMTRANS_RINGSIZE	(IPC_DSIZE * 8)
+
+/* takes a connected unix socket, returns the descriptor to use for ipc or -1 */
+int shmtrans_connect(int /* unix socket */);
+
+/* same, for the accepting (drone) side */
+int shmtrans_accept(int /* unix socket */);
+
+/* 1 if this ipc descriptor is a shm connection */
+int shmtrans_isshm(int /* fd */);
+
+/*
+ * read(2) alike, blocks until there is something, 0 is eof, -1 with errno EAGAIN
+ * means a wakeup arrived but its data was already picked up by an earlier read
+ */
+ssize_t shmtrans_read(int /* fd */, void * /* buf */, size_t /* len */);
+
+/* writev(2) alike, the whole message goes into the ring or nothing does */
+ssize_t shmtrans_writev(int /* fd */, const struct iovec * /* iov */, int /* iovcnt */);
+
+/* tells the peer we are gone and releases everything, including fd */
+void shmtrans_close(int /* fd */);
+
+#endif
@@ -33,12 +33,14 @@
 
 #include <unilib/output.h>
 #include <unilib/sockpath.h>
+#include <unilib/shmtrans.h>
 
 /* Static buffers for path storage */
 static char sockdir_buf[PATH_MAX];
 static char sender_uri_buf[PATH_MAX + 16];
 static char listener_uri_buf[PATH_MAX + 16];
 static int sockdir_initialized = 0;
+static int sock_instance = 0;
 
 /*
  * Create directory with specified permissions.
@@ -144,6 +146,25 @@ const char *sockpath_get_dir(void) {
 	return sockdir_buf;
 }
 
+/*
+ * shm: still binds a unix socket at the same path for the handshake,
+ * so cleanup below doesnt care which one is in use
+ */
+static const char *sockpath_scheme(void) {
+#ifdef SHMTRANS_SUPPORTED
+	if (GET_IPCSHM()) {
+		return "shm";
+	}
+#endif
+	return "unix";
+}
+
+void sockpath_set_instance(int instance) {
+
+	sock_instance = instance;
+	DBG(M_SCK, "socket instance %d", instance);
+}
+
 const char *sockpath_get_sender(void) {
 	const char *dir;
 
@@ -152,7 +173,12 @@ const char *sockpath_get_sender(void) {
 		return NULL;
 	}
 
-	snprintf(sender_uri_buf, sizeof(sender_uri_buf), "unix:%s/send", dir);
+	if (sock_instance > 0) {
+		snprintf(sender_uri_buf, sizeof(sender_uri_buf), "%s:%s/send.%d", sockpath_scheme(), dir, sock_instance);
+	}
+	else {
+		snprintf(sender_uri_buf, sizeof(sender_uri_buf), "%s:%s/send", sockpath_scheme(), dir);
+	}
 	return sender_uri_buf;
 }
 
@@ -164,7 +190,12 @@ const char *sockpath_get_listener(void) {
 		return NULL;
 	}
 
-	snprintf(listener_uri_buf, sizeof(listener_uri_buf), "unix:%s/listen", dir);
+	if (sock_instance > 0) {
+		snprintf(listener_uri_buf, sizeof(listener_uri_buf), "%s:%s/listen.%d", sockpath_scheme(), dir, sock_instance);
+	}
+	else {
+		snprintf(listener_uri_buf, sizeof(listener_uri_buf), "%s:%s/listen", sockpath_scheme(), dir);
+	}
 	return listener_uri_buf;
 }
 
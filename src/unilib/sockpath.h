@@ -59,6 +59,13 @@ const char *sockpath_get_sender(void);
  */
 const char *sockpath_get_listener(void);
 
+/*
+ * Give the sender and listener sockets a .N suffix, so several masters
+ * with their own local drones (daemon workers) dont step on each other.
+ * 0, the default, means no suffix.
+ */
+void sockpath_set_instance(int instance);
+
 /*
  * Clean up stale socket files from the socket directory.
  * This is called at startup to remove any leftover sockets from previous runs.
@@ -35,8 +35,12 @@
 
 #include <unilib/output.h>
 #include <unilib/xmalloc.h>
+#include <unilib/shmtrans.h>
+#include <unilib/xipc.h>
+#include <unilib/xpoll.h>
 
 static uint16_t lbind=BINDPORT_START;
+static int shm_bsock=-1; /* the bound socket wants a shm handshake after accept */
 
 static void accept_timeout(int ); /* signal handler */
 static int accept_timedout=0;
@@ -48,7 +52,7 @@ static int socktrans_makeinetsock(int /* family */, int /* bind port */);
 static int socktrans_makeunixsock(void);
 
 int socktrans_connect(const char *uri) {
-	int rsock=0;
+	int rsock=0, ptype=0;
 	struct sockaddr_in c_sin;
 	struct sockaddr_un c_sun;
 
@@ -72,7 +76,7 @@ int socktrans_connect(const char *uri) {
 			return -1;
 		}
 	}
-	else if (socktrans_strtopath(uri, &c_sun) == 1) {
+	else if ((ptype=socktrans_strtopath(uri, &c_sun)) > 0) {
 
 		if ((rsock=socktrans_makeunixsock()) < 0) {
 			return -1;
@@ -87,6 +91,15 @@ int socktrans_connect(const char *uri) {
 			}
 			PANIC("unix connect fails: %s", strerror(errno));
 		}
+
+		if (ptype == 2) {
+			int shm_fd=-1;
+
+			if ((shm_fd=shmtrans_connect(rsock)) < 0) {
+				close(rsock);
+			}
+			return shm_fd;
+		}
 	}
 
 	return rsock;
@@ -97,6 +110,7 @@ int socktrans_bind(const char *uri) {
 	struct sockaddr_in bsin;
 	struct sockaddr_un bsun;
 	char addr_str[INET_ADDRSTRLEN];
+	int ptype=0;
 
 	assert(uri != NULL);
 
@@ -112,7 +126,7 @@ int socktrans_bind(const char *uri) {
 			return -1;
 		}
 	}
-	else if (socktrans_strtopath(uri, &bsun) == 1) {
+	else if ((ptype=socktrans_strtopath(uri, &bsun)) > 0) {
 		struct stat sb;
 
 		if ((s_sock=socktrans_makeunixsock()) < 0) {
@@ -129,6 +143,10 @@ int socktrans_bind(const char *uri) {
 			ERR("bind() path `%s' fails: %s", bsun.sun_path, strerror(errno));
 			return -1;
 		}
+
+		if (ptype == 2) {
+			shm_bsock=s_sock;
+		}
 	}
 
 	return s_sock;
@@ -219,16 +237,38 @@ doover:
 
 	close(bsock);
 
+	if (bsock == shm_bsock) {
+		int shm_fd=-1;
+
+		shm_bsock=-1;
+		if ((shm_fd=shmtrans_accept(cli_fd)) < 0) {
+			close(cli_fd);
+		}
+		return shm_fd;
+	}
+
 	return cli_fd;
 }
 
 void socktrans_close(int sock) {
+	/* the fd number is about to be free for reuse, nothing may remember it */
+	xpoll_forget(sock);
+	ipc_close(sock);
+
+	if (shmtrans_isshm(sock)) {
+		shmtrans_close(sock);
+		return;
+	}
 	if (sock > -1) close(sock);
 }
 
 int socktrans_immediate(int isock, int flag) {
 	int param=0;
 
+	if (shmtrans_isshm(isock)) {
+		return 1;
+	}
+
 	if (flag) {
 		param=1;
 	}
@@ -306,6 +346,18 @@ static int socktrans_strtopath(const char *uri, struct sockaddr_un *isun) {
 		return 1;
 	}
 
+	/* shm is a unix socket for the handshake, then the rings */
+	if (sscanf(uri, "shm:%95s", upath) == 1) {
+		memcpy(isun->sun_path, upath, MIN((sizeof(isun->sun_path) - 1), strlen(upath)));
+		isun->sun_family=AF_UNIX;
+#ifdef SHMTRANS_SUPPORTED
+		return 2;
+#else
+		DBG(M_SCK, "shared memory ipc isnt supported here, using a unix socket for `%s'", upath);
+		return 1;
+#endif
+	}
+
 	return -1;
 }
 
@@ -19,6 +19,11 @@
 #ifndef _SOCKTRANS_H
 # define _SOCKTRANS_H
 
+/*
+ * uris are host:port, unix:/path or shm:/path, shm hands back a descriptor
+ * that only works with the xipc functions and socktrans_close
+ */
+
 /* returns socket */
 int socktrans_connect(const char * /* uri */);
 
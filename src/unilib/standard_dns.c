@@ -19,8 +19,13 @@
 #include <config.h>
 #include <settings.h>
 
+#include <errno.h>
+#include <ctype.h>
+#include <poll.h>
+
 #include <unilib/xmalloc.h>
 #include <unilib/cidr.h>
+#include <unilib/prng.h>
 #include <unilib/standard_dns.h>
 #include <unilib/output.h>
 
@@ -28,12 +33,76 @@
 #define EXACT		1
 #define CHECK_WILDCARD(x)	(0)
 
+/*
+ * ipv4 reverse lookups dont go through getnameinfo one at a time, they are
+ * PTR queries we send ourselves over one udp socket, up to STDDNS_INFLIGHT
+ * at once, with the answers (names and nxdomains both) kept for their ttl.
+ * stddns_prefetch starts a lookup without waiting for it, stddns_poll moves
+ * things along, stddns_getname only waits if the answer isnt back yet
+ */
+#define STDDNS_INFLIGHT		256	/* the low byte of the query id is the slot	*/
+#define STDDNS_TIMEOUT_MS	1500
+#define STDDNS_TRIES		3
+#define STDDNS_MINTTL		60
+#define STDDNS_MAXTTL		86400
+#define STDDNS_NEGTTL		300	/* nxdomain without a soa to go by	*/
+#define STDDNS_FAILTTL		60	/* servfail, timeouts			*/
+#define STDDNS_INITSIZE		1024
+
+#define PTR_EMPTY		0
+#define PTR_QUEUED		1
+#define PTR_INFLIGHT		2
+#define PTR_OK			3
+#define PTR_NONE		4
+
+typedef struct ptr_ent_t {
+	uint32_t addr;		/* network order		*/
+	uint8_t state;		/* PTR_				*/
+	uint8_t tries;
+	uint16_t slot;		/* in flight slot		*/
+	time_t expires;
+	struct timeval sent;
+	char *name;		/* PTR_OK only			*/
+} ptr_ent_t;
+
+typedef struct stddns_async_t {
+	int fd;
+	struct sockaddr_in srv;
+
+	ptr_ent_t *tbl;		/* open addressing on addr	*/
+	uint32_t size;		/* power of 2			*/
+	uint32_t cnt;
+
+	struct {
+		uint32_t addr;
+		uint16_t id;
+		uint8_t busy;
+	} fl[STDDNS_INFLIGHT];
+	uint32_t nflight;
+
+	uint32_t *q;		/* waiting for a slot, a ring	*/
+	uint32_t qhead, qlen, qsize;
+
+	uint64_t queries, answers, timeouts, hits;
+} stddns_async_t;
+
 typedef struct stddns_context_t {
 	uint32_t magic;
 	void (*fp)(int, const void *, const void *);
 	int flags;
+	int async;		/* 0 not tried yet, 1 up, -1 getnameinfo it is */
+	stddns_async_t *as;
 } stddns_context_t;
 
+static int as_start(stddns_context_t *);
+static ptr_ent_t *as_find(stddns_async_t *, uint32_t /* addr */, int /* create */);
+static void as_queue(stddns_async_t *, ptr_ent_t *);
+static void as_send(stddns_async_t *, ptr_ent_t *);
+static void as_run(stddns_async_t *);
+static void as_answer(stddns_async_t *, const uint8_t *, size_t);
+static int as_getname(const uint8_t *, size_t, size_t *, char *, size_t);
+static const char *as_lookup(stddns_context_t *, uint32_t /* addr */);
+
 void *stddns_init(void (*callback)(int /* type */, const void *, const void *), int flags) {
 	stddns_context_t *sc=NULL;
 
@@ -41,6 +110,8 @@ void *stddns_init(void (*callback)(int /* type */, const void *, const void *),
 	sc->magic=STDDNS_MAGIC;
 	sc->fp=callback;
 	sc->flags=flags;
+	sc->async=0;
+	sc->as=NULL;
 
 	return (void *)sc;
 }
@@ -75,6 +146,19 @@ char *stddns_getname(void *c, const struct sockaddr *is) {
 
 	switch (is_u.fs->family) {
 		case AF_INET:
+			if (c_u.c->async == 0) {
+				as_start(c_u.c);
+			}
+			if (c_u.c->async == 1) {
+				const char *name=NULL;
+
+				name=as_lookup(c_u.c, ((const struct sockaddr_in *)is)->sin_addr.s_addr);
+				if (name == NULL) {
+					return NULL;
+				}
+				strncpy(hname, name, sizeof(hname) - 1);
+				return hname;
+			}
 			sl=(socklen_t )sizeof(struct sockaddr_in);
 			break;
 
@@ -415,8 +499,537 @@ void stddns_fini(void **p) {
 	}
 
 	assert(c_u.c->magic == STDDNS_MAGIC);
+
+	if (c_u.c->as != NULL) {
+		stddns_async_t *as=c_u.c->as;
+		uint32_t j=0;
+
+		DBG(M_DNS, "%" PRIu64 " ptr queries, %" PRIu64 " answers, %" PRIu64 " timeouts, %" PRIu64 " cache hits",
+			as->queries, as->answers, as->timeouts, as->hits
+		);
+		for (j=0; j < as->size; j++) {
+			if (as->tbl[j].name != NULL) {
+				xfree(as->tbl[j].name);
+			}
+		}
+		xfree(as->tbl);
+		if (as->q != NULL) {
+			xfree(as->q);
+		}
+		close(as->fd);
+		xfree(as);
+	}
+
 	xfree(*p);
 	*p=NULL;
 
 	return;
 }
+
+/*
+ * start an ipv4 reverse lookup if there isnt one going or cached already,
+ * other address families are left for stddns_getname
+ */
+void stddns_prefetch(void *c, const struct sockaddr *is) {
+	union {
+		void *p;
+		stddns_context_t *c;
+	} c_u;
+	ptr_ent_t *pe=NULL;
+
+	if (c == NULL || is == NULL || is->sa_family != AF_INET) {
+		return;
+	}
+
+	c_u.p=c;
+	assert(c_u.c->magic == STDDNS_MAGIC);
+
+	if (c_u.c->async == 0) {
+		as_start(c_u.c);
+	}
+	if (c_u.c->async != 1) {
+		return;
+	}
+
+	pe=as_find(c_u.c->as, ((const struct sockaddr_in *)is)->sin_addr.s_addr, 1);
+
+	if ((pe->state == PTR_OK || pe->state == PTR_NONE) && pe->expires > time(NULL)) {
+		return;
+	}
+	if (pe->state == PTR_QUEUED || pe->state == PTR_INFLIGHT) {
+		return;
+	}
+
+	as_queue(c_u.c->as, pe);
+	as_run(c_u.c->as);
+
+	return;
+}
+
+int stddns_poll(void *c) {
+	union {
+		void *p;
+		stddns_context_t *c;
+	} c_u;
+
+	if (c == NULL) {
+		return 0;
+	}
+
+	c_u.p=c;
+	assert(c_u.c->magic == STDDNS_MAGIC);
+
+	if (c_u.c->async != 1) {
+		return 0;
+	}
+
+	as_run(c_u.c->as);
+
+	return (int)(c_u.c->as->nflight + c_u.c->as->qlen);
+}
+
+/*
+ * s->dns_server if set (system means dont bother), else the first ipv4
+ * nameserver in /etc/resolv.conf.  any failure leaves getnameinfo to it
+ */
+static int as_start(stddns_context_t *c) {
+	char line[256], srv[128];
+	const char *port=NULL;
+	stddns_async_t *as=NULL;
+	FILE *rc=NULL;
+	int fd=-1;
+
+	c->async=-1;
+	srv[0]='\0';
+
+	if (s != NULL && s->dns_server != NULL) {
+		if (strcmp(s->dns_server, "system") == 0) {
+			return -1;
+		}
+		strncpy(srv, s->dns_server, sizeof(srv) - 1);
+		srv[sizeof(srv) - 1]='\0';
+	}
+	else if ((rc=fopen("/etc/resolv.conf", "r")) != NULL) {
+		while (fgets(line, sizeof(line), rc) != NULL) {
+			struct in_addr ia;
+
+			if (sscanf(line, " nameserver %127s", srv) == 1 && inet_pton(AF_INET, srv, &ia) == 1) {
+				break;
+			}
+			srv[0]='\0';
+		}
+		fclose(rc);
+	}
+
+	if (srv[0] == '\0') {
+		DBG(M_DNS, "no ipv4 nameserver to talk to, using getnameinfo");
+		return -1;
+	}
+
+	as=(stddns_async_t *)xmalloc(sizeof(stddns_async_t));
+	memset(as, 0, sizeof(stddns_async_t));
+
+	as->srv.sin_family=AF_INET;
+	as->srv.sin_port=htons(53);
+	if ((port=strchr(srv, ':')) != NULL) {
+		as->srv.sin_port=htons((uint16_t)atoi(port + 1));
+		srv[port - srv]='\0';
+	}
+	if (inet_pton(AF_INET, srv, &as->srv.sin_addr) != 1) {
+		ERR("resolver `%s' isnt an ipv4 address, using getnameinfo", srv);
+		xfree(as);
+		return -1;
+	}
+
+	if ((fd=socket(AF_INET, SOCK_DGRAM, 0)) < 0 ||
+	    connect(fd, (const struct sockaddr *)&as->srv, sizeof(as->srv)) < 0 ||
+	    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0) {
+		ERR("cant set up resolver socket: %s, using getnameinfo", strerror(errno));
+		if (fd >= 0) {
+			close(fd);
+		}
+		xfree(as);
+		return -1;
+	}
+	as->fd=fd;
+
+	as->size=STDDNS_INITSIZE;
+	as->tbl=(ptr_ent_t *)xmalloc(sizeof(ptr_ent_t) * as->size);
+	memset(as->tbl, 0, sizeof(ptr_ent_t) * as->size);
+
+	DBG(M_DNS, "reverse lookups go to %s:%u, %d at a time", srv, ntohs(as->srv.sin_port), STDDNS_INFLIGHT);
+
+	c->as=as;
+	c->async=1;
+
+	return 1;
+}
+
+#define AS_SLOT(a, sz)	(((uint32_t)(a) * 0x9e3779b1U) >> 8 & ((sz) - 1))
+
+static ptr_ent_t *as_find(stddns_async_t *as, uint32_t addr, int create) {
+	uint32_t j=0;
+
+	for (j=AS_SLOT(addr, as->size); as->tbl[j].state != PTR_EMPTY; j=(j + 1) & (as->size - 1)) {
+		if (as->tbl[j].addr == addr) {
+			return &as->tbl[j];
+		}
+	}
+
+	if (create == 0) {
+		return NULL;
+	}
+
+	if ((as->cnt + 1) * 2 > as->size) {
+		ptr_ent_t *old=as->tbl;
+		uint32_t osize=as->size, k=0;
+
+		as->size *= 2;
+		as->tbl=(ptr_ent_t *)xmalloc(sizeof(ptr_ent_t) * as->size);
+		memset(as->tbl, 0, sizeof(ptr_ent_t) * as->size);
+
+		for (k=0; k < osize; k++) {
+			if (old[k].state == PTR_EMPTY) {
+				continue;
+			}
+			for (j=AS_SLOT(old[k].addr, as->size); as->tbl[j].state != PTR_EMPTY; j=(j + 1) & (as->size - 1)) {
+				;
+			}
+			as->tbl[j]=old[k];
+		}
+		xfree(old);
+
+		for (j=AS_SLOT(addr, as->size); as->tbl[j].state != PTR_EMPTY; j=(j + 1) & (as->size - 1)) {
+			;
+		}
+	}
+
+	/* PTR_NONE that has already expired, as_queue will set it straight */
+	as->tbl[j].addr=addr;
+	as->tbl[j].state=PTR_NONE;
+	as->tbl[j].expires=0;
+	as->tbl[j].name=NULL;
+	as->cnt++;
+
+	return &as->tbl[j];
+}
+
+static void as_queue(stddns_async_t *as, ptr_ent_t *pe) {
+
+	if (as->qlen == as->qsize) {
+		uint32_t *nq=NULL, j=0;
+		uint32_t nsize=(as->qsize == 0 ? 256 : as->qsize * 2);
+
+		nq=(uint32_t *)xmalloc(sizeof(uint32_t) * nsize);
+		for (j=0; j < as->qlen; j++) {
+			nq[j]=as->q[(as->qhead + j) % as->qsize];
+		}
+		if (as->q != NULL) {
+			xfree(as->q);
+		}
+		as->q=nq;
+		as->qhead=0;
+		as->qsize=nsize;
+	}
+
+	as->q[(as->qhead + as->qlen) % as->qsize]=pe->addr;
+	as->qlen++;
+	pe->state=PTR_QUEUED;
+	pe->tries=0;
+
+	return;
+}
+
+/* into a free slot, or the same one again for a retry */
+static void as_send(stddns_async_t *as, ptr_ent_t *pe) {
+	uint8_t pkt[128];
+	const uint8_t *oct=(const uint8_t *)&pe->addr;
+	size_t off=0;
+	int j=0, len=0;
+
+	if (pe->state != PTR_INFLIGHT) {
+		for (j=0; j < STDDNS_INFLIGHT && as->fl[j].busy; j++) {
+			;
+		}
+		assert(j < STDDNS_INFLIGHT);
+		pe->slot=(uint16_t)j;
+		pe->state=PTR_INFLIGHT;
+		as->fl[j].busy=1;
+		as->fl[j].addr=pe->addr;
+		as->nflight++;
+	}
+	/* new id for every try, so a late answer to an old one is just dropped */
+	as->fl[pe->slot].id=(uint16_t)((genrand_get32() & 0xff00) | pe->slot);
+
+	memset(pkt, 0, 12);
+	pkt[0]=as->fl[pe->slot].id >> 8;
+	pkt[1]=as->fl[pe->slot].id & 0xff;
+	pkt[2]=0x01;		/* rd */
+	pkt[5]=1;		/* one question */
+	off=12;
+
+	for (j=3; j >= 0; j--) {
+		len=snprintf((char *)&pkt[off + 1], 4, "%u", oct[j]);
+		pkt[off]=(uint8_t)len;
+		off += len + 1;
+	}
+	memcpy(&pkt[off], "\007in-addr\004arpa\000\000\014\000\001", 18);
+	off += 18;
+
+	gettimeofday(&pe->sent, NULL);
+	pe->tries++;
+	as->queries++;
+
+	if (send(as->fd, pkt, off, 0) < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+		DBG(M_DNS, "ptr query send fails: %s", strerror(errno));
+	}
+
+	return;
+}
+
+/* read what came back, retry or give up on what didnt, send what is waiting */
+static void as_run(stddns_async_t *as) {
+	uint8_t buf[1500];
+	struct timeval now;
+	ssize_t rlen=0;
+	ptr_ent_t *pe=NULL;
+	uint32_t j=0;
+	long ms=0;
+
+	while ((rlen=recv(as->fd, buf, sizeof(buf), 0)) > 0) {
+		as_answer(as, buf, (size_t)rlen);
+	}
+
+	gettimeofday(&now, NULL);
+
+	for (j=0; j < STDDNS_INFLIGHT && as->nflight > 0; j++) {
+		if (! as->fl[j].busy) {
+			continue;
+		}
+		pe=as_find(as, as->fl[j].addr, 0);
+		assert(pe != NULL);
+
+		ms=(now.tv_sec - pe->sent.tv_sec) * 1000 + (now.tv_usec - pe->sent.tv_usec) / 1000;
+		if (ms < STDDNS_TIMEOUT_MS) {
+			continue;
+		}
+		if (pe->tries < STDDNS_TRIES) {
+			as_send(as, pe);
+			continue;
+		}
+
+		as->timeouts++;
+		as->fl[j].busy=0;
+		as->nflight--;
+		pe->state=PTR_NONE;
+		pe->expires=now.tv_sec + STDDNS_FAILTTL;
+	}
+
+	while (as->qlen > 0 && as->nflight < STDDNS_INFLIGHT) {
+		pe=as_find(as, as->q[as->qhead], 0);
+		as->qhead=(as->qhead + 1) % as->qsize;
+		as->qlen--;
+		if (pe != NULL && pe->state == PTR_QUEUED) {
+			as_send(as, pe);
+		}
+	}
+
+	return;
+}
+
+static uint16_t as_get16(const uint8_t *p) {
+	return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t as_get32(const uint8_t *p) {
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void as_answer(stddns_async_t *as, const uint8_t *pkt, size_t len) {
+	char qname[256], want[64], name[256];
+	const uint8_t *oct=NULL;
+	ptr_ent_t *pe=NULL;
+	uint16_t id=0, qd=0, an=0, ns=0, j=0, type=0, rdlen=0;
+	uint32_t ttl=0, negttl=STDDNS_NEGTTL;
+	size_t off=12;
+	int rcode=0, found=0;
+
+	if (len < 12 || ! (pkt[2] & 0x80)) {
+		return;
+	}
+
+	id=as_get16(pkt);
+	if (! as->fl[id & 0xff].busy || as->fl[id & 0xff].id != id) {
+		DBG(M_DNS, "dns answer with id %04x we arent waiting on", id);
+		return;
+	}
+	pe=as_find(as, as->fl[id & 0xff].addr, 0);
+	assert(pe != NULL);
+
+	rcode=pkt[3] & 0x0f;
+	qd=as_get16(&pkt[4]);
+	an=as_get16(&pkt[6]);
+	ns=as_get16(&pkt[8]);
+
+	/* the question has to be ours too */
+	oct=(const uint8_t *)&pe->addr;
+	snprintf(want, sizeof(want), "%u.%u.%u.%u.in-addr.arpa", oct[3], oct[2], oct[1], oct[0]);
+	if (qd != 1 || as_getname(pkt, len, &off, qname, sizeof(qname)) != 1 || strcasecmp(qname, want) != 0 || off + 4 > len) {
+		DBG(M_DNS, "dns answer for a question we didnt ask");
+		return;
+	}
+	off += 4;
+
+	if (rcode == 0) {
+		for (j=0; j < an + ns && ! found; j++) {
+			if (as_getname(pkt, len, &off, qname, sizeof(qname)) != 1 || off + 10 > len) {
+				break;
+			}
+			type=as_get16(&pkt[off]);
+			ttl=as_get32(&pkt[off + 4]);
+			rdlen=as_get16(&pkt[off + 8]);
+			off += 10;
+			if (off + rdlen > len) {
+				break;
+			}
+
+			if (j < an && type == 12) {		/* PTR, maybe after a cname */
+				size_t noff=off;
+
+				if (as_getname(pkt, len, &noff, name, sizeof(name)) == 1 && name[0] != '\0') {
+					found=1;
+				}
+			}
+			else if (j >= an && type == 6) {	/* SOA, negative ttl is the smaller of its ttl and minimum */
+				size_t noff=off;
+				char dummy[256];
+
+				if (as_getname(pkt, len, &noff, dummy, sizeof(dummy)) == 1 &&
+				    as_getname(pkt, len, &noff, dummy, sizeof(dummy)) == 1 && noff + 20 <= off + rdlen) {
+					negttl=MIN(ttl, as_get32(&pkt[noff + 16]));
+				}
+			}
+			off += rdlen;
+		}
+	}
+	else if (rcode != 3) {
+		/* servfail, refused and the like, dont hold on to it long */
+		negttl=STDDNS_FAILTTL;
+	}
+
+	as->answers++;
+	as->fl[pe->slot].busy=0;
+	as->nflight--;
+
+	if (pe->name != NULL) {
+		xfree(pe->name);
+		pe->name=NULL;
+	}
+
+	if (found) {
+		pe->state=PTR_OK;
+		pe->name=xstrdup(name);
+		pe->expires=time(NULL) + MAX(STDDNS_MINTTL, MIN(ttl, STDDNS_MAXTTL));
+	}
+	else {
+		pe->state=PTR_NONE;
+		pe->expires=time(NULL) + MAX(STDDNS_MINTTL, MIN(negttl, STDDNS_MAXTTL));
+	}
+
+	return;
+}
+
+/*
+ * a possibly compressed name at *off, dotted and without the trailing dot,
+ * off ends up past it.  characters that have no business in a hostname come
+ * out as ? since this is going to someones terminal
+ */
+static int as_getname(const uint8_t *pkt, size_t len, size_t *off, char *out, size_t olen) {
+	size_t p=*off, o=0, end=0;
+	int jumps=0;
+	uint8_t l=0, j=0;
+
+	out[0]='\0';
+
+	for (;;) {
+		if (p >= len) {
+			return 0;
+		}
+		l=pkt[p];
+
+		if ((l & 0xc0) == 0xc0) {
+			if (p + 1 >= len || ++jumps > 16) {
+				return 0;
+			}
+			if (end == 0) {
+				end=p + 2;
+			}
+			p=((l & 0x3f) << 8) | pkt[p + 1];
+			continue;
+		}
+		if (l & 0xc0) {
+			return 0;
+		}
+		if (l == 0) {
+			if (end == 0) {
+				end=p + 1;
+			}
+			break;
+		}
+		if (p + 1 + l > len || o + l + 2 > olen) {
+			return 0;
+		}
+		if (o > 0) {
+			out[o++]='.';
+		}
+		for (j=0; j < l; j++) {
+			char ch=(char)pkt[p + 1 + j];
+
+			out[o++]=(isalnum((unsigned char)ch) || ch == '-' || ch == '_') ? ch : '?';
+		}
+		p += l + 1;
+	}
+
+	out[o]='\0';
+	*off=end;
+
+	return 1;
+}
+
+/* a cached or fresh answer for addr, waiting for it if it has to */
+static const char *as_lookup(stddns_context_t *c, uint32_t addr) {
+	struct sockaddr_in sin;
+	struct pollfd pfd;
+	ptr_ent_t *pe=NULL;
+
+	pe=as_find(c->as, addr, 0);
+	if (pe != NULL && (pe->state == PTR_OK || pe->state == PTR_NONE) && pe->expires > time(NULL)) {
+		c->as->hits++;
+		return pe->state == PTR_OK ? pe->name : NULL;
+	}
+
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family=AF_INET;
+	sin.sin_addr.s_addr=addr;
+	stddns_prefetch(c, (const struct sockaddr *)&sin);
+
+	for (;;) {
+		as_run(c->as);
+
+		pe=as_find(c->as, addr, 0);
+		assert(pe != NULL);
+		if (pe->state == PTR_OK || pe->state == PTR_NONE) {
+			break;
+		}
+
+		pfd.fd=c->as->fd;
+		pfd.events=POLLIN;
+		pfd.revents=0;
+		if (poll(&pfd, 1, 50) < 0 && errno != EINTR) {
+			ERR("poll fails: %s", strerror(errno));
+			return NULL;
+		}
+	}
+
+	return pe->state == PTR_OK ? pe->name : NULL;
+}
@@ -75,4 +75,12 @@ void stddns_freeaddr(void * /* context */, struct sockaddr_list_t ***);
 
 extern void stddns_fini(void ** /* pointer to context */);
 
+/*
+ * ipv4 reverse lookups are asynchronous PTR queries against s->dns_server or
+ * the resolv.conf nameserver, cached for their ttl.  prefetch starts one
+ * without waiting, poll reads answers and retries, returns lookups outstanding
+ */
+void stddns_prefetch(void * /* context */, const struct sockaddr *);
+int stddns_poll(void * /* context */);
+
 #endif
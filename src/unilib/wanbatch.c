@@ -0,0 +1,582 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#include <config.h>
+
+#include <stddef.h>
+
+#ifdef HAVE_COMPRESS2
+#include <zlib.h>
+#endif
+
+#include <settings.h>
+
+#include <unilib/output.h>
+#include <unilib/xmalloc.h>
+#include <unilib/xipc.h>
+#include <unilib/wanbatch.h>
+#include <scan_progs/scan_export.h>
+
+/*
+ * body of a batch is a run of records:
+ *	varint	length of the original MSG_OUTPUT payload
+ *	byte	kind, an ip report, an arp report or opaque
+ *	...	the report, field by field, against the previous report of that kind
+ *	...	whatever followed the report in the payload (a returned packet), as is
+ */
+#define WB_KIND_RAW	0
+#define WB_KIND_IP	1
+#define WB_KIND_ARP	2
+
+#define WB_DELTA	0	/* host order integer, zigzag varint of the change	*/
+#define WB_DELTANET	1	/* network order address, swapped first so neighbours are close */
+#define WB_RAW		2	/* bytes as they are					*/
+
+/* leaves room for the batch header, the ipc header and the worst case deflate overhead */
+#define WB_RAWMAX	(IPC_DSIZE - 1024)
+#define WB_MAXVARINT	10
+
+typedef struct wb_field_t {
+	uint16_t off;
+	uint8_t len;
+	uint8_t how;
+} wb_field_t;
+
+#define WB_FIELD(type, member, how) { offsetof(type, member), sizeof(((type *)0)->member), how }
+
+/* pointers are left out, they mean nothing on the other end and come out NULL */
+static const wb_field_t ip_fields[]={
+	WB_FIELD(ip_report_t, magic, WB_DELTA),
+	WB_FIELD(ip_report_t, sport, WB_DELTA),
+	WB_FIELD(ip_report_t, dport, WB_DELTA),
+	WB_FIELD(ip_report_t, proto, WB_DELTA),
+	WB_FIELD(ip_report_t, type, WB_DELTA),
+	WB_FIELD(ip_report_t, subtype, WB_DELTA),
+	WB_FIELD(ip_report_t, send_addr, WB_DELTANET),
+	WB_FIELD(ip_report_t, host_addr, WB_DELTANET),
+	WB_FIELD(ip_report_t, trace_addr, WB_DELTANET),
+	WB_FIELD(ip_report_t, ttl, WB_DELTA),
+	WB_FIELD(ip_report_t, recv_time.tv_sec, WB_DELTA),
+	WB_FIELD(ip_report_t, recv_time.tv_usec, WB_DELTA),
+	WB_FIELD(ip_report_t, flags, WB_DELTA),
+	WB_FIELD(ip_report_t, mseq, WB_DELTA),
+	WB_FIELD(ip_report_t, tseq, WB_DELTA),
+	WB_FIELD(ip_report_t, window_size, WB_DELTA),
+	WB_FIELD(ip_report_t, t_tstamp, WB_DELTA),
+	WB_FIELD(ip_report_t, m_tstamp, WB_DELTA),
+	WB_FIELD(ip_report_t, eth_hwaddr, WB_RAW),
+	WB_FIELD(ip_report_t, eth_hwaddr_valid, WB_DELTA),
+	WB_FIELD(ip_report_t, doff, WB_DELTA),
+};
+
+static const wb_field_t arp_fields[]={
+	WB_FIELD(arp_report_t, magic, WB_DELTA),
+	WB_FIELD(arp_report_t, hwaddr, WB_RAW),
+	WB_FIELD(arp_report_t, ipaddr, WB_DELTANET),
+	WB_FIELD(arp_report_t, recv_time.tv_sec, WB_DELTA),
+	WB_FIELD(arp_report_t, recv_time.tv_usec, WB_DELTA),
+	WB_FIELD(arp_report_t, flags, WB_DELTA),
+	WB_FIELD(arp_report_t, doff, WB_DELTA),
+};
+
+#define IP_NFIELDS	(sizeof(ip_fields) / sizeof(wb_field_t))
+#define ARP_NFIELDS	(sizeof(arp_fields) / sizeof(wb_field_t))
+
+/* listener side state, there is only ever the one connection to the master */
+static int wb_sock=-1;
+static uint8_t wb_caps=0;
+static uint8_t *wb_raw=NULL, *wb_out=NULL;
+static size_t wb_rawlen=0;
+static uint16_t wb_count=0;
+static uint8_t prev_ip[sizeof(ip_report_t)], prev_arp[sizeof(arp_report_t)];
+static struct timeval wb_first;
+static time_t wb_lastsend=0;
+static uint64_t wb_bytesin=0, wb_bytesout=0, wb_batches=0;
+
+static uint64_t wb_getint(const uint8_t *, size_t);
+static void wb_putint(uint8_t *, size_t, uint64_t);
+static size_t wb_putvarint(uint8_t *, uint64_t);
+static int wb_getvarint(const uint8_t **, const uint8_t *, uint64_t *);
+static size_t wb_encode(uint8_t *, const wb_field_t *, size_t, uint8_t *, const uint8_t *);
+static int wb_decode(const uint8_t **, const uint8_t *, const wb_field_t *, size_t, uint8_t *, uint8_t *);
+
+uint8_t wanbatch_caps(void) {
+#ifdef HAVE_COMPRESS2
+	return DRONE_CAP_BATCH|DRONE_CAP_ZLIB;
+#else
+	return DRONE_CAP_BATCH;
+#endif
+}
+
+/* fields are whatever width the struct says, packed, so no alignment to count on */
+static uint64_t wb_getint(const uint8_t *p, size_t len) {
+	uint8_t u8=0;
+	uint16_t u16=0;
+	uint32_t u32=0;
+	uint64_t u64=0;
+
+	switch (len) {
+		case 1:
+			memcpy(&u8, p, 1);
+			return u8;
+		case 2:
+			memcpy(&u16, p, 2);
+			return u16;
+		case 4:
+			memcpy(&u32, p, 4);
+			return u32;
+		case 8:
+			memcpy(&u64, p, 8);
+			return u64;
+		default:
+			PANIC("odd integer field width " STFMT, len);
+	}
+
+	return 0;
+}
+
+static void wb_putint(uint8_t *p, size_t len, uint64_t val) {
+	uint8_t u8=0;
+	uint16_t u16=0;
+	uint32_t u32=0;
+
+	switch (len) {
+		case 1:
+			u8=(uint8_t)val;
+			memcpy(p, &u8, 1);
+			break;
+		case 2:
+			u16=(uint16_t)val;
+			memcpy(p, &u16, 2);
+			break;
+		case 4:
+			u32=(uint32_t)val;
+			memcpy(p, &u32, 4);
+			break;
+		case 8:
+			memcpy(p, &val, 8);
+			break;
+		default:
+			PANIC("odd integer field width " STFMT, len);
+	}
+
+	return;
+}
+
+static size_t wb_putvarint(uint8_t *p, uint64_t val) {
+	size_t j=0;
+
+	while (val >= 0x80) {
+		p[j++]=(uint8_t)(val | 0x80);
+		val >>= 7;
+	}
+	p[j++]=(uint8_t)val;
+
+	return j;
+}
+
+static int wb_getvarint(const uint8_t **p, const uint8_t *end, uint64_t *val) {
+	unsigned int shift=0;
+
+	*val=0;
+	while (*p < end && shift < 64) {
+		*val |= (uint64_t)(**p & 0x7f) << shift;
+		if ((*(*p)++ & 0x80) == 0) {
+			return 1;
+		}
+		shift += 7;
+	}
+
+	return -1;
+}
+
+/*
+ * the change is taken modulo the field width and then sign extended, so a
+ * counter wrapping or an address going down by one both code in a byte
+ */
+static size_t wb_encode(uint8_t *out, const wb_field_t *f, size_t nf, uint8_t *prev, const uint8_t *cur) {
+	uint64_t c=0, p=0, d=0, mask=0;
+	int64_t sd=0;
+	size_t j=0, o=0;
+
+	for (j=0; j < nf; j++) {
+		if (f[j].how == WB_RAW) {
+			memcpy(out + o, cur + f[j].off, f[j].len);
+			o += f[j].len;
+			continue;
+		}
+
+		c=wb_getint(cur + f[j].off, f[j].len);
+		p=wb_getint(prev + f[j].off, f[j].len);
+		if (f[j].how == WB_DELTANET) {
+			c=ntohl((uint32_t)c);
+			p=ntohl((uint32_t)p);
+		}
+
+		mask=(f[j].len == 8 ? ~(uint64_t)0 : (((uint64_t)1 << (f[j].len * 8)) - 1));
+		d=(c - p) & mask;
+		if (f[j].len < 8 && (d & ((mask >> 1) + 1))) {
+			sd=(int64_t)d - (int64_t)(mask + 1);
+		}
+		else {
+			sd=(int64_t)d;
+		}
+
+		o += wb_putvarint(out + o, ((uint64_t)sd << 1) ^ (uint64_t)(sd >> 63));
+	}
+
+	memcpy(prev, cur, (f == ip_fields ? sizeof(ip_report_t) : sizeof(arp_report_t)));
+
+	return o;
+}
+
+static int wb_decode(const uint8_t **p, const uint8_t *end, const wb_field_t *f, size_t nf, uint8_t *prev, uint8_t *cur) {
+	uint64_t zz=0, pv=0, c=0, mask=0;
+	size_t j=0;
+
+	for (j=0; j < nf; j++) {
+		if (f[j].how == WB_RAW) {
+			if ((size_t)(end - *p) < f[j].len) {
+				return -1;
+			}
+			memcpy(cur + f[j].off, *p, f[j].len);
+			*p += f[j].len;
+			continue;
+		}
+
+		if (wb_getvarint(p, end, &zz) < 0) {
+			return -1;
+		}
+
+		pv=wb_getint(prev + f[j].off, f[j].len);
+		if (f[j].how == WB_DELTANET) {
+			pv=ntohl((uint32_t)pv);
+		}
+
+		mask=(f[j].len == 8 ? ~(uint64_t)0 : (((uint64_t)1 << (f[j].len * 8)) - 1));
+		c=(pv + ((zz >> 1) ^ (~(zz & 1) + 1))) & mask;
+
+		if (f[j].how == WB_DELTANET) {
+			c=htonl((uint32_t)c);
+		}
+		wb_putint(cur + f[j].off, f[j].len, c);
+	}
+
+	memcpy(prev, cur, (f == ip_fields ? sizeof(ip_report_t) : sizeof(arp_report_t)));
+
+	return 1;
+}
+
+void wanbatch_start(int sock, uint8_t caps) {
+
+	wb_sock=sock;
+	wb_caps=caps & wanbatch_caps();
+
+	if (wb_raw == NULL) {
+		wb_raw=(uint8_t *)xmalloc(WB_RAWMAX);
+		wb_out=(uint8_t *)xmalloc(IPC_DSIZE);
+	}
+	wb_rawlen=0;
+	wb_count=0;
+	wb_lastsend=time(NULL);
+	wb_bytesin=wb_bytesout=wb_batches=0;
+
+	VRB(1, "batching results to the master%s", (wb_caps & DRONE_CAP_ZLIB ? " with compression" : ""));
+
+	return;
+}
+
+int wanbatch_active(void) {
+	return wb_sock < 0 ? 0 : 1;
+}
+
+int wanbatch_add(const uint8_t *msg, size_t len) {
+	union {
+		const uint8_t *ptr;
+		const uint32_t *magic;
+	} m_u;
+	const wb_field_t *f=NULL;
+	size_t nf=0, r_size=0, worst=0;
+	uint8_t kind=WB_KIND_RAW, *prev=NULL;
+
+	assert(wb_sock > -1 && msg != NULL);
+
+	m_u.ptr=msg;
+	if (len >= sizeof(ip_report_t) && *m_u.magic == IP_REPORT_MAGIC) {
+		kind=WB_KIND_IP; f=ip_fields; nf=IP_NFIELDS; prev=prev_ip; r_size=sizeof(ip_report_t);
+	}
+	else if (len >= sizeof(arp_report_t) && *m_u.magic == ARP_REPORT_MAGIC) {
+		kind=WB_KIND_ARP; f=arp_fields; nf=ARP_NFIELDS; prev=prev_arp; r_size=sizeof(arp_report_t);
+	}
+
+	worst=WB_MAXVARINT + 1 + (nf * WB_MAXVARINT) + len;
+
+	if (worst > WB_RAWMAX) {
+		/* wont ever fit a batch, keep the order and send it the old way */
+		if (wanbatch_flush() < 0) {
+			return -1;
+		}
+		wb_bytesin += len;
+		wb_bytesout += len;
+		return send_message(wb_sock, MSG_OUTPUT, MSG_STATUS_OK, msg, len) < 0 ? -1 : 1;
+	}
+
+	if (wb_rawlen + worst > WB_RAWMAX || wb_count == 0xffff) {
+		if (wanbatch_flush() < 0) {
+			return -1;
+		}
+	}
+
+	if (wb_count == 0) {
+		/* every batch starts from zero so it can be decoded by itself */
+		memset(prev_ip, 0, sizeof(prev_ip));
+		memset(prev_arp, 0, sizeof(prev_arp));
+		gettimeofday(&wb_first, NULL);
+	}
+
+	wb_rawlen += wb_putvarint(wb_raw + wb_rawlen, (uint64_t)len);
+	wb_raw[wb_rawlen++]=kind;
+	if (kind != WB_KIND_RAW) {
+		wb_rawlen += wb_encode(wb_raw + wb_rawlen, f, nf, prev, msg);
+	}
+	memcpy(wb_raw + wb_rawlen, msg + r_size, len - r_size);
+	wb_rawlen += len - r_size;
+
+	wb_count++;
+	wb_bytesin += len;
+
+	return 1;
+}
+
+int wanbatch_flush(void) {
+	union {
+		uint8_t *ptr;
+		wanbatch_hdr_t *h;
+	} o_u;
+	size_t olen=0;
+
+	if (wb_sock < 0 || wb_count == 0) {
+		return 1;
+	}
+
+	o_u.ptr=wb_out;
+	o_u.h->magic=WANBATCH_MAGIC;
+	o_u.h->count=wb_count;
+	o_u.h->codec=WANBATCH_CODEC_NONE;
+	o_u.h->res=0;
+	o_u.h->rawlen=(uint32_t)wb_rawlen;
+
+#ifdef HAVE_COMPRESS2
+	if (wb_caps & DRONE_CAP_ZLIB) {
+		uLongf zlen=(uLongf)(IPC_DSIZE - 64 - sizeof(wanbatch_hdr_t));
+
+		if (compress2(wb_out + sizeof(wanbatch_hdr_t), &zlen, wb_raw, (uLong)wb_rawlen, Z_BEST_SPEED) == Z_OK && zlen < wb_rawlen) {
+			o_u.h->codec=WANBATCH_CODEC_ZLIB;
+			olen=(size_t)zlen;
+		}
+	}
+#endif
+	if (o_u.h->codec == WANBATCH_CODEC_NONE) {
+		memcpy(wb_out + sizeof(wanbatch_hdr_t), wb_raw, wb_rawlen);
+		olen=wb_rawlen;
+	}
+	olen += sizeof(wanbatch_hdr_t);
+
+	DBG(M_IPC, "batch of %u reports, " STFMT " bytes coded " STFMT " on the wire", wb_count, wb_rawlen, olen);
+
+	wb_count=0;
+	wb_rawlen=0;
+	wb_bytesout += olen;
+	wb_batches++;
+	wb_lastsend=time(NULL);
+
+	if (send_message(wb_sock, MSG_OUTBATCH, MSG_STATUS_OK, wb_out, olen) < 0) {
+		return -1;
+	}
+
+	return 1;
+}
+
+int wanbatch_tick(void) {
+	struct timeval now;
+	long age=0;
+
+	if (wb_sock < 0) {
+		return 1;
+	}
+
+	gettimeofday(&now, NULL);
+
+	if (wb_count > 0) {
+		age=((now.tv_sec - wb_first.tv_sec) * 1000) + ((now.tv_usec - wb_first.tv_usec) / 1000);
+		if (age >= WANBATCH_DELAY_MS) {
+			return wanbatch_flush();
+		}
+		return 1;
+	}
+
+	if ((now.tv_sec - wb_lastsend) >= WANBATCH_KEEPALIVE) {
+		wb_lastsend=now.tv_sec;
+		DBG(M_IPC, "idle link, sending keepalive");
+		if (send_message(wb_sock, MSG_NOP, MSG_STATUS_OK, NULL, 0) < 0) {
+			return -1;
+		}
+	}
+
+	return 1;
+}
+
+void wanbatch_stop(void) {
+
+	if (wb_sock < 0) {
+		return;
+	}
+
+	if (wanbatch_flush() < 0) {
+		ERR("cant send last result batch to master");
+	}
+
+	if (wb_batches > 0) {
+		VRB(1, "result batching: %llu bytes of results sent as %llu bytes in %llu batches (%.1fx)",
+			(unsigned long long)wb_bytesin, (unsigned long long)wb_bytesout, (unsigned long long)wb_batches,
+			(wb_bytesout > 0 ? (double)wb_bytesin / (double)wb_bytesout : 0.0)
+		);
+	}
+
+	xfree(wb_raw);
+	xfree(wb_out);
+	wb_raw=NULL;
+	wb_out=NULL;
+	wb_sock=-1;
+
+	return;
+}
+
+int wanbatch_unpack(const uint8_t *data, size_t len, int (*cb)(void *, size_t)) {
+	union {
+		const uint8_t *ptr;
+		const wanbatch_hdr_t *h;
+	} d_u;
+	uint8_t d_ip[sizeof(ip_report_t)], d_arp[sizeof(arp_report_t)];
+	uint8_t *body=NULL, *rec=NULL, kind=0;
+	const uint8_t *p=NULL, *end=NULL;
+	uint64_t rlen=0;
+	size_t r_size=0;
+	uint16_t j=0;
+	int ret=-1;
+
+	assert(data != NULL && cb != NULL);
+
+	if (len < sizeof(wanbatch_hdr_t)) {
+		ERR("short result batch");
+		return -1;
+	}
+
+	d_u.ptr=data;
+	if (d_u.h->magic != WANBATCH_MAGIC || d_u.h->rawlen > WB_RAWMAX) {
+		ERR("damaged result batch");
+		return -1;
+	}
+
+	switch (d_u.h->codec) {
+		case WANBATCH_CODEC_NONE:
+			if (len - sizeof(wanbatch_hdr_t) != d_u.h->rawlen) {
+				ERR("result batch length mismatch");
+				return -1;
+			}
+			p=data + sizeof(wanbatch_hdr_t);
+			break;
+
+#ifdef HAVE_COMPRESS2
+		case WANBATCH_CODEC_ZLIB: {
+			uLongf blen=(uLongf)d_u.h->rawlen;
+
+			body=(uint8_t *)xmalloc(d_u.h->rawlen + 1);
+			if (uncompress(body, &blen, data + sizeof(wanbatch_hdr_t), (uLong)(len - sizeof(wanbatch_hdr_t))) != Z_OK ||
+			blen != d_u.h->rawlen) {
+				ERR("cant inflate result batch");
+				xfree(body);
+				return -1;
+			}
+			p=body;
+			break;
+		}
+#endif
+
+		default:
+			ERR("result batch uses codec %u that we dont have", d_u.h->codec);
+			return -1;
+	}
+
+	end=p + d_u.h->rawlen;
+	memset(d_ip, 0, sizeof(d_ip));
+	memset(d_arp, 0, sizeof(d_arp));
+	rec=(uint8_t *)xmalloc(IPC_DSIZE);
+
+	for (j=0; j < d_u.h->count; j++) {
+		if (wb_getvarint(&p, end, &rlen) < 0 || p >= end || rlen > IPC_DSIZE) {
+			goto bad;
+		}
+		kind=*p++;
+
+		memset(rec, 0, (size_t)rlen);
+		r_size=0;
+
+		if (kind == WB_KIND_IP && rlen >= sizeof(ip_report_t)) {
+			if (wb_decode(&p, end, ip_fields, IP_NFIELDS, d_ip, rec) < 0) {
+				goto bad;
+			}
+			r_size=sizeof(ip_report_t);
+		}
+		else if (kind == WB_KIND_ARP && rlen >= sizeof(arp_report_t)) {
+			if (wb_decode(&p, end, arp_fields, ARP_NFIELDS, d_arp, rec) < 0) {
+				goto bad;
+			}
+			r_size=sizeof(arp_report_t);
+		}
+		else if (kind != WB_KIND_RAW) {
+			goto bad;
+		}
+
+		if ((size_t)(end - p) < (size_t)rlen - r_size) {
+			goto bad;
+		}
+		memcpy(rec + r_size, p, (size_t)rlen - r_size);
+		p += (size_t)rlen - r_size;
+
+		if (cb(rec, (size_t)rlen) < 0) {
+			goto done;
+		}
+	}
+
+	if (p != end) {
+		goto bad;
+	}
+
+	ret=(int)d_u.h->count;
+	goto done;
+
+bad:
+	ERR("damaged result batch, record %u of %u", j, d_u.h->count);
+done:
+	xfree(rec);
+	if (body != NULL) {
+		xfree(body);
+	}
+	return ret;
+}
@@ -0,0 +1,70 @@
+/**********************************************************************
+ * Copyright (C) 2026 (Robert E. Lee) <robert@unicornscan.org>        *
+ *                                                                    *
+ * This program is free software; you can redistribute it and/or      *
+ * modify it under the terms of the GNU General Public License        *
+ * as published by the Free Software Foundation; either               *
+ * version 2 of the License, or (at your option) any later            *
+ * version.                                                           *
+ *                                                                    *
+ * This program is distributed in the hope that it will be useful,    *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of     *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the      *
+ * GNU General Public License for more details.                       *
+ *                                                                    *
+ * You should have received a copy of the GNU General Public License  *
+ * along with this program; if not, write to the Free Software        *
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.          *
+ **********************************************************************/
+#ifndef _WANBATCH_H
+# define _WANBATCH_H
+
+/*
+ * result batching for listener drones on the far side of a slow link.
+ * instead of one MSG_OUTPUT per report, reports are collected into a
+ * MSG_OUTBATCH, each report field coded as the difference from the same
+ * field of the report before it, and the batch deflated when zlib is
+ * around.  batches decode on their own, nothing carries over between them
+ *
+ * negotiated at ident time, the listener puts wanbatch_caps() in the caps
+ * of its drone_version_t, the master answers with the caps it wants in a
+ * one byte MSG_ACK payload
+ */
+
+#define DRONE_CAP_BATCH		1
+#define DRONE_CAP_ZLIB		2
+
+/* a batch goes out once it has been sitting this long */
+#define WANBATCH_DELAY_MS	250
+/* idle links get a MSG_NOP this often so the master doesnt think we died */
+#define WANBATCH_KEEPALIVE	2
+
+typedef struct _PACKED_ wanbatch_hdr_t {
+	uint32_t magic;
+#define WANBATCH_MAGIC		0x57424331
+	uint16_t count;		/* reports in this batch		*/
+	uint8_t codec;		/* WANBATCH_CODEC_			*/
+	uint8_t res;
+	uint32_t rawlen;	/* body length before compression	*/
+} wanbatch_hdr_t;
+
+#define WANBATCH_CODEC_NONE	0
+#define WANBATCH_CODEC_ZLIB	1
+
+/* what this build can do */
+uint8_t wanbatch_caps(void);
+
+/* listener side */
+void wanbatch_start(int /* socket */, uint8_t /* negotiated caps */);
+int wanbatch_active(void);
+int wanbatch_add(const uint8_t * /* MSG_OUTPUT payload */, size_t /* length */);
+/* sends whatever is queued now, 1 ok -1 error */
+int wanbatch_flush(void);
+/* call often, flushes an old batch and keeps an idle link alive */
+int wanbatch_tick(void);
+void wanbatch_stop(void);
+
+/* master side, calls back once per report with what MSG_OUTPUT would have carried */
+int wanbatch_unpack(const uint8_t * /* MSG_OUTBATCH payload */, size_t /* length */, int (*)(void *, size_t));
+
+#endif
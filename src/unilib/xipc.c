@@ -19,295 +19,310 @@
 #include <config.h>
 
 #include <errno.h>
+#include <sys/uio.h>
 
 #include <settings.h>
 #include <unilib/output.h>
 #include <unilib/xmalloc.h>
 #include <unilib/xipc.h>
 #include <unilib/xipc_private.h>
+#include <unilib/shmtrans.h>
+#include <unilib/metrics.h>
 
-/* XXX this needs to be written more clearly */
-
-static union {
-	struct message_s *m;
-	void *ptr;
-	uint8_t *hdr;
-} m_u[MAX_CONNS][MAX_MSGS];
+/*
+ * every connection keeps one buffer for its whole life, messages are handed
+ * back as pointers into it, so a pointer from get_message() is good until the
+ * next recv_messages() on that socket.  unconsumed bytes (normally just the
+ * front of a message that hasnt fully arrived yet) are slid down to the start
+ * of the buffer before each read, so free space is always one contiguous run
+ */
+typedef struct ipc_conn_t {
+	uint8_t *buf;
+	size_t off;	/* next unconsumed byte	*/
+	size_t len;	/* end of valid data	*/
+	size_t msgs;	/* messages handed out since the last read, debug only */
+} ipc_conn_t;
 
-static int setup_mptrs(int /* sock */);
+/*
+ * indexed by descriptor, grown to the highest one we have seen, a slot is only
+ * allocated once that descriptor carries ipc and freed again by ipc_close()
+ */
+static ipc_conn_t **conns=NULL;
+static size_t conns_size=0;
 
-static uint8_t *msg_buf[MAX_CONNS], *save_buf[MAX_CONNS];
-static size_t m_off[MAX_CONNS], m_max[MAX_CONNS];
-static ssize_t readsize[MAX_CONNS];
-static size_t save_size[MAX_CONNS], ureadsize[MAX_CONNS];
+static ipc_conn_t *get_conn(int /* sock */);
+static ipc_msghdr_t *peek_message(ipc_conn_t *);
+static void compact_conn(ipc_conn_t *);
+static void reset_conn(int /* sock */);
 
 int ipc_init(void) {
-	int j=0;
+	size_t j=0;
 
-	for (j=0; j < MAX_CONNS; j++) {
-		msg_buf[j]=NULL; save_buf[j]=NULL;
-		m_off[j]=0; m_max[j]=0;
-		readsize[j]=-1;
-		save_size[j]=0; ureadsize[j]=0;
+	for (j=0; j < conns_size; j++) {
+		if (conns[j] != NULL) {
+			ipc_close((int)j);
+		}
 	}
 
 	return 1;
 }
 
-static void reset_messages(int sock) {
-	int j=0;
+static ipc_conn_t *get_conn(int sock) {
+	size_t nsize=0, j=0;
+	ipc_conn_t **nconns=NULL;
 
-	if (sock < 0 || sock >= MAX_CONNS) {
+	if (sock < 0) {
 		PANIC("socket out of range [%d]", sock);
 	}
 
-	for (j=0; j < MAX_MSGS; j++) {
-		m_u[sock][j].ptr=NULL;
+	if ((size_t)sock >= conns_size) {
+		for (nsize=(conns_size > 0 ? conns_size : 64); nsize <= (size_t)sock; nsize *= 2) {
+			;
+		}
+
+		nconns=(ipc_conn_t **)xmalloc(nsize * sizeof(ipc_conn_t *));
+		for (j=0; j < nsize; j++) {
+			nconns[j]=(j < conns_size ? conns[j] : NULL);
+		}
+		if (conns != NULL) {
+			xfree(conns);
+		}
+		conns=nconns;
+		conns_size=nsize;
+	}
+
+	if (conns[sock] == NULL) {
+		conns[sock]=(ipc_conn_t *)xmalloc(sizeof(ipc_conn_t));
+		memset(conns[sock], 0, sizeof(ipc_conn_t));
+	}
+
+	return conns[sock];
+}
+
+void ipc_close(int sock) {
+
+	if (sock < 0 || (size_t)sock >= conns_size || conns[sock] == NULL) {
+		return;
 	}
 
-	if (msg_buf[sock] != NULL) {
-		xfree(msg_buf[sock]);
-		msg_buf[sock]=NULL;
+	if (conns[sock]->buf != NULL) {
+		xfree(conns[sock]->buf);
 	}
+	xfree(conns[sock]);
+	conns[sock]=NULL;
 
-	ureadsize[sock]=0; readsize[sock]=0;
 	return;
 }
 
+/* peer went away, dont hand its leftovers to whoever gets this fd next */
+static void reset_conn(int sock) {
+	ipc_conn_t *c=get_conn(sock);
 
-int recv_messages(int sock) {
+	c->off=0;
+	c->len=0;
+	c->msgs=0;
 
-	DBG(M_IPC, "recv_messages on socket %d", sock);
+	return;
+}
 
-	if (sock < 0 || sock >= MAX_CONNS) {
-		PANIC("socket out of range [%d]", sock);
+/* this invalidates what get_message handed out last time, same as it always did */
+static void compact_conn(ipc_conn_t *c) {
+
+	if (c->off > 0) {
+		if (c->len > c->off) {
+			DBG(M_IPC, "keeping " STFMT " unconsumed bytes", c->len - c->off);
+			memmove(c->buf, c->buf + c->off, c->len - c->off);
+		}
+		c->len -= c->off;
+		c->off=0;
 	}
+	c->msgs=0;
+
+	return;
+}
 
-	reset_messages(sock);
+int recv_messages(int sock) {
+	ipc_conn_t *c=NULL;
+	ssize_t readsize=0;
 
-	msg_buf[sock]=(uint8_t *)xmalloc(IPC_DSIZE);
-	memset(msg_buf[sock], 0, IPC_DSIZE);
+	DBG(M_IPC, "recv_messages on socket %d", sock);
 
-	assert(save_size[sock] <= MAX_SLACKSIZE);
+	c=get_conn(sock);
 
-	if (save_size[sock]) {
-		if (save_buf[sock] == NULL) {
-			PANIC("save_size is not zero but save_buf is null");
-		}
+	if (c->buf == NULL) {
+		c->buf=(uint8_t *)xmalloc(IPC_BUFSIZE);
+		c->off=0;
+		c->len=0;
+	}
+
+	compact_conn(c);
 
-		DBG(M_IPC, "saved data in buffer, saving it in beginning of read buffer");
-		memcpy(msg_buf[sock], save_buf[sock], save_size[sock]);
-		xfree(save_buf[sock]);
+	/* xpoll said readable because of what we already have, the socket may have nothing */
+	if (peek_message(c) != NULL) {
+		return 1;
 	}
 
+	assert(c->len < IPC_DSIZE);
+
 again:
-	readsize[sock]=read(
-		sock,
-		&msg_buf[sock][save_size[sock]],
-		IPC_DSIZE - save_size[sock]
-	);
+	if (shmtrans_isshm(sock)) {
+		readsize=shmtrans_read(sock, c->buf + c->len, IPC_BUFSIZE - c->len);
+		if (readsize < 0 && errno == EAGAIN) {
+			/* stale wakeup, nothing new but nothing wrong either */
+			return 1;
+		}
+	}
+	else {
+		readsize=read(sock, c->buf + c->len, IPC_BUFSIZE - c->len);
+	}
 
-	if (readsize[sock] < 0 && errno == EINTR) {
+	if (readsize < 0 && errno == EINTR) {
 		goto again;
 	}
 
-	if (readsize[sock] < 0) {
-		msg_buf[sock]=NULL;
+	if (readsize < 0) {
 		ERR("read fails: %s", strerror(errno));
+		reset_conn(sock);
 		return -1;
 	}
 
-	ureadsize[sock]=(size_t)readsize[sock];
-	ureadsize[sock] += save_size[sock];
-	save_size[sock]=0;
-
-	if (ureadsize[sock] == 0) {
-		/* EOF from peer, even with buffer */
+	if (readsize == 0) {
+		/* EOF from peer */
+		reset_conn(sock);
 		return 0;
 	}
 
-	if (ureadsize[sock] < sizeof(ipc_msghdr_t)) {
-		ERR("undersized ipc message, only " SSTFMT " bytes [min required " STFMT "]",
-			ureadsize[sock], sizeof(ipc_msghdr_t)
-		);
-		return -1;
-	}
-
-	DBG(M_IPC, "read %u bytes of data from fd %d", (unsigned int)ureadsize[sock], sock);
+	c->len += (size_t)readsize;
 
-	/* now setup the m_u strucure to point to the messages */
-	setup_mptrs(sock);
-
-	m_off[sock]=0;
+	DBG(M_IPC, "read " SSTFMT " bytes of data from fd %d, " STFMT " buffered", readsize, sock, c->len);
 
 	return 1;
 }
 
-/*
- * returns 1 (more to read) or 0 (done reading), or -1 for error
- * if a sender sends 2 messages, then the last will be read first,
- * and the second to last next, etc
- */
+/* NULL if there isnt a whole message at the read offset yet */
+static ipc_msghdr_t *peek_message(ipc_conn_t *c) {
+	union {
+		ipc_msghdr_t *h;
+		uint8_t *ptr;
+	} h_u;
 
-int get_message(int sock, uint8_t *type, uint8_t *status, uint8_t **data, size_t *data_len) {
+	if (c->buf == NULL || (c->len - c->off) < sizeof(ipc_msghdr_t)) {
+		return NULL;
+	}
 
-	assert(data != NULL && type != NULL && status != NULL && data_len != NULL);
-	*data=NULL; *type=0; *data_len=0;
+	h_u.ptr=c->buf + c->off;
 
-	if (sock < 0 || sock >= MAX_CONNS) {
-		PANIC("socket out of range [%d]", sock);
+	if (h_u.h->header != IPC_MAGIC_HEADER) {
+		PANIC("ipc message is damaged, wrong magic number `%08x' offset " STFMT, h_u.h->header, c->off);
 	}
 
-	assert(m_off[sock] < (MAX_MSGS - 1));
+	if (h_u.h->len > (IPC_DSIZE - sizeof(ipc_msghdr_t))) {
+		PANIC("ipc message is damaged, length " STFMT " is too large", h_u.h->len);
+	}
 
-	if (m_u[sock][m_off[sock]].ptr == NULL) {
-		DBG(M_IPC, "get_message: returning 0 end of messages");
-		*type=0;
-		*status=0;
-		*data=NULL;
-		*data_len=0;
-		return 0;
+	if ((c->len - c->off) < (sizeof(ipc_msghdr_t) + h_u.h->len)) {
+		return NULL;
 	}
 
+	return h_u.h;
+}
 
-	DBG(M_IPC,	"get_message: message type %u status %u data_len " STFMT
-			" and m_off " STFMT " out of m_max " STFMT,
-			m_u[sock][m_off[sock]].m->hdr.type,
-			m_u[sock][m_off[sock]].m->hdr.status,
-			m_u[sock][m_off[sock]].m->hdr.len,
-			m_off[sock],
-			m_max[sock]
-	);
+int ipc_buffered(int sock) {
 
-	if (m_u[sock][m_off[sock]].m->hdr.header != IPC_MAGIC_HEADER) {
-		PANIC("wrong magic number for IPC header"); /* obviously we should choose our friends more closely */
+	if (sock < 0 || (size_t)sock >= conns_size || conns[sock] == NULL) {
+		return 0;
 	}
-	*type=m_u[sock][m_off[sock]].m->hdr.type;
-	*status=m_u[sock][m_off[sock]].m->hdr.status;
-	*data=&m_u[sock][m_off[sock]].m->data[0];
-	*data_len=m_u[sock][m_off[sock]].m->hdr.len;
-	++m_off[sock];
 
-	return 1;
+	return peek_message(conns[sock]) != NULL ? 1 : 0;
 }
 
-int get_singlemessage(int sock, uint8_t *type, uint8_t *status, uint8_t **data, size_t *data_len) {
+/*
+ * returns 1 (more to read) or 0 (done reading), or -1 for error
+ * messages come back in the order they were sent
+ */
+
+int get_message(int sock, uint8_t *type, uint8_t *status, uint8_t **data, size_t *data_len) {
+	ipc_msghdr_t *h=NULL;
+	ipc_conn_t *c=NULL;
 
 	assert(data != NULL && type != NULL && status != NULL && data_len != NULL);
-	*data=NULL; *type=0; *data_len=0;
+	*data=NULL; *type=0; *data_len=0; *status=0;
 
-	if (sock < 0 || sock >= MAX_CONNS) PANIC("socket out of range [%d]", sock);
+	c=get_conn(sock);
 
-	if (recv_messages(sock) < 1) {
-		return -1;
+	h=peek_message(c);
+	if (h == NULL) {
+		DBG(M_IPC, "get_message: returning 0 end of messages");
+		return 0;
 	}
 
-	if (m_max[sock] > 1) {
-		PANIC("too many messages m_max is " STFMT, m_max[sock]);
-	}
+	DBG(M_IPC,	"get_message: message type %u status %u data_len " STFMT
+			" message " STFMT " at offset " STFMT,
+			h->type,
+			h->status,
+			h->len,
+			c->msgs,
+			c->off
+	);
 
-	if (m_u[sock][m_off[sock]].ptr == NULL) {
-		PANIC("null message");
-	}
+	*type=h->type;
+	*status=h->status;
+	*data=(uint8_t *)h + sizeof(ipc_msghdr_t);
+	*data_len=h->len;
 
-	DBG(M_IPC,	"get_message: message type %s status %u data_len " STFMT
-			" and m_off " STFMT " out of m_max " STFMT,
-			strmsgtype(m_u[sock][0].m->hdr.type),
-			m_u[sock][0].m->hdr.status,
-			m_u[sock][0].m->hdr.len,
-			m_off[sock],
-			m_max[sock]
-	);
+	c->off += sizeof(ipc_msghdr_t) + h->len;
+	c->msgs++;
 
-	*type=m_u[sock][0].m->hdr.type;
-	*status=m_u[sock][0].m->hdr.status;
-	*data=&m_u[sock][0].m->data[0];
-	*data_len=m_u[sock][0].m->hdr.len;
+	METRIC_ADD(MET_IPC_MSGS_RECV, 1);
+	METRIC_ADD(MET_IPC_BYTES_RECV, sizeof(ipc_msghdr_t) + h->len);
 
 	return 1;
 }
 
-static int setup_mptrs(int sock) {
-	size_t mptr_off=0, gmptr_off=0;
-
-	if (sock < 0 || sock >= MAX_CONNS) {
-		PANIC("socket out of range [%d]", sock);
-	}
+int get_singlemessage(int sock, uint8_t *type, uint8_t *status, uint8_t **data, size_t *data_len) {
+	ipc_msghdr_t *h=NULL;
+	ipc_conn_t *c=NULL;
 
-	if (ureadsize[sock] < sizeof(ipc_msghdr_t)) {
-		PANIC("setup mptrs called with too small read buffer " SSTFMT " bytes", ureadsize[sock]);
-	}
+	assert(data != NULL && type != NULL && status != NULL && data_len != NULL);
+	*data=NULL; *type=0; *data_len=0;
 
-	for (m_off[sock]=0, mptr_off=0, m_max[sock]=0; mptr_off < ureadsize[sock]; m_off[sock]++) {
+	c=get_conn(sock);
 
-		if (m_off[sock] >= MAX_MSGS) {
-			PANIC("too many messages in ipc read " STFMT, m_off[sock]);
-		}
+	if (c->buf != NULL) {
+		compact_conn(c);
+	}
 
-		if (mptr_off + sizeof(ipc_msghdr_t) > ureadsize[sock]) {
-			save_size[sock]=ureadsize[sock] - mptr_off;
-			save_buf[sock]=(uint8_t *)xmalloc(save_size[sock]);
-			memcpy(save_buf[sock], &msg_buf[sock][mptr_off], save_size[sock]);
-			m_u[sock][m_off[sock]].ptr=NULL;
-			break;
-		}
-		m_u[sock][m_off[sock]].hdr=&msg_buf[sock][mptr_off];
-
-		if (m_u[sock][m_off[sock]].m->hdr.header != IPC_MAGIC_HEADER) {
-			PANIC("ipc message is damaged, wrong magic number `%08x' m_off=" STFMT " mptr_off=" STFMT,
-				m_u[sock][m_off[sock]].m->hdr.header,
-				m_off[sock],
-				mptr_off
-			);
+	/* only block in read if a whole message isnt already buffered, a large one can span reads */
+	while ((h=peek_message(c)) == NULL) {
+		if (recv_messages(sock) < 1) {
+			return -1;
 		}
-		DBG(M_IPC, "got IPC Message header type %u[%s] status %u length " STFMT,
-			m_u[sock][m_off[sock]].m->hdr.type,
-			strmsgtype(m_u[sock][m_off[sock]].m->hdr.type),
-			m_u[sock][m_off[sock]].m->hdr.status,
-			m_u[sock][m_off[sock]].m->hdr.len
-		);
-		gmptr_off=mptr_off;
-		mptr_off += (m_u[sock][m_off[sock]].m->hdr.len + sizeof(ipc_msghdr_t)); /* INC */
-	} /* for mptr_off < ureadsize */
-
-	/* now figure out how many (if any) bytes were left trailing at the end, and save them */
-	if (mptr_off > ureadsize[sock]) {
-		save_size[sock]=ureadsize[sock] - gmptr_off;
-		if (save_size[sock] > MAX_SLACKSIZE) PANIC("saved data is too big");
-
-		save_buf[sock]=(uint8_t *)xmalloc(save_size[sock]);
-		memcpy(save_buf[sock], &msg_buf[sock][gmptr_off], save_size[sock]);
-		/* the message we are on is incomplete, remove it from the recv area */
-		m_off[sock]--;
-		m_u[sock][m_off[sock]].ptr=NULL;
 	}
 
-	if (m_off[sock] == 0) {
-		ERR("wtf");
-		return -1;
+	/* the rest stays buffered, xpoll and recv_messages know to look here */
+	if (c->len - c->off > sizeof(ipc_msghdr_t) + h->len) {
+		DBG(M_IPC, "get_singlemessage: more than one message buffered on fd %d", sock);
 	}
 
-	assert(m_off[sock] > 0);
-
-	m_max[sock]=(m_off[sock] - 1);
-	m_off[sock]=0;
+	DBG(M_IPC,	"get_message: message type %s status %u data_len " STFMT,
+			strmsgtype(h->type),
+			h->status,
+			h->len
+	);
 
-	return 1;
+	return get_message(sock, type, status, data, data_len);
 }
 
-
 int send_message(int sock, int type, int status, const uint8_t *data, size_t data_len) {
-	union {
-		struct message_s *m;
-		void *ptr;
-	} sm_u;
+	ipc_msghdr_t hdr;
+	struct iovec iov[2];
 	ssize_t ret=0;
-	struct message_s m;
+	size_t total=0, sent=0;
+	int iovcnt=1;
 
-	if (sock < 0 || sock >= MAX_CONNS) PANIC("socket out of range [%d]", sock);
+	if (sock < 0) PANIC("socket out of range [%d]", sock);
 
-	memset(&m, 0, sizeof(m));
-	sm_u.m=&m;
+	memset(&hdr, 0, sizeof(hdr));
 
 	if (data_len > (IPC_DSIZE - sizeof(ipc_msghdr_t))) {
 		PANIC("attempt to send oversized packet of length " STFMT " from IPC", data_len);
@@ -317,16 +332,16 @@ int send_message(int sock, int type, int status, const uint8_t *data, size_t dat
 		ERR("message type out of range `%d'", type);
 		return -1;
 	}
-	sm_u.m->hdr.type=(uint8_t)type;
+	hdr.type=(uint8_t)type;
 
 	if (status < 0 || status > 0xFF) {
 		ERR("message status out of range `%d'", status);
 		return -1;
 	}
-	sm_u.m->hdr.status=(uint8_t)status;
+	hdr.status=(uint8_t)status;
 
-	sm_u.m->hdr.len=data_len;
-	sm_u.m->hdr.header=IPC_MAGIC_HEADER;
+	hdr.len=data_len;
+	hdr.header=IPC_MAGIC_HEADER;
 
 	DBG(M_IPC, "sending ipc message type %d[%s] status %d len " STFMT " to fd %d",
 		type,
@@ -336,29 +351,56 @@ int send_message(int sock, int type, int status, const uint8_t *data, size_t dat
 		sock
 	);
 
+	/* header and payload go out in one writev, no staging copy */
+	iov[0].iov_base=&hdr;
+	iov[0].iov_len=sizeof(ipc_msghdr_t);
 	if (data_len > 0) {
-		memcpy(sm_u.m->data, data, data_len);
+		iov[1].iov_base=(void *)(uintptr_t)data;
+		iov[1].iov_len=data_len;
+		iovcnt=2;
 	}
+	total=sizeof(ipc_msghdr_t) + data_len;
 
-again:
-	ret=write(sock, sm_u.ptr, (sizeof(ipc_msghdr_t) + data_len));
-	if (ret < 0 && errno == EINTR) {
-		goto again;
-	}
+	while (sent < total) {
+		if (shmtrans_isshm(sock)) {
+			ret=shmtrans_writev(sock, iov, iovcnt);
+		}
+		else {
+			ret=writev(sock, iov, iovcnt);
+		}
+		if (ret < 0 && errno == EINTR) {
+			continue;
+		}
+		if (ret < 1) {
+			ERR("write failed somehow, this is likely going to cause problems");
+			return -1;
+		}
 
-	/* XXX
-	 * in practice this doesnt generally fail (partial writes mostly),
-	 * but we should check for it and retry
-	 */
+		sent += (size_t)ret;
+		if (sent == total) {
+			break;
+		}
 
-	if (ret > 0 && (size_t)ret != sizeof(ipc_msghdr_t) + data_len) {
-		ERR("partial write, this is likely going to cause problems");
-	}
-	else if (ret < 1) {
-		ERR("write failed somehow, this is likely going to cause problems");
+		/* partial write, skip what went out and go again */
+		DBG(M_IPC, "partial write of " SSTFMT " bytes on fd %d, retrying", ret, sock);
+		while (ret > 0 && iovcnt > 0) {
+			if ((size_t)ret >= iov[0].iov_len) {
+				ret -= (ssize_t)iov[0].iov_len;
+				iov[0]=iov[1];
+				iovcnt--;
+			}
+			else {
+				iov[0].iov_base=(uint8_t *)iov[0].iov_base + ret;
+				iov[0].iov_len -= (size_t)ret;
+				ret=0;
+			}
+		}
 	}
 
-	return ret;
+	METRIC_ADD(MET_IPC_MSGS_SENT, 1);
+	METRIC_ADD(MET_IPC_BYTES_SENT, sent);
+
+	return (int)sent;
 }
 
 struct msg_ntbl {
@@ -382,6 +424,9 @@ static struct msg_ntbl m_tbl[]={
 {MSG_IDENTLISTENER,			"IdentListener"			  },
 {MSG_NOP,				"Nop"				  },
 {MSG_TERMINATE,				"Terminate"			  },
+{MSG_OUTBATCH,				"OutputBatch"			  },
+{MSG_PROGRESS,				"Progress"			  },
+{MSG_ANSWERED,				"Answered"			  },
 {-1,					"error"				  }
 };
 
@@ -403,5 +448,4 @@ char *strmsgtype(int msgtype) {
 
 #undef IPC_DSIZE
 #undef IPC_MAGIC_HEADER
-#undef MAX_MSGS
-#undef MAX_SLACKSIZE
+#undef IPC_BUFSIZE
@@ -33,17 +33,24 @@
 #define MSG_IDENTLISTENER	11
 #define MSG_NOP			12
 #define MSG_TERMINATE		13
+#define MSG_OUTBATCH		14	/* a wanbatch of MSG_OUTPUT payloads */
+#define MSG_PROGRESS		15	/* send_progress_t, how far into its workunit a sender is */
+#define MSG_ANSWERED		16	/* send_answered_t array, targets a sender need not probe again */
 
 #define MSG_STATUS_OK		0
 #define MSG_STATUS_ERROR	1
 #define MSG_STATUS_UNKNOWN	2
 
 int ipc_init(void);
+/* drops the buffered state for a descriptor, socktrans_close() does this */
+void ipc_close(int /* socket */);
 
 int send_message(int /* socket */, int /* type */, int /* status */, const uint8_t * /* data */, size_t /* datalen */);
 int recv_messages(int /* socket */);
 int get_message(int /* socket */, uint8_t * /* type */, uint8_t * /* status */, uint8_t ** /* data */, size_t * /* msg len */);
 int get_singlemessage(int /* socket */, uint8_t * /* type */, uint8_t * /* status */, uint8_t ** /* data */, size_t * /* msg len */);
+/* 1 if a whole message is already buffered for the descriptor, xpoll counts it readable */
+int ipc_buffered(int /* socket */);
 
 char *strmsgtype(int );
 
@@ -19,9 +19,8 @@
 #ifndef _XIPC_PRIVATE_H
 # define _XIPC_PRIVATE_H
 
-#define MAX_SLACKSIZE		2048
 #define IPC_MAGIC_HEADER	0xf0f1f2f3      /* to make endian mis-matches fault, as this is not mis-matched endian safe */
-#define MAX_MSGS		(IPC_DSIZE / 8) /* close to maximum allowed */
+#define IPC_BUFSIZE		(IPC_DSIZE * 2) /* room for a partial message plus a full read */
 
 typedef struct _PACKED_ ipc_msghdr_t {
 	uint32_t header;
@@ -30,9 +29,4 @@ typedef struct _PACKED_ ipc_msghdr_t {
 	size_t len;
 } ipc_msghdr_t;
 
-struct _PACKED_ message_s {
-	ipc_msghdr_t hdr;
-	uint8_t data[IPC_DSIZE - sizeof(ipc_msghdr_t)];
-};
-
 #endif
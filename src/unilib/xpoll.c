@@ -24,11 +24,33 @@
 #include <unilib/xmalloc.h>
 #include <unilib/output.h>
 #include <unilib/xpoll.h>
+#include <unilib/xipc.h>
 
 /*
-XXX add epoll support and perhaps a wrapper for RT IO etc
-XXX make dynamic not bounded
-*/
+ * kqueue on macOS/BSD, a persistent epoll set on linux, poll() elsewhere.
+ * none of them put a limit on how many descriptors can be watched, the
+ * arrays below just grow (keeping their contents) to the biggest set we
+ * have been asked about
+ */
+
+static void *xpoll_grow(void * /* old */, size_t * /* cur count */, size_t /* want count */, size_t /* elem size */);
+static int xpoll_wait(xpoll_t * /* array */, uint32_t /* len */, int /* timeout */);
+
+static void *xpoll_grow(void *old, size_t *cur, size_t want, size_t esize) {
+	size_t ncur=0;
+
+	if (want <= *cur && old != NULL) {
+		return old;
+	}
+
+	for (ncur=(*cur > 0 ? *cur : 64); ncur < want; ncur *= 2) {
+		;
+	}
+
+	*cur=ncur;
+
+	return xrealloc(old, ncur * esize);
+}
 
 #if defined(HAVE_KQUEUE) && defined(HAVE_KEVENT)
 
@@ -103,22 +125,24 @@ static int get_kqueue_fd(void) {
 	return kq_fd;
 }
 
-int xpoll(xpoll_t *array, uint32_t len, int timeout) {
+static int xpoll_wait(xpoll_t *array, uint32_t len, int timeout) {
 	uint32_t j=0, idx=0;
 	int ret=0, nev=0, kqfd=-1;
 	xpoll_t *start=NULL;
-	struct kevent changelist[MAX_CONNS];
-	struct kevent eventlist[MAX_CONNS];
+	static struct kevent *changelist=NULL, *eventlist=NULL;
+	static size_t chg_size=0, ev_size=0;
 	struct timespec ts, *tsp=NULL;
 
 	assert(array != NULL);
-	assert(len < MAX_CONNS);
 
 	kqfd=get_kqueue_fd();
 	if (kqfd < 0) {
 		return -1;
 	}
 
+	changelist=(struct kevent *)xpoll_grow(changelist, &chg_size, len, sizeof(struct kevent));
+	eventlist=(struct kevent *)xpoll_grow(eventlist, &ev_size, len, sizeof(struct kevent));
+
 	/*
 	 * Build the changelist: register EVFILT_READ on each fd.
 	 * EV_ADD adds or modifies the filter. EV_ONESHOT is NOT used
@@ -242,19 +266,230 @@ rekqueue:
 	return ret;
 }
 
-#else /* !HAVE_KQUEUE || !HAVE_KEVENT -- use poll() fallback */
+/* closed descriptors drop out of a kqueue by themselves */
+void xpoll_forget(int fd) {
+	return;
+}
+
+#elif defined(HAVE_SYS_EPOLL_H) && defined(HAVE_EPOLL_CREATE1)
+
+#include <sys/epoll.h>
+
+/*
+ * epoll implementation for linux.
+ *
+ * the interest set lives in the kernel between calls, so a drone_poll()
+ * over hundreds of drones costs one epoll_wait, not hundreds of poll
+ * entries copied in and out.  the fd table below remembers which call last
+ * asked about each fd, anything that wasnt asked about this time is taken
+ * back out of the set so it cant report on behalf of a dead drone.
+ *
+ * level triggered, so partial reads behave exactly like poll().
+ * epoll refuses regular files (a pcap readfile), poll() calls those always
+ * readable, so we do the same without involving the kernel.
+ * callers must xpoll_forget() an fd before closing it (socktrans_close does)
+ * so a recycled fd number gets registered again.
+ */
+
+#define EPF_NONE	0
+#define EPF_KERNEL	1	/* in the epoll set				*/
+#define EPF_ALWAYS	2	/* epoll wont take it, always readable	*/
+
+typedef struct ep_fdent_t {
+	uint32_t gen;		/* last call that asked about this fd	*/
+	uint32_t idx;		/* its slot in that calls array		*/
+	uint8_t state;
+} ep_fdent_t;
+
+static int ep_fd=-1;
+static ep_fdent_t *ep_tbl=NULL;
+static size_t ep_tblsize=0;
+static uint32_t ep_gen=0;
+static int *ep_reg=NULL;		/* fds currently in the epoll set		*/
+static size_t ep_regcnt=0, ep_regsize=0;
+
+static int get_epoll_fd(void) {
+	if (ep_fd != -1) {
+		return ep_fd;
+	}
+
+	ep_fd=epoll_create1(EPOLL_CLOEXEC);
+	if (ep_fd < 0) {
+		ERR("epoll_create1 fails: %s", strerror(errno));
+		return -1;
+	}
+
+	return ep_fd;
+}
+
+static void ep_growtbl(int fd) {
+	size_t old=ep_tblsize;
+
+	if ((size_t)fd < ep_tblsize) {
+		return;
+	}
+
+	ep_tbl=(ep_fdent_t *)xpoll_grow(ep_tbl, &ep_tblsize, (size_t)fd + 1, sizeof(ep_fdent_t));
+	memset(&ep_tbl[old], 0, (ep_tblsize - old) * sizeof(ep_fdent_t));
+
+	return;
+}
+
+static void ep_remove(int fd) {
+	size_t j=0;
+
+	if (ep_tbl[fd].state == EPF_KERNEL) {
+		/* ENOENT/EBADF just mean the kernel already forgot it */
+		epoll_ctl(ep_fd, EPOLL_CTL_DEL, fd, NULL);
+
+		for (j=0; j < ep_regcnt; j++) {
+			if (ep_reg[j] == fd) {
+				ep_reg[j]=ep_reg[--ep_regcnt];
+				break;
+			}
+		}
+	}
+	ep_tbl[fd].state=EPF_NONE;
+
+	return;
+}
+
+void xpoll_forget(int fd) {
+
+	if (fd < 0 || (size_t)fd >= ep_tblsize || ep_fd < 0) {
+		return;
+	}
+
+	ep_remove(fd);
+
+	return;
+}
+
+static int xpoll_wait(xpoll_t *array, uint32_t len, int timeout) {
+	static struct epoll_event *evs=NULL;
+	static size_t evsize=0;
+	struct epoll_event ev;
+	uint32_t j=0;
+	size_t k=0;
+	int ret=0, nev=0, fd=-1, always=0;
+
+	assert(array != NULL);
+
+	if (get_epoll_fd() < 0) {
+		return -1;
+	}
+
+	ep_gen++;
+	if (ep_gen == 0) {
+		ep_gen=1;
+	}
+
+	for (j=0; j < len; j++) {
+		array[j].rw=0;
+		fd=array[j].fd;
+
+		/* like poll, a negative fd is just ignored */
+		if (fd < 0) {
+			continue;
+		}
+
+		ep_growtbl(fd);
+		ep_tbl[fd].gen=ep_gen;
+		ep_tbl[fd].idx=j;
+
+		if (ep_tbl[fd].state == EPF_NONE) {
+			memset(&ev, 0, sizeof(ev));
+			ev.events=EPOLLIN|EPOLLPRI;
+			ev.data.fd=fd;
+
+			if (epoll_ctl(ep_fd, EPOLL_CTL_ADD, fd, &ev) == 0 || errno == EEXIST) {
+				ep_tbl[fd].state=EPF_KERNEL;
+				ep_reg=(int *)xpoll_grow(ep_reg, &ep_regsize, ep_regcnt + 1, sizeof(int));
+				ep_reg[ep_regcnt++]=fd;
+			}
+			else if (errno == EPERM) {
+				ep_tbl[fd].state=EPF_ALWAYS;
+			}
+			else {
+				/* POLLNVAL */
+				DBG(M_PIO, "Socket %d cant be watched: %s", fd, strerror(errno));
+				array[j].rw=XPOLL_DEAD;
+				ret++;
+				continue;
+			}
+		}
+
+		if (ep_tbl[fd].state == EPF_ALWAYS) {
+			array[j].rw=XPOLL_READABLE;
+			always++;
+		}
+	}
+
+	/* drop whatever this caller stopped asking about */
+	for (k=0; k < ep_regcnt;) {
+		fd=ep_reg[k];
+		if (ep_tbl[fd].gen != ep_gen) {
+			ep_remove(fd);
+			continue;
+		}
+		k++;
+	}
+
+	evs=(struct epoll_event *)xpoll_grow(evs, &evsize, (ep_regcnt > 0 ? ep_regcnt : 1), sizeof(struct epoll_event));
+
+reepoll:
+	nev=epoll_wait(ep_fd, evs, (int)evsize, (always || ret ? 0 : timeout));
+	if (nev < 0) {
+		if (errno == EINTR) {
+			goto reepoll;
+		}
+		ERR("epoll_wait errors: %s", strerror(errno));
+		return -1;
+	}
+
+	for (k=0; k < (size_t)nev; k++) {
+		fd=evs[k].data.fd;
+		j=ep_tbl[fd].idx;
+
+		if (evs[k].events & (EPOLLHUP|EPOLLERR)) {
+			array[j].rw |= XPOLL_DEAD;
+		}
+		if (evs[k].events & EPOLLIN) {
+			array[j].rw |= XPOLL_READABLE;
+		}
+		if (evs[k].events & EPOLLPRI) {
+			array[j].rw |= XPOLL_PRIREADABLE;
+		}
+
+		DBG(M_PIO, "Socket %d is %s %s %s", fd,
+			(array[j].rw & XPOLL_DEAD ? "dead" : "alive"),
+			(array[j].rw & XPOLL_READABLE ? "readable" : "not readable"),
+			(array[j].rw & XPOLL_PRIREADABLE ? "pri-readable" : "not pri-readable")
+		);
+	}
+
+	return ret + always + nev;
+}
+
+#else /* no kqueue or epoll -- use poll() fallback */
 
 #include <poll.h>
 #include <sys/poll.h>
 
-int xpoll(xpoll_t *array, uint32_t len, int timeout) {
+void xpoll_forget(int fd) {
+	return;
+}
+
+static int xpoll_wait(xpoll_t *array, uint32_t len, int timeout) {
 	uint32_t j=0;
 	int ret=0;
 	xpoll_t *start=NULL;
-	struct pollfd pdf[MAX_CONNS];
+	static struct pollfd *pdf=NULL;
+	static size_t pdf_size=0;
 
 	assert(array != NULL);
-	assert(len < MAX_CONNS);
+
+	pdf=(struct pollfd *)xpoll_grow(pdf, &pdf_size, (len > 0 ? len : 1), sizeof(struct pollfd));
 
 	for (j=0, start=array; j < len; j++, array++) {
 		pdf[j].fd=array->fd;
@@ -293,4 +528,38 @@ repoll:
 	return ret;
 }
 
-#endif /* HAVE_KQUEUE && HAVE_KEVENT */
+#endif /* HAVE_KQUEUE && HAVE_KEVENT, HAVE_EPOLL_CREATE1 */
+
+/*
+ * xipc may already hold a whole message it read along with the last one, the
+ * kernel knows nothing about it, so that descriptor is readable and nobody
+ * waits on it
+ */
+int xpoll(xpoll_t *array, uint32_t len, int timeout) {
+	uint32_t j=0, buffered=0;
+	int ret=0;
+
+	assert(array != NULL);
+
+	for (j=0; j < len; j++) {
+		if (ipc_buffered(array[j].fd)) {
+			buffered++;
+		}
+	}
+
+	ret=xpoll_wait(array, len, buffered > 0 ? 0 : timeout);
+	if (ret < 0 || buffered == 0) {
+		return ret;
+	}
+
+	for (j=0; j < len; j++) {
+		if (ipc_buffered(array[j].fd) && ! (array[j].rw & XPOLL_READABLE)) {
+			if (array[j].rw == 0) {
+				ret++;
+			}
+			array[j].rw |= XPOLL_READABLE;
+		}
+	}
+
+	return ret;
+}
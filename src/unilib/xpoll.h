@@ -30,4 +30,7 @@ typedef struct xpoll_t {
 
 int xpoll(xpoll_t * /* array */,  uint32_t /* len */, int /* timeout */);
 
+/* call before closing an fd that has been through xpoll, its number may come back */
+void xpoll_forget(int /* fd */);
+
 #endif